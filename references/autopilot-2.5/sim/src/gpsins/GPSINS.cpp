@@ -31,6 +31,7 @@
 #include <mat/Vector.h>
 #include <mat/Matrix.h>
 #include <mat/Matrix_Invert.h>
+#include <mat/Kalman.h>
 #include <mat/Nav.h>
 
 #include "macros.h"
@@ -41,13 +42,16 @@ namespace gpsins
 using namespace libmat;
 using namespace util;
 
-GPSINS::GPSINS(
+template<
+	class			T
+>
+GPSINSFilter<T>::GPSINSFilter(
 ) :
 	imu_samples(0),
 	compass_samples(0),
 	gps_samples(0),
 	Q( 0.0 ),
-	P( eye<11,double>() ),
+	P( eye<11,T>() ),
 	compass_sd( 0.2 ),
 	position_sd( 0.4 ),
 	velocity_sd( 0.1 )
@@ -87,25 +91,28 @@ GPSINS::GPSINS(
 }
 
 
+template<
+	class			T
+>
 void
-GPSINS::propagate_state(
-	const Vector<3> &	accel,
-	const Vector<3> &	pqr,
-	double			dt
+GPSINSFilter<T>::propagate_state(
+	const Vector<3,T> &	accel,
+	const Vector<3,T> &	pqr,
+	T			dt
 )
 {
-	const Vector<3>		uvw( this->uvw() );
-	Vector<4>		q( this->q() );
+	const Vector<3,T>	uvw( this->uvw() );
+	Vector<4,T>		q( this->q() );
 
-	const Matrix<4,4>	Wxq( quatW( pqr ) );
-	const Matrix<3,3>	Wx( eulerWx( pqr ) );
-	const Matrix<3,3>	dcm( quatDC( q ) );
+	const Matrix<4,4,T>	Wxq( quatW( pqr ) );
+	const Matrix<3,3,T>	Wx( eulerWx( pqr ) );
+	const Matrix<3,3,T>	dcm( quatDC( q ) );
 
-	const Vector<3>		XYZdot( dcm.transpose() * uvw );
-	const Vector<3>		UVWdot(
-		accel + dcm * Vector<3>(0,0,this->g()) - Wx * uvw
+	const Vector<3,T>	XYZdot( dcm.transpose() * uvw );
+	const Vector<3,T>	UVWdot(
+		accel + dcm * Vector<3,T>(0,0,this->g()) - Wx * uvw
 	);
-	const Vector<4>		Qdot( Wxq * q );
+	const Vector<4,T>	Qdot( Wxq * q );
 
 	// Update our state vector with the new values
 	this->X[ X_index ]	+= XYZdot[0] * dt;
@@ -124,21 +131,21 @@ GPSINS::propagate_state(
 }
 	
 
+template<
+	class			T
+>
 void
-GPSINS::propagate_covariance(
-	const Vector<3> &	pqr,
-	double			dt
+GPSINSFilter<T>::propagate_covariance(
+	const Vector<3,T> &	pqr,
+	T			dt
 )
 {
-	Matrix<11,11>		A;
+	SparseMatrix<11,11,T>	A;
 
 	this->make_a_matrix( A, pqr );
 
-	const Matrix<11,11>	Pdot(
-		this->Q + A * this->P + this->P * A.transpose()
-	);
-
-	this->P += Pdot * dt;
+	// P * A' is the transpose of A * P, since P is symmetric
+	propagate_symmetric( this->P, A * this->P, this->Q, dt );
 }
 
 
@@ -146,34 +153,42 @@ GPSINS::propagate_covariance(
  *  Hand translated from Aaron's matlab code.
  * I'm not at all clear on what this does...
  */
+template<
+	class			T
+>
 void
-GPSINS::make_a_matrix(
-	Matrix<11,11> &		A,
-	const Vector<3> &	pqr
+GPSINSFilter<T>::make_a_matrix(
+	SparseMatrix<11,11,T> &	A,
+	const Vector<3,T> &	pqr
 )
 {
-	const Vector<3>		uvw( this->uvw() );
-	const double		u( uvw[0] );
-	const double		v( uvw[1] );
-	const double		w( uvw[2] );
-
-	const Vector<4>		q( this->q() );
-	const double		q0( q[0] );
-	const double		q1( q[1] );
-	const double		q2( q[2] );
-	const double		q3( q[3] );
-
-	const double		g( this->g() );
-
-	const Matrix<3,3>	C( quatDC( q ) );
-	const Matrix<4,4>	Wxq( quatW( pqr ) );
-	const Matrix<3,3>	Wx( eulerWx( pqr ) );
+	const Vector<3,T>	uvw( this->uvw() );
+	const T			u( uvw[0] );
+	const T			v( uvw[1] );
+	const T			w( uvw[2] );
+
+	const Vector<4,T>	q( this->q() );
+	const T			q0( q[0] );
+	const T			q1( q[1] );
+	const T			q2( q[2] );
+	const T			q3( q[3] );
+
+	const T			g( this->g() );
+
+	const Matrix<3,3,T>	C( quatDC( q ) );
+	const Matrix<4,4,T>	Wxq( quatW( pqr ) );
+	const Matrix<3,3,T>	Wx( eulerWx( pqr ) );
 	
 	A.fill( 0.0 );
 
-	A.insert(   C, 0, 3 );
-	A.insert( -Wx, 3, 3 );
-	A.insert( Wxq, 6, 6 );
+	// Row 10 and columns 0 to 2 are all zero
+	A.block( 0, 3, 3, 7 );
+	A.block( 3, 3, 3, 8 );
+	A.block( 6, 6, 4, 4 );
+
+	A.insert( 0, 3,   C );
+	A.insert( 3, 3, -Wx );
+	A.insert( 6, 6, Wxq );
 
 	A[0][6] =         - 2*v*q3 + 2*w*q2;
 	A[0][7] =           2*v*q2 + 2*w*q3;
@@ -211,32 +226,41 @@ GPSINS::make_a_matrix(
 }
 
 
+template<
+	class			T
+>
 void
-GPSINS::imu_init(
-	const Vector<3> &	accel,
-	const Vector<3> &	UNUSED( pqr )
+GPSINSFilter<T>::imu_init(
+	const Vector<3,T> &	accel,
+	const Vector<3,T> &	UNUSED( pqr )
 )
 {
-	const Vector<4>		q( euler2quat( accel2euler( accel, 0 ) ) );
+	const Vector<4,T>	q( euler2quat( accel2euler( accel, 0 ) ) );
 	insert( this->X, Q0_index, q );
 }
 
 
+template<
+	class			T
+>
 void
-GPSINS::compass_init(
-	double			heading
+GPSINSFilter<T>::compass_init(
+	T			heading
 )
 {
-	Vector<3>		euler( quat2euler( this->q() ) );
+	Vector<3,T>		euler( quat2euler( this->q() ) );
 	euler[2] = heading;
 	
 	insert( this->X, Q0_index, euler2quat( euler ) );
 }
 
+template<
+	class			T
+>
 void
-GPSINS::gps_init(
-	const Vector<3> &	xyz,
-	const Vector<3> &	uvw
+GPSINSFilter<T>::gps_init(
+	const Vector<3,T> &	xyz,
+	const Vector<3,T> &	uvw
 )
 {
 	this->X[ X_index ] = xyz[0];
@@ -249,11 +273,14 @@ GPSINS::gps_init(
 }
 
 
+template<
+	class			T
+>
 void
-GPSINS::imu_update(
-	const Vector<3> &	accel,
-	const Vector<3> &	pqr,
-	double			dt
+GPSINSFilter<T>::imu_update(
+	const Vector<3,T> &	accel,
+	const Vector<3,T> &	pqr,
+	T			dt
 )
 {
 	if( this->imu_samples++ == 0 )
@@ -275,11 +302,14 @@ GPSINS::imu_update(
 }
 
 
+template<
+	class			T
+>
 void
-GPSINS::gps_update(
-	const Vector<3> &	ned,
-	const Vector<3> &	uvw,
-	double			UNUSED( dt )
+GPSINSFilter<T>::gps_update(
+	const Vector<3,T> &	ned,
+	const Vector<3,T> &	uvw,
+	T			UNUSED( dt )
 )
 {
 	if( this->gps_samples++ == 0 )
@@ -288,9 +318,9 @@ GPSINS::gps_update(
 		return;
 	}
 
-	Matrix<6,6>		R;
-	const double		pos_sd = sqr( this->position_sd );
-	const double		vel_sd = sqr( this->velocity_sd );
+	Matrix<6,6,T>		R;
+	const T			pos_sd = sqr( this->position_sd );
+	const T			vel_sd = sqr( this->velocity_sd );
 
 	R[0][0] = pos_sd;
 	R[1][1] = pos_sd;
@@ -299,7 +329,7 @@ GPSINS::gps_update(
 	R[4][4] = vel_sd;
 	R[5][5] = vel_sd;
 
-	Matrix<6,11>		C( 0.0 );
+	Matrix<6,11,T>		C( 0.0 );
 	C[0][0] = 1;
 	C[1][1] = 1;
 	C[2][2] = 1;
@@ -307,12 +337,7 @@ GPSINS::gps_update(
 	C[4][4] = 1;
 	C[5][5] = 1;
 
-	const Matrix<11,6>	C_transpose( C.transpose() );
-
-	const Matrix<6,6>	E( R + mult3( C, P, C_transpose ) );
-	const Matrix<11,6>	K( mult3( P, C_transpose, invert( E ) ) );
-
-	Vector<6>		measured;
+	Vector<6,T>		measured;
 	measured[0] = ned[0];
 	measured[1] = ned[1];
 	measured[2] = ned[2];
@@ -320,18 +345,25 @@ GPSINS::gps_update(
 	measured[4] = uvw[1];
 	measured[5] = uvw[2];
 	
-	// Update our state
-	this->X += K * ( measured - C * this->X );
-
-	// Update the covariance matrix
-	this->P -= mult3( K, C, P );
+	// Update our state and the covariance matrix.  R is diagonal,
+	// so this is done a measurement at a time with no inverse.
+	Kalman_sequential(
+		this->P,
+		this->X,
+		C,
+		R,
+		measured - C * this->X
+	);
 }
 
 
+template<
+	class			T
+>
 void
-GPSINS::compass_update(
-	const double		heading,
-	double			UNUSED( dt )
+GPSINSFilter<T>::compass_update(
+	const T			heading,
+	T			UNUSED( dt )
 )
 {
 	if( this->compass_samples++ == 0 )
@@ -340,33 +372,39 @@ GPSINS::compass_update(
 		return;
 	}
 
-	const Vector<4>		q( this->q() );
+	const Vector<4,T>	q( this->q() );
 
-	Matrix<1,1>		R;
+	Matrix<1,1,T>		R;
 	R[0][0] = sqr( this->compass_sd );
 
 	// Build our estimate matrix
-	Matrix<1,11>		C( 0.0 );
-	const Vector<4>		dpsi( dpsi_dq( q ) );
+	Matrix<1,11,T>		C( 0.0 );
+	const Vector<4,T>	dpsi( dpsi_dq( q ) );
 
 	for( int i=0; i<4 ; i++ )
 		C[0][6+i] = dpsi[i];
 
-	// Compute the E matrix
-	const Matrix<11,1>	C_transpose( C.transpose() );
-	const Matrix<1,1>	E( R + mult3( C, this->P, C_transpose ) );
+	// Update the state vector and the covariance matrix
+	const Vector<3,T>	eul( quat2euler( q ) );
+	Vector<1,T>		err;
 
-	// Compute the Kalman gain
-	const Matrix<11,1>	K( mult3( this->P, C_transpose, invert( E ) ) );
+	err[0] = heading - eul[2];
 
-	// Update the state vector
-	const Vector<3>		eul( quat2euler( q ) );
+	Kalman_sequential(
+		this->P,
+		this->X,
+		C,
+		R,
+		err
+	);
+}
 
-	this->X += (K * ( heading - eul[2] ) ).col(0);
 
-	// Update the covariance matrix
-	this->P -= mult3( K, C, P );
-}
 
-}
+/*
+ *  Both precisions are built into the library
+ */
+template class GPSINSFilter<float>;
+template class GPSINSFilter<double>;
 
+}
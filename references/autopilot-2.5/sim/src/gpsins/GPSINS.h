@@ -30,6 +30,7 @@
 
 #include <mat/Vector.h>
 #include <mat/Matrix.h>
+#include <mat/Matrix_Sparse.h>
 #include <mat/Quat.h>
 
 namespace gpsins
@@ -37,56 +38,63 @@ namespace gpsins
 
 using namespace libmat;
 
-class GPSINS
+/*
+ *  T is the precision of the state, the covariance and everything
+ * used to update them.  GPSINS is the double version.
+ */
+template<
+	class			T = double
+>
+class GPSINSFilter
 {
 public:
-	GPSINS();
+	GPSINSFilter();
 
 	void
 	imu_update(
-		const Vector<3> &	accel,
-		const Vector<3> &	pqr,
-		double			dt
+		const Vector<3,T> &	accel,
+		const Vector<3,T> &	pqr,
+		T			dt
 	);
 
 	void
 	gps_update(
-		const Vector<3> &	xyz,
-		const Vector<3> &	uvw,
-		double			dt
+		const Vector<3,T> &	xyz,
+		const Vector<3,T> &	uvw,
+		T			dt
 	);
 
 	void
 	compass_update(
-		const double		heading,
-		double			dt
+		const T			heading,
+		T			dt
 	);
 
 	// Public accessors for our state vector.
-	const Vector<3>
+	const Vector<3,T>
 	xyz()
 	{
-		return Vector<3>(
+		return Vector<3,T>(
 			this->X[ X_index ],
 			this->X[ Y_index ],
 			this->X[ Z_index ]
 		);
 	};
 
-	const Vector<3>
+	const Vector<3,T>
 	uvw()
 	{
-		return Vector<3>(
+		return Vector<3,T>(
 			this->X[ U_index ],
 			this->X[ V_index ],
 			this->X[ W_index ]
 		);
 	};
 
-	const Vector<4>
+	const Vector<4,T>
 	q()
 	{
-		return Vector<4>(
+		return Vector<4,T>(
 			this->X[ Q0_index ],
 			this->X[ Q1_index ],
 			this->X[ Q2_index ],
@@ -94,22 +102,32 @@ public:
 		);
 	};
 
-	double
+	T
 	g()
 	{
 		return this->X[ G_index ];
 	}
 
-	const Vector<3>
+	const Vector<3,T>
 	theta()
 	{
 		return quat2euler( this->q() );
 	};
 
+	/*
+	 *  The system derivative matrix for the current state, with
+	 * its nonzero blocks declared.  Public so that test-blocks in
+	 * imu-filter can check that nothing is left outside of them.
+	 */
+	void make_a_matrix(
+		SparseMatrix<11,11,T> &	A,
+		const Vector<3,T> &	pqr
+	);
+
 private:
 	// Private copy of our state vector.
 	// Canonical copy is in the data members
-	Vector<11>		X;
+	Vector<11,T>		X;
 
 	static const int	X_index		= 0;
 	static const int	Y_index		= 1;
@@ -134,50 +152,47 @@ private:
 	int			gps_samples;
 
 	// Process noise
-	Matrix<11,11>		Q;
+	Matrix<11,11,T>		Q;
 
 	// Covariance matrix
-	Matrix<11,11>		P;
+	Matrix<11,11,T>		P;
 
 	// Standard deviation values?
-	const double		compass_sd;
-	const double		position_sd;
-	const double		velocity_sd;
+	const T			compass_sd;
+	const T			position_sd;
+	const T			velocity_sd;
 
 	void
 	imu_init(
-		const Vector<3> &	accel,
-		const Vector<3> &	pqr
+		const Vector<3,T> &	accel,
+		const Vector<3,T> &	pqr
 	);
 
 	void
 	compass_init(
-		double			heading
+		T			heading
 	);
 
 	void
 	gps_init(
-		const Vector<3> &	xyz,
-		const Vector<3> &	uvw
+		const Vector<3,T> &	xyz,
+		const Vector<3,T> &	uvw
 	);
 		
-	void make_a_matrix(
-		Matrix<11,11> &		A,
-		const Vector<3> &	pqr
-	);
-
 	void propagate_state(
-		const Vector<3> &	accel,
-		const Vector<3> &	pqr,
-		double			dt
+		const Vector<3,T> &	accel,
+		const Vector<3,T> &	pqr,
+		T			dt
 	);
 
 	void propagate_covariance(
-		const Vector<3> &	pqr,
-		double			dt
+		const Vector<3,T> &	pqr,
+		T			dt
 	);
 };
 
+typedef GPSINSFilter<double>	GPSINS;
+
 }
 
 #endif
@@ -57,6 +57,7 @@ viewpoint_t		viewpoint	= view_stationary;
 Server *		server		= 0;
 static const char *	server_host	= "localhost";
 static int		server_port	= 2002;
+static const char *	encoding	= 0;
 
 static state_t		state;
 static int		packets		= 0;
@@ -71,10 +72,28 @@ void
 reconnect_server( void )
 {
 	server->connect( server_host, server_port );
+
+	if( encoding )
+		server->telemetry( telemetry_encoding( encoding ) );
 }
 
 
 
+/*
+ *  A ring does not wake up Fltk, so look at it every few ms
+ */
+static void
+read_ring(
+	void *			UNUSED( priv )
+)
+{
+	if( server->shared() )
+		server->drain();
+
+	Fl::repeat_timeout( 0.005, read_ring );
+}
+
+
 static void
 ahrs_state(
 	void *			UNUSED( priv ),
@@ -369,6 +388,8 @@ help( void )
 "	-h | --help		This help\n"
 "	-s | --server host	Server hostname or IP\n"
 "	-p | --port port	Server port\n"
+"	-e | --encoding e	Telemetry from a remote server:\n"
+"				float64, float32 or quant16\n"
 "	-v | --viewpoint v	Viewpoint:\n"
 "				0: Stationary\n"
 "				1: Walk behind\n"
@@ -394,6 +415,7 @@ main(
 		"h|?|help=&",		help,
 		"s|server=s",		&server_host,
 		"p|port=i",		&server_port,
+		"e|encoding=s",		&encoding,
 		"v|viewpoint=i",	&viewpoint,
 		0
 	);
@@ -403,6 +425,8 @@ main(
 	if( rc < 0 )
 		return help();
 
+	if( encoding && telemetry_encoding( encoding ) < 0 )
+		return help();
 
 	Fl::gl_visual( FL_RGB );
 
@@ -421,6 +445,8 @@ main(
 		(void*) server
 	);
 
+	Fl::add_timeout( 0.005, read_ring );
+
 
 	return Fl::run();
 }
@@ -31,11 +31,17 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <cmath>
 
 #include "macros.h"
 #include "Blade.h"
 
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define BLADE_SIMD
+#include <immintrin.h>
+#endif
+
 #include <mat/Conversions.h>
 #include <mat/rk4.h>
 
@@ -43,9 +49,354 @@ namespace sim {
 
 using namespace util;
 
-// number of stations to use in blade element (total is always 100)
-static const int	num_stations	= 93;
 
+/*
+ *  Per-call constants that the station kernels need, along with
+ * the cached station geometry.  They are filled in by Blade::step()
+ * and passed to whichever kernel is selected.
+ */
+struct blade_stations_t
+{
+	double			omega;
+	double			Vperp;
+	double			vv;
+	double			vv2;
+	double			theta0;
+	double			keys1;
+	double			keys2;
+
+	const double *		r;
+	const double *		omega_r;
+	const double *		omega_r2;
+	const double *		twst_r_R;
+	const double *		proudy_r;
+
+	// Partial sums, indexed [sum][T Q P v1]
+	double			sums[Blade::num_sums][4];
+};
+
+
+/*
+ *  One blade element station.  Every kernel does exactly these
+ * operations in exactly this order so that they round the same.
+ */
+static inline void
+station(
+	const blade_stations_t *	s,
+	int			i,
+	double *		sum
+)
+{
+	// local radius
+	const double		r	= s->r[i];
+
+	// local collective angle
+	const double		theta_r	= s->theta0 + s->twst_r_R[i];
+
+	// local velocity
+	const double		omega_r	= s->omega_r[i];
+
+	// local angle of attack
+	const double		alpha	= theta_r - s->Vperp/omega_r;
+
+	// Proudy pg 96
+	const double		temp	= s->vv2 + s->proudy_r[i] * alpha;
+
+	// local induced velocity
+	const double		v1	=
+		( sqrt(fabs(temp)) - s->vv ) / ( 8.0 * C_PI );
+
+	const double		temp2	= s->Vperp + v1;
+
+	// Keys eq 3.11
+	// incriment of thrust
+	const double		dT	= s->keys2 * temp2 * v1 * r;
+
+	// Keys eq 3.5
+	// incriment of profile drag
+	const double		dD	= s->keys1 * s->omega_r2[i];
+
+	// Keys eq 3.9a
+	// incriment of torque
+	const double		dQ	= r * ( dT*temp2/omega_r + dD );
+
+	// Keys eq 3.9b
+	// incriment of power
+	const double		dP	= dQ * s->omega;
+
+	// Add this blade element to its partial sum
+	sum[0]	+= dT;
+	sum[1]	+= dQ;
+	sum[2]	+= dP;
+	sum[3]	+= v1;
+}
+
+
+static void
+stations_scalar(
+	blade_stations_t *	s
+)
+{
+	for( int i=0 ; i<Blade::num_stations ; ++i )
+		station( s, i, s->sums[i % Blade::num_sums] );
+}
+
+
+#ifdef BLADE_SIMD
+
+/*
+ *  SSE2 kernel: stations i and i+1 go in one register, i+2 and
+ * i+3 in the other, so each lane is one of the four partial sums.
+ * The stations left over at the end are done with the scalar code.
+ */
+__attribute__((target("sse2")))
+static void
+stations_sse2(
+	blade_stations_t *	s
+)
+{
+	const __m128d		omega	= _mm_set1_pd( s->omega );
+	const __m128d		Vperp	= _mm_set1_pd( s->Vperp );
+	const __m128d		vv	= _mm_set1_pd( s->vv );
+	const __m128d		vv2	= _mm_set1_pd( s->vv2 );
+	const __m128d		theta0	= _mm_set1_pd( s->theta0 );
+	const __m128d		keys1	= _mm_set1_pd( s->keys1 );
+	const __m128d		keys2	= _mm_set1_pd( s->keys2 );
+	const __m128d		pi8	= _mm_set1_pd( 8.0 * C_PI );
+	const __m128d		sign	= _mm_set1_pd( -0.0 );
+
+	__m128d			sum[2][4];
+
+	for( int k=0 ; k<2 ; k++ )
+		for( int j=0 ; j<4 ; j++ )
+			sum[k][j] = _mm_setzero_pd();
+
+	int			i;
+
+	for( i=0 ; i + Blade::num_sums <= Blade::num_stations ; i += Blade::num_sums )
+	{
+		for( int k=0 ; k<2 ; k++ )
+		{
+			const int	n	= i + 2*k;
+
+			const __m128d	r	= _mm_loadu_pd( s->r + n );
+			const __m128d	omega_r	= _mm_loadu_pd( s->omega_r + n );
+			const __m128d	theta_r	= _mm_add_pd( theta0, _mm_loadu_pd( s->twst_r_R + n ) );
+			const __m128d	alpha	= _mm_sub_pd( theta_r, _mm_div_pd( Vperp, omega_r ) );
+			const __m128d	temp	= _mm_add_pd( vv2, _mm_mul_pd( _mm_loadu_pd( s->proudy_r + n ), alpha ) );
+			const __m128d	v1	= _mm_div_pd(
+				_mm_sub_pd( _mm_sqrt_pd( _mm_andnot_pd( sign, temp ) ), vv ),
+				pi8
+			);
+			const __m128d	temp2	= _mm_add_pd( Vperp, v1 );
+			const __m128d	dT	= _mm_mul_pd( _mm_mul_pd( _mm_mul_pd( keys2, temp2 ), v1 ), r );
+			const __m128d	dD	= _mm_mul_pd( keys1, _mm_loadu_pd( s->omega_r2 + n ) );
+			const __m128d	dQ	= _mm_mul_pd( r, _mm_add_pd(
+				_mm_div_pd( _mm_mul_pd( dT, temp2 ), omega_r ),
+				dD
+			) );
+			const __m128d	dP	= _mm_mul_pd( dQ, omega );
+
+			sum[k][0]	= _mm_add_pd( sum[k][0], dT );
+			sum[k][1]	= _mm_add_pd( sum[k][1], dQ );
+			sum[k][2]	= _mm_add_pd( sum[k][2], dP );
+			sum[k][3]	= _mm_add_pd( sum[k][3], v1 );
+		}
+	}
+
+	for( int k=0 ; k<2 ; k++ )
+	{
+		for( int j=0 ; j<4 ; j++ )
+		{
+			double		lanes[2];
+			_mm_storeu_pd( lanes, sum[k][j] );
+			s->sums[2*k+0][j] = lanes[0];
+			s->sums[2*k+1][j] = lanes[1];
+		}
+	}
+
+	for( ; i<Blade::num_stations ; ++i )
+		station( s, i, s->sums[i % Blade::num_sums] );
+}
+
+
+/*
+ *  AVX2 kernel: four stations per register, one lane for each
+ * of the partial sums.  FMA is deliberately not enabled since
+ * it would round differently than the other kernels.
+ */
+__attribute__((target("avx2")))
+static void
+stations_avx2(
+	blade_stations_t *	s
+)
+{
+	const __m256d		omega	= _mm256_set1_pd( s->omega );
+	const __m256d		Vperp	= _mm256_set1_pd( s->Vperp );
+	const __m256d		vv	= _mm256_set1_pd( s->vv );
+	const __m256d		vv2	= _mm256_set1_pd( s->vv2 );
+	const __m256d		theta0	= _mm256_set1_pd( s->theta0 );
+	const __m256d		keys1	= _mm256_set1_pd( s->keys1 );
+	const __m256d		keys2	= _mm256_set1_pd( s->keys2 );
+	const __m256d		pi8	= _mm256_set1_pd( 8.0 * C_PI );
+	const __m256d		sign	= _mm256_set1_pd( -0.0 );
+
+	__m256d			sum[4];
+
+	for( int j=0 ; j<4 ; j++ )
+		sum[j] = _mm256_setzero_pd();
+
+	int			i;
+
+	for( i=0 ; i + Blade::num_sums <= Blade::num_stations ; i += Blade::num_sums )
+	{
+		const __m256d	r	= _mm256_loadu_pd( s->r + i );
+		const __m256d	omega_r	= _mm256_loadu_pd( s->omega_r + i );
+		const __m256d	theta_r	= _mm256_add_pd( theta0, _mm256_loadu_pd( s->twst_r_R + i ) );
+		const __m256d	alpha	= _mm256_sub_pd( theta_r, _mm256_div_pd( Vperp, omega_r ) );
+		const __m256d	temp	= _mm256_add_pd( vv2, _mm256_mul_pd( _mm256_loadu_pd( s->proudy_r + i ), alpha ) );
+		const __m256d	v1	= _mm256_div_pd(
+			_mm256_sub_pd( _mm256_sqrt_pd( _mm256_andnot_pd( sign, temp ) ), vv ),
+			pi8
+		);
+		const __m256d	temp2	= _mm256_add_pd( Vperp, v1 );
+		const __m256d	dT	= _mm256_mul_pd( _mm256_mul_pd( _mm256_mul_pd( keys2, temp2 ), v1 ), r );
+		const __m256d	dD	= _mm256_mul_pd( keys1, _mm256_loadu_pd( s->omega_r2 + i ) );
+		const __m256d	dQ	= _mm256_mul_pd( r, _mm256_add_pd(
+			_mm256_div_pd( _mm256_mul_pd( dT, temp2 ), omega_r ),
+			dD
+		) );
+		const __m256d	dP	= _mm256_mul_pd( dQ, omega );
+
+		sum[0]	= _mm256_add_pd( sum[0], dT );
+		sum[1]	= _mm256_add_pd( sum[1], dQ );
+		sum[2]	= _mm256_add_pd( sum[2], dP );
+		sum[3]	= _mm256_add_pd( sum[3], v1 );
+	}
+
+	for( int j=0 ; j<4 ; j++ )
+	{
+		double			lanes[4];
+		_mm256_storeu_pd( lanes, sum[j] );
+		for( int k=0 ; k<4 ; k++ )
+			s->sums[k][j] = lanes[k];
+	}
+
+	for( ; i<Blade::num_stations ; ++i )
+		station( s, i, s->sums[i % Blade::num_sums] );
+}
+
+#endif
+
+
+bool
+Blade::have_kernel(
+	kernel_t		kernel
+)
+{
+	switch( kernel )
+	{
+	case KERNEL_AUTO:
+	case KERNEL_SCALAR:
+		return true;
+#ifdef BLADE_SIMD
+	case KERNEL_SSE2:
+		return __builtin_cpu_supports( "sse2" );
+	case KERNEL_AVX2:
+		return __builtin_cpu_supports( "avx2" );
+#endif
+	default:
+		return false;
+	}
+}
+
+
+Blade::kernel_t
+Blade::best_kernel()
+{
+	if( have_kernel( KERNEL_AVX2 ) )
+		return KERNEL_AVX2;
+	if( have_kernel( KERNEL_SSE2 ) )
+		return KERNEL_SSE2;
+	return KERNEL_SCALAR;
+}
+
+
+/*
+ *  The kernel that step() runs for each one that is asked for.  The
+ * CPU is asked once, here, and not on every step.
+ */
+static Blade::kernel_t
+usable_kernel(
+	Blade::kernel_t		kernel
+)
+{
+	static const Blade::kernel_t	best = Blade::best_kernel();
+	static const Blade::kernel_t	usable[] = {
+		best,
+		Blade::KERNEL_SCALAR,
+		Blade::have_kernel( Blade::KERNEL_SSE2 ) ? Blade::KERNEL_SSE2 : best,
+		Blade::have_kernel( Blade::KERNEL_AVX2 ) ? Blade::KERNEL_AVX2 : best,
+	};
+
+	if( kernel < 0 || kernel > Blade::KERNEL_AVX2 )
+		return best;
+
+	return usable[ kernel ];
+}
+
+
+/*
+ *  Recompute the station geometry if any of the values that it
+ * depends on have changed since the last call.  The expressions
+ * are the same as the ones that used to be in the station loop,
+ * so the cached values are bit for bit what the loop computed.
+ */
+void
+Blade::update_stations()
+{
+	const double		key[] = {
+		this->a,
+		this->b,
+		this->c,
+		this->R,
+		this->R0,
+		this->twst,
+		this->omega,
+	};
+
+	if( this->stations_valid
+	&&  memcmp( key, this->stations_key, sizeof(key) ) == 0
+	)
+		return;
+
+	memcpy( this->stations_key, key, sizeof(key) );
+	this->stations_valid = true;
+
+	// thickness of the blade element
+	const double		dR	= (this->R - this->R0) / 100.0;
+
+	const double		proudy	=
+		8.0 * C_PI * sqr( this->omega ) * this->a * this->b * this->c;
+
+	for( int i=0 ; i<num_stations ; ++i )
+	{
+		// ratio of local radius to total radius
+		const double	r_R	= (this->R0 + double(i+1)*dR) / this->R;
+
+		// local radius
+		const double	r	= r_R * this->R;
+
+		// local velocity
+		const double	omega_r	= this->omega*r;
+
+		this->station_r[i]		= r;
+		this->station_omega_r[i]	= omega_r;
+		this->station_omega_r2[i]	= sqr( omega_r );
+		this->station_twst_r_R[i]	= this->twst*r_R;
+		this->station_proudy_r[i]	= proudy * r;
+	}
+}
 
 
 /*
@@ -71,89 +422,82 @@ static const int	num_stations	= 93;
 void
 Blade::step()
 {
-	// Reset the outputs for this computation.
-	this->T		= 0.0;
-	this->Q		= 0.0;
-	this->P		= 0.0;
-	this->avg_v1	= 0.0;
+	this->step( KERNEL_AUTO );
+}
 
+
+void
+Blade::step(
+	kernel_t		kernel
+)
+{
+#ifdef CHECK_NAN
 	if( isnan(this->Vperp) )
 		abort();
+#endif
+
+	kernel = usable_kernel( kernel );
+
+	this->update_stations();
+
+	blade_stations_t	s;
+
+	s.omega		= this->omega;
+	s.Vperp		= this->Vperp;
 
 	// abcOmega/2 + 4piVperp
-	const double		vv	=
+	s.vv		=
 		this->a * this->b * this->c * this->omega / 2.0
 		+ 4.0 * C_PI * this->Vperp;
 
 	// thickness of the blade element
-	const double		dR	=
-		(this->R - this->R0) / 100.0;
+	const double		dR	= (this->R - this->R0) / 100.0;
 
 	// root collective angle
-	const double		theta0	=
+	s.theta0	=
 		fabs(this->collective)
 		- this->twst * (0.75 - (this->R0/this->R));
 
-	// Constants hoisted out of the loop
-	const double		omega2	= sqr( this->omega );
-	const double		vv2	= sqr( vv );
-	const double		proudy	= 
-		8.0 * C_PI * omega2 * this->a * this->b * this->c;
-	const double		keys1	=
-		this->Cd0 * this->rho * this->c * dR / 2.0;
-	const double		keys2	=
-		4.0 * C_PI * this->rho * dR;
-
-	for( int i=0 ;  i<num_stations ;  ++i )
-	{
-		// ratio of local radius to total radius
-		const double	r_R	= (this->R0 + double(i+1)*dR) / this->R;
-
-		// local radius
-		const double	r	= r_R * this->R;
-
-		// local collective angle
-		const double	theta_r	= theta0 + this->twst*r_R;
-
-		// local velocity
-		const double	omega_r	= this->omega*r;
-
-		// local angle of attack
-		const double	alpha	= theta_r - this->Vperp/omega_r;
-
-		// Proudy pg 96
-		const double	temp	= vv2 + proudy * r * alpha;
-
-		// local induced velocity
-		const double	v1	= 
-			( sqrt(fabs(temp)) - vv ) / ( 8.0 * C_PI );
+	s.vv2		= sqr( s.vv );
+	s.keys1		= this->Cd0 * this->rho * this->c * dR / 2.0;
+	s.keys2		= 4.0 * C_PI * this->rho * dR;
 
-		const double	temp2	= this->Vperp + v1;
+	s.r		= this->station_r;
+	s.omega_r	= this->station_omega_r;
+	s.omega_r2	= this->station_omega_r2;
+	s.twst_r_R	= this->station_twst_r_R;
+	s.proudy_r	= this->station_proudy_r;
 
-		// Keys eq 3.11
-		// incriment of thrust
-		const double	dT	= keys2 * temp2 * v1 * r;
+	for( int k=0 ; k<num_sums ; k++ )
+		for( int j=0 ; j<4 ; j++ )
+			s.sums[k][j] = 0.0;
 
-		// Keys eq 3.5
-		// incriment of profile drag
-		const double	dD	= keys1 * sqr(omega_r);
-
-		// Keys eq 3.9a
-		// incriment of torque
-		const double	dQ	= r * ( dT*temp2/omega_r + dD );
+	switch( kernel )
+	{
+#ifdef BLADE_SIMD
+	case KERNEL_AVX2:
+		stations_avx2( &s );
+		break;
+	case KERNEL_SSE2:
+		stations_sse2( &s );
+		break;
+#endif
+	default:
+		stations_scalar( &s );
+		break;
+	}
 
-		// Keys eq 3.9b
-		// incriment of power
-		const double	dP	= dQ * this->omega;
+	// Add the partial sums for the entire blade
+	double			sum[4];
 
-		// Add this blade element to the entire blade
-		this->T		+= dT;
-		this->Q		+= dQ;
-		this->P		+= dP;
-		this->avg_v1	+= v1;
-	}
+	for( int j=0 ; j<4 ; j++ )
+		sum[j] = ( s.sums[0][j] + s.sums[1][j] )
+		       + ( s.sums[2][j] + s.sums[3][j] );
 
-	this->avg_v1	= this->avg_v1 / num_stations;
+	this->T		= sum[0];
+	this->Q		= sum[1];
+	this->P		= sum[2];
+	this->avg_v1	= sum[3] / num_stations;
 	
 	if( this->collective < 0.0 )
 	{
@@ -38,11 +38,74 @@ namespace sim {
 class Blade
 {
 public:
-	Blade() {}
+	Blade() :
+		stations_valid( false )
+	{}
+
 	~Blade() {}
 
+	/*
+	 *  Station loop implementations.  step() picks the fastest
+	 * one that the CPU supports the first time it is called.
+	 *
+	 * All of them compute each station with the same operations
+	 * in the same order and sum the stations into four interleaved
+	 * partial sums (station i goes into sum i % 4), which are
+	 * added as (s0 + s1) + (s2 + s3).  The SIMD versions therefore
+	 * match the scalar version to max_ulp_error ULP in T, Q, P and
+	 * avg_v1.  This holds as long as the scalar code is not
+	 * contracted into FMA instructions or run on the x87 with
+	 * extended precision; the default x86-64 flags do neither.
+	 *
+	 * Against the original loop, which added every station to one
+	 * running sum in order, only the order of the additions differs.
+	 * Any order of n additions is within (n-1)/2 epsilon of the sum
+	 * of the magnitudes of the terms, so the two agree to within
+	 * max_reorder_error epsilon of that sum.  testblade checks both.
+	 */
+	typedef enum {
+		KERNEL_AUTO,
+		KERNEL_SCALAR,
+		KERNEL_SSE2,
+		KERNEL_AVX2,
+	} kernel_t;
+
+	static const int	max_ulp_error = 0;
+
 	void step();
 
+	void step(
+		kernel_t		kernel
+	);
+
+	// Fastest kernel for this CPU
+	static kernel_t best_kernel();
+
+	// Is this kernel compiled in and supported by the CPU?
+	static bool have_kernel(
+		kernel_t		kernel
+	);
+
+	/*
+	 *  Force the station geometry to be recomputed on the next
+	 * step().  This is never needed for correctness since step()
+	 * notices any change to the geometry or omega on its own.
+	 */
+	void
+	invalidate()
+	{
+		this->stations_valid = false;
+	}
+
+	// number of stations to use in blade element (total is always 100)
+	static const int	num_stations = 93;
+
+	// stations are summed into this many interleaved partial sums
+	static const int	num_sums = 4;
+
+	// distance from a single running sum, in epsilon of the magnitudes
+	static const int	max_reorder_error = num_stations - 1;
+
 
 	// lift curve slope (*/rad)
 	double a;
@@ -92,6 +155,33 @@ public:
 	// output average induced velocity (ft/s)
 	double avg_v1;
 
+private:
+	/*
+	 *  Station geometry cache.  These only depend on a, b, c, R,
+	 * R0, twst and omega, which change on Heli::reset() or when
+	 * the RPM changes, so they are kept between calls.  The
+	 * values that they were computed from are in stations_key.
+	 */
+	void update_stations();
+
+	bool			stations_valid;
+	double			stations_key[7];
+
+	// local radius (ft)
+	double			station_r[num_stations];
+
+	// local velocity omega * r (ft/s)
+	double			station_omega_r[num_stations];
+
+	// sqr( omega * r )
+	double			station_omega_r2[num_stations];
+
+	// twist contribution twst * r/R (rad)
+	double			station_twst_r_R[num_stations];
+
+	// 8 pi omega^2 a b c r, the Proudy term without alpha
+	double			station_proudy_r[num_stations];
+
 };
 
 
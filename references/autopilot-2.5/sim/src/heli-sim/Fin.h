@@ -66,6 +66,9 @@ public:
 	);
 
 private:
+	// The batch engine reads the parameters directly
+	friend class HeliBatch;
+
 	// fin horizontal fuse station point (from MR hub in)
 	double	fs;
 
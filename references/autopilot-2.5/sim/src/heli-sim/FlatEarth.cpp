@@ -374,4 +374,85 @@ sixdof_fe(
 	pX->Vb		= cBE * X.Vned;		// body velocity in body frame
 }
 
+
+
+void
+sixdof_fe_pack(
+	double			X[13],
+	const sixdof_fe_state_def *	pX
+)
+{
+	const Quat		Q( pX->Q.norm() );
+
+	for( int i=0 ; i<3 ; i++ )
+	{
+		X[0+i]		= pX->Ve[i];
+		X[3+i]		= pX->NED[i];
+		X[6+i]		= pX->rate[i];
+	}
+
+	for( int i=0 ; i<4 ; i++ )
+		X[9+i]		= Q[i];
+}
+
+
+void
+sixdof_fe_unpack(
+	sixdof_fe_state_def *	pX,
+	const double		X[13]
+)
+{
+	for( int i=0 ; i<3 ; i++ )
+	{
+		pX->Ve[i]	= X[0+i];
+		pX->NED[i]	= X[3+i];
+		pX->rate[i]	= X[6+i];
+	}
+
+	for( int i=0 ; i<4 ; i++ )
+		pX->Q[i]	= X[9+i];
+	pX->Q.norm_self();
+
+	const Rotate<Frame::Body,Frame::NED> 	cBE( quatDC( pX->Q ) );
+
+	pX->THETA	= quat2euler( pX->Q );	// Convert attitude to euler
+	pX->Vb		= cBE * pX->Ve;		// body velocity in body frame
+}
+
+
+void
+sixdof_fe_vector_derivs(
+	double			Xdot[13],
+	const double		X[13],
+	sixdof_fe_inputs_def *	pU
+)
+{
+	sixdofX_fe_def		x;
+	sixdofXdot_fe_def	xdot;
+
+	for( int i=0 ; i<3 ; i++ )
+	{
+		x.Vned[i]	= X[0+i];
+		x.NED[i]	= X[3+i];
+		x.pqr[i]	= X[6+i];
+	}
+
+	for( int i=0 ; i<4 ; i++ )
+		x.Q[i]		= X[9+i];
+
+	x.Q.norm_self();
+
+	sixdof_fe_derivs( &xdot, &x, pU );
+
+	for( int i=0 ; i<3 ; i++ )
+	{
+		Xdot[0+i]	= xdot.Vned_dot[i];
+		Xdot[3+i]	= xdot.NED_dot[i];
+		Xdot[6+i]	= xdot.pqr_dot[i];
+	}
+
+	for( int i=0 ; i<4 ; i++ )
+		Xdot[9+i]	= xdot.Q_dot[i];
+}
+
 }
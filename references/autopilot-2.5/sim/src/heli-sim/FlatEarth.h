@@ -12,7 +12,8 @@
  * and longitude.  All that is needed is the starting NED (north east down)
  * position.  The main difference is that altitude is now + down not up.  
  *
- * Propogation of the dynamics is done with RK4.
+ * Propogation of the dynamics is done with RK4, or by the caller
+ * with the state vector form below.
  *
  * NOTE: ALL VALUES ARE AT THE CG OF THE VEHCILE!
  *
@@ -161,5 +162,31 @@ sixdof_fe(
 );
 
 
+/*
+ *  The 6-DOF as a plain state vector X[13] = [Vned NED pqr Q], so
+ * that it can be integrated together with the rest of a vehicle
+ * model.  sixdof_fe_unpack() normalizes the quaternion and fills in
+ * THETA and Vb.  sixdof_fe_vector_derivs() uses the F and M in pU,
+ * so the caller must update them for each evaluation.
+ */
+extern void
+sixdof_fe_pack(
+	double			X[13],
+	const sixdof_fe_state_def *	pX
+);
+
+extern void
+sixdof_fe_unpack(
+	sixdof_fe_state_def *	pX,
+	const double		X[13]
+);
+
+extern void
+sixdof_fe_vector_derivs(
+	double			Xdot[13],
+	const double		X[13],
+	sixdof_fe_inputs_def *	pU
+);
+
 }
 #endif
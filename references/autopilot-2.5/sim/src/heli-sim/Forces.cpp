@@ -34,6 +34,7 @@
 #include <mat/Vector_Rotate.h>
 #include <mat/Quat.h>
 #include <mat/Nav.h>
+#include <mat/Atmosphere.h>
 
 namespace sim
 {
@@ -61,11 +62,13 @@ Forces::rho()
 	double			densAlt = this->altitude - this->NED[2];
 
 	atmosphere(
+		this->atmosphere_model,
 		densAlt,
 		&rho,
 		&pressure,
 		&temperature,
-		&sp_sound
+		&sp_sound,
+		&this->atmosphere_cache
 	);
 
 	return rho;
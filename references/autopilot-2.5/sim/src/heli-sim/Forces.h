@@ -35,6 +35,7 @@
 #include <mat/Frames.h>
 #include <mat/Vector.h>
 #include <mat/Vector_Rotate.h>
+#include <mat/Atmosphere.h>
 
 namespace sim {
 
@@ -47,14 +48,18 @@ class Forces
 {
 
 public:
-	Forces() {}
+	Forces() :
+		atmosphere_model( ATMOSPHERE_TABLE )
+	{
+	}
+
 	~Forces() {}
 
 	/*
 	 *  Random accessors
 	 */
 
-	// Returns the air density
+	// Returns the air density from atmosphere_model
 	double rho();
 
 	// Computes the local gravity for the forces
@@ -100,6 +105,9 @@ public:
 	// starting density altitude (ft + up)
 	double altitude;
 
+	// analytic or tabulated atmosphere for rho()
+	atmosphere_model_t	atmosphere_model;
+
 
 	/*
 	 *  Computed dynamics
@@ -131,6 +139,9 @@ public:
 	// sim time (sec)
 	double time;
 
+	// last table cell used by rho()
+	AtmosphereCache		atmosphere_cache;
+
 };
 
 }
@@ -71,7 +71,7 @@ const double	Gear::default_k		= 120.0;
  *
  * For more information, see the structure definitions below.
  */
-void
+double
 Gear::step(
 	Forces *		cg,
 	const Rotate<Frame::Body,Frame::NED> &	cBE,
@@ -88,7 +88,7 @@ Gear::step(
 
 	// underground?  We don't change the values at all
 	if( delta < 0.0 )
-		return;
+		return delta;
 
 	// make the true position of the wheel (earth frame)
 	Pw_e[2] = 0.0;
@@ -156,7 +156,7 @@ Gear::step(
 	cg->M += M;
 
 	if( this->max_force < 0 )
-		return;
+		return delta;
 
 	// Check for maximum force exceeded
 	const double magnitude = F.mag2();
@@ -166,6 +166,8 @@ Gear::step(
 			<< "Force=" << magnitude
 			<< " exceeds max " <<  this->max_force
 			<< endl;
+
+	return delta;
 }
 
 
@@ -110,9 +110,11 @@ public:
 	);
 
 	/*
-	 *  Compute the forces and moments
+	 *  Compute the forces and moments.  Returns how far the
+	 * contact point is below the ground (ft), which is negative
+	 * when it is above the ground.
 	 */
-	void step(
+	double step(
 		Forces *		cg,
 		const Rotate<Frame::Body,Frame::NED> &	cEB,
 		const Rotate<Frame::NED,Frame::Body> &	cBE,
@@ -121,6 +123,9 @@ public:
 
 
 private:
+	// The batch engine reads the parameters directly
+	friend class HeliBatch;
+
 	// the vector from vehicle CG -> contact pt, body frame [X Y Z] (ft)
 	Position<Frame::Body>	cg2point;
 
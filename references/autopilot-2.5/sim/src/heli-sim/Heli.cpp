@@ -47,6 +47,7 @@
 #include "Fin.h"
 
 #include <mat/rk4.h>
+#include <mat/dopri5.h>
 #include <mat/Conversions.h>
 #include <mat/Matrix.h>
 #include <mat/Vector.h>
@@ -113,10 +114,6 @@ RotorFlapDynamics(
 	Xdot[2] = d_dot;
 	Xdot[3] = c_dot;
 
-	// If this is unchecked, the program dies eventually
-	if( isnan( Xdot[0] ) )
-		abort();
-
 #ifdef CHECK_NAN
 	if( Xdot.isnan() )
 		abort();
@@ -140,6 +137,18 @@ Heli::setup_wind()
 		0			// D
 	);
 
+	/*
+	 * MIL-F-8785C low altitude scale lengths at 100 ft,
+	 * L = h / (0.177 + 0.000823 h)^1.2 horizontally and h
+	 * vertically, flown through at 30 ft/s.
+	 */
+	params->scale		= Vector<3>(
+		505,			// N
+		505,			// E
+		100			// D
+	);
+	params->airspeed	= 30;
+
 	wind_init(
 		params,
 		state
@@ -323,8 +332,13 @@ Heli::do_gear(
 	const Matrix<3,3>	wx( eulerWx( cg->pqr.v ) );
 
 
+	this->gear_depth = -HUGE_VAL;
+
 	FOR_ALL( vector<Gear>, g, this->gear,
-		g->step( cg, cBE, cEB, wx );
+		const double	depth = g->step( cg, cBE, cEB, wx );
+
+		if( depth > this->gear_depth )
+			this->gear_depth = depth;
 	);
 }
 
@@ -342,6 +356,62 @@ Heli::do_forces(
 {
 	mainrotor_def *		m	= &this->m;
 	flybar_def *		fb	= &this->fb;
+	Forces *		cg	= &this->cg;
+
+	this->do_rotors( g );
+
+	// Main Rotor TPP Dynamics
+	// Everything gets wrapped into args for
+	// the Runge Kutta routine.
+	// for RK4 routine (rotor dynamics)
+	Vector<4>		Xdot;
+	Vector<4>		X(
+		m->a1,
+		m->b1,
+		fb->d,
+		fb->c
+	);
+
+#ifdef CHECK_NAN
+	if( isnan( m->a1 ) )
+		abort();
+#endif
+
+	Vector<2>		U;
+	Vector<13>		args;
+
+	this->flap_inputs( U, args );
+	
+	RK4( X, Xdot, cg->time, U, args, dt, &RotorFlapDynamics );
+
+	// Extract out our new state
+	m->a1		= X[0];
+	m->b1		= X[1];
+	fb->d		= X[2];
+	fb->c		= X[3];
+	m->a1dot	= Xdot[0];
+	m->b1dot	= Xdot[1];
+	fb->d_dot	= Xdot[2];
+	fb->c_dot	= Xdot[3];
+
+#ifdef CHECK_NAN
+	if( isnan( m->a1 ) )
+		abort();
+#endif
+}
+
+
+/*
+ *  Main and tail rotor and fin forces and moments for the current
+ * state, summed into cg->F and cg->M along with gravity.  This is
+ * do_forces() without the flapping integration.
+ */
+void
+Heli::do_rotors(
+	const Force<Frame::Body> &	g
+)
+{
+	mainrotor_def *		m	= &this->m;
 	tailrotor_def *		t	= &this->t;
 	Forces *		cg	= &this->cg;
 	Blade *			mb	= &this->main_rotor_blade;
@@ -435,29 +505,32 @@ Heli::do_forces(
 		fin->step( cg, m->vi );
 	);
 
+	// Sum Up Total Forces and Moments At CG of main and tail rotors
+	cg->F += m->F;
+	cg->F += t->F;
 
-	// Main Rotor TPP Dynamics
-	// Everything gets wrapped into args for
-	// the Runge Kutta routine.
-	// for RK4 routine (rotor dynamics)
-	Vector<4>		Xdot;
-	Vector<4>		X(
-		m->a1,
-		m->b1,
-		fb->d,
-		fb->c
-	);
+	cg->M += m->M;
+	cg->M += t->M;
+}
 
-	static double old_ma1;
-	old_ma1	= m->a1;
-	if( isnan( m->a1 ) )
-		abort();
 
-	Vector<2>		U;
+/*
+ *  Inputs to RotorFlapDynamics() for the current state
+ */
+void
+Heli::flap_inputs(
+	Vector<2> &		U,
+	Vector<13> &		args
+) const
+{
+	const mainrotor_def *	m	= &this->m;
+	const flybar_def *	fb	= &this->fb;
+	const Forces *		cg	= &this->cg;
+	const control_def *	c	= &this->c;
+
 	U[0]			= c->A1;
 	U[1]			= c->B1;
 
-	Vector<13>		args;
 	args[ 0]		= cg->uvw[0];
 	args[ 1]		= cg->uvw[1];
 	args[ 2]		= cg->pqr[0];
@@ -471,28 +544,6 @@ Heli::do_forces(
 	args[10]		= fb->tau;
 	args[11]		= fb->Kc;
 	args[12]		= fb->Kd;
-	
-	RK4( X, Xdot, cg->time, U, args, dt, &RotorFlapDynamics );
-
-	// Extract out our new state
-	m->a1		= X[0];
-	m->b1		= X[1];
-	fb->d		= X[2];
-	fb->c		= X[3];
-	m->a1dot	= Xdot[0];
-	m->b1dot	= Xdot[1];
-	fb->d_dot	= Xdot[2];
-	fb->c_dot	= Xdot[3];
-
-	if( isnan( m->a1 ) )
-		abort();
-
-	// Sum Up Total Forces and Moments At CG of main and tail rotors
-	cg->F += m->F;
-	cg->F += t->F;
-
-	cg->M += m->M;
-	cg->M += t->M;
 }
 
 
@@ -542,7 +593,6 @@ void
 Heli::setup_main_rotor()
 {
 	mainrotor_def *		m	= &this->m;
-	Forces *		cg	= &this->cg;
 
 	/* Parameters */
 	m->fs		=  0.0;			// in
@@ -561,21 +611,31 @@ Heli::setup_main_rotor()
 	m->dir		= -1.0;			// MR direction of rotation viewed from top (1 = ccw; -1 = cw)
 	m->ib		=  0.0;			// laterial shaft tilt (rad)
 
+	this->compute_main_rotor();
+
+	m->vi		= 15.0;
+	m->a1		= 0.0;
+	m->b1		= 0.0;
+	m->a1dot	= 0.0;
+	m->b1dot	= 0.0;
+	m->thrust	= 0.0;
+	m->F.fill();
+	m->M.fill();
+}
+
+
+/*
+ *  Compute the main rotor values that are derived from the
+ * parameters.  Call this after changing any of them.
+ */
+void
+Heli::compute_main_rotor()
+{
+	mainrotor_def *		m	= &this->m;
+	Forces *		cg	= &this->cg;
 
 	/* Dynamics */
-	double			rho;
-	double			temp;
-	double			pres;
-	double			sp_sound;
-
-
-	atmosphere(
-		cg->altitude - cg->NED[2],
-		&rho,
-		&pres,
-		&temp,
-		&sp_sound
-	);
+	const double		rho = cg->rho();
 
 	m->omega	= this->c.mr_rev * C_TWOPI / 60.0;	// rad/s
 	m->v_tip	= m->r * this->m.omega;	// ft/s
@@ -620,14 +680,9 @@ Heli::setup_main_rotor()
 	// flab back coef
 	m->da1du	= -m->db1dv;
 
-	m->vi		= 15.0;
-	m->a1		= 0.0;
-	m->b1		= 0.0;
-	m->a1dot	= 0.0;
-	m->b1dot	= 0.0;
-	m->thrust	= 0.0;
-	m->F.fill();
-	m->M.fill();
+	// The derivatives kept from the last step used the old values
+	this->first_stage.valid	= false;
+	this->last_stage.valid	= false;
 }
 
 
@@ -783,52 +838,84 @@ Heli::setup_sixdof()
  * function to call to propogate the helicopter model, 6-DOF,
  * landing gear, servos, and wind.
  */
-void
+int
 Heli::step(
 	double			model_dt,
 	const double		U[4]
 )
 {
-	Forces *		cg = &this->cg;
-	const Force<Frame::Body>	g( cg->compute_gravity() );
-
-	if( isnan( cg->F[0] ) )
-		abort();
+	if( this->substep( model_dt, U, this->integrator ) < 0 )
+		return -1;
 
-	this->do_forces( model_dt, g );
-	if( isnan( cg->F[0] ) )
-		abort();
-
-	this->do_gear( model_dt );
-	if( isnan( cg->F[0] ) )
-		abort();
+	if( this->health != HEALTH_NONE && !this->is_finite() )
+		return -1;
 
-	this->do_servos( model_dt, U );
-	if( isnan( cg->F[0] ) )
-		abort();
+	return 0;
+}
 
 
-	this->sixdofIn.F = cg->F;
-	this->sixdofIn.M = cg->M;
+/*
+ *  One step of the selected integrator.  With HEALTH_FULL the forces
+ * are checked after every stage and -1 is returned as soon as one of
+ * them is not finite, leaving the step half done.
+ */
+int
+Heli::substep(
+	double			model_dt,
+	const double		U[4],
+	integrator_t		integrator
+)
+{
+	Forces *		cg = &this->cg;
+	Force<Frame::Body>	g( cg->compute_gravity() );
+	const bool		full = this->health == HEALTH_FULL;
 
-	sixdof_fe(
-		&this->sixdofX,
-		&this->sixdofIn,
-		model_dt
-	);
+	if( full && isnan( cg->F[0] ) )
+		return -1;
 
-	cg->NED		= this->sixdofX.NED;
-	cg->uvw		= this->sixdofX.Vb;
-	cg->V		= this->sixdofX.Ve;
-	cg->THETA	= this->sixdofX.THETA;
-	cg->pqr		= this->sixdofX.rate;
+	if( integrator == INTEGRATOR_DOPRI5 )
+	{
+		this->do_coupled( model_dt, U );
+		if( full && isnan( cg->F[0] ) )
+			return -1;
+
+		// The forces are for the end of the step
+		g = cg->compute_gravity();
+	} else {
+		this->do_forces( model_dt, g );
+		this->force_evaluations++;
+		if( full && isnan( cg->F[0] ) )
+			return -1;
+
+		this->do_gear( model_dt );
+		if( full && isnan( cg->F[0] ) )
+			return -1;
+
+		this->do_servos( model_dt, U );
+		if( full && isnan( cg->F[0] ) )
+			return -1;
+
+
+		this->sixdofIn.F = cg->F;
+		this->sixdofIn.M = cg->M;
+
+		sixdof_fe(
+			&this->sixdofX,
+			&this->sixdofIn,
+			model_dt
+		);
+
+		cg->NED		= this->sixdofX.NED;
+		cg->uvw		= this->sixdofX.Vb;
+		cg->V		= this->sixdofX.Ve;
+		cg->THETA	= this->sixdofX.THETA;
+		cg->pqr		= this->sixdofX.rate;
+	}
 
 	/*
 	 * Aaron says to do this after sixdof_fe() and memcpy().
-	 * It is turned off right now because it costs 10 usec
-	 * and we have zero wind all the time now.
 	 */
-	//this->do_wind( model_dt );
+	this->do_wind( model_dt );
 
 	/* Advance the time clock */
 	cg->time += model_dt;
@@ -837,8 +924,38 @@ Heli::step(
 	// would read at the cg.
 	cg->F -= g;
 
-	if( isnan( cg->NED[0] ) )
-		abort();
+	if( full && isnan( cg->NED[0] ) )
+		return -1;
+
+	return 0;
+}
+
+
+/*
+ *  NaN and Inf both survive being added to anything, so the sum of
+ * the state is only finite if every part of it is.  This is one
+ * branch instead of one per value.
+ */
+bool
+Heli::is_finite() const
+{
+	const Forces *		cg	= &this->cg;
+	double			sum	= 0;
+
+	sum += this->m.a1 + this->m.b1;
+	sum += this->fb.d + this->fb.c;
+
+	for( int i=0 ; i<3 ; i++ )
+	{
+		sum += cg->F[i] + cg->M[i];
+		sum += cg->NED[i] + cg->uvw[i];
+		sum += cg->THETA[i] + cg->pqr[i];
+	}
+
+	for( int i=0 ; i<4 ; i++ )
+		sum += this->servos[i].state()[0] + this->servos[i].state()[1];
+
+	return fabs( sum ) < HUGE_VAL;
 }
 
 
@@ -895,6 +1012,431 @@ Heli::reset()
 	this->sixdofIn.hold_u	= 0;
 	this->sixdofIn.hold_v	= 0;
 	this->sixdofIn.hold_w	= 0;
+
+	// Integrator state
+	this->next_dt		= this->fixed_dt;
+	this->gear_depth	= -HUGE_VAL;
+	this->step_error	= 0;
+	this->steps_accepted	= 0;
+	this->steps_rejected	= 0;
+	this->force_evaluations	= 0;
+	this->first_stage.valid	= false;
+	this->last_stage.valid	= false;
+}
+
+
+
+/*
+ *  Pack the integrated state of the model into X for DOPRI5
+ */
+void
+Heli::coupled_pack(
+	coupled_t &		X
+) const
+{
+	sixdof_fe_pack( &X[0], &this->sixdofX );
+
+	X[13]		= this->m.a1;
+	X[14]		= this->m.b1;
+	X[15]		= this->fb.d;
+	X[16]		= this->fb.c;
+
+	for( int i=0 ; i < 4 ; i++ )
+		this->servos[i].pack( &X[17 + 2*i] );
+}
+
+
+/*
+ *  Set the model to the state in X.  The cg state and the swashplate
+ * positions are filled in from it, so that do_rotors() and do_gear()
+ * see the same values they would after a fixed step.
+ */
+void
+Heli::coupled_unpack(
+	const coupled_t &	X
+)
+{
+	Forces *		cg = &this->cg;
+	control_def *		c = &this->c;
+
+	// Same order as do_servos()
+	double *		controls[] = {
+		&c->B1,
+		&c->A1,
+		&c->mr_col,
+		&c->tr_col,
+	};
+
+	sixdof_fe_unpack( &this->sixdofX, &X[0] );
+
+	cg->NED		= this->sixdofX.NED;
+	cg->uvw		= this->sixdofX.Vb;
+	cg->V		= this->sixdofX.Ve;
+	cg->THETA	= this->sixdofX.THETA;
+	cg->pqr		= this->sixdofX.rate;
+
+	// The wind is held over the step, as do_wind() left it
+	cg->uvw += rotate<Frame::Body>(
+		this->wind_state.Ve,
+		cg->THETA
+	);
+
+	this->m.a1	= X[13];
+	this->m.b1	= X[14];
+	this->fb.d	= X[15];
+	this->fb.c	= X[16];
+
+	for( int i=0 ; i < 4 ; i++ )
+	{
+		this->servos[i].unpack( &X[17 + 2*i] );
+		*controls[i] = Servo::output( &X[17 + 2*i] );
+	}
+}
+
+
+/*
+ *  Derivative of the whole model for DOPRI5.  The forces are
+ * recomputed from the state for every evaluation.
+ */
+void
+Heli::coupled_derivs(
+	coupled_t &		Xdot,
+	const coupled_t &	X,
+	const double		t,
+	const Vector<4> &	commands,
+	Heli * const &		heli
+)
+{
+	Forces *		cg = &heli->cg;
+
+	heli->force_evaluations++;
+	heli->coupled_unpack( X );
+	heli->do_rotors( cg->compute_gravity() );
+	heli->do_gear( 0 );
+
+	heli->sixdofIn.F = cg->F;
+	heli->sixdofIn.M = cg->M;
+
+	sixdof_fe_vector_derivs( &Xdot[0], &X[0], &heli->sixdofIn );
+
+	Vector<4>		flapXdot;
+	const Vector<4>		flapX(
+		X[13],
+		X[14],
+		X[15],
+		X[16]
+	);
+
+	Vector<2>		A1B1;
+	Vector<13>		args;
+
+	heli->flap_inputs( A1B1, args );
+	RotorFlapDynamics( flapXdot, flapX, t, A1B1, args );
+
+	for( int i=0 ; i < 4 ; i++ )
+	{
+		Xdot[13 + i] = flapXdot[i];
+		heli->servos[i].derivs(
+			&Xdot[17 + 2*i],
+			&X[17 + 2*i],
+			commands[i]
+		);
+	}
+}
+
+
+/*
+ *  DOPRI5 step of the whole model.  The step error is left in
+ * step_error for advance() to accept or reject the step.
+ *
+ * The first stage is the last one of the previous step when nothing
+ * that the derivative depends on has changed since.  A step that
+ * was rejected and put back starts from the same state, so the
+ * retry reuses it, too.  Only the state, the commands and the wind
+ * are compared, so restore() and compute_main_rotor() drop both
+ * stages.  The turbulence changes the wind on every
+ * step, so with it on only the retries do.
+ */
+void
+Heli::do_coupled(
+	double			dt,
+	const double		U[4]
+)
+{
+	Forces *		cg = &this->cg;
+	coupled_t		X;
+	coupled_t		Xdot;
+	coupled_t		error;
+	Vector<4>		commands;
+
+	for( int i=0 ; i < 4 ; i++ )
+		commands[i] = this->servos[i].limit_command( U[i] );
+
+	this->coupled_pack( X );
+
+	const coupled_t		X0( X );
+	Heli * const		self = this;
+
+	const stage_t *		stages[] = {
+		&this->last_stage,
+		&this->first_stage,
+	};
+
+	const stage_t *		reuse = 0;
+
+	for( int i=0 ; i < 2 && !reuse ; i++ )
+	{
+		const stage_t *		stage = stages[i];
+
+		// A zero wind is +0 or -0, so it is compared by value
+		if( stage->valid
+		&&  memcmp( &stage->X, &X, sizeof(X) ) == 0
+		&&  memcmp( &stage->commands, &commands, sizeof(commands) ) == 0
+		&&  stage->wind[0] == this->wind_state.Ve[0]
+		&&  stage->wind[1] == this->wind_state.Ve[1]
+		&&  stage->wind[2] == this->wind_state.Ve[2]
+		)
+			reuse = stage;
+	}
+
+	if( reuse )
+		Xdot = reuse->Xdot;
+	else
+		coupled_derivs( Xdot, X, cg->time, commands, self );
+
+	coupled_t		next_dot;
+
+	DOPRI5(
+		X,
+		Xdot,
+		next_dot,
+		error,
+		cg->time,
+		commands,
+		self,
+		dt,
+		&Heli::coupled_derivs
+	);
+
+	stage_t *		first = &this->first_stage;
+	stage_t *		last = &this->last_stage;
+
+	first->valid		= true;
+	first->X		= X0;
+	first->Xdot		= Xdot;
+	first->commands		= commands;
+	first->wind		= this->wind_state.Ve;
+
+	// The last stage unpacked X and normalized its quaternion, so
+	// the next step starts from that and not from X itself.  The
+	// derivative is for X, which differs from it only by rounding.
+	last->valid		= true;
+	this->coupled_pack( last->X );
+	last->Xdot		= next_dot;
+	last->commands		= commands;
+	last->wind		= this->wind_state.Ve;
+
+	this->step_error = rk_error_norm( error, X0, X, this->tolerance );
+
+	// The last evaluation was at X, so the state, the forces in cg
+	// and gear_depth are already for the end of the step.  Xdot is
+	// from the start of the step, the same as RK4() returns.
+	this->m.a1dot		= Xdot[13];
+	this->m.b1dot		= Xdot[14];
+	this->fb.d_dot		= Xdot[15];
+	this->fb.c_dot		= Xdot[16];
+
+	for( int i=0 ; i<3 ; i++ )
+		this->sixdofX.alpha[i]	= Xdot[6+i];
+	this->sixdofX.accel	= this->sixdofIn.F.v / this->sixdofIn.m;
+
+	// do_wind() adds the new wind back in
+	cg->uvw			= this->sixdofX.Vb;
+}
+
+
+void
+Heli::save(
+	snapshot_t &		snapshot
+) const
+{
+	snapshot.m		= this->m;
+	snapshot.fb		= this->fb;
+	snapshot.t		= this->t;
+	snapshot.cg		= this->cg;
+	snapshot.c		= this->c;
+	snapshot.sixdofIn	= this->sixdofIn;
+	snapshot.sixdofX	= this->sixdofX;
+	snapshot.wind_state	= this->wind_state;
+	snapshot.gear_depth	= this->gear_depth;
+	snapshot.next_dt	= this->next_dt;
+	snapshot.step_error	= this->step_error;
+
+	for( int i=0 ; i < 4 ; i++ )
+		snapshot.servo_X[i] = this->servos[i].state();
+}
+
+
+/*
+ *  The parameters may differ from the ones the kept DOPRI5 stages
+ * were computed with, so those are dropped.
+ */
+void
+Heli::restore(
+	const snapshot_t &	snapshot
+)
+{
+	this->restore_state( snapshot );
+
+	this->first_stage.valid	= false;
+	this->last_stage.valid	= false;
+}
+
+
+/*
+ *  advance() undoes a rejected step with this, which keeps the stages
+ * so that the retry can reuse its first one.
+ */
+void
+Heli::restore_state(
+	const snapshot_t &	snapshot
+)
+{
+	this->m			= snapshot.m;
+	this->fb		= snapshot.fb;
+	this->t			= snapshot.t;
+	this->cg		= snapshot.cg;
+	this->c			= snapshot.c;
+	this->sixdofIn		= snapshot.sixdofIn;
+	this->sixdofX		= snapshot.sixdofX;
+	this->wind_state	= snapshot.wind_state;
+	this->gear_depth	= snapshot.gear_depth;
+	this->next_dt		= snapshot.next_dt;
+	this->step_error	= snapshot.step_error;
+
+	for( int i=0 ; i < 4 ; i++ )
+		this->servos[i].set_state( snapshot.servo_X[i] );
+}
+
+
+/*
+ *  With RK4 this is just a loop over substep().  With DOPRI5 each step
+ * is checked against the tolerance and redone with a shorter dt if
+ * it is too large.  The last step is shortened to land exactly on
+ * span.
+ */
+int
+Heli::advance(
+	double			span,
+	const double		U[4]
+)
+{
+	if( this->integrator == INTEGRATOR_RK4 )
+	{
+		int		steps	= int( span / this->fixed_dt + 0.5 );
+		if( steps < 1 )
+			steps = 1;
+
+		// Use fixed_dt itself if it divides span, so that
+		// advance() matches calling step( fixed_dt ) directly.
+		const double	dt	= fabs( steps * this->fixed_dt - span ) < 1e-12
+			? this->fixed_dt
+			: span / steps;
+
+		for( int i=0 ; i < steps ; i++ )
+		{
+			if( this->substep( dt, U, INTEGRATOR_RK4 ) < 0 )
+				return -1;
+
+			if( this->step_hook )
+				this->step_hook( this->step_hook_priv, this, U );
+		}
+
+		this->steps_accepted += steps;
+
+		if( this->health != HEALTH_NONE && !this->is_finite() )
+			return -1;
+
+		return steps;
+	}
+
+	double			done	= 0;
+	int			steps	= 0;
+
+	while( done < span )
+	{
+		double		dt	= this->next_dt;
+
+		if( dt > this->max_dt )
+			dt = this->max_dt;
+
+		// On or near the ground the gear contact is stiff and
+		// switches on and off, so the error control would only
+		// keep rejecting steps down to min_dt.  Take fixed RK4
+		// steps there, short enough that the gear does not go
+		// deep into the ground before the contact force builds.
+		const double	sink	= fabs( this->cg.V[2] ) * dt + 0.25;
+
+		if( this->gear_depth > -sink )
+		{
+			dt = this->contact_dt;
+
+			const bool	last	= dt >= span - done;
+			if( last )
+				dt = span - done;
+
+			if( this->substep( dt, U, INTEGRATOR_RK4 ) < 0 )
+				return -1;
+
+			if( this->step_hook )
+				this->step_hook( this->step_hook_priv, this, U );
+
+			done = last ? span : done + dt;
+			steps++;
+
+			// Start off the ground from the same step
+			this->next_dt = this->contact_dt;
+			continue;
+		}
+
+		if( dt < this->min_dt )
+			dt = this->min_dt;
+
+		const bool	last	= dt >= span - done;
+		if( last )
+			dt = span - done;
+
+		this->save( this->saved );
+		if( this->substep( dt, U, INTEGRATOR_DOPRI5 ) < 0 )
+			return -1;
+
+		const double	next	= rk_next_dt( dt, this->step_error );
+
+		if( !( this->step_error <= 1.0 ) && dt > this->min_dt )
+		{
+			this->restore_state( this->saved );
+			this->steps_rejected++;
+			this->next_dt = next;
+			continue;
+		}
+
+		if( this->step_hook )
+			this->step_hook( this->step_hook_priv, this, U );
+
+		done = last ? span : done + dt;
+		steps++;
+
+		// A last step that was cut short says nothing about the next
+		if( !last || next < this->next_dt )
+			this->next_dt = next;
+	}
+
+	this->steps_accepted += steps;
+
+	if( this->health != HEALTH_NONE && !this->is_finite() )
+		return -1;
+
+	return steps;
 }
 
 }
@@ -368,12 +368,71 @@ typedef struct
 } control_def;
 
 
+/*
+ * Flight condition for Heli::trim()
+ */
+typedef struct
+{
+	// velocity over the ground [Vn Ve Vd] (ft/s), zero for hover
+	Velocity<Frame::NED>	V;
+
+	// position [north east down] (ft), high enough to be clear
+	// of the ground
+	Position<Frame::NED>	NED;
+
+	// heading (rad)
+	double			psi;
+
+	// largest acceptable residual (ft/s/s, rad/s/s and rad/s)
+	double			tolerance;
+
+	// give up after this many Levenberg-Marquardt iterations
+	int			max_iterations;
+} trim_inputs_def;
+
+
+/*
+ * Equilibrium found by Heli::trim()
+ */
+typedef struct
+{
+	// servo commands in the order of step():
+	// [B1 (pitch), A1 (roll), mr_coll, tr_coll] (rad)
+	double			U[4];
+
+	// attitude [phi theta psi] (rad)
+	Angle<Frame::Body>	THETA;
+
+	// main rotor TPP and flybar tilts (rad)
+	double			a1;
+	double			b1;
+	double			d;
+	double			c;
+
+	// largest residual at the solution
+	double			residual;
+
+	// iterations and derivative evaluations used
+	int			iterations;
+	int			evaluations;
+} trim_state_def;
+
+
 /********** THE MAIN HELICOPTER STRUCTURE FOR EVERYTHING **********/
 // Main Helicopter Parameters
 class Heli
 {
 public:
-	Heli()
+	Heli() :
+		integrator( INTEGRATOR_RK4 ),
+		tolerance( 1e-6 ),
+		fixed_dt( 0.002 ),
+		min_dt( 0.0005 ),
+		max_dt( 0.02 ),
+		contact_dt( 0.002 ),
+		health( HEALTH_FRAME ),
+		step_hook( 0 ),
+		step_hook_priv( 0 )
 	{
 		this->reset();
 	}
@@ -396,13 +455,186 @@ public:
 	 * landing gear, servos.
 	 *
 	 *	U[4] = [mr_coll, A1, B1, tr_coll]
+	 *
+	 * Returns -1 if the health check finds a NaN or Inf in the
+	 * state, 0 otherwise.
 	 */
-	void
+	int
 	step(
 		double			model_dt,
 		const double		U[4]
 	);
 
+	/*
+	 * Advance the model by span seconds with the selected
+	 * integrator, taking as many steps as it needs.
+	 * Returns the number of steps that were kept, or -1 if the
+	 * health check finds a NaN or Inf in the state.
+	 */
+	int
+	advance(
+		double			span,
+		const double		U[4]
+	);
+
+	/*
+	 * Integrator for the 6-DOF, rotor flapping and servo dynamics.
+	 *
+	 * INTEGRATOR_RK4 steps each of them in turn with the forces
+	 * from the start of the step held constant, and advance()
+	 * takes fixed steps of fixed_dt.
+	 *
+	 * INTEGRATOR_DOPRI5 integrates all of them together with the
+	 * Dormand-Prince 5(4) pair, recomputing the rotor, fin and gear
+	 * forces for every stage.  advance() picks a step between
+	 * min_dt and max_dt to keep the error estimate under tolerance.
+	 * The gear contact is too stiff for the error control to do
+	 * anything but shrink the step, so while the gear is on or
+	 * close to the ground advance() takes RK4 steps of contact_dt
+	 * instead.  The servo commands are held over each step.
+	 *
+	 * The wind is a discrete filter, stepped once per step.
+	 */
+	typedef enum {
+		INTEGRATOR_RK4,
+		INTEGRATOR_DOPRI5,
+	} integrator_t;
+
+	integrator_t		integrator;
+	double			tolerance;
+	double			fixed_dt;
+	double			min_dt;
+	double			max_dt;
+	double			contact_dt;
+
+	/*
+	 * How often the model checks its own state for NaN or Inf.
+	 *
+	 * HEALTH_NONE never checks.
+	 * HEALTH_FRAME checks once at the end of each step() or
+	 * advance() call, so once per output frame.
+	 * HEALTH_FULL also checks the forces after every stage of
+	 * every step, the way step() always used to.
+	 *
+	 * Once step() or advance() has returned -1 the model has to be
+	 * reset() or restore()d before it is used again.  Building with
+	 * CHECK_NAN adds checks inside the rotor and blade models as
+	 * well; those abort() since they have no way to report it.
+	 *
+	 * The policy is chosen at run time and costs a compare per
+	 * check even with HEALTH_NONE.  Next to the rotor model that is
+	 * below what testhealth can resolve, so it is not a build flag.
+	 */
+	typedef enum {
+		HEALTH_NONE,
+		HEALTH_FRAME,
+		HEALTH_FULL,
+	} health_t;
+
+	health_t		health;
+
+	// True if the state carried between steps is all finite
+	bool
+	is_finite() const;
+
+	// Scaled error estimate of the last DOPRI5 step (0 for RK4)
+	double			step_error;
+
+	// Steps kept and thrown away by advance() since reset()
+	unsigned long		steps_accepted;
+	unsigned long		steps_rejected;
+
+	// Rotor, fin and gear force computations since reset(): one
+	// per RK4 step and one per DOPRI5 stage that is not reused
+	unsigned long		force_evaluations;
+
+	/*
+	 * Called by advance() after every step that it keeps, with the
+	 * model at the end of the step and the commands that were held
+	 * over it.  The time of the step is heli->cg.time.  A flight
+	 * recorder hooks in here to see every physics step without
+	 * changing how they are taken.
+	 */
+	typedef void		(*step_hook_t)(
+		void *			priv,
+		const Heli *		heli,
+		const double		U[4]
+	);
+
+	step_hook_t		step_hook;
+	void *			step_hook_priv;
+
+	/*
+	 * Everything that step() and advance() change, so that the
+	 * model can be flown to some point once and then restarted
+	 * from there as often as needed.  It is plain data with a
+	 * fixed size, so copying it is about as cheap as a memcpy.
+	 *
+	 * The rotor, flybar, cg and control structures hold both
+	 * parameters and dynamic state, so they are saved whole and
+	 * restore() puts back the parameters, too.  Perturb any of
+	 * them after calling restore().  A run from a restored
+	 * snapshot matches the original bit for bit, and a perturbed
+	 * one matches a new Heli given the same snapshot and changes.
+	 */
+	typedef struct
+	{
+		mainrotor_def		m;
+		flybar_def		fb;
+		tailrotor_def		t;
+		Forces			cg;
+		control_def		c;
+		sixdof_fe_inputs_def	sixdofIn;
+		sixdof_fe_state_def	sixdofX;
+		wind_state_def		wind_state;
+		Vector<2>		servo_X[4];
+		double			gear_depth;
+		double			next_dt;
+		double			step_error;
+	} snapshot_t;
+
+	void
+	save(
+		snapshot_t &		snapshot
+	) const;
+
+	void
+	restore(
+		const snapshot_t &	snapshot
+	);
+
+	/*
+	 * Find the controls, attitude and rotor flapping that hold the
+	 * model in steady, unaccelerated flight at the condition in
+	 * pIn.  The Jacobian of the accelerations is taken by finite
+	 * differences on copies of this model, and the equations are
+	 * solved with Levenberg-Marquardt starting from the current
+	 * controls, attitude and flapping.
+	 *
+	 * On success the model is left in the trimmed state and 0 is
+	 * returned.  If it does not converge, -1 is returned and the
+	 * model is not changed.  Either way pOut has the best point
+	 * found.  Pass pOut->U to step() to hold the trim, although
+	 * the servos round the commands to their resolution, so the
+	 * model will slowly drift away from it.
+	 */
+	int
+	trim(
+		const trim_inputs_def *	pIn,
+		trim_state_def *	pOut
+	);
+
+	/*
+	 * Recompute the derived main rotor values (lock number,
+	 * flapping time constant, dihedral derivatives, etc) after
+	 * changing the parameters in m, such as the lift curve slope.
+	 * Call it, reset() or restore() after changing any other
+	 * parameter between steps, too, since those are the only
+	 * things that make DOPRI5 recompute its first stage.
+	 */
+	void
+	compute_main_rotor();
+
 
 
 	mainrotor_def		m;
@@ -469,10 +701,89 @@ private:
 	/**
 	 *  Step routines for each of the parameters
 	 */
+	int substep( double dt, const double U[4], integrator_t integrator );
+
+	// restore() without dropping the DOPRI5 stages
+	void restore_state( const snapshot_t & snapshot );
+
 	void do_wind( double dt );
 	void do_servos( double dt, const double U[4] );
 	void do_gear( double dt );
 	void do_forces( double dt, const Force<Frame::Body> &local_gravity );
+	void do_rotors( const Force<Frame::Body> &local_gravity );
+	void flap_inputs( Vector<2> &A1B1, Vector<13> &args ) const;
+
+
+	/**
+	 *  DOPRI5 integrates the whole model as one state vector:
+	 *
+	 *	[Vned NED pqr Q] [a1 b1 d c] [servo 0] ... [servo 3]
+	 */
+	typedef Vector<13 + 4 + 2*4>	coupled_t;
+
+	void do_coupled( double dt, const double U[4] );
+	void coupled_pack( coupled_t &X ) const;
+	void coupled_unpack( const coupled_t &X );
+
+	static void
+	coupled_derivs(
+		coupled_t &		Xdot,
+		const coupled_t &	X,
+		const double		t,
+		const Vector<4> &	commands,
+		Heli * const &		heli
+	);
+
+
+	/**
+	 *  Trim unknowns are [U0..U3 phi theta a1 b1 d c] and the
+	 * residuals are the NED, angular and flapping accelerations.
+	 */
+	typedef Vector<10>		trim_t;
+
+	void
+	trim_pack(
+		coupled_t &		X,
+		const trim_t &		x,
+		const trim_inputs_def *	pIn
+	) const;
+
+	void
+	trim_residual(
+		trim_t &		r,
+		const trim_t &		x,
+		const trim_inputs_def *	pIn
+	);
+
+
+	/**
+	 *  Adaptive step state
+	 */
+
+	// Next step that advance() will try
+	double			next_dt;
+
+	// The derivative at the start and at the end of the last DOPRI5
+	// step and what each was computed from.  A step that starts
+	// from either with the same servo commands and wind reuses it
+	// as its first stage.
+	typedef struct
+	{
+		bool			valid;
+		coupled_t		X;
+		coupled_t		Xdot;
+		Vector<4>		commands;
+		Velocity<Frame::NED>	wind;
+	} stage_t;
+
+	stage_t			first_stage;
+	stage_t			last_stage;
+
+	// Deepest landing gear point below the ground (ft, - above)
+	double			gear_depth;
+
+	// Copy of everything step() changes, so a step can be undone
+	snapshot_t		saved;
 };
 
 
@@ -0,0 +1,1859 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Batched, structure-of-arrays version of the XCell math model.
+ * See HeliBatch.h for the layout.  Each stage of Heli::step() is
+ * a loop over the airframes with the same arithmetic, in the same
+ * order, as the single airframe code in Heli.cpp and friends.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+
+#include "macros.h"
+#include "HeliBatch.h"
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define BLADE_SIMD
+#include <immintrin.h>
+#endif
+
+#include <mat/Conversions.h>
+#include <mat/Nav.h>
+#include <mat/Atmosphere.h>
+
+namespace sim {
+
+using namespace std;
+using namespace libmat;
+using namespace util;
+
+
+/*
+ *  Number of airframes that the RK4 loops integrate together.
+ * Each block is copied into a local structure, which is small
+ * enough to stay in the L1 through all four stages.
+ */
+static const size_t	block_size = 32;
+
+
+/*
+ *  Per-call constants and cached station geometry for the batch
+ * station kernels, one entry per airframe.  The station arrays
+ * are indexed [station * n + airframe].
+ */
+struct blade_batch_t
+{
+	size_t			n;
+
+	const double *		omega;
+	const double *		Vperp;
+	const double *		vv;
+	const double *		vv2;
+	const double *		theta0;
+	const double *		keys1;
+	const double *		keys2;
+	const double *		proudy;
+
+	const double *		r;
+	const double *		omega_r;
+	const double *		twst_r_R;
+
+	// Sums of T, Q, P and v1 over the stations of each airframe
+	double *		sums[4];
+};
+
+
+/*
+ *  The stations of airframes j0 through j1-1, one airframe at a
+ * time.  This is Blade.cpp's station(), with the same operations
+ * in the same order and the same interleaved partial sums.
+ */
+static void
+stations_scalar(
+	const blade_batch_t *	s,
+	size_t			j0,
+	size_t			j1
+)
+{
+	for( size_t j=j0 ; j<j1 ; j++ )
+	{
+		const double	omega	= s->omega[j];
+		const double	Vperp	= s->Vperp[j];
+		const double	vv	= s->vv[j];
+		const double	vv2	= s->vv2[j];
+		const double	theta0	= s->theta0[j];
+		const double	keys1	= s->keys1[j];
+		const double	keys2	= s->keys2[j];
+		const double	proudy	= s->proudy[j];
+
+		double		sum[Blade::num_sums][4];
+
+		for( int k=0 ; k<Blade::num_sums ; k++ )
+			for( int q=0 ; q<4 ; q++ )
+				sum[k][q] = 0.0;
+
+		for( int i=0 ; i<Blade::num_stations ; i++ )
+		{
+			const size_t	at	= i * s->n + j;
+			const double	r	= s->r[at];
+			const double	omega_r	= s->omega_r[at];
+			const double	theta_r	= theta0 + s->twst_r_R[at];
+			const double	alpha	= theta_r - Vperp/omega_r;
+			const double	temp	= vv2 + proudy * r * alpha;
+			const double	v1	=
+				( sqrt(fabs(temp)) - vv ) / ( 8.0 * C_PI );
+			const double	temp2	= Vperp + v1;
+			const double	dT	= keys2 * temp2 * v1 * r;
+			const double	dD	= keys1 * sqr( omega_r );
+			const double	dQ	= r * ( dT*temp2/omega_r + dD );
+			const double	dP	= dQ * omega;
+
+			double *	x	= sum[ i % Blade::num_sums ];
+
+			x[0]	+= dT;
+			x[1]	+= dQ;
+			x[2]	+= dP;
+			x[3]	+= v1;
+		}
+
+		for( int q=0 ; q<4 ; q++ )
+			s->sums[q][j] = ( sum[0][q] + sum[1][q] )
+				      + ( sum[2][q] + sum[3][q] );
+	}
+}
+
+
+#ifdef BLADE_SIMD
+
+/*
+ *  SSE2 kernel: two airframes per register.  Returns the first
+ * airframe that it did not do, which is left for the scalar code.
+ */
+__attribute__((target("sse2")))
+static size_t
+stations_sse2(
+	const blade_batch_t *	s,
+	size_t			j0,
+	size_t			j1
+)
+{
+	const __m128d		pi8	= _mm_set1_pd( 8.0 * C_PI );
+	const __m128d		sign	= _mm_set1_pd( -0.0 );
+
+	size_t			j;
+
+	for( j=j0 ; j + 2 <= j1 ; j += 2 )
+	{
+		const __m128d	omega	= _mm_loadu_pd( s->omega + j );
+		const __m128d	Vperp	= _mm_loadu_pd( s->Vperp + j );
+		const __m128d	vv	= _mm_loadu_pd( s->vv + j );
+		const __m128d	vv2	= _mm_loadu_pd( s->vv2 + j );
+		const __m128d	theta0	= _mm_loadu_pd( s->theta0 + j );
+		const __m128d	keys1	= _mm_loadu_pd( s->keys1 + j );
+		const __m128d	keys2	= _mm_loadu_pd( s->keys2 + j );
+		const __m128d	proudy	= _mm_loadu_pd( s->proudy + j );
+
+		__m128d		sum[Blade::num_sums][4];
+
+		for( int k=0 ; k<Blade::num_sums ; k++ )
+			for( int q=0 ; q<4 ; q++ )
+				sum[k][q] = _mm_setzero_pd();
+
+		for( int i=0 ; i<Blade::num_stations ; i++ )
+		{
+			const size_t	at	= i * s->n + j;
+			const __m128d	r	= _mm_loadu_pd( s->r + at );
+			const __m128d	omega_r	= _mm_loadu_pd( s->omega_r + at );
+			const __m128d	theta_r	= _mm_add_pd( theta0, _mm_loadu_pd( s->twst_r_R + at ) );
+			const __m128d	alpha	= _mm_sub_pd( theta_r, _mm_div_pd( Vperp, omega_r ) );
+			const __m128d	temp	= _mm_add_pd( vv2, _mm_mul_pd( _mm_mul_pd( proudy, r ), alpha ) );
+			const __m128d	v1	= _mm_div_pd(
+				_mm_sub_pd( _mm_sqrt_pd( _mm_andnot_pd( sign, temp ) ), vv ),
+				pi8
+			);
+			const __m128d	temp2	= _mm_add_pd( Vperp, v1 );
+			const __m128d	dT	= _mm_mul_pd( _mm_mul_pd( _mm_mul_pd( keys2, temp2 ), v1 ), r );
+			const __m128d	dD	= _mm_mul_pd( keys1, _mm_mul_pd( omega_r, omega_r ) );
+			const __m128d	dQ	= _mm_mul_pd( r, _mm_add_pd(
+				_mm_div_pd( _mm_mul_pd( dT, temp2 ), omega_r ),
+				dD
+			) );
+			const __m128d	dP	= _mm_mul_pd( dQ, omega );
+
+			__m128d *	x	= sum[ i % Blade::num_sums ];
+
+			x[0]	= _mm_add_pd( x[0], dT );
+			x[1]	= _mm_add_pd( x[1], dQ );
+			x[2]	= _mm_add_pd( x[2], dP );
+			x[3]	= _mm_add_pd( x[3], v1 );
+		}
+
+		for( int q=0 ; q<4 ; q++ )
+			_mm_storeu_pd( s->sums[q] + j, _mm_add_pd(
+				_mm_add_pd( sum[0][q], sum[1][q] ),
+				_mm_add_pd( sum[2][q], sum[3][q] )
+			) );
+	}
+
+	return j;
+}
+
+
+/*
+ *  AVX2 kernel: four airframes per register.  FMA is not enabled,
+ * for the same reason as in Blade.cpp.
+ */
+__attribute__((target("avx2")))
+static size_t
+stations_avx2(
+	const blade_batch_t *	s,
+	size_t			j0,
+	size_t			j1
+)
+{
+	const __m256d		pi8	= _mm256_set1_pd( 8.0 * C_PI );
+	const __m256d		sign	= _mm256_set1_pd( -0.0 );
+
+	size_t			j;
+
+	for( j=j0 ; j + 4 <= j1 ; j += 4 )
+	{
+		const __m256d	omega	= _mm256_loadu_pd( s->omega + j );
+		const __m256d	Vperp	= _mm256_loadu_pd( s->Vperp + j );
+		const __m256d	vv	= _mm256_loadu_pd( s->vv + j );
+		const __m256d	vv2	= _mm256_loadu_pd( s->vv2 + j );
+		const __m256d	theta0	= _mm256_loadu_pd( s->theta0 + j );
+		const __m256d	keys1	= _mm256_loadu_pd( s->keys1 + j );
+		const __m256d	keys2	= _mm256_loadu_pd( s->keys2 + j );
+		const __m256d	proudy	= _mm256_loadu_pd( s->proudy + j );
+
+		__m256d		sum[Blade::num_sums][4];
+
+		for( int k=0 ; k<Blade::num_sums ; k++ )
+			for( int q=0 ; q<4 ; q++ )
+				sum[k][q] = _mm256_setzero_pd();
+
+		for( int i=0 ; i<Blade::num_stations ; i++ )
+		{
+			const size_t	at	= i * s->n + j;
+			const __m256d	r	= _mm256_loadu_pd( s->r + at );
+			const __m256d	omega_r	= _mm256_loadu_pd( s->omega_r + at );
+			const __m256d	theta_r	= _mm256_add_pd( theta0, _mm256_loadu_pd( s->twst_r_R + at ) );
+			const __m256d	alpha	= _mm256_sub_pd( theta_r, _mm256_div_pd( Vperp, omega_r ) );
+			const __m256d	temp	= _mm256_add_pd( vv2, _mm256_mul_pd( _mm256_mul_pd( proudy, r ), alpha ) );
+			const __m256d	v1	= _mm256_div_pd(
+				_mm256_sub_pd( _mm256_sqrt_pd( _mm256_andnot_pd( sign, temp ) ), vv ),
+				pi8
+			);
+			const __m256d	temp2	= _mm256_add_pd( Vperp, v1 );
+			const __m256d	dT	= _mm256_mul_pd( _mm256_mul_pd( _mm256_mul_pd( keys2, temp2 ), v1 ), r );
+			const __m256d	dD	= _mm256_mul_pd( keys1, _mm256_mul_pd( omega_r, omega_r ) );
+			const __m256d	dQ	= _mm256_mul_pd( r, _mm256_add_pd(
+				_mm256_div_pd( _mm256_mul_pd( dT, temp2 ), omega_r ),
+				dD
+			) );
+			const __m256d	dP	= _mm256_mul_pd( dQ, omega );
+
+			__m256d *	x	= sum[ i % Blade::num_sums ];
+
+			x[0]	= _mm256_add_pd( x[0], dT );
+			x[1]	= _mm256_add_pd( x[1], dQ );
+			x[2]	= _mm256_add_pd( x[2], dP );
+			x[3]	= _mm256_add_pd( x[3], v1 );
+		}
+
+		for( int q=0 ; q<4 ; q++ )
+			_mm256_storeu_pd( s->sums[q] + j, _mm256_add_pd(
+				_mm256_add_pd( sum[0][q], sum[1][q] ),
+				_mm256_add_pd( sum[2][q], sum[3][q] )
+			) );
+	}
+
+	return j;
+}
+
+#endif
+
+
+/*
+ *  The same combined blade element momentum theory computation as
+ * Blade::step(), for every airframe at once.  See Blade.cpp for
+ * the sources of the equations.
+ */
+void
+BladeBatch::resize(
+	size_t			n
+)
+{
+	batch_array_t *		arrays[] = {
+		&this->a, &this->R, &this->omega, &this->b, &this->c,
+		&this->R0, &this->collective, &this->twst, &this->Cd0,
+		&this->Vperp, &this->rho,
+		&this->T, &this->Q, &this->P, &this->avg_v1,
+		&this->vv, &this->vv2, &this->theta0,
+		&this->proudy, &this->keys1, &this->keys2,
+	};
+
+	for( size_t i=0 ; i < sizeof(arrays)/sizeof(*arrays) ; i++ )
+		arrays[i]->resize( n );
+
+	this->stations_valid.assign( n, 0 );
+	this->stations_key.resize( 4 * n );
+	this->station_r.resize( Blade::num_stations * n );
+	this->station_omega_r.resize( Blade::num_stations * n );
+	this->station_twst_r_R.resize( Blade::num_stations * n );
+}
+
+
+/*
+ *  Recompute the stations of any airframe whose R, R0, twst or
+ * omega has changed since the last call.  The expressions are the
+ * ones in Blade::update_stations().
+ */
+void
+BladeBatch::update_stations()
+{
+	const size_t		n = this->a.size();
+
+	for( size_t j=0 ; j<n ; j++ )
+	{
+		const double	key[4] = {
+			this->R[j],
+			this->R0[j],
+			this->twst[j],
+			this->omega[j],
+		};
+
+		double *	old = &this->stations_key[ 4 * j ];
+
+		if( this->stations_valid[j]
+		&&  memcmp( key, old, sizeof(key) ) == 0
+		)
+			continue;
+
+		memcpy( old, key, sizeof(key) );
+		this->stations_valid[j] = 1;
+
+		const double	R	= this->R[j];
+		const double	R0	= this->R0[j];
+		const double	omega	= this->omega[j];
+
+		// thickness of the blade element
+		const double	dR	= (R - R0) / 100.0;
+
+		for( int i=0 ; i<Blade::num_stations ; i++ )
+		{
+			const size_t	at	= i * n + j;
+
+			// ratio of local radius to total radius
+			const double	r_R	= (R0 + double(i+1)*dR) / R;
+
+			// local radius
+			const double	r	= r_R * R;
+
+			this->station_r[at]		= r;
+			this->station_omega_r[at]	= omega*r;
+			this->station_twst_r_R[at]	= this->twst[j]*r_R;
+		}
+	}
+}
+
+
+void
+BladeBatch::step()
+{
+	this->step( Blade::KERNEL_AUTO );
+}
+
+
+void
+BladeBatch::step(
+	Blade::kernel_t		kernel
+)
+{
+	static const Blade::kernel_t	best = Blade::best_kernel();
+
+	const size_t		n = this->a.size();
+
+	if( kernel == Blade::KERNEL_AUTO || !Blade::have_kernel( kernel ) )
+		kernel = best;
+
+	this->update_stations();
+
+	for( size_t j=0 ; j<n ; j++ )
+	{
+		const double	a	= this->a[j];
+		const double	b	= this->b[j];
+		const double	c	= this->c[j];
+		const double	R	= this->R[j];
+		const double	R0	= this->R0[j];
+		const double	omega	= this->omega[j];
+		const double	rho	= this->rho[j];
+
+		// abcOmega/2 + 4piVperp
+		this->vv[j]	= a * b * c * omega / 2.0
+				+ 4.0 * C_PI * this->Vperp[j];
+
+		// thickness of the blade element
+		const double	dR	= (R - R0) / 100.0;
+
+		// root collective angle
+		this->theta0[j]	= fabs(this->collective[j])
+				- this->twst[j] * (0.75 - (R0/R));
+
+		this->vv2[j]	= sqr( this->vv[j] );
+		this->proudy[j]	= 8.0 * C_PI * sqr( omega ) * a * b * c;
+		this->keys1[j]	= this->Cd0[j] * rho * c * dR / 2.0;
+		this->keys2[j]	= 4.0 * C_PI * rho * dR;
+	}
+
+	blade_batch_t		s;
+
+	s.n		= n;
+	s.omega		= &this->omega[0];
+	s.Vperp		= &this->Vperp[0];
+	s.vv		= &this->vv[0];
+	s.vv2		= &this->vv2[0];
+	s.theta0	= &this->theta0[0];
+	s.keys1		= &this->keys1[0];
+	s.keys2		= &this->keys2[0];
+	s.proudy	= &this->proudy[0];
+	s.r		= &this->station_r[0];
+	s.omega_r	= &this->station_omega_r[0];
+	s.twst_r_R	= &this->station_twst_r_R[0];
+	s.sums[0]	= &this->T[0];
+	s.sums[1]	= &this->Q[0];
+	s.sums[2]	= &this->P[0];
+	s.sums[3]	= &this->avg_v1[0];
+
+	// The airframes left over from a SIMD kernel are done one by one
+	size_t			j = 0;
+
+	switch( kernel )
+	{
+#ifdef BLADE_SIMD
+	case Blade::KERNEL_AVX2:
+		j = stations_avx2( &s, 0, n );
+		break;
+	case Blade::KERNEL_SSE2:
+		j = stations_sse2( &s, 0, n );
+		break;
+#endif
+	default:
+		break;
+	}
+
+	stations_scalar( &s, j, n );
+
+	for( j=0 ; j<n ; j++ )
+	{
+		this->avg_v1[j] /= Blade::num_stations;
+
+		if( this->collective[j] < 0.0 )
+		{
+			this->T[j]	*= -1.0;
+			this->avg_v1[j]	*= -1.0;
+		}
+	}
+}
+
+
+HeliBatch::HeliBatch(
+	size_t			n,
+	const Heli &		proto
+) :
+	n(n),
+	fins( proto.fins.size() ),
+	gear( proto.gear.size() ),
+	servos( proto.servos.size() )
+{
+	this->resize();
+
+	for( size_t i=0 ; i<n ; i++ )
+		if( this->load( i, proto ) < 0 )
+			abort();
+}
+
+
+/*
+ *  Size all of the per-airframe arrays.  There are a lot of them,
+ * so we collect pointers and do them in one pass.
+ */
+void
+HeliBatch::resize()
+{
+	std::vector<batch_array_t*>	arrays;
+
+#define ADD_ARRAY( a )		arrays.push_back( &(a) )
+#define ADD_ARRAYS( a, count )						\
+	do {								\
+		for( int _k=0 ; _k < (count) ; _k++ )			\
+			ADD_ARRAY( (a)[_k] );				\
+	} while(0)
+
+	ADD_ARRAYS( this->F, 3 );
+	ADD_ARRAYS( this->M, 3 );
+	ADD_ARRAYS( this->THETA, 3 );
+	ADD_ARRAYS( this->pqr, 3 );
+	ADD_ARRAYS( this->uvw, 3 );
+	ADD_ARRAYS( this->V, 3 );
+	ADD_ARRAYS( this->NED, 3 );
+	ADD_ARRAYS( this->Q, 4 );
+	ADD_ARRAYS( this->accel, 3 );
+	ADD_ARRAYS( this->alpha, 3 );
+	ADD_ARRAY( this->time );
+
+	ADD_ARRAY( this->a1 );
+	ADD_ARRAY( this->b1 );
+	ADD_ARRAY( this->a1dot );
+	ADD_ARRAY( this->b1dot );
+	ADD_ARRAY( this->fb_d );
+	ADD_ARRAY( this->fb_c );
+	ADD_ARRAY( this->fb_d_dot );
+	ADD_ARRAY( this->fb_c_dot );
+
+	ADD_ARRAY( this->B1 );
+	ADD_ARRAY( this->A1 );
+	ADD_ARRAY( this->mr_col );
+	ADD_ARRAY( this->tr_col );
+
+	ADD_ARRAY( this->m_thrust );
+	ADD_ARRAY( this->m_power );
+	ADD_ARRAY( this->m_torque );
+	ADD_ARRAY( this->m_vi );
+	ADD_ARRAY( this->t_thrust );
+	ADD_ARRAY( this->t_power );
+
+	ADD_ARRAY( this->m_a );
+	ADD_ARRAY( this->m_b );
+	ADD_ARRAY( this->m_c );
+	ADD_ARRAY( this->m_cd0 );
+	ADD_ARRAY( this->m_r );
+	ADD_ARRAY( this->m_ro );
+	ADD_ARRAY( this->m_twst );
+	ADD_ARRAY( this->m_is );
+	ADD_ARRAY( this->m_ib );
+	ADD_ARRAY( this->m_h );
+	ADD_ARRAY( this->m_d );
+	ADD_ARRAY( this->m_dl_db1 );
+	ADD_ARRAY( this->m_dm_da1 );
+	ADD_ARRAY( this->m_dir );
+	ADD_ARRAY( this->m_db1dv );
+	ADD_ARRAY( this->m_da1du );
+	ADD_ARRAY( this->m_w_in );
+	ADD_ARRAY( this->m_w_off );
+	ADD_ARRAY( this->m_kc );
+
+	ADD_ARRAY( this->fb_tau );
+	ADD_ARRAY( this->fb_Kc );
+	ADD_ARRAY( this->fb_Kd );
+
+	ADD_ARRAY( this->t_a );
+	ADD_ARRAY( this->t_b );
+	ADD_ARRAY( this->t_c );
+	ADD_ARRAY( this->t_cd0 );
+	ADD_ARRAY( this->t_r );
+	ADD_ARRAY( this->t_r0 );
+	ADD_ARRAY( this->t_twst );
+	ADD_ARRAY( this->t_duct );
+	ADD_ARRAY( this->t_d );
+	ADD_ARRAY( this->t_h );
+
+	ADD_ARRAY( this->mr_rev );
+	ADD_ARRAY( this->tr_rev );
+	ADD_ARRAY( this->gyro_gain );
+
+	ADD_ARRAY( this->mass );
+	ADD_ARRAY( this->altitude );
+	ADD_ARRAY( this->sixdof_m );
+	ADD_ARRAYS( this->J, 9 );
+	ADD_ARRAYS( this->Jinv, 9 );
+	ADD_ARRAYS( this->hold, 6 );
+
+	FOR_ALL( std::vector<fin_batch_t>, fin, this->fins,
+		ADD_ARRAY( fin->xuu );
+		ADD_ARRAY( fin->yvv );
+		ADD_ARRAY( fin->zww );
+		ADD_ARRAY( fin->h );
+		ADD_ARRAY( fin->d );
+	);
+
+	FOR_ALL( std::vector<gear_batch_t>, g, this->gear,
+		ADD_ARRAYS( g->cg2point, 3 );
+		ADD_ARRAY( g->k );
+		ADD_ARRAY( g->b );
+		ADD_ARRAY( g->mu_x );
+		ADD_ARRAY( g->mu_y );
+	);
+
+	FOR_ALL( std::vector<servo_batch_t>, s, this->servos,
+		ADD_ARRAY( s->min );
+		ADD_ARRAY( s->max );
+		ADD_ARRAY( s->wn );
+		ADD_ARRAY( s->zeta );
+		ADD_ARRAYS( s->X, 2 );
+	);
+
+	ADD_ARRAYS( this->cBE, 9 );
+	ADD_ARRAYS( this->g, 3 );
+	ADD_ARRAY( this->rho );
+	ADD_ARRAY( this->depth );
+
+#undef ADD_ARRAYS
+#undef ADD_ARRAY
+
+	FOR_ALL( std::vector<batch_array_t*>, a, arrays,
+		(*a)->resize( this->n );
+	);
+
+	this->atmosphere_model.resize( this->n );
+	this->atmosphere_cache.resize( this->n );
+	this->wind_params.resize( this->n );
+	this->wind_state.resize( this->n );
+
+	this->main_rotor_blade.resize( this->n );
+	this->tail_rotor_blade.resize( this->n );
+
+	this->diverged.resize( this->n );
+}
+
+
+int
+HeliBatch::load(
+	size_t			i,
+	const Heli &		heli
+)
+{
+	if( heli.fins.size() != this->fins.size()
+	||  heli.gear.size() != this->gear.size()
+	||  heli.servos.size() != this->servos.size()
+	) {
+		cerr << "HeliBatch: airframe " << i
+			<< " does not match the prototype"
+			<< endl;
+		return -1;
+	}
+
+	if( heli.integrator != Heli::INTEGRATOR_RK4
+	||  heli.health != Heli::HEALTH_FRAME
+	) {
+		cerr << "HeliBatch: airframe " << i
+			<< " is not on RK4 with HEALTH_FRAME"
+			<< endl;
+		return -1;
+	}
+
+	this->diverged[i]	= 0;
+
+	const mainrotor_def &	m	= heli.m;
+	const flybar_def &	fb	= heli.fb;
+	const tailrotor_def &	t	= heli.t;
+	const Forces &		cg	= heli.cg;
+	const control_def &	c	= heli.c;
+
+	for( int k=0 ; k<3 ; k++ )
+	{
+		this->F[k][i]		= cg.F[k];
+		this->M[k][i]		= cg.M[k];
+		this->THETA[k][i]	= cg.THETA[k];
+		this->pqr[k][i]		= cg.pqr[k];
+		this->uvw[k][i]		= cg.uvw[k];
+		this->V[k][i]		= cg.V[k];
+		this->NED[k][i]		= cg.NED[k];
+		this->accel[k][i]	= heli.sixdofX.accel[k];
+		this->alpha[k][i]	= heli.sixdofX.alpha[k];
+	}
+
+	for( int k=0 ; k<4 ; k++ )
+		this->Q[k][i]		= heli.sixdofX.Q[k];
+
+	this->time[i]		= cg.time;
+
+	this->a1[i]		= m.a1;
+	this->b1[i]		= m.b1;
+	this->a1dot[i]		= m.a1dot;
+	this->b1dot[i]		= m.b1dot;
+	this->fb_d[i]		= fb.d;
+	this->fb_c[i]		= fb.c;
+	this->fb_d_dot[i]	= fb.d_dot;
+	this->fb_c_dot[i]	= fb.c_dot;
+
+	this->B1[i]		= c.B1;
+	this->A1[i]		= c.A1;
+	this->mr_col[i]		= c.mr_col;
+	this->tr_col[i]		= c.tr_col;
+
+	this->m_thrust[i]	= m.thrust;
+	this->m_power[i]	= m.power;
+	this->m_torque[i]	= m.torque;
+	this->m_vi[i]		= m.vi;
+	this->t_thrust[i]	= t.thrust;
+	this->t_power[i]	= t.power;
+
+	this->m_a[i]		= m.a;
+	this->m_b[i]		= m.b;
+	this->m_c[i]		= m.c;
+	this->m_cd0[i]		= m.cd0;
+	this->m_r[i]		= m.r;
+	this->m_ro[i]		= m.ro;
+	this->m_twst[i]		= m.twst;
+	this->m_is[i]		= m.is;
+	this->m_ib[i]		= m.ib;
+	this->m_h[i]		= m.h;
+	this->m_d[i]		= m.d;
+	this->m_dl_db1[i]	= m.dl_db1;
+	this->m_dm_da1[i]	= m.dm_da1;
+	this->m_dir[i]		= m.dir;
+	this->m_db1dv[i]	= m.db1dv;
+	this->m_da1du[i]	= m.da1du;
+	this->m_w_in[i]		= m.w_in;
+	this->m_w_off[i]	= m.w_off;
+	this->m_kc[i]		= m.kc;
+
+	this->fb_tau[i]		= fb.tau;
+	this->fb_Kc[i]		= fb.Kc;
+	this->fb_Kd[i]		= fb.Kd;
+
+	this->t_a[i]		= t.a;
+	this->t_b[i]		= t.b;
+	this->t_c[i]		= t.c;
+	this->t_cd0[i]		= t.cd0;
+	this->t_r[i]		= t.r;
+	this->t_r0[i]		= t.r0;
+	this->t_twst[i]		= t.twst;
+	this->t_duct[i]		= t.duct;
+	this->t_d[i]		= t.d;
+	this->t_h[i]		= t.h;
+
+	this->mr_rev[i]		= c.mr_rev;
+	this->tr_rev[i]		= c.tr_rev;
+	this->gyro_gain[i]	= c.gyro_gain;
+
+	this->mass[i]		= cg.m;
+	this->altitude[i]	= cg.altitude;
+	this->atmosphere_model[i] = cg.atmosphere_model;
+	this->wind_params[i]	= heli.wind_params;
+	this->wind_state[i]	= heli.wind_state;
+	this->sixdof_m[i]	= heli.sixdofIn.m;
+
+	for( int r=0 ; r<3 ; r++ )
+	{
+		for( int k=0 ; k<3 ; k++ )
+		{
+			this->J[3*r+k][i]	= heli.sixdofIn.J[r][k];
+			this->Jinv[3*r+k][i]	= heli.sixdofIn.Jinv[r][k];
+		}
+	}
+
+	this->hold[0][i]	= heli.sixdofIn.hold_u;
+	this->hold[1][i]	= heli.sixdofIn.hold_v;
+	this->hold[2][i]	= heli.sixdofIn.hold_w;
+	this->hold[3][i]	= heli.sixdofIn.hold_p;
+	this->hold[4][i]	= heli.sixdofIn.hold_q;
+	this->hold[5][i]	= heli.sixdofIn.hold_r;
+
+	FOR_ALL_CONST( std::vector<Fin>, fin, heli.fins,
+		fin_batch_t &		f = this->fins[fin_index];
+		f.xuu[i]		= fin->xuu;
+		f.yvv[i]		= fin->yvv;
+		f.zww[i]		= fin->zww;
+		f.h[i]			= fin->h;
+		f.d[i]			= fin->d;
+	);
+
+	FOR_ALL_CONST( std::vector<Gear>, g, heli.gear,
+		gear_batch_t &		b = this->gear[g_index];
+		for( int k=0 ; k<3 ; k++ )
+			b.cg2point[k][i]	= g->cg2point[k];
+		b.k[i]			= g->k;
+		b.b[i]			= g->b;
+		b.mu_x[i]		= g->mu_x;
+		b.mu_y[i]		= g->mu_y;
+	);
+
+	FOR_ALL_CONST( std::vector<Servo>, s, heli.servos,
+		servo_batch_t &		b = this->servos[s_index];
+		b.min[i]		= s->min;
+		b.max[i]		= s->max;
+		b.wn[i]			= s->wn;
+		b.zeta[i]		= s->zeta;
+		b.X[0][i]		= s->X[0];
+		b.X[1][i]		= s->X[1];
+	);
+
+	return 0;
+}
+
+
+void
+HeliBatch::store(
+	size_t			i,
+	Heli &			heli
+) const
+{
+	mainrotor_def &		m	= heli.m;
+	flybar_def &		fb	= heli.fb;
+	tailrotor_def &		t	= heli.t;
+	Forces &		cg	= heli.cg;
+	control_def &		c	= heli.c;
+
+	for( int k=0 ; k<3 ; k++ )
+	{
+		cg.F[k]			= this->F[k][i];
+		cg.M[k]			= this->M[k][i];
+		cg.THETA[k]		= this->THETA[k][i];
+		cg.pqr[k]		= this->pqr[k][i];
+		cg.uvw[k]		= this->uvw[k][i];
+		cg.V[k]			= this->V[k][i];
+		cg.NED[k]		= this->NED[k][i];
+
+		heli.sixdofX.accel[k]	= this->accel[k][i];
+		heli.sixdofX.alpha[k]	= this->alpha[k][i];
+		heli.sixdofX.THETA[k]	= this->THETA[k][i];
+		heli.sixdofX.rate[k]	= this->pqr[k][i];
+		heli.sixdofX.Vb[k]	= this->uvw[k][i];
+		heli.sixdofX.Ve[k]	= this->V[k][i];
+		heli.sixdofX.NED[k]	= this->NED[k][i];
+	}
+
+	for( int k=0 ; k<4 ; k++ )
+		heli.sixdofX.Q[k]	= this->Q[k][i];
+
+	cg.time		= this->time[i];
+
+	m.a1		= this->a1[i];
+	m.b1		= this->b1[i];
+	m.a1dot		= this->a1dot[i];
+	m.b1dot		= this->b1dot[i];
+	fb.d		= this->fb_d[i];
+	fb.c		= this->fb_c[i];
+	fb.d_dot	= this->fb_d_dot[i];
+	fb.c_dot	= this->fb_c_dot[i];
+
+	c.B1		= this->B1[i];
+	c.A1		= this->A1[i];
+	c.mr_col	= this->mr_col[i];
+	c.tr_col	= this->tr_col[i];
+
+	m.thrust	= this->m_thrust[i];
+	m.power		= this->m_power[i];
+	m.torque	= this->m_torque[i];
+	m.vi		= this->m_vi[i];
+	t.thrust	= this->t_thrust[i];
+	t.power		= this->t_power[i];
+
+	heli.wind_state	= this->wind_state[i];
+
+	FOR_ALL( std::vector<Servo>, s, heli.servos,
+		const servo_batch_t &	b = this->servos[s_index];
+		s->X[0]		= b.X[0][i];
+		s->X[1]		= b.X[1][i];
+	);
+}
+
+
+/*
+ *  One block of airframes for the rotor flapping.  Everything that
+ * the derivatives read is copied in, so the compiler knows that
+ * none of it aliases and can vectorize the loops across the
+ * airframes.  The state is [a1 b1 d c]; the swashplate and the
+ * body rates are held over the step.  sum collects the RK4 stages
+ * in the same order as the X0 + K0/6 + K1/3 + K2/3 + K3/6 of rk4().
+ */
+struct flap_block_t
+{
+	size_t			len;
+
+	double			u[block_size];
+	double			v[block_size];
+	double			p[block_size];
+	double			q[block_size];
+	double			dir[block_size];
+	double			kc[block_size];
+	double			w_in[block_size];
+	double			w_off[block_size];
+	double			tau[block_size];
+	double			Kd[block_size];
+	double			Kc[block_size];
+	double			db1dv[block_size];
+	double			da1du[block_size];
+	double			A1[block_size];
+	double			B1[block_size];
+
+	double			X0[4][block_size];
+	double			X[4][block_size];
+	double			Xdot[4][block_size];
+	double			sum[4][block_size];
+};
+
+
+/*
+ *  Rotor flapping derivatives of X into b->Xdot, see
+ * RotorFlapDynamics() in Heli.cpp.
+ */
+static void
+flap_derivs(
+	flap_block_t *		b,
+	const double		X[4][block_size]
+)
+{
+	for( size_t i=0 ; i<b->len ; i++ )
+	{
+		const double	u	= b->u[i];
+		const double	v	= b->v[i];
+		const double	p	= b->p[i];
+		const double	q	= b->q[i];
+		const double	dir	= b->dir[i];
+		const double	kc	= b->kc[i];
+		const double	w_in	= b->w_in[i];
+		const double	w_off	= b->w_off[i];
+		const double	tau	= b->tau[i];
+
+		const double	a1	= X[0][i];
+		const double	b1	= X[1][i];
+		const double	d	= X[2][i];
+		const double	c	= X[3][i];
+
+		const double	A1	= b->A1[i] + b->Kd[i]*d;
+		const double	B1	= b->B1[i] + b->Kc[i]*c;
+
+		const double	a_sum	= b1 - A1 + dir*kc*a1 - b->db1dv[i]*v*0.3;
+		const double	b_sum	= a1 + B1 - dir*kc*b1 - b->da1du[i]*u*0.3;
+
+		b->Xdot[0][i]	= -w_in*b_sum - w_off*a_sum - q;
+		b->Xdot[1][i]	= -w_in*a_sum + w_off*b_sum - p;
+		b->Xdot[2][i]	= -d/tau - p + 0.2731*b->A1[i]/tau;
+		b->Xdot[3][i]	= -c/tau - q - 0.2587*b->B1[i]/tau;
+	}
+}
+
+
+/*
+ *  Forces and moments for every airframe; see Heli::do_forces().
+ * The gravity vector and body->earth DCM have already been
+ * computed by step().
+ */
+void
+HeliBatch::do_forces(
+	double			dt
+)
+{
+	const size_t		n	= this->n;
+	BladeBatch &		mb	= this->main_rotor_blade;
+	BladeBatch &		tb	= this->tail_rotor_blade;
+
+	for( size_t i=0 ; i<n ; i++ )
+	{
+		double		pressure;
+		double		temperature;
+		double		sp_sound;
+
+		for( int k=0 ; k<3 ; k++ )
+		{
+			this->F[k][i]	= this->g[k][i];
+			this->M[k][i]	= 0.0;
+		}
+
+		atmosphere(
+			this->atmosphere_model[i],
+			this->altitude[i] - this->NED[2][i],
+			&this->rho[i],
+			&pressure,
+			&temperature,
+			&sp_sound,
+			&this->atmosphere_cache[i]
+		);
+
+		// Main rotor
+		mb.a[i]		= this->m_a[i];
+		mb.b[i]		= this->m_b[i];
+		mb.c[i]		= this->m_c[i];
+		mb.Cd0[i]	= this->m_cd0[i];
+		mb.collective[i] = this->mr_col[i];
+		mb.omega[i]	= this->mr_rev[i]*C_TWOPI/60.0;
+		mb.R[i]		= this->m_r[i];
+		mb.R0[i]	= this->m_ro[i];
+		mb.rho[i]	= this->rho[i];
+		mb.twst[i]	= this->m_twst[i];
+		mb.Vperp[i]	= this->uvw[0][i] * (this->m_is[i] + this->a1[i])
+				- this->uvw[1][i] * (this->m_ib[i] + this->b1[i])
+				- this->uvw[2][i];
+
+		// Tail rotor
+		tb.a[i]		= this->t_a[i];
+		tb.b[i]		= this->t_b[i];
+		tb.c[i]		= this->t_c[i];
+		tb.Cd0[i]	= this->t_cd0[i];
+		tb.collective[i] = this->tr_col[i]
+				- this->gyro_gain[i] * this->pqr[2][i];
+		tb.omega[i]	= this->tr_rev[i]*C_TWOPI/60.0;
+		tb.R[i]		= this->t_r[i];
+		tb.R0[i]	= this->t_r0[i];
+		tb.rho[i]	= this->rho[i];
+		tb.twst[i]	= this->t_twst[i];
+		tb.Vperp[i]	= this->m_dir[i] * (this->uvw[1][i]
+				- this->t_d[i]*this->pqr[2][i]);
+	}
+
+	mb.step();
+	tb.step();
+
+	for( size_t i=0 ; i<n ; i++ )
+	{
+		this->m_thrust[i]	= mb.T[i];
+		this->m_power[i]	= mb.P[i];
+		this->m_torque[i]	= mb.Q[i];
+		this->m_vi[i]		= mb.avg_v1[i];
+
+		this->t_thrust[i]	= tb.T[i] + tb.T[i]*this->t_duct[i];
+		this->t_power[i]	= tb.P[i] - tb.P[i]*this->t_duct[i];
+	}
+
+	// Fins, fuselage, etc. use the main rotor downwash
+	FOR_ALL( std::vector<fin_batch_t>, fin, this->fins,
+		for( size_t i=0 ; i<n ; i++ )
+		{
+			const double	rho2	= this->rho[i] / 2.0;
+			const double	u	= this->uvw[0][i];
+			const double	v	= this->uvw[1][i];
+			const double	w	= this->uvw[2][i];
+			const double	zww	= fin->zww[i];
+			const double	h	= fin->h[i];
+			const double	d	= fin->d[i];
+
+			const double	F0	= rho2 * fin->xuu[i] * u * fabs(u);
+			const double	F1	= rho2 * fin->yvv[i] * v * fabs(v);
+			const double	F2	= rho2 * zww * w * fabs(w)
+						- rho2 * zww * this->m_vi[i];
+
+			this->F[0][i]	+= F0;
+			this->F[1][i]	+= F1;
+			this->F[2][i]	+= F2;
+
+			this->M[0][i]	+= F1*h;
+			this->M[1][i]	+= F2*d - F0*h;
+			this->M[2][i]	+= -F1*d;
+		}
+	);
+
+	// Main rotor TPP and flybar dynamics, RK4 a block at a time
+	static const double	half[]	= { 2.0, 2.0, 1.0 };
+	static const double	weight[] = { 6.0, 3.0, 3.0, 6.0 };
+
+	batch_array_t *		flap_out[] = {
+		&this->a1, &this->b1, &this->fb_d, &this->fb_c
+	};
+
+	batch_array_t *		flap_dot[] = {
+		&this->a1dot, &this->b1dot, &this->fb_d_dot, &this->fb_c_dot
+	};
+
+	flap_block_t		b;
+
+	for( size_t i0=0 ; i0<n ; i0 += block_size )
+	{
+		const size_t	len = n - i0 < block_size ? n - i0 : block_size;
+
+		b.len = len;
+
+		for( size_t i=0 ; i<len ; i++ )
+		{
+			const size_t	j	= i0 + i;
+
+			b.u[i]		= this->uvw[0][j];
+			b.v[i]		= this->uvw[1][j];
+			b.p[i]		= this->pqr[0][j];
+			b.q[i]		= this->pqr[1][j];
+			b.dir[i]	= this->m_dir[j];
+			b.kc[i]		= this->m_kc[j];
+			b.w_in[i]	= this->m_w_in[j];
+			b.w_off[i]	= this->m_w_off[j];
+			b.tau[i]	= this->fb_tau[j];
+			b.Kd[i]		= this->fb_Kd[j];
+			b.Kc[i]		= this->fb_Kc[j];
+			b.db1dv[i]	= this->m_db1dv[j];
+			b.da1du[i]	= this->m_da1du[j];
+			b.A1[i]		= this->A1[j];
+			b.B1[i]		= this->B1[j];
+
+			for( int k=0 ; k<4 ; k++ )
+				b.X0[k][i] = b.sum[k][i] = (*flap_out[k])[j];
+		}
+
+		for( int s=0 ; s<4 ; s++ )
+		{
+			flap_derivs( &b, s == 0 ? b.X0 : b.X );
+
+			for( int k=0 ; k<4 ; k++ )
+			{
+				// The derivative output is from the first stage
+				if( s == 0 )
+					for( size_t i=0 ; i<len ; i++ )
+						(*flap_dot[k])[i0+i] = b.Xdot[k][i];
+
+				for( size_t i=0 ; i<len ; i++ )
+				{
+					const double	K = b.Xdot[k][i] * dt;
+
+					b.sum[k][i] += K / weight[s];
+
+					if( s < 3 )
+						b.X[k][i] = K / half[s] + b.X0[k][i];
+				}
+			}
+		}
+
+		for( size_t i=0 ; i<len ; i++ )
+		{
+			const size_t	j	= i0 + i;
+
+			for( int k=0 ; k<4 ; k++ )
+				(*flap_out[k])[j] = b.sum[k][i];
+
+			// The rotor forces use the TPP tilt from before the update
+			const double	T	= this->m_thrust[j];
+			const double	a1	= b.X0[0][i];
+			const double	b1	= b.X0[1][i];
+			const double	h	= this->m_h[j];
+
+			const double	mF0	= -T*(this->m_is[j] + a1);
+			const double	mF1	=  T*(this->m_ib[j] + b1);
+			const double	mF2	= -T;
+
+			const double	mM0	= mF1 * h + this->m_dl_db1[j] * b1;
+			const double	mM1	= mF2 * this->m_d[j]
+						+ this->m_dm_da1[j] * a1
+						- mF0 * h;
+			const double	mM2	= this->m_torque[j] * b.dir[i];
+
+			const double	tF1	= this->t_thrust[j] * b.dir[i];
+			const double	tM0	= tF1 * this->t_h[j];
+			const double	tM2	= -tF1 * this->t_d[j];
+
+			this->F[0][j]	+= mF0;
+			this->F[1][j]	+= mF1;
+			this->F[2][j]	+= mF2;
+			this->F[1][j]	+= tF1;
+
+			this->M[0][j]	+= mM0;
+			this->M[1][j]	+= mM1;
+			this->M[2][j]	+= mM2;
+			this->M[0][j]	+= tM0;
+			this->M[2][j]	+= tM2;
+		}
+	}
+}
+
+
+/*
+ *  Landing gear contact forces; see Gear::step().  The contact
+ * check only needs the down component of each point, so that is
+ * done for all of the airframes first and the rest of the work
+ * only for points that are touching.
+ */
+void
+HeliBatch::do_gear()
+{
+	const size_t		n = this->n;
+
+	for( size_t j=0 ; j < this->gear.size() ; j++ )
+	{
+		const gear_batch_t &	gear = this->gear[j];
+
+		for( size_t i=0 ; i<n ; i++ )
+			this->depth[i] = this->cBE[2][i]*gear.cg2point[0][i]
+				+ this->cBE[5][i]*gear.cg2point[1][i]
+				+ this->cBE[8][i]*gear.cg2point[2][i]
+				+ this->NED[2][i];
+
+		for( size_t i=0 ; i<n ; i++ )
+		{
+			if( this->depth[i] < 0.0 )
+				continue;
+
+			double	cBE[3][3];
+			double	p[3];
+
+			for( int r=0 ; r<3 ; r++ )
+			{
+				p[r] = gear.cg2point[r][i];
+				for( int k=0 ; k<3 ; k++ )
+					cBE[r][k] = this->cBE[3*r+k][i];
+			}
+
+			// position of the contact point in earth frame
+			double	Pw_e[3];
+			for( int r=0 ; r<2 ; r++ )
+				Pw_e[r] = cBE[0][r]*p[0]
+					+ cBE[1][r]*p[1]
+					+ cBE[2][r]*p[2];
+
+			const double	delta = this->depth[i];
+
+			Pw_e[2] = 0.0;
+
+			const double	pp	= this->pqr[0][i];
+			const double	qq	= this->pqr[1][i];
+			const double	rr	= this->pqr[2][i];
+			const double	wx[3][3] = {
+				{   0, -rr,  qq },
+				{  rr,   0, -pp },
+				{ -qq,  pp,   0 },
+			};
+
+			double	Pw_b[3];
+			double	Vw_b[3];
+			double	Vw_e[3];
+
+			for( int r=0 ; r<3 ; r++ )
+				Pw_b[r] = cBE[r][0]*Pw_e[0]
+					+ cBE[r][1]*Pw_e[1]
+					+ cBE[r][2]*Pw_e[2];
+
+			for( int r=0 ; r<3 ; r++ )
+				Vw_b[r] = wx[r][0]*Pw_b[0]
+					+ wx[r][1]*Pw_b[1]
+					+ wx[r][2]*Pw_b[2]
+					+ this->uvw[r][i];
+
+			for( int r=0 ; r<3 ; r++ )
+				Vw_e[r] = cBE[0][r]*Vw_b[0]
+					+ cBE[1][r]*Vw_b[1]
+					+ cBE[2][r]*Vw_b[2];
+
+			double	Fw_e[3];
+
+			Fw_e[2] = gear.k[i]*delta + gear.b[i]*Vw_e[2];
+
+			if( Vw_e[0] != 0.0 )
+				Fw_e[0] = -gear.mu_x[i]*Fw_e[2]*Vw_e[0]/fabs(Vw_e[0]);
+			else
+				Fw_e[0] = 0.0;
+
+			if( Vw_e[1] != 0.0 )
+				Fw_e[1] = -gear.mu_y[i]*Fw_e[2]*Vw_e[1]/fabs(Vw_e[1]);
+			else
+				Fw_e[1] = 0.0;
+
+			Fw_e[2] *= -1.0;
+
+			// moment arm in earth frame
+			const double	a[3] = {
+				Pw_e[0] * -1.0,
+				Pw_e[1] * -1.0,
+				Pw_e[2] * -1.0,
+			};
+
+			const double	r_e[3] = {
+				Fw_e[1]*a[2] - Fw_e[2]*a[1],
+				Fw_e[2]*a[0] - Fw_e[0]*a[2],
+				Fw_e[0]*a[1] - Fw_e[1]*a[0],
+			};
+
+			for( int r=0 ; r<3 ; r++ )
+			{
+				this->F[r][i] += cBE[r][0]*Fw_e[0]
+					+ cBE[r][1]*Fw_e[1]
+					+ cBE[r][2]*Fw_e[2];
+			}
+
+			for( int r=0 ; r<3 ; r++ )
+			{
+				this->M[r][i] += cBE[r][0]*r_e[0]
+					+ cBE[r][1]*r_e[1]
+					+ cBE[r][2]*r_e[2];
+			}
+		}
+	}
+}
+
+
+/*
+ *  One block of airframes for one servo, laid out the same way as
+ * flap_block_t.  The state is [x x'] and U is the quantized command.
+ */
+struct servo_block_t
+{
+	size_t			len;
+
+	double			wn[block_size];
+	double			zeta[block_size];
+	double			U[block_size];
+
+	double			X0[2][block_size];
+	double			X[2][block_size];
+	double			sum[2][block_size];
+};
+
+
+/*
+ *  Second order servo model for every servo of every airframe.
+ * See Servo::step().
+ */
+void
+HeliBatch::do_servos(
+	double			dt,
+	const double		U[][4]
+)
+{
+	const size_t		n = this->n;
+
+	batch_array_t *		controls[] = {
+		&this->B1,
+		&this->A1,
+		&this->mr_col,
+		&this->tr_col,
+	};
+
+	static const double	half[]	= { 2.0, 2.0, 1.0 };
+	static const double	weight[] = { 6.0, 3.0, 3.0, 6.0 };
+
+	servo_block_t		b;
+
+	for( size_t j=0 ; j < this->servos.size() ; j++ )
+	{
+		servo_batch_t &		servo = this->servos[j];
+		batch_array_t &		out = *controls[j];
+
+		for( size_t i0=0 ; i0<n ; i0 += block_size )
+		{
+			const size_t	len = n - i0 < block_size ? n - i0 : block_size;
+
+			b.len = len;
+
+			for( size_t i=0 ; i<len ; i++ )
+			{
+				const double	command = limit( U[i0+i][j],
+					servo.min[i0+i],
+					servo.max[i0+i]
+				);
+
+				b.U[i]		= floor(command * Servo::max_steps)
+						/ Servo::max_steps;
+				b.wn[i]		= servo.wn[i0+i];
+				b.zeta[i]	= servo.zeta[i0+i];
+
+				for( int k=0 ; k<2 ; k++ )
+					b.X0[k][i] = b.sum[k][i] = servo.X[k][i0+i];
+			}
+
+			for( int s=0 ; s<4 ; s++ )
+			{
+				const double	(*X)[block_size] = s == 0 ? b.X0 : b.X;
+
+				for( size_t i=0 ; i<len ; i++ )
+				{
+					const double	wn	= b.wn[i];
+					const double	zeta	= b.zeta[i];
+					const double	Xdot0	= X[1][i];
+					const double	Xdot1	= -2.0*zeta*wn*X[1][i]
+								- wn*wn*X[0][i]
+								+ b.U[i];
+					const double	K0	= Xdot0 * dt;
+					const double	K1	= Xdot1 * dt;
+
+					b.sum[0][i] += K0 / weight[s];
+					b.sum[1][i] += K1 / weight[s];
+
+					if( s < 3 )
+					{
+						b.X[0][i] = K0 / half[s] + b.X0[0][i];
+						b.X[1][i] = K1 / half[s] + b.X0[1][i];
+					}
+				}
+			}
+
+			for( size_t i=0 ; i<len ; i++ )
+			{
+				const double	wn = b.wn[i];
+
+				servo.X[0][i0+i] = b.sum[0][i];
+				servo.X[1][i0+i] = b.sum[1][i];
+
+				out[i0+i] = b.sum[1][i] + wn * wn * b.sum[0][i];
+			}
+		}
+	}
+}
+
+
+/*
+ *  One block of airframes for the 6-DOF, laid out the same way
+ * as flap_block_t.  The state is [Vned NED pqr Q].
+ */
+struct sixdof_block_t
+{
+	size_t			len;
+
+	double			F[3][block_size];
+	double			M[3][block_size];
+	double			m[block_size];
+	double			J[9][block_size];
+	double			Jinv[9][block_size];
+	double			hold[6][block_size];
+
+	double			X0[13][block_size];
+	double			X[13][block_size];
+	double			Xdot[13][block_size];
+	double			sum[13][block_size];
+};
+
+
+/*
+ *  Quaternion normalization, matching Vector::norm_self()
+ */
+static inline void
+norm_quat(
+	double			X[13][block_size],
+	size_t			len
+)
+{
+	for( size_t i=0 ; i<len ; i++ )
+	{
+		const double	q0 = X[ 9][i];
+		const double	q1 = X[10][i];
+		const double	q2 = X[11][i];
+		const double	q3 = X[12][i];
+		const double	mag = sqrt( q0*q0 + q1*q1 + q2*q2 + q3*q3 );
+
+		X[ 9][i] = q0 / mag;
+		X[10][i] = q1 / mag;
+		X[11][i] = q2 / mag;
+		X[12][i] = q3 / mag;
+	}
+}
+
+
+/*
+ *  Flat earth 6-DOF derivatives of b->X into b->Xdot; see
+ * sixdof_fe_derivs() in FlatEarth.cpp.
+ */
+static void
+sixdof_derivs(
+	sixdof_block_t *	b
+)
+{
+	for( size_t i=0 ; i<b->len ; i++ )
+	{
+		const double	vn[3]	= { b->X[0][i], b->X[1][i], b->X[2][i] };
+		const double	p	= b->X[6][i];
+		const double	q	= b->X[7][i];
+		const double	r	= b->X[8][i];
+		const double	q0	= b->X[ 9][i];
+		const double	q1	= b->X[10][i];
+		const double	q2	= b->X[11][i];
+		const double	q3	= b->X[12][i];
+
+		const double	wx[3][3] = {
+			{  0, -r,  q },
+			{  r,  0, -p },
+			{ -q,  p,  0 },
+		};
+
+		// quatDC()
+		const double	cBE[3][3] = {
+			{
+				1.0-2*(q2*q2 + q3*q3),
+				    2*(q1*q2 + q0*q3),
+				    2*(q1*q3 - q0*q2),
+			}, {
+				    2*(q1*q2 - q0*q3),
+				1.0-2*(q1*q1 + q3*q3),
+				    2*(q2*q3 + q0*q1),
+			}, {
+				    2*(q1*q3 + q0*q2),
+				    2*(q2*q3 - q0*q1),
+				1.0-2*(q1*q1 + q2*q2),
+			},
+		};
+
+		double		Vb[3];
+		double		a[3];
+
+		for( int k=0 ; k<3 ; k++ )
+			Vb[k] = cBE[k][0]*vn[0] + cBE[k][1]*vn[1] + cBE[k][2]*vn[2];
+
+		/*
+		 * A held axis is computed anyway and then zeroed with a
+		 * select instead of a branch, so that this vectorizes
+		 */
+		for( int k=0 ; k<3 ; k++ )
+		{
+			const double	ak = b->F[k][i] / b->m[i]
+				- ( wx[k][0]*Vb[0] + wx[k][1]*Vb[1] + wx[k][2]*Vb[2] );
+
+			a[k] = b->hold[k][i] ? 0.0 : ak;
+		}
+
+		for( int k=0 ; k<3 ; k++ )
+		{
+			b->Xdot[k][i]	= cBE[0][k]*a[0] + cBE[1][k]*a[1] + cBE[2][k]*a[2];
+			b->Xdot[3+k][i]	= vn[k];
+		}
+
+		// wdot_body = -Jinv*Omega*J*w_body + Jinv*M_body
+		double		wJ[3][3];
+		double		Mw[3];
+
+		for( int k=0 ; k<3 ; k++ )
+			for( int j=0 ; j<3 ; j++ )
+				wJ[k][j] = b->J[0+j][i]*wx[k][0]
+					+ b->J[3+j][i]*wx[k][1]
+					+ b->J[6+j][i]*wx[k][2];
+
+		for( int k=0 ; k<3 ; k++ )
+			Mw[k] = b->M[k][i]
+				- ( wJ[k][0]*p + wJ[k][1]*q + wJ[k][2]*r );
+
+		for( int k=0 ; k<3 ; k++ )
+		{
+			const double	wdot = b->Jinv[3*k+0][i]*Mw[0]
+				+ b->Jinv[3*k+1][i]*Mw[1]
+				+ b->Jinv[3*k+2][i]*Mw[2];
+
+			b->Xdot[6+k][i] = b->hold[3+k][i] ? 0.0 : wdot;
+		}
+
+		// quatW()
+		const double	hp	= p / 2.0;
+		const double	hq	= q / 2.0;
+		const double	hr	= r / 2.0;
+
+		b->Xdot[ 9][i] = -hp*q1 - hq*q2 - hr*q3;
+		b->Xdot[10][i] =  hp*q0 + hr*q2 - hq*q3;
+		b->Xdot[11][i] =  hq*q0 - hr*q1 + hp*q3;
+		b->Xdot[12][i] =  hr*q0 + hq*q1 - hp*q2;
+	}
+}
+
+
+/*
+ *  Integrate the 6-DOF for all airframes; see integrate_sixdof_fe()
+ * and sixdof_fe() in FlatEarth.cpp.
+ */
+void
+HeliBatch::do_sixdof(
+	double			dt
+)
+{
+	const size_t		n = this->n;
+
+	static const double	half[]	= { 2.0, 2.0, 1.0 };
+	static const double	weight[] = { 6.0, 3.0, 3.0, 6.0 };
+
+	sixdof_block_t		b;
+
+	for( size_t i0=0 ; i0<n ; i0 += block_size )
+	{
+		const size_t	len = n - i0 < block_size ? n - i0 : block_size;
+
+		b.len = len;
+
+		for( size_t i=0 ; i<len ; i++ )
+		{
+			for( int k=0 ; k<3 ; k++ )
+			{
+				b.F[k][i]	= this->F[k][i0+i];
+				b.M[k][i]	= this->M[k][i0+i];
+				b.X0[0+k][i]	= this->V[k][i0+i];
+				b.X0[3+k][i]	= this->NED[k][i0+i];
+				b.X0[6+k][i]	= this->pqr[k][i0+i];
+			}
+
+			for( int k=0 ; k<4 ; k++ )
+				b.X0[9+k][i]	= this->Q[k][i0+i];
+
+			for( int k=0 ; k<9 ; k++ )
+			{
+				b.J[k][i]	= this->J[k][i0+i];
+				b.Jinv[k][i]	= this->Jinv[k][i0+i];
+			}
+
+			for( int k=0 ; k<6 ; k++ )
+				b.hold[k][i]	= this->hold[k][i0+i];
+
+			b.m[i]		= this->sixdof_m[i0+i];
+		}
+
+		norm_quat( b.X0, len );
+
+		for( int k=0 ; k<13 ; k++ )
+			for( size_t i=0 ; i<len ; i++ )
+				b.X[k][i] = b.sum[k][i] = b.X0[k][i];
+
+		norm_quat( b.X, len );
+
+		for( int s=0 ; s<4 ; s++ )
+		{
+			sixdof_derivs( &b );
+
+			// Body angular accelerations come from the first stage
+			if( s == 0 )
+				for( int k=0 ; k<3 ; k++ )
+					for( size_t i=0 ; i<len ; i++ )
+						this->alpha[k][i0+i] = b.Xdot[6+k][i];
+
+			for( int k=0 ; k<13 ; k++ )
+			{
+				for( size_t i=0 ; i<len ; i++ )
+				{
+					const double	K = b.Xdot[k][i] * dt;
+
+					b.sum[k][i] += K / weight[s];
+
+					if( s < 3 )
+						b.X[k][i] = K / half[s] + b.X0[k][i];
+				}
+			}
+
+			if( s < 3 )
+				norm_quat( b.X, len );
+		}
+
+		norm_quat( b.sum, len );
+
+		for( size_t i=0 ; i<len ; i++ )
+		{
+			const size_t	j	= i0 + i;
+
+			// Body velocity uses the attitude from before the step
+			const double	q0	= this->Q[0][j];
+			const double	q1	= this->Q[1][j];
+			const double	q2	= this->Q[2][j];
+			const double	q3	= this->Q[3][j];
+
+			const double	cBE[3][3] = {
+				{
+					1.0-2*(q2*q2 + q3*q3),
+					    2*(q1*q2 + q0*q3),
+					    2*(q1*q3 - q0*q2),
+				}, {
+					    2*(q1*q2 - q0*q3),
+					1.0-2*(q1*q1 + q3*q3),
+					    2*(q2*q3 + q0*q1),
+				}, {
+					    2*(q1*q3 + q0*q2),
+					    2*(q2*q3 - q0*q1),
+					1.0-2*(q1*q1 + q2*q2),
+				},
+			};
+
+			double		X[13];
+
+			for( int k=0 ; k<13 ; k++ )
+				X[k] = b.sum[k][i];
+
+			for( int k=0 ; k<3 ; k++ )
+			{
+				this->pqr[k][j]		= X[6+k];
+				this->accel[k][j]	= b.F[k][i] / b.m[i];
+				this->V[k][j]		= X[0+k];
+				this->NED[k][j]		= X[3+k];
+			}
+
+			for( int k=0 ; k<4 ; k++ )
+				this->Q[k][j] = X[9+k];
+
+			for( int k=0 ; k<3 ; k++ )
+				this->uvw[k][j] = cBE[k][0]*X[0]
+					+ cBE[k][1]*X[1]
+					+ cBE[k][2]*X[2];
+
+			// quat2euler()
+			const double	n0	= X[ 9];
+			const double	n1	= X[10];
+			const double	n2	= X[11];
+			const double	n3	= X[12];
+
+			this->THETA[0][j] = atan2(
+				  2*(n2*n3 + n0*n1),
+				1-2*(n1*n1 + n2*n2)
+			);
+
+			this->THETA[1][j] = -asin(
+				  2*(n1*n3 - n0*n2)
+			);
+
+			this->THETA[2][j] = atan2(
+				  2*(n1*n2 + n0*n3),
+				1-2*(n2*n2 + n3*n3)
+			);
+		}
+	}
+}
+
+
+/*
+ *  Wind model for every airframe; see Heli::do_wind().  The wind
+ * is rotated into the body frame with the attitude from the end of
+ * the step.  With no gusts the wind is exactly zero, and adding it
+ * to uvw could only change the sign of a zero, so the rotation is
+ * skipped for those airframes.
+ */
+void
+HeliBatch::do_wind(
+	double			dt
+)
+{
+	for( size_t i=0 ; i<this->n ; i++ )
+	{
+		wind_state_def *	state = &this->wind_state[i];
+
+		wind_model(
+			&this->wind_params[i],
+			state,
+			dt
+		);
+
+		if( state->Ve[0] == 0.0
+		&&  state->Ve[1] == 0.0
+		&&  state->Ve[2] == 0.0
+		)
+			continue;
+
+		const Velocity<Frame::Body>	wind = rotate<Frame::Body>(
+			state->Ve,
+			Angle<Frame::Body>(
+				this->THETA[0][i],
+				this->THETA[1][i],
+				this->THETA[2][i]
+			)
+		);
+
+		for( int k=0 ; k<3 ; k++ )
+			this->uvw[k][i] += wind[k];
+	}
+}
+
+
+/*
+ *  Step every airframe in the batch.  The order of operations
+ * is the same as Heli::step().
+ */
+int
+HeliBatch::step(
+	double			model_dt,
+	const double		U[][4]
+)
+{
+	const size_t		n = this->n;
+
+	// Local gravity and the DCM used by the landing gear
+	for( size_t i=0 ; i<n ; i++ )
+	{
+		const double	phi	= this->THETA[0][i];
+		const double	theta	= this->THETA[1][i];
+		const double	psi	= this->THETA[2][i];
+
+		const double	cpsi	= cos(psi);
+		const double	cphi	= cos(phi);
+		const double	ctheta	= cos(theta);
+		const double	spsi	= sin(psi);
+		const double	sphi	= sin(phi);
+		const double	stheta	= sin(theta);
+
+		this->cBE[0][i]	=  cpsi*ctheta;
+		this->cBE[1][i]	=  spsi*ctheta;
+		this->cBE[2][i]	= -stheta;
+		this->cBE[3][i]	= -spsi*cphi + cpsi*stheta*sphi;
+		this->cBE[4][i]	=  cpsi*cphi + spsi*stheta*sphi;
+		this->cBE[5][i]	=  ctheta*sphi;
+		this->cBE[6][i]	=  spsi*sphi + cpsi*stheta*cphi;
+		this->cBE[7][i]	= -cpsi*sphi + spsi*stheta*cphi;
+		this->cBE[8][i]	=  ctheta*cphi;
+
+		const double	W	= 32.2 * this->mass[i];
+
+		this->g[0][i]	= this->cBE[2][i] * W;
+		this->g[1][i]	= this->cBE[5][i] * W;
+		this->g[2][i]	= this->cBE[8][i] * W;
+	}
+
+	this->do_forces( model_dt );
+	this->do_gear();
+	this->do_servos( model_dt, U );
+	this->do_sixdof( model_dt );
+
+	// The wind goes after the 6-DOF, as in Heli::substep()
+	this->do_wind( model_dt );
+
+	for( size_t i=0 ; i<n ; i++ )
+	{
+		this->time[i] += model_dt;
+
+		for( int k=0 ; k<3 ; k++ )
+			this->F[k][i] -= this->g[k][i];
+	}
+
+	return this->check_health();
+}
+
+
+/*
+ *  The HEALTH_FRAME check of Heli::step() for every airframe, with
+ * the same sum as Heli::is_finite().  Returns the number of
+ * airframes that are marked as diverged.
+ */
+int
+HeliBatch::check_health()
+{
+	int			count = 0;
+
+	for( size_t i=0 ; i<this->n ; i++ )
+	{
+		double			sum = 0;
+
+		sum += this->a1[i] + this->b1[i];
+		sum += this->fb_d[i] + this->fb_c[i];
+
+		for( int k=0 ; k<3 ; k++ )
+		{
+			sum += this->F[k][i] + this->M[k][i];
+			sum += this->NED[k][i] + this->uvw[k][i];
+			sum += this->THETA[k][i] + this->pqr[k][i];
+		}
+
+		FOR_ALL_CONST( std::vector<servo_batch_t>, s, this->servos,
+			sum += s->X[0][i] + s->X[1][i];
+		);
+
+		if( !( fabs( sum ) < HUGE_VAL ) )
+			this->diverged[i] = 1;
+
+		if( this->diverged[i] )
+			count++;
+	}
+
+	return count;
+}
+
+}
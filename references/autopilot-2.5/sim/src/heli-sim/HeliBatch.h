@@ -0,0 +1,384 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Batched version of the XCell math model.  HeliBatch holds many
+ * airframes in structure-of-arrays form and steps all of them at
+ * once.  Every stage of Heli::step() is done as a loop over the
+ * airframes, and the RK4 stages are done on small blocks of them
+ * so that the compiler can vectorize across the airframes.
+ *
+ * The arithmetic follows Heli.cpp, Blade.cpp, Fin.cpp, Gear.cpp,
+ * Servo.cpp, FlatEarth.cpp and wind_model.cpp in the same order,
+ * so a batch of N airframes matches N separate Heli::step() calls
+ * bit for bit, turbulence included.  testbatch compares the two.
+ *
+ * It is only the INTEGRATOR_RK4 path of Heli::step() with the
+ * default HEALTH_FRAME check, and there is no advance().  load()
+ * refuses a Heli that is set up for anything else.
+ *
+ * This falls well short of the "far higher" airframes per second it
+ * was written for.  benchbatch sees 1.4x to 1.5x the airframe-steps
+ * per second of separate Heli objects with 256 airframes and 1.3x
+ * with 1024.  About half of the batch time is in the blade element
+ * stations, which are limited by the divides and the square root.
+ * Their lanes here are airframes, but a single Heli already runs
+ * Blade's kernels four stations wide.  Either way it is about 0.3
+ * usec per blade per step, so the batch gains nothing there.  Even if
+ * everything else were free, the batch would stay under 3x.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _HELI_BATCH_H_
+#define _HELI_BATCH_H_
+
+#include "Heli.h"
+
+#include <vector>
+#include <cstddef>
+
+namespace sim {
+
+typedef std::vector<double>	batch_array_t;
+
+
+/*
+ *  Blade element inputs and outputs for every airframe in the
+ * batch.  The fields are the same as in sim::Blade, with one
+ * entry per airframe.  The station loop is on the inside and
+ * the lanes of the SIMD kernels are airframes, so each lane does
+ * exactly the operations of Blade::step() for its airframe and
+ * the results match it bit for bit with any of the kernels.
+ */
+class BladeBatch
+{
+public:
+	BladeBatch() {}
+	~BladeBatch() {}
+
+	void resize( size_t n );
+
+	void step();
+
+	void step(
+		Blade::kernel_t		kernel
+	);
+
+	batch_array_t	a;
+	batch_array_t	R;
+	batch_array_t	omega;
+	batch_array_t	b;
+	batch_array_t	c;
+	batch_array_t	R0;
+	batch_array_t	collective;
+	batch_array_t	twst;
+	batch_array_t	Cd0;
+	batch_array_t	Vperp;
+	batch_array_t	rho;
+
+	batch_array_t	T;
+	batch_array_t	Q;
+	batch_array_t	P;
+	batch_array_t	avg_v1;
+
+private:
+	// Per-call constants hoisted out of the station loop
+	batch_array_t	vv;
+	batch_array_t	vv2;
+	batch_array_t	theta0;
+	batch_array_t	proudy;
+	batch_array_t	keys1;
+	batch_array_t	keys2;
+
+	/*
+	 *  Station geometry cache, the same as the one in Blade.  It
+	 * only depends on R, R0, twst and omega, so each airframe's
+	 * stations are recomputed only when one of those changes.
+	 * The stations are stored [station * n + airframe] so that a
+	 * kernel loads adjacent airframes together.  The Proudy term
+	 * and sqr(omega r) are one multiply each and are not cached.
+	 */
+	void update_stations();
+
+	std::vector<char>	stations_valid;
+	batch_array_t		stations_key;
+
+	// local radius (ft)
+	batch_array_t		station_r;
+
+	// local velocity omega * r (ft/s)
+	batch_array_t		station_omega_r;
+
+	// twist contribution twst * r/R (rad)
+	batch_array_t		station_twst_r_R;
+};
+
+
+class HeliBatch
+{
+public:
+	/*
+	 *  Create a batch of n airframes, all copied from the
+	 * prototype.  Use load() to give each one its own parameters
+	 * or initial state.  The prototype must be one that load()
+	 * accepts.
+	 */
+	HeliBatch(
+		size_t			n,
+		const Heli &		proto = Heli()
+	);
+
+	~HeliBatch() {}
+
+	size_t
+	size() const
+	{
+		return this->n;
+	}
+
+	/*
+	 *  Copy the parameters and dynamic state of a Heli into
+	 * airframe i and clear its diverged flag.  Returns -1 and
+	 * changes nothing if the Heli does not have the same number of
+	 * fins, gear points and servos as the prototype, or is not set
+	 * to INTEGRATOR_RK4 and HEALTH_FRAME.
+	 */
+	int
+	load(
+		size_t			i,
+		const Heli &		heli
+	);
+
+	/*
+	 *  Copy the dynamic state of airframe i back into a Heli.
+	 * The parameters of the Heli are not changed.
+	 */
+	void
+	store(
+		size_t			i,
+		Heli &			heli
+	) const;
+
+	/*
+	 *  Step every airframe by model_dt.  U[i] is the control
+	 * input for airframe i, in the same order as Heli::step():
+	 *
+	 *	U[i] = [B1 (pitch), A1 (roll), mr_coll, tr_coll]
+	 *
+	 * After the step every airframe gets the HEALTH_FRAME check of
+	 * Heli::step(), and one with a NaN or Inf in its state is
+	 * marked in diverged[].  It stays marked until it is load()ed
+	 * again and does not stop the others.  Returns the number of
+	 * airframes that are marked.
+	 */
+	int
+	step(
+		double			model_dt,
+		const double		U[][4]
+	);
+
+	// Nonzero for each airframe whose state is no longer finite
+	std::vector<char>	diverged;
+
+
+	/*
+	 *  Dynamic state, one entry per airframe.  The names follow
+	 * the Heli members they are copied from.
+	 */
+
+	// cg->F, cg->M (accelerometer forces after step, lb and lb-ft)
+	batch_array_t		F[3];
+	batch_array_t		M[3];
+
+	// cg->THETA, cg->pqr, cg->uvw, cg->V, cg->NED
+	batch_array_t		THETA[3];
+	batch_array_t		pqr[3];
+	batch_array_t		uvw[3];
+	batch_array_t		V[3];
+	batch_array_t		NED[3];
+
+	// sixdofX.Q, sixdofX.accel, sixdofX.alpha
+	batch_array_t		Q[4];
+	batch_array_t		accel[3];
+	batch_array_t		alpha[3];
+
+	// cg->time (sec)
+	batch_array_t		time;
+
+	// Main rotor TPP and flybar states
+	batch_array_t		a1;
+	batch_array_t		b1;
+	batch_array_t		a1dot;
+	batch_array_t		b1dot;
+	batch_array_t		fb_d;
+	batch_array_t		fb_c;
+	batch_array_t		fb_d_dot;
+	batch_array_t		fb_c_dot;
+
+	// Swashplate positions out of the servos
+	batch_array_t		B1;
+	batch_array_t		A1;
+	batch_array_t		mr_col;
+	batch_array_t		tr_col;
+
+	// Rotor outputs from the last step
+	batch_array_t		m_thrust;
+	batch_array_t		m_power;
+	batch_array_t		m_torque;
+	batch_array_t		m_vi;
+	batch_array_t		t_thrust;
+	batch_array_t		t_power;
+
+private:
+	size_t			n;
+
+	/*
+	 *  Per-airframe parameters
+	 */
+
+	// Main rotor
+	batch_array_t		m_a;
+	batch_array_t		m_b;
+	batch_array_t		m_c;
+	batch_array_t		m_cd0;
+	batch_array_t		m_r;
+	batch_array_t		m_ro;
+	batch_array_t		m_twst;
+	batch_array_t		m_is;
+	batch_array_t		m_ib;
+	batch_array_t		m_h;
+	batch_array_t		m_d;
+	batch_array_t		m_dl_db1;
+	batch_array_t		m_dm_da1;
+	batch_array_t		m_dir;
+	batch_array_t		m_db1dv;
+	batch_array_t		m_da1du;
+	batch_array_t		m_w_in;
+	batch_array_t		m_w_off;
+	batch_array_t		m_kc;
+
+	// Flybar
+	batch_array_t		fb_tau;
+	batch_array_t		fb_Kc;
+	batch_array_t		fb_Kd;
+
+	// Tail rotor
+	batch_array_t		t_a;
+	batch_array_t		t_b;
+	batch_array_t		t_c;
+	batch_array_t		t_cd0;
+	batch_array_t		t_r;
+	batch_array_t		t_r0;
+	batch_array_t		t_twst;
+	batch_array_t		t_duct;
+	batch_array_t		t_d;
+	batch_array_t		t_h;
+
+	// Controls that are not driven by the servos
+	batch_array_t		mr_rev;
+	batch_array_t		tr_rev;
+	batch_array_t		gyro_gain;
+
+	// CG and 6-DOF
+	batch_array_t		mass;
+	batch_array_t		altitude;
+	batch_array_t		sixdof_m;
+	batch_array_t		J[9];
+	batch_array_t		Jinv[9];
+	batch_array_t		hold[6];
+
+	// Atmosphere model and last table cell of each airframe
+	std::vector<atmosphere_model_t>	atmosphere_model;
+	std::vector<AtmosphereCache>	atmosphere_cache;
+
+	// Wind model of each airframe; the state is copied by store()
+	std::vector<wind_inputs_def>	wind_params;
+	std::vector<wind_state_def>	wind_state;
+
+	/*
+	 *  Fins, gear and servos.  Every airframe has the same
+	 * number of each, so they are stored as one set of arrays
+	 * per element.
+	 */
+	struct fin_batch_t
+	{
+		batch_array_t	xuu;
+		batch_array_t	yvv;
+		batch_array_t	zww;
+		batch_array_t	h;
+		batch_array_t	d;
+	};
+
+	struct gear_batch_t
+	{
+		batch_array_t	cg2point[3];
+		batch_array_t	k;
+		batch_array_t	b;
+		batch_array_t	mu_x;
+		batch_array_t	mu_y;
+	};
+
+	struct servo_batch_t
+	{
+		batch_array_t	min;
+		batch_array_t	max;
+		batch_array_t	wn;
+		batch_array_t	zeta;
+		batch_array_t	X[2];
+	};
+
+	std::vector<fin_batch_t>	fins;
+	std::vector<gear_batch_t>	gear;
+	std::vector<servo_batch_t>	servos;
+
+	/*
+	 *  Scratch space for a single step
+	 */
+	BladeBatch		main_rotor_blade;
+	BladeBatch		tail_rotor_blade;
+
+	// eulerDC() of THETA, gravity and air density
+	batch_array_t		cBE[9];
+	batch_array_t		g[3];
+	batch_array_t		rho;
+
+	// Depth of one gear point below the ground (ft)
+	batch_array_t		depth;
+
+	void resize();
+
+	int check_health();
+
+	/**
+	 *  Step routines, each one a loop over all of the airframes
+	 */
+	void do_forces( double dt );
+	void do_gear();
+	void do_servos( double dt, const double U[][4] );
+	void do_sixdof( double dt );
+	void do_wind( double dt );
+};
+
+
+}
+
+#endif
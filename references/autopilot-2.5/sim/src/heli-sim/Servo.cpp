@@ -97,11 +97,7 @@ Servo::step(
 	args[0]		= this->wn;
 	args[1]		= this->zeta;
 
-	// Limit the command to the (swashplate's) travel
-	command = limit( command, this->min, this->max );
-
-	// Round the command to an even step
-	command = floor(command * this->max_steps) / this->max_steps;
+	command = this->limit_command( command );
 
 	// integrate the state
 	RK4( this->X, Xdot, 0.0, command, args, dt, &servo_derivs );
@@ -110,4 +106,53 @@ Servo::step(
 	return this->X[1] + this->wn * this->wn * this->X[0];
 }
 
+
+
+double
+Servo::limit_command(
+	double			command
+) const
+{
+	// Limit the command to the (swashplate's) travel
+	command = limit( command, this->min, this->max );
+
+	// Round the command to an even step
+	return floor(command * this->max_steps) / this->max_steps;
+}
+
+
+void
+Servo::pack(
+	double			y[2]
+) const
+{
+	y[0]	= this->wn * this->wn * this->X[0];
+	y[1]	= this->X[1];
+}
+
+
+void
+Servo::unpack(
+	const double		y[2]
+)
+{
+	this->X[0]	= y[0] / ( this->wn * this->wn );
+	this->X[1]	= y[1];
+}
+
+
+/*
+ *  servo_derivs() in the scaled state of pack()
+ */
+void
+Servo::derivs(
+	double			ydot[2],
+	const double		y[2],
+	double			command
+) const
+{
+	ydot[0] = this->wn * this->wn * y[1];
+	ydot[1] = -2.0 * this->zeta * this->wn * y[1] - y[0] + command;
+}
+
 }
@@ -93,7 +93,65 @@ public:
 		double			command
 	);
 
+	/*
+	 *  The servo model as a plain state vector, so that it can be
+	 * integrated together with the rest of the vehicle.  The state
+	 * is [wn^2 * X[0], X[1]], which puts both parts in units of the
+	 * output position.  The command should be passed through
+	 * limit_command() once per step, the same as step() does.
+	 */
+	double
+	limit_command(
+		double			command
+	) const;
+
+	void
+	pack(
+		double			y[2]
+	) const;
+
+	void
+	unpack(
+		const double		y[2]
+	);
+
+	void
+	derivs(
+		double			ydot[2],
+		const double		y[2],
+		double			command
+	) const;
+
+	static double
+	output(
+		const double		y[2]
+	)
+	{
+		return y[0] + y[1];
+	}
+
+	/*
+	 *  The raw internal state, for saving and restoring the model
+	 * exactly.  Use pack() and unpack() for integrating it.
+	 */
+	const Vector<2> &
+	state() const
+	{
+		return this->X;
+	}
+
+	void
+	set_state(
+		const Vector<2> &	X
+	)
+	{
+		this->X = X;
+	}
+
 private:
+	// The batch engine reads the parameters directly
+	friend class HeliBatch;
+
 	/* Maximum number of steps between the max and min */
 	static const double	max_steps;
 
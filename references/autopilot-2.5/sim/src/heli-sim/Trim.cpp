@@ -0,0 +1,280 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Trim solver for the XCell model.  The unknowns are the four servo
+ * commands, roll and pitch, and the main rotor and flybar tilts.
+ * They are chosen to zero the NED and angular accelerations and the
+ * flapping rates, using the same derivatives that the DOPRI5
+ * integrator uses.  See Heli::trim() in Heli.h.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cmath>
+#include <vector>
+
+#include "Heli.h"
+#include <mat/Matrix.h>
+#include <mat/Matrix_Invert.h>
+#include <mat/Quat.h>
+
+namespace sim {
+
+using namespace std;
+using namespace libmat;
+
+
+// Finite difference step for the Jacobian (rad)
+static const double	trim_dx		= 1e-7;
+
+// Starting and largest Levenberg-Marquardt damping
+static const double	trim_lambda	= 1e-3;
+static const double	trim_max_lambda	= 1e10;
+
+
+template<
+	const int		n
+>
+static double
+max_abs(
+	const Vector<n> &	r
+)
+{
+	double			max = 0;
+
+	for( int i=0 ; i<n ; i++ )
+		if( !( fabs( r[i] ) <= max ) )
+			max = fabs( r[i] );
+
+	return max;
+}
+
+
+/*
+ *  The full model state for the trim unknowns in x.  The body rates
+ * are zero, and the servos are at rest with their outputs equal to
+ * the commands.
+ */
+void
+Heli::trim_pack(
+	coupled_t &		X,
+	const trim_t &		x,
+	const trim_inputs_def *	pIn
+) const
+{
+	const Quat		Q( euler2quat( Vector<3>(
+		x[4],
+		x[5],
+		pIn->psi
+	) ) );
+
+	for( int i=0 ; i<3 ; i++ )
+	{
+		X[0+i]		= pIn->V[i];
+		X[3+i]		= pIn->NED[i];
+		X[6+i]		= 0;
+	}
+
+	for( int i=0 ; i<4 ; i++ )
+	{
+		X[9+i]		= Q[i];
+		X[13+i]		= x[6+i];
+		X[17+2*i]	= x[i];
+		X[18+2*i]	= 0;
+	}
+}
+
+
+/*
+ *  Accelerations at the trim point x.  This changes the state of
+ * the model, so trim() only calls it on copies.
+ */
+void
+Heli::trim_residual(
+	trim_t &		r,
+	const trim_t &		x,
+	const trim_inputs_def *	pIn
+)
+{
+	coupled_t		X;
+	coupled_t		Xdot;
+	const Vector<4>		commands( x[0], x[1], x[2], x[3] );
+	Heli * const		self = this;
+
+	this->trim_pack( X, x, pIn );
+	coupled_derivs( Xdot, X, this->cg.time, commands, self );
+
+	for( int i=0 ; i<3 ; i++ )
+	{
+		r[0+i]	= Xdot[0+i];
+		r[3+i]	= Xdot[6+i];
+	}
+
+	for( int i=0 ; i<4 ; i++ )
+		r[6+i]	= Xdot[13+i];
+}
+
+
+int
+Heli::trim(
+	const trim_inputs_def *	pIn,
+	trim_state_def *	pOut
+)
+{
+	const int		n = 10;
+	trim_t			x;
+
+	// Start from where the model is now
+	x[0]	= this->c.B1;
+	x[1]	= this->c.A1;
+	x[2]	= this->c.mr_col;
+	x[3]	= this->c.tr_col;
+	x[4]	= this->cg.THETA[0];
+	x[5]	= this->cg.THETA[1];
+	x[6]	= this->m.a1;
+	x[7]	= this->m.b1;
+	x[8]	= this->fb.d;
+	x[9]	= this->fb.c;
+
+	// One copy per column of the Jacobian plus one for the trial
+	// points, so no evaluation sees what another one left behind
+	// and this model is not touched until the end.
+	vector<Heli>		clones( n + 1, *this );
+	Heli &			trial = clones[n];
+
+	trim_t			r;
+	trial.trim_residual( r, x, pIn );
+
+	double			cost		= r * r;
+	double			lambda		= trim_lambda;
+	int			iterations	= 0;
+	int			evaluations	= 1;
+
+	while( iterations < pIn->max_iterations
+	&& !( max_abs( r ) <= pIn->tolerance )
+	) {
+		iterations++;
+
+		// Forward differences, one unknown on each copy
+		Matrix<n,n>		J;
+
+		for( int j=0 ; j<n ; j++ )
+		{
+			trim_t			xp( x );
+			trim_t			rp;
+
+			xp[j] += trim_dx;
+			clones[j].trim_residual( rp, xp, pIn );
+
+			for( int i=0 ; i<n ; i++ )
+				J[i][j] = ( rp[i] - r[i] ) / trim_dx;
+		}
+
+		evaluations += n;
+
+		// J' * J and J' * r without building J'
+		const Matrix<n,n>	JtJ( transpose_mult( J, J ) );
+		const trim_t		g( r * J );
+
+		// Raise the damping until the step is downhill
+		bool			improved = false;
+
+		while( lambda < trim_max_lambda )
+		{
+			Matrix<n,n>		A( JtJ );
+			Matrix<n,n>		L;
+			Matrix<n,n>		U;
+
+			for( int i=0 ; i<n ; i++ )
+				A[i][i] += lambda * JtJ[i][i] + 1e-12;
+
+			// JtJ is positive definite, so LU needs no pivots
+			LU( A, L, U );
+
+			const trim_t		dx( solve_upper( U, solve_lower( L, g ) ) );
+			const trim_t		xt( x - dx );
+			trim_t			rt;
+
+			trial.trim_residual( rt, xt, pIn );
+			evaluations++;
+
+			const double		cost_t = rt * rt;
+
+			if( cost_t < cost )
+			{
+				x		= xt;
+				r		= rt;
+				cost		= cost_t;
+				lambda		/= 10;
+				improved	= true;
+				break;
+			}
+
+			lambda *= 10;
+		}
+
+		if( !improved )
+			break;
+	}
+
+	for( int i=0 ; i<4 ; i++ )
+		pOut->U[i]	= x[i];
+
+	pOut->THETA		= Angle<Frame::Body>( x[4], x[5], pIn->psi );
+	pOut->a1		= x[6];
+	pOut->b1		= x[7];
+	pOut->d			= x[8];
+	pOut->c			= x[9];
+	pOut->residual		= max_abs( r );
+	pOut->iterations	= iterations;
+	pOut->evaluations	= evaluations;
+
+	if( !( pOut->residual <= pIn->tolerance ) )
+		return -1;
+
+	// Leave the model at the trim point, the same as the end of a
+	// DOPRI5 step would.
+	coupled_t		X;
+	coupled_t		Xdot;
+	const Vector<4>		commands( x[0], x[1], x[2], x[3] );
+	Heli * const		self = this;
+	Forces *		cg = &this->cg;
+
+	this->trim_pack( X, x, pIn );
+	coupled_derivs( Xdot, X, cg->time, commands, self );
+
+	this->m.a1dot		= Xdot[13];
+	this->m.b1dot		= Xdot[14];
+	this->fb.d_dot		= Xdot[15];
+	this->fb.c_dot		= Xdot[16];
+
+	for( int i=0 ; i<3 ; i++ )
+		this->sixdofX.alpha[i]	= Xdot[6+i];
+	this->sixdofX.accel	= this->sixdofIn.F.v / this->sixdofIn.m;
+
+	cg->uvw			= this->sixdofX.Vb;
+	cg->F			-= cg->compute_gravity();
+
+	return 0;
+}
+
+}
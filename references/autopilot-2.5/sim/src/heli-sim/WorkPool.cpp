@@ -0,0 +1,291 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Work stealing thread pool.  See WorkPool.h for details.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "WorkPool.h"
+
+namespace sim {
+
+
+int
+WorkPool::num_cpus()
+{
+	const long		n = sysconf( _SC_NPROCESSORS_ONLN );
+
+	return n > 0 ? int(n) : 1;
+}
+
+
+WorkPool::WorkPool(
+	int			threads
+) :
+	num_threads( threads > 0 ? threads : num_cpus() ),
+	queues( num_threads ),
+	workers( num_threads ),
+	job( 0 ),
+	priv( 0 ),
+	generation( 0 ),
+	busy( 0 ),
+	shutdown( false )
+{
+	pthread_mutex_init( &this->lock, 0 );
+	pthread_cond_init( &this->start_cond, 0 );
+	pthread_cond_init( &this->done_cond, 0 );
+
+	for( int i=0 ; i<this->num_threads ; i++ )
+	{
+		queue_t &		q = this->queues[i];
+
+		pthread_mutex_init( &q.lock, 0 );
+		q.head		= 0;
+		q.tail		= 0;
+	}
+
+	for( int i=0 ; i<this->num_threads ; i++ )
+	{
+		worker_t &		w = this->workers[i];
+
+		w.pool		= this;
+		w.index		= i;
+
+		if( pthread_create( &w.thread, 0, thread_main, &w ) != 0 )
+		{
+			perror( "pthread_create" );
+			abort();
+		}
+	}
+}
+
+
+WorkPool::~WorkPool()
+{
+	pthread_mutex_lock( &this->lock );
+	this->shutdown = true;
+	pthread_cond_broadcast( &this->start_cond );
+	pthread_mutex_unlock( &this->lock );
+
+	for( int i=0 ; i<this->num_threads ; i++ )
+		pthread_join( this->workers[i].thread, 0 );
+
+	for( int i=0 ; i<this->num_threads ; i++ )
+		pthread_mutex_destroy( &this->queues[i].lock );
+
+	pthread_cond_destroy( &this->done_cond );
+	pthread_cond_destroy( &this->start_cond );
+	pthread_mutex_destroy( &this->lock );
+}
+
+
+void
+WorkPool::run(
+	job_t			job,
+	void *			priv,
+	size_t			n
+)
+{
+	const size_t		threads = this->num_threads;
+
+	// Hand out contiguous ranges, the first few one job larger
+	size_t			head = 0;
+
+	for( size_t i=0 ; i<threads ; i++ )
+	{
+		queue_t &		q = this->queues[i];
+		const size_t		len = n / threads + ( i < n % threads );
+
+		pthread_mutex_lock( &q.lock );
+		q.head		= head;
+		q.tail		= head + len;
+		pthread_mutex_unlock( &q.lock );
+
+		head += len;
+	}
+
+	pthread_mutex_lock( &this->lock );
+
+	this->job	= job;
+	this->priv	= priv;
+	this->busy	= this->num_threads;
+	this->generation++;
+
+	pthread_cond_broadcast( &this->start_cond );
+
+	while( this->busy > 0 )
+		pthread_cond_wait( &this->done_cond, &this->lock );
+
+	this->job	= 0;
+	this->priv	= 0;
+
+	pthread_mutex_unlock( &this->lock );
+}
+
+
+void *
+WorkPool::thread_main(
+	void *			arg
+)
+{
+	worker_t *		w = (worker_t*) arg;
+	WorkPool *		pool = w->pool;
+	unsigned long		seen = 0;
+
+	while( 1 )
+	{
+		pthread_mutex_lock( &pool->lock );
+
+		while( !pool->shutdown && pool->generation == seen )
+			pthread_cond_wait( &pool->start_cond, &pool->lock );
+
+		if( pool->shutdown )
+		{
+			pthread_mutex_unlock( &pool->lock );
+			return 0;
+		}
+
+		seen = pool->generation;
+		pthread_mutex_unlock( &pool->lock );
+
+		pool->work( w->index );
+
+		pthread_mutex_lock( &pool->lock );
+		if( --pool->busy == 0 )
+			pthread_cond_signal( &pool->done_cond );
+		pthread_mutex_unlock( &pool->lock );
+	}
+}
+
+
+void
+WorkPool::work(
+	int			self
+)
+{
+	size_t			index;
+
+	while( 1 )
+	{
+		if( this->next( self, &index ) )
+			this->job( this->priv, index, self );
+		else
+		if( !this->steal( self ) )
+			break;
+	}
+}
+
+
+/*
+ *  Take the next job off the front of our own range
+ */
+bool
+WorkPool::next(
+	int			self,
+	size_t *		index
+)
+{
+	queue_t &		q = this->queues[self];
+	bool			found = false;
+
+	pthread_mutex_lock( &q.lock );
+
+	if( q.head < q.tail )
+	{
+		*index	= q.head++;
+		found	= true;
+	}
+
+	pthread_mutex_unlock( &q.lock );
+
+	return found;
+}
+
+
+/*
+ *  Our range is empty.  Find the worker with the most jobs left
+ * and move the back half of its range into ours.  Returns false
+ * once every range is empty.
+ */
+bool
+WorkPool::steal(
+	int			self
+)
+{
+	while( 1 )
+	{
+		int			victim = -1;
+		size_t			most = 0;
+
+		for( int i=0 ; i<this->num_threads ; i++ )
+		{
+			if( i == self )
+				continue;
+
+			queue_t &		q = this->queues[i];
+
+			pthread_mutex_lock( &q.lock );
+			const size_t		left = q.tail - q.head;
+			pthread_mutex_unlock( &q.lock );
+
+			if( left <= most )
+				continue;
+
+			most	= left;
+			victim	= i;
+		}
+
+		if( victim < 0 )
+			return false;
+
+		queue_t &		v = this->queues[victim];
+		size_t			head;
+		size_t			tail;
+
+		pthread_mutex_lock( &v.lock );
+		tail		= v.tail;
+		head		= v.head + ( v.tail - v.head ) / 2;
+		v.tail		= head;
+		pthread_mutex_unlock( &v.lock );
+
+		// Someone else got there first; look again
+		if( head == tail )
+			continue;
+
+		queue_t &		q = this->queues[self];
+
+		pthread_mutex_lock( &q.lock );
+		q.head		= head;
+		q.tail		= tail;
+		pthread_mutex_unlock( &q.lock );
+
+		return true;
+	}
+}
+
+
+}
@@ -0,0 +1,137 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Work stealing thread pool for running many independent jobs,
+ * such as Monte-Carlo cases of the helicopter model.
+ *
+ * run() splits the job indices into one contiguous range per
+ * worker.  Each worker takes jobs off the front of its own range.
+ * When it runs out it steals the back half of the range of the
+ * busiest worker, so cases that finish early (diverged airframes)
+ * do not leave a core idle.
+ *
+ * How the wall time falls with the number of workers has not been
+ * measured on a multi-core machine.  On one core, extra workers only
+ * add switching overhead.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _WORK_POOL_H_
+#define _WORK_POOL_H_
+
+#include <pthread.h>
+#include <cstddef>
+#include <vector>
+
+namespace sim {
+
+
+class WorkPool
+{
+public:
+	/*
+	 *  Jobs are called with the private pointer passed to run(),
+	 * the index of the job and the number of the worker thread
+	 * running it, which can be used to pick per-thread scratch.
+	 */
+	typedef void (*job_t)(
+		void *			priv,
+		size_t			index,
+		int			worker
+	);
+
+	/*
+	 *  Start the worker threads.  threads <= 0 uses one per CPU.
+	 */
+	WorkPool(
+		int			threads = 0
+	);
+
+	~WorkPool();
+
+	int
+	size() const
+	{
+		return this->num_threads;
+	}
+
+	/*
+	 *  Run job( priv, i, worker ) for every i in [0,n) and return
+	 * once all of them are done.  Only one run() may be active at
+	 * a time.
+	 */
+	void
+	run(
+		job_t			job,
+		void *			priv,
+		size_t			n
+	);
+
+	// Number of online CPUs, or 1 if it can not be found
+	static int num_cpus();
+
+private:
+	// One range of job indices per worker
+	struct queue_t
+	{
+		pthread_mutex_t		lock;
+		size_t			head;
+		size_t			tail;
+	};
+
+	struct worker_t
+	{
+		WorkPool *		pool;
+		int			index;
+		pthread_t		thread;
+	};
+
+	int			num_threads;
+	std::vector<queue_t>	queues;
+	std::vector<worker_t>	workers;
+
+	// The current job and the run counters, under lock
+	pthread_mutex_t		lock;
+	pthread_cond_t		start_cond;
+	pthread_cond_t		done_cond;
+	job_t			job;
+	void *			priv;
+	unsigned long		generation;
+	int			busy;
+	bool			shutdown;
+
+	static void * thread_main( void * arg );
+
+	void work( int self );
+	bool next( int self, size_t * index );
+	bool steal( int self );
+
+	// Not copyable
+	WorkPool( const WorkPool & );
+	WorkPool & operator=( const WorkPool & );
+};
+
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Time the batched XCell model against the same airframes as separate
+ * Heli instances.  The airframes are set up the way testbatch does,
+ * with slightly different parameters and inputs, and every other one
+ * in turbulence.  The two are stepped in turns and the best round of
+ * each is reported, since a busy machine only slows one down.
+ *
+ * This only reports the times.  testbatch checks that the two agree.
+ *
+ * Usage: benchbatch [airframes] [seconds]
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "Heli.h"
+#include "HeliBatch.h"
+#include "fleet.h"
+#include <timer.h>
+
+using namespace std;
+using namespace sim;
+
+
+static const double	dt		= 0.002;
+
+// The steps are timed in this many turns
+static const int	rounds		= 5;
+
+
+int
+main(
+	int			argc,
+	char **			argv
+)
+{
+	const int		n	= argc > 1 ? atoi( argv[1] ) : 256;
+	const double		seconds	= argc > 2 ? atof( argv[2] ) : 2.0;
+	const int		per_round = int( seconds / dt ) / rounds;
+	const int		steps	= per_round * rounds;
+
+	std::vector<Heli>	helis( n );
+	double			(*U)[4] = new double[n][4];
+
+	make_fleet( helis, U );
+
+	HeliBatch		batch( n, helis[0] );
+
+	for( int i=0 ; i<n ; i++ )
+		batch.load( i, helis[i] );
+
+	stopwatch_t		timer;
+	unsigned long		single_usec = 0;
+	unsigned long		batch_usec = 0;
+
+	for( int r=0 ; r<rounds ; r++ )
+	{
+		start( &timer );
+		for( int s=0 ; s<per_round ; s++ )
+			for( int i=0 ; i<n ; i++ )
+				helis[i].step( dt, U[i] );
+		const unsigned long	single = stop( &timer );
+
+		start( &timer );
+		for( int s=0 ; s<per_round ; s++ )
+			batch.step( dt, U );
+		const unsigned long	multi = stop( &timer );
+
+		if( r == 0 || single < single_usec )
+			single_usec = single;
+		if( r == 0 || multi < batch_usec )
+			batch_usec = multi;
+	}
+
+	const double		frames	= double(n) * per_round;
+
+	printf( "%d airframes, %d steps of %f sec, best of %d rounds\n",
+		n,
+		steps,
+		dt,
+		rounds
+	);
+	printf( "Heli:      %lu usec => %.0f airframe-steps/sec\n",
+		single_usec,
+		frames * 1e6 / single_usec
+	);
+	printf( "HeliBatch: %lu usec => %.0f airframe-steps/sec\n",
+		batch_usec,
+		frames * 1e6 / batch_usec
+	);
+	printf( "Speedup %.2fx\n",
+		double(single_usec) / double(batch_usec)
+	);
+
+	delete[] U;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * The fleet of slightly different airframes that testbatch checks
+ * and benchbatch times, so that both step the same helicopters.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _FLEET_H_
+#define _FLEET_H_
+
+#include <cstdlib>
+#include <vector>
+
+#include "Heli.h"
+#include <mat/Conversions.h>
+
+namespace sim {
+
+/*
+ *  Spread the rotor drag and flybar time constant by 5% either way,
+ * give each airframe its own control inputs near a hover and its own
+ * wind seed, and put every other one in turbulence.  The same seed
+ * gives the same fleet every time.  U must have room for one row per
+ * Heli.
+ */
+static inline void
+make_fleet(
+	std::vector<Heli> &	helis,
+	double			U[][4]
+)
+{
+	srand48( 0x5eed );
+
+	for( size_t i=0 ; i<helis.size() ; i++ )
+	{
+		Heli &			heli = helis[i];
+
+		heli.m.cd0	*= 1.0 + 0.1 * (drand48() - 0.5);
+		heli.fb.tau	*= 1.0 + 0.1 * (drand48() - 0.5);
+
+		U[i][0]	= ( drand48() - 0.5 ) * 2.0 * C_DEG2RAD;
+		U[i][1]	= ( drand48() - 0.5 ) * 2.0 * C_DEG2RAD;
+		U[i][2]	= ( 5.0 + drand48() ) * C_DEG2RAD;
+		U[i][3]	= ( 4.0 + drand48() ) * C_DEG2RAD;
+
+		heli.wind_params.seed = i;
+
+		if( i % 2 )
+			heli.wind_params.wind_max = Velocity<Frame::NED>(
+				2.0,
+				2.0,
+				1.0
+			);
+	}
+}
+
+}
+
+#endif
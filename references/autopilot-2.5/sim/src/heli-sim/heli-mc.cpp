@@ -0,0 +1,484 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Monte-Carlo driver for the helicopter model.  Every case gets
+ * its own Heli with the main rotor lift curve slope, profile drag,
+ * twist, flybar time constant and wind seed drawn at random around
+ * the nominal values.  The cases are run for a fixed time on a
+ * WorkPool and the results are printed as one table.
+ *
+ * With --start the nominal model is flown with the same inputs
+ * once, and every case is started from a snapshot of that state
+ * instead of from the ground.  With --trim every case is trimmed
+ * in hover for its own parameters and flown with its trim controls
+ * instead of the fixed inputs.
+ *
+ * This replaces starting many copies of heli-sim, which all want
+ * port 2002.  No sockets are opened.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <time.h>
+
+#include "Heli.h"
+#include "WorkPool.h"
+#include <mat/Conversions.h>
+#include <getoptions/getoptions.h>
+#include <timer.h>
+
+using namespace std;
+using namespace sim;
+using namespace libmat;
+
+
+static const double	dt		= 0.002;	// sec
+
+/*
+ *  A case is stopped as diverged once the body rates or velocities
+ * pass these, or once Heli::step() reports a NaN in the state.
+ */
+static const double	max_rate	= 50.0;		// rad/sec
+static const double	max_velocity	= 500.0;	// ft/sec
+
+
+/*
+ *  Parameters of the sweep, shared by all of the cases
+ */
+typedef struct
+{
+	int			cases;
+	int			seed;
+	double			duration;	// sec
+	double			start;		// sec
+	double			trim;		// ft of altitude, 0 for none
+
+	// Relative spreads (0.1 = +/- 10%)
+	double			a_spread;
+	double			cd0_spread;
+	double			tau_spread;
+
+	// Absolute spread (rad)
+	double			twst_spread;
+
+	// Maximum wind in each NED axis (ft/s)
+	double			wind;
+
+	// [B1 (pitch), A1 (roll), mr_coll, tr_coll] (rad)
+	double			U[4];
+} sweep_t;
+
+
+typedef struct
+{
+	// Inputs
+	int			wind_seed;
+	double			a;
+	double			cd0;
+	double			twst;
+	double			tau;
+
+	// Outputs
+	int			diverged;
+	double			time;		// sec
+	double			max_att_err;	// rad
+	double			NED[3];		// ft
+	double			cpu;		// sec of CPU time
+} mc_case_t;
+
+
+typedef struct
+{
+	const sweep_t *		sweep;
+	std::vector<mc_case_t>	cases;
+
+	// Starting state for every case, if sweep->start is set
+	Heli::snapshot_t	start;
+} mc_run_t;
+
+
+/*
+ *  Uniform random number in [-1,1] from a per-case generator
+ */
+static double
+uniform(
+	unsigned short		xsubi[3]
+)
+{
+	return 2.0 * erand48( xsubi ) - 1.0;
+}
+
+
+/*
+ *  Draw the parameters of every case.  They only depend on the
+ * seed and the case number, not on the number of threads.
+ */
+static void
+draw_cases(
+	const sweep_t *		sweep,
+	std::vector<mc_case_t> &	cases
+)
+{
+	const Heli		nominal;
+
+	cases.resize( sweep->cases );
+
+	for( int i=0 ; i<sweep->cases ; i++ )
+	{
+		mc_case_t &		c = cases[i];
+		unsigned short		xsubi[3];
+
+		memset( &c, 0, sizeof(c) );
+
+		xsubi[0]	= sweep->seed & 0xFFFF;
+		xsubi[1]	= i & 0xFFFF;
+		xsubi[2]	= ( i >> 16 ) & 0xFFFF;
+
+		c.a		= nominal.m.a * ( 1.0 + sweep->a_spread * uniform( xsubi ) );
+		c.cd0		= nominal.m.cd0 * ( 1.0 + sweep->cd0_spread * uniform( xsubi ) );
+		c.tau		= nominal.fb.tau * ( 1.0 + sweep->tau_spread * uniform( xsubi ) );
+		c.twst		= nominal.m.twst + sweep->twst_spread * uniform( xsubi );
+		c.wind_seed	= sweep->seed + i;
+	}
+}
+
+
+static bool
+is_diverged(
+	const Forces &		cg
+)
+{
+	for( int i=0 ; i<3 ; i++ )
+	{
+		if( !( fabs( cg.NED[i] ) < HUGE_VAL )
+		||  !( fabs( cg.THETA[i] ) < HUGE_VAL )
+		||  !( fabs( cg.uvw[i] ) < max_velocity )
+		||  !( fabs( cg.pqr[i] ) < max_rate )
+		)
+			return true;
+	}
+
+	return false;
+}
+
+
+/*
+ *  CPU time used by the calling thread.  The total over all of the
+ * cases divided by the wall clock time is how many cores were kept
+ * busy.  That is not the speedup over one thread, since a busy core
+ * can still be slowed by the others; for that, compare the wall time
+ * of the same run with -j 1 and -j N.
+ */
+static double
+thread_cpu( void )
+{
+	struct timespec		ts;
+
+	clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/*
+ *  WorkPool job: run one case from the initial hover, or from the
+ * start snapshot, for the length of the sweep.
+ */
+static void
+run_case(
+	void *			priv,
+	size_t			index,
+	int			UNUSED( worker )
+)
+{
+	mc_run_t *		run	= (mc_run_t*) priv;
+	const sweep_t *		sweep	= run->sweep;
+	mc_case_t &		c	= run->cases[index];
+	const double		cpu	= thread_cpu();
+
+	Heli			heli;
+
+	// The snapshot has the nominal parameters, so restore it first
+	if( sweep->start > 0 )
+		heli.restore( run->start );
+
+	heli.m.a	= c.a;
+	heli.m.cd0	= c.cd0;
+	heli.m.twst	= c.twst;
+	heli.fb.tau	= c.tau;
+	heli.compute_main_rotor();
+
+	heli.wind_params.seed		= c.wind_seed;
+	heli.wind_params.wind_max	= Velocity<Frame::NED>(
+		sweep->wind,
+		sweep->wind,
+		sweep->wind
+	);
+	wind_init( &heli.wind_params, &heli.wind_state );
+
+	double			U[4];
+
+	for( int i=0 ; i<4 ; i++ )
+		U[i] = sweep->U[i];
+
+	if( sweep->trim > 0 )
+	{
+		trim_inputs_def		in;
+		trim_state_def		out;
+
+		in.V			= Velocity<Frame::NED>( 0, 0, 0 );
+		in.NED			= Position<Frame::NED>( 0, 0, -sweep->trim );
+		in.psi			= heli.cg.THETA[2];
+		in.tolerance		= 1e-8;
+		in.max_iterations	= 50;
+
+		// A case with no trim point counts as diverged
+		if( heli.trim( &in, &out ) < 0 )
+			c.diverged = 1;
+
+		for( int i=0 ; i<4 ; i++ )
+			U[i] = out.U[i];
+	}
+
+	const Angle<Frame::Body>	THETA0( heli.cg.THETA );
+	const int		steps = int( sweep->duration / dt + 0.5 );
+
+	for( int s=0 ; s<steps && !c.diverged ; s++ )
+	{
+		if( heli.step( dt, U ) < 0
+		||  is_diverged( heli.cg ) )
+		{
+			c.diverged = 1;
+			break;
+		}
+
+		for( int i=0 ; i<3 ; i++ )
+		{
+			double		err = heli.cg.THETA[i] - THETA0[i];
+
+			// Wrap the heading error to +/- pi
+			err = fmod( err + C_PI, C_TWOPI );
+			if( err < 0 )
+				err += C_TWOPI;
+			err = fabs( err - C_PI );
+
+			if( err > c.max_att_err )
+				c.max_att_err = err;
+		}
+	}
+
+	c.time		= heli.cg.time;
+	c.NED[0]	= heli.cg.NED[0];
+	c.NED[1]	= heli.cg.NED[1];
+	c.NED[2]	= heli.cg.NED[2];
+	c.cpu		= thread_cpu() - cpu;
+}
+
+
+static int
+help( void )
+{
+	fprintf( stderr,
+"Usage: heli-mc [options]\n"
+"\n"
+"	-h | --help			This help\n"
+"	-n | --cases count		Number of cases (64)\n"
+"	-j | --threads count		Worker threads (one per CPU)\n"
+"	-t | --time seconds		Simulated time per case (10)\n"
+"	--start seconds			Fly the nominal model first (0)\n"
+"	--trim altitude			Start each case trimmed (ft)\n"
+"	-s | --seed seed		Base random seed (1)\n"
+"	-o | --output file		Result table ('-' for stdout)\n"
+"	--a-spread fraction		Lift curve slope spread (0.1)\n"
+"	--cd0-spread fraction		Profile drag spread (0.1)\n"
+"	--tau-spread fraction		Flybar time constant spread (0.1)\n"
+"	--twst-spread rad		Blade twist spread (0.02)\n"
+"	--wind ft/s			Maximum wind per axis (0)\n"
+"	--pitch --roll --coll --yaw rad	Fixed servo inputs\n"
+"\n"
+	);
+
+	return -10;
+}
+
+
+int
+main(
+	int			argc,
+	char **			argv
+)
+{
+	sweep_t			sweep;
+	int			threads		= 0;
+	const char *		output		= "-";
+
+	sweep.cases		= 64;
+	sweep.seed		= 1;
+	sweep.duration		= 10.0;
+	sweep.start		= 0.0;
+	sweep.trim		= 0.0;
+	sweep.a_spread		= 0.1;
+	sweep.cd0_spread	= 0.1;
+	sweep.tau_spread	= 0.1;
+	sweep.twst_spread	= 0.02;
+	sweep.wind		= 0.0;
+	sweep.U[0]		= 0.0;
+	sweep.U[1]		= 0.0;
+	sweep.U[2]		= 2.5 * C_DEG2RAD;
+	sweep.U[3]		= 4.5 * C_DEG2RAD;
+
+	int rc = getoptions( &argc, &argv,
+		"h|?|help&",		help,
+		"n|cases=i",		&sweep.cases,
+		"j|threads=i",		&threads,
+		"t|time=d",		&sweep.duration,
+		"start=d",		&sweep.start,
+		"trim=d",		&sweep.trim,
+		"s|seed=i",		&sweep.seed,
+		"o|output=s",		&output,
+		"a-spread=d",		&sweep.a_spread,
+		"cd0-spread=d",		&sweep.cd0_spread,
+		"tau-spread=d",		&sweep.tau_spread,
+		"twst-spread=d",	&sweep.twst_spread,
+		"wind=d",		&sweep.wind,
+		"pitch=d",		&sweep.U[0],
+		"roll=d",		&sweep.U[1],
+		"coll=d",		&sweep.U[2],
+		"yaw=d",		&sweep.U[3],
+		0
+	);
+
+	if( rc == -10 )
+		return EXIT_FAILURE;
+	if( rc < 0 )
+		return help();
+
+	FILE *			out = stdout;
+
+	if( strcmp( output, "-" ) != 0 )
+		out = fopen( output, "w" );
+	if( !out )
+	{
+		perror( output );
+		return EXIT_FAILURE;
+	}
+
+	mc_run_t		run;
+
+	run.sweep = &sweep;
+	draw_cases( &sweep, run.cases );
+
+	if( sweep.start > 0 )
+	{
+		Heli			nominal;
+		const int		steps = int( sweep.start / dt + 0.5 );
+
+		for( int s=0 ; s<steps ; s++ )
+			nominal.step( dt, sweep.U );
+
+		nominal.save( run.start );
+	}
+
+	WorkPool		pool( threads );
+	stopwatch_t		timer;
+
+	start( &timer );
+	pool.run( run_case, &run, run.cases.size() );
+	const unsigned long	wall_usec = stop( &timer );
+
+	fprintf( out,
+		"# case wind_seed a cd0 twst tau diverged time"
+		" max_att_deg N E D cpu\n"
+	);
+
+	int			diverged	= 0;
+	double			worst		= 0;
+	double			sum		= 0;
+	double			sim_time	= 0;
+	double			cpu		= 0;
+
+	for( size_t i=0 ; i<run.cases.size() ; i++ )
+	{
+		const mc_case_t &	c = run.cases[i];
+
+		fprintf( out,
+			"%lu %d %f %f %f %f %d %f %f %f %f %f %f\n",
+			(unsigned long) i,
+			c.wind_seed,
+			c.a,
+			c.cd0,
+			c.twst,
+			c.tau,
+			c.diverged,
+			c.time,
+			c.max_att_err * C_RAD2DEG,
+			c.NED[0],
+			c.NED[1],
+			c.NED[2],
+			c.cpu
+		);
+
+		sim_time	+= c.time;
+		cpu		+= c.cpu;
+
+		if( c.diverged )
+		{
+			diverged++;
+			continue;
+		}
+
+		sum += c.max_att_err;
+		if( c.max_att_err > worst )
+			worst = c.max_att_err;
+	}
+
+	const int		ok = run.cases.size() - diverged;
+
+	fprintf( out,
+		"# %d cases, %d diverged, max attitude error %f deg"
+		" (mean %f deg)\n",
+		int( run.cases.size() ),
+		diverged,
+		worst * C_RAD2DEG,
+		ok ? sum / ok * C_RAD2DEG : 0.0
+	);
+
+	fprintf( out,
+		"# %d threads, %.3f sec wall, %.3f sec cpu, %.2f cores busy,"
+		" %.1f sim sec/wall sec\n",
+		pool.size(),
+		wall_usec / 1e6,
+		cpu,
+		cpu / ( wall_usec / 1e6 ),
+		sim_time / ( wall_usec / 1e6 )
+	);
+
+	if( out != stdout )
+		fclose( out );
+
+	return EXIT_SUCCESS;
+}
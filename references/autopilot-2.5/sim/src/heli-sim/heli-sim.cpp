@@ -11,6 +11,11 @@
  * the roll, pitch, yaw, X, Y, Z coordinates
  * of the aircraft.
  *
+ * With --batch it runs headless instead: the control inputs come
+ * from a script, the model is stepped as fast as the CPU allows
+ * and the state is written to a file.  See run_batch() for the
+ * script format.
+ *
  **************
  *
  *  This file is part of the autopilot simulation package.
@@ -44,6 +49,10 @@
 #include <state/commands.h>
 #include <state/state.h>
 #include <state/Server.h>
+#include <state/Loop.h>
+#include <state/recorder.h>
+#include <getoptions/getoptions.h>
+#include <timer.h>
 
 using namespace std;
 using namespace sim;
@@ -58,8 +67,20 @@ static const long	dt		=  2000;		// usec
 // to allow the system to run in real time.
 static const bool	no_wait		= 0;
 
+// Frames between reports of the cost of sending to the clients
+// and of how late the frames start
+static int		send_stats	= 0;
+static int		tick_stats	= 0;
+
+// usec before each frame to stop sleeping and spin on the clock
+static int		tick_spin	= 0;
+
 static Heli		xcell;
 
+// Every physics step goes into the flight recorder, if there is one
+static recorder_t *	recorder	= 0;
+static int		record_size	= 1 << 22;	// records
+
 
 
 #if 0
@@ -113,35 +134,49 @@ process_line(
 
 
 static void
-write_to_clients(
-	Server *		server,
+fill_state(
+	state_t *		state,
 	const Forces *		cg
 )
 {
-	state_t			state;
+	memset( state, 0, sizeof(*state) );
+
+	state->ax	= cg->F[0];
+	state->ay	= cg->F[1];
+	state->az	= cg->F[2];
 
-	state.ax	= cg->F[0];
-	state.ay	= cg->F[1];
-	state.az	= cg->F[2];
+	state->p	= cg->pqr[0];
+	state->q	= cg->pqr[1];
+	state->r	= cg->pqr[2];
 
-	state.p		= cg->pqr[0];
-	state.q		= cg->pqr[1];
-	state.r		= cg->pqr[2];
+	state->x	= cg->NED[0];
+	state->y	= cg->NED[1];
+	state->z	= cg->NED[2];
 
-	state.x		= cg->NED[0];
-	state.y		= cg->NED[1];
-	state.z		= cg->NED[2];
+	state->phi	= cg->THETA[0];
+	state->theta	= cg->THETA[1];
+	state->psi	= cg->THETA[2];
 
-	state.phi	= cg->THETA[0];
-	state.theta	= cg->THETA[1];
-	state.psi	= cg->THETA[2];
+	state->vx	= cg->V[0];
+	state->vy	= cg->V[1];
+	state->vz	= cg->V[2];
 
-	state.vx	= cg->V[0];
-	state.vy	= cg->V[1];
-	state.vz	= cg->V[2];
+	state->mx	= xcell.m.b1;
+	state->my	= xcell.m.a1;
+
+	state->end_of_line = '\n';
+}
+
+
+static void
+write_to_clients(
+	Server *		server,
+	const Forces *		cg
+)
+{
+	state_t			state;
 
-	state.mx	= xcell.m.b1;
-	state.my	= xcell.m.a1;
+	fill_state( &state, cg );
 	
 	server->send_packet(
 		AHRS_STATE,
@@ -152,6 +187,66 @@ write_to_clients(
 
 
 
+/*
+ *  Model time and sim time at the start of the frame, so that the
+ * steps are recorded on the sim clock even after the model is reset.
+ */
+static double		frame_model_time;
+static double		frame_sim_time;
+
+
+/*
+ *  Heli::step_hook: record the state and the controls of every step
+ */
+static void
+record_step(
+	void *			UNUSED( priv ),
+	const Heli *		heli,
+	const double		U[4]
+)
+{
+	const double		t = frame_sim_time
+		+ heli->cg.time - frame_model_time;
+	state_t			state;
+
+	fill_state( &state, &heli->cg );
+
+	recorder_write( recorder, RECORD_STATE, t, &state, sizeof(state) );
+	recorder_write( recorder, RECORD_CONTROLS, t, U, 4 * sizeof(*U) );
+}
+
+
+/*
+ *  Step the model through the frame of out_dt that ends at time.
+ * The recorder, if there is one, sees each step from advance().
+ */
+static int
+advance_frame(
+	double			time
+)
+{
+	const double		span = double(out_dt) / 1000000;
+
+	frame_model_time	= xcell.cg.time;
+	frame_sim_time		= time - span;
+
+	return xcell.advance( span, heli_controls );
+}
+
+
+static void
+close_recorder( void )
+{
+	const unsigned long	dropped = recorder->dropped;
+
+	recorder_close( recorder );
+	recorder = 0;
+
+	if( dropped )
+		fprintf( stderr, "Flight recorder dropped %lu records\n", dropped );
+}
+
+
 /*
  *  Helpers to track time used in different tasks
  */
@@ -276,13 +371,295 @@ sim_close(
 }
 
 
-int
-main(
-	int			UNUSED( argc ),
-	char **			UNUSED( argv )
+/*
+ *  Read the next event out of the batch script.  Each line is
+ *
+ *	time axis value
+ *	time reset
+ *	time quit
+ *
+ * where time is in seconds since the start of the run, axis is one
+ * of pitch, roll, coll or yaw and value is the same servo position
+ * that the SERVO_* packets carry.  Blank lines and anything after
+ * a '#' are ignored.  Returns 0 at the end of the script.
+ */
+typedef struct
+{
+	double			time;
+	char			axis[32];
+	double			value;
+} script_event_t;
+
+
+static int
+read_event(
+	FILE *			script,
+	script_event_t *	event
+)
+{
+	char			line[ 256 ];
+
+	while( fgets( line, sizeof(line), script ) )
+	{
+		char *			comment = strchr( line, '#' );
+		if( comment )
+			*comment = '\0';
+
+		const int		n = sscanf( line, "%lf %31s %lf",
+			&event->time,
+			event->axis,
+			&event->value
+		);
+
+		if( n <= 0 )
+			continue;
+
+		if( n == 2
+		&&  ( strcmp( event->axis, "reset" ) == 0
+		||    strcmp( event->axis, "quit" ) == 0 )
+		)
+			return 1;
+
+		if( n == 3 )
+			return 1;
+
+		cerr << "Unable to parse: " << line << endl;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  Apply one event.  Returns -1 if the run should stop.
+ */
+static int
+do_event(
+	const script_event_t *	event
+)
+{
+	const char *		axis = event->axis;
+
+	if( strcmp( axis, "quit" ) == 0 )
+		return -1;
+
+	if( strcmp( axis, "reset" ) == 0 )
+		xcell.reset();
+	else
+	if( strcmp( axis, "coll" ) == 0 )
+		heli_controls[2] = event->value;
+	else
+	if( strcmp( axis, "roll" ) == 0 )
+		heli_controls[1] = event->value;
+	else
+	if( strcmp( axis, "pitch" ) == 0 )
+		heli_controls[0] = event->value;
+	else
+	if( strcmp( axis, "yaw" ) == 0 )
+		heli_controls[3] = event->value;
+	else
+		cerr << "Unknown axis: " << axis << endl;
+
+	return 0;
+}
+
+
+static void
+write_record(
+	FILE *			out,
+	int			text,
+	double			time,
+	const state_t *		state
+)
+{
+	if( !text )
+	{
+		fwrite( state, sizeof(*state), 1, out );
+		return;
+	}
+
+	fprintf( out,
+		"%f "			/* simulation time */
+		"%f %f %f "		/* body accelerations */
+		"%f %f %f "		/* body rotational rates */
+		"%f %f %f "		/* NED positions */
+		"%f %f %f "		/* NED euler angles */
+		"%f %f %f "		/* NED velocities */
+		"%f %f "		/* Rotor mass moments */
+		"\n",
+
+		time,
+
+		state->ax,
+		state->ay,
+		state->az,
+
+		state->p,
+		state->q,
+		state->r,
+
+		state->x,
+		state->y,
+		state->z,
+
+		state->phi,
+		state->theta,
+		state->psi,
+
+		state->vx,
+		state->vy,
+		state->vz,
+
+		state->mx,
+		state->my
+	);
+}
+
+
+/*
+ *  Headless mode.  The controls come from the script and the
+ * model is stepped as fast as possible, with a state_t record
+ * written every out_dt of simulated time.  The run stops at a
+ * quit event, after duration seconds or, if no duration was
+ * given, at the last event in the script.
+ */
+static int
+run_batch(
+	const char *		script_name,
+	const char *		out_name,
+	double			duration,
+	int			text
 )
 {
-	Server			server( 2002 );
+	FILE *			script = stdin;
+	FILE *			out = stdout;
+
+	if( strcmp( script_name, "-" ) != 0 )
+		script = fopen( script_name, "r" );
+	if( !script )
+	{
+		perror( script_name );
+		return EXIT_FAILURE;
+	}
+
+	if( strcmp( out_name, "-" ) != 0 )
+		out = fopen( out_name, text ? "w" : "wb" );
+	if( !out )
+	{
+		perror( out_name );
+		return EXIT_FAILURE;
+	}
+
+	const long long		end_usec	= (long long)( duration * 1000000 );
+
+	script_event_t		event;
+	int			have_event	= read_event( script, &event );
+	long long		sim_usec	= 0;
+	int			failed		= 0;
+	stopwatch_t		timer;
+
+	start( &timer );
+
+	while( duration > 0 ? sim_usec < end_usec : have_event )
+	{
+		// Apply everything that is due before this frame
+		while( have_event && event.time * 1000000 <= sim_usec )
+		{
+			if( do_event( &event ) < 0 )
+				goto done;
+			have_event = read_event( script, &event );
+		}
+
+		// Faster than real time, so wait for the recorder
+		if( recorder )
+			recorder_wait( recorder, RECORDER_RING / 2 );
+
+		if( advance_frame( ( sim_usec + out_dt ) / 1000000.0 ) < 0 )
+		{
+			fprintf( stderr,
+				"Model diverged at %.3f sec\n",
+				sim_usec / 1000000.0
+			);
+
+			failed = 1;
+			break;
+		}
+
+		sim_usec += out_dt;
+
+		state_t			state;
+
+		fill_state( &state, &xcell.cg );
+		write_record( out, text, sim_usec / 1000000.0, &state );
+	}
+
+done:
+	const double		wall = stop( &timer ) / 1000000.0;
+	const double		sim = sim_usec / 1000000.0;
+
+	fflush( out );
+
+	fprintf( stderr,
+		"Simulated %.3f sec in %.3f sec: %.1f sim sec/wall sec\n",
+		sim,
+		wall,
+		wall > 0 ? sim / wall : 0.0
+	);
+
+	fprintf( stderr,
+		"%lu steps, %lu rejected\n",
+		xcell.steps_accepted,
+		xcell.steps_rejected
+	);
+
+	if( out != stdout )
+		fclose( out );
+	if( script != stdin )
+		fclose( script );
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+static int
+help( void )
+{
+	cerr <<
+"Usage: heli-sim [options]\n"
+"\n"
+"	-h | --help			This help\n"
+"	-b | --batch script		Run headless from a control script\n"
+"					('-' for stdin)\n"
+"	-o | --output file		Batch state output ('-' for stdout)\n"
+"	-t | --time seconds		Batch run length\n"
+"	-T | --text			Batch output in text, not state_t\n"
+"	--dopri5			Adaptive step integrator\n"
+"	--tolerance tol			DOPRI5 error tolerance\n"
+"	--health none|frame|full	How often to check for NaN (frame)\n"
+"	--trim altitude			Start trimmed at altitude (ft)\n"
+"	--trim-speed ft/s		Forward speed for --trim (0)\n"
+"	--analytic-atmosphere		Evaluate the atmosphere, not the table\n"
+"	--send-stats frames		Print the client send cost every so many frames\n"
+"	--tick-stats frames		Print the frame timing every so many frames\n"
+"	--tick-spin usec		Spin this long before each frame (0)\n"
+"	--record file			Record every physics step in a log\n"
+"	--record-size records		Room in the log (4194304)\n"
+"\n"
+	<< endl;
+
+	return -10;
+}
+
+
+static int
+run_server( void )
+{
+	const int		port = 2002;
+	Server			server( port );
+
+	// Clients on this host read the state from shared memory
+	if( server.share( port ) < 0 )
+		perror( "Unable to share state; local clients will use UDP" );
 
 	// Install our handlers for different commands
 	server.handle( SERVO_PITCH,	servo_set, (void*) &heli_controls[0] );
@@ -293,18 +670,6 @@ main(
 	server.handle( SIM_RESET,	sim_reset, (void*) &xcell );
 	server.handle( COMMAND_CLOSE,	sim_close, (void*) &server );
 
-	/* Set initial conditions for the heli */
-
-	sixdof_fe_inputs_def *	sixdof = &xcell.sixdofIn;
-
-	sixdof->hold_u = 0;		// North
-	sixdof->hold_v = 0;		// East
-	sixdof->hold_w = 0;		// Down
-	sixdof->hold_p = 0;		// Roll
-	sixdof->hold_q = 0;		// Pitch
-	sixdof->hold_r = 0;		// Yaw
-
-
 	/* Setup the environment for our clients */
 	set_state_dt( double(out_dt) / 1000000 );
 
@@ -321,6 +686,19 @@ main(
 	/* Give the children a short while to catch up */
 	usleep( 100000 );
 
+	/*
+	 * Sleep until the next frame is due, handling commands from
+	 * the clients as they come in.
+	 */
+	Loop			loop;
+
+	loop.add_fd( server.sock, Server::update, (void*) &server );
+
+	if( loop.spin( tick_spin ) < 0 )
+		perror( "Unable to spin before the frames" );
+
+	loop.tick( out_dt );
+
 	/* Run the simulation */
 	int steps = 0;
 
@@ -332,35 +710,185 @@ main(
 
 		
 		start();
-		for( int step = 0 ; step < steps_per_dt ; step++ )
-			xcell.step(
-				double(dt) / 1000000,
-				heli_controls
-			);
+		const int	substeps = advance_frame(
+			steps * double(out_dt) / 1000000
+		);
 
 		time_used = stop();
 
-		long extra = out_dt - time_used;
+		/*
+		 * A diverged model is reset and sends nothing this frame,
+		 * but still waits for the tick so that it does not spin
+		 * through resets as fast as it can.
+		 */
+		if( substeps < 0 )
+		{
+			fprintf( stderr, "Model diverged, resetting\n" );
+			xcell.reset();
+		} else {
+			const long	extra = out_dt - time_used;
+
+			if( extra < 0 && substeps > 0 )
+				fprintf( stderr,
+					"Overran quantum by %ld (used %ld usec)\n",
+					-extra / substeps,
+					time_used / substeps
+				);
+
+			// Everything for this frame goes out in one system call
+			server.set_time( steps * double(out_dt) / 1000000 );
+			server.hold();
+			write_to_clients( &server, &xcell.cg  );
+			server.flush();
+
+			if( send_stats && steps % send_stats == 0 && server.send_frames )
+				fprintf( stderr,
+					"send: %.1f usec, %.2f syscalls, %.2f datagrams per frame\n",
+					double( server.send_usec ) / server.send_frames,
+					double( server.send_syscalls ) / server.send_frames,
+					double( server.send_datagrams ) / server.send_frames
+				);
+
+			if( tick_stats && steps % tick_stats == 0 && loop.ticks )
+				fprintf( stderr,
+					"tick: %.1f usec late, %lu max, %lu missed, %lu packets in %lu syscalls\n",
+					double( loop.late_usec ) / loop.ticks,
+					loop.late_max,
+					loop.missed,
+					server.recv_packets,
+					server.recv_syscalls
+				);
+		}
+
+		if( loop.wait_tick() < 0 )
+		{
+			perror( "wait_tick" );
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+int
+main(
+	int			argc,
+	char **			argv
+)
+{
+	const char *		batch		= 0;
+	const char *		output		= "-";
+	double			duration	= 0;
+	int			text		= 0;
+	int			dopri5		= 0;
+	double			tolerance	= xcell.tolerance;
+	const char *		health		= "frame";
+	double			trim_altitude	= 0;
+	double			trim_speed	= 0;
+	int			analytic	= 0;
+	const char *		record_name	= 0;
+
+	int rc = getoptions( &argc, &argv,
+		"h|?|help&",		help,
+		"b|batch=s",		&batch,
+		"o|output=s",		&output,
+		"t|time=d",		&duration,
+		"T|text!",		&text,
+		"dopri5!",		&dopri5,
+		"tolerance=d",		&tolerance,
+		"health=s",		&health,
+		"trim=d",		&trim_altitude,
+		"trim-speed=d",		&trim_speed,
+		"analytic-atmosphere!",	&analytic,
+		"send-stats=i",		&send_stats,
+		"tick-stats=i",		&tick_stats,
+		"tick-spin=i",		&tick_spin,
+		"record=s",		&record_name,
+		"record-size=i",	&record_size,
+		0
+	);
+
+	if( rc == -10 )
+		return EXIT_FAILURE;
+	if( rc < 0 )
+		return help();
+
+	/* Set initial conditions for the heli */
+
+	sixdof_fe_inputs_def *	sixdof = &xcell.sixdofIn;
+
+	sixdof->hold_u = 0;		// North
+	sixdof->hold_v = 0;		// East
+	sixdof->hold_w = 0;		// Down
+	sixdof->hold_p = 0;		// Roll
+	sixdof->hold_q = 0;		// Pitch
+	sixdof->hold_r = 0;		// Yaw
+
+
+	xcell.fixed_dt		= double(dt) / 1000000;
+	xcell.tolerance		= tolerance;
+
+	if( dopri5 )
+		xcell.integrator = Heli::INTEGRATOR_DOPRI5;
+
+	if( strcmp( health, "none" ) == 0 )
+		xcell.health = Heli::HEALTH_NONE;
+	else
+	if( strcmp( health, "frame" ) == 0 )
+		xcell.health = Heli::HEALTH_FRAME;
+	else
+	if( strcmp( health, "full" ) == 0 )
+		xcell.health = Heli::HEALTH_FULL;
+	else
+		return help();
 
-		if( extra < 0 )
+	if( analytic )
+		xcell.cg.atmosphere_model = ATMOSPHERE_ANALYTIC;
+
+	if( trim_altitude > 0 )
+	{
+		trim_inputs_def		in;
+		trim_state_def		out;
+
+		in.V			= Velocity<Frame::NED>( trim_speed, 0, 0 );
+		in.NED			= Position<Frame::NED>( 0, 0, -trim_altitude );
+		in.psi			= 0;
+		in.tolerance		= 1e-8;
+		in.max_iterations	= 50;
+
+		if( xcell.trim( &in, &out ) < 0 )
 		{
 			fprintf( stderr,
-				"Overran quantum by %ld (used %ld usec)\n",
-				-extra / steps_per_dt,
-				time_used / steps_per_dt
+				"Unable to trim: residual %g after %d iterations\n",
+				out.residual,
+				out.iterations
 			);
-
-			extra = 0;
+			return EXIT_FAILURE;
 		}
 
-		write_to_clients( &server, &xcell.cg  );
+		for( int i=0 ; i<4 ; i++ )
+			heli_controls[i] = out.U[i];
+	}
 
-		start();
-		while( (long) stop() < extra )
-			if( server.poll() )
-				server.get_packet();
+	if( record_name )
+	{
+		recorder = recorder_open( record_name, record_size );
+
+		if( !recorder )
+		{
+			perror( record_name );
+			return EXIT_FAILURE;
+		}
 
+		// sim_quit exits from inside the server loop
+		atexit( close_recorder );
+
+		xcell.step_hook = record_step;
 	}
 
-	return 0;
+	if( batch )
+		return run_batch( batch, output, duration, text );
+
+	return run_server();
 }
@@ -0,0 +1,366 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Compare the batched XCell model against separate Heli instances.
+ * Each airframe gets slightly different parameters and control
+ * inputs so that the batch really is stepping different helicopters,
+ * and every other one flies in turbulence.  The batch has to match
+ * them bit for bit.  The default count is not a multiple of the batch
+ * block, so the short block at the end is checked, too.  The batch
+ * blade element kernels are also checked against Blade::step() one
+ * kernel at a time.  Last, load() has to refuse a Heli that is not
+ * on RK4 and HEALTH_FRAME, and an airframe that goes to NaN has to be
+ * reported on its own.
+ *
+ * benchbatch times the two.
+ *
+ * Usage: testbatch [airframes] [seconds]
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+#include "Heli.h"
+#include "HeliBatch.h"
+#include "fleet.h"
+#include <mat/Conversions.h>
+
+using namespace std;
+using namespace sim;
+
+
+static const double	dt		= 0.002;
+
+
+static const char *	kernel_names[] = {
+	"auto",
+	"scalar",
+	"sse2",
+	"avx2",
+};
+
+
+/*
+ *  Every kernel of BladeBatch has to match Blade::step() exactly
+ * for each airframe, including the ones left over at the end of
+ * the SIMD kernels.  Returns the number of kernels that do not.
+ */
+static int
+check_kernels(
+	int			n
+)
+{
+	const Heli		heli;
+	std::vector<Blade>	blades( n );
+	BladeBatch		batch;
+	int			failed = 0;
+
+	batch.resize( n );
+
+	for( int i=0 ; i<n ; i++ )
+	{
+		Blade &			b = blades[i];
+
+		b.a		= heli.m.a;
+		b.b		= heli.m.b;
+		b.c		= heli.m.c;
+		b.Cd0		= heli.m.cd0 * ( 1.0 + 0.01 * i );
+		b.R		= heli.m.r;
+		b.R0		= heli.m.ro;
+		b.twst		= heli.m.twst;
+		b.omega		= ( 1500.0 + i ) * C_TWOPI / 60.0;
+		b.collective	= ( 6.0 - 0.5 * i ) * C_DEG2RAD;
+		b.Vperp		= 0.5 * i - 3.0;
+		b.rho		= 0.002377;
+
+		b.step();
+
+		batch.a[i]		= b.a;
+		batch.b[i]		= b.b;
+		batch.c[i]		= b.c;
+		batch.Cd0[i]		= b.Cd0;
+		batch.R[i]		= b.R;
+		batch.R0[i]		= b.R0;
+		batch.twst[i]		= b.twst;
+		batch.omega[i]		= b.omega;
+		batch.collective[i]	= b.collective;
+		batch.Vperp[i]		= b.Vperp;
+		batch.rho[i]		= b.rho;
+	}
+
+	for( int k=Blade::KERNEL_SCALAR ; k<=Blade::KERNEL_AVX2 ; k++ )
+	{
+		const Blade::kernel_t	kernel = Blade::kernel_t( k );
+		int			wrong = 0;
+
+		if( !Blade::have_kernel( kernel ) )
+		{
+			printf( "BladeBatch %s: not supported\n", kernel_names[k] );
+			continue;
+		}
+
+		batch.step( kernel );
+
+		for( int i=0 ; i<n ; i++ )
+		{
+			const Blade &		b = blades[i];
+
+			if( batch.T[i] != b.T
+			||  batch.Q[i] != b.Q
+			||  batch.P[i] != b.P
+			||  batch.avg_v1[i] != b.avg_v1
+			)
+				wrong++;
+		}
+
+		printf( "BladeBatch %s: %d of %d airframes differ from Blade\n",
+			kernel_names[k],
+			wrong,
+			n
+		);
+
+		if( wrong )
+			failed++;
+	}
+
+	return failed;
+}
+
+
+/*
+ *  load() has to refuse an airframe that the batch would not step
+ * the way Heli::step() does.  Returns the number of failures.
+ */
+static int
+check_load( void )
+{
+	HeliBatch		batch( 1 );
+	int			failed = 0;
+
+	Heli			dopri;
+	dopri.integrator = Heli::INTEGRATOR_DOPRI5;
+
+	Heli			full;
+	full.health	= Heli::HEALTH_FULL;
+
+	Heli			none;
+	none.health	= Heli::HEALTH_NONE;
+
+	const Heli		plain;
+
+	if( batch.load( 0, dopri ) == 0 )
+	{
+		printf( "FAILED: a DOPRI5 Heli was loaded\n" );
+		failed++;
+	}
+
+	if( batch.load( 0, full ) == 0
+	||  batch.load( 0, none ) == 0
+	) {
+		printf( "FAILED: a Heli without HEALTH_FRAME was loaded\n" );
+		failed++;
+	}
+
+	if( batch.load( 0, plain ) < 0 )
+	{
+		printf( "FAILED: the default Heli was refused\n" );
+		failed++;
+	}
+
+	return failed;
+}
+
+
+/*
+ *  One airframe that goes to NaN has to be marked on its own and
+ * leave the others stepping as they would on their own.  Loading it
+ * again clears the mark.  Returns the number of failures.
+ */
+static int
+check_diverged( void )
+{
+	const int		n	= 5;
+	const int		bad	= 2;
+	std::vector<Heli>	helis( n );
+	double			(*U)[4] = new double[n][4];
+	int			failed = 0;
+	int			marked = 0;
+
+	make_fleet( helis, U );
+
+	helis[bad].m.a1 = NAN;
+
+	HeliBatch		batch( n, helis[0] );
+
+	for( int i=0 ; i<n ; i++ )
+		batch.load( i, helis[i] );
+
+	for( int s=0 ; s<10 ; s++ )
+	{
+		for( int i=0 ; i<n ; i++ )
+			if( i != bad )
+				helis[i].step( dt, U[i] );
+
+		marked = batch.step( dt, U );
+	}
+
+	for( int i=0 ; i<n ; i++ )
+	{
+		if( ( batch.diverged[i] != 0 ) != ( i == bad ) )
+		{
+			printf( "FAILED: airframe %d is %s\n",
+				i,
+				batch.diverged[i] ? "marked" : "not marked"
+			);
+			failed++;
+		}
+
+		if( i != bad && batch.NED[2][i] != helis[i].cg.NED[2] )
+		{
+			printf( "FAILED: airframe %d moved off its Heli\n", i );
+			failed++;
+		}
+	}
+
+	if( marked != 1 )
+	{
+		printf( "FAILED: step() counted %d diverged airframes\n",
+			marked
+		);
+		failed++;
+	}
+
+	helis[bad].reset();
+	batch.load( bad, helis[bad] );
+
+	if( batch.diverged[bad] || batch.step( dt, U ) != 0 )
+	{
+		printf( "FAILED: load() did not clear the diverged airframe\n" );
+		failed++;
+	}
+
+	printf( "%d airframes, airframe %d diverged, %d marked\n",
+		n,
+		bad,
+		marked
+	);
+
+	delete[] U;
+
+	return failed;
+}
+
+
+int
+main(
+	int			argc,
+	char **			argv
+)
+{
+	const int		n	= argc > 1 ? atoi( argv[1] ) : 67;
+	const double		seconds	= argc > 2 ? atof( argv[2] ) : 1.0;
+	const int		steps	= int( seconds / dt );
+
+	std::vector<Heli>	helis( n );
+	double			(*U)[4] = new double[n][4];
+
+	make_fleet( helis, U );
+
+	HeliBatch		batch( n, helis[0] );
+
+	for( int i=0 ; i<n ; i++ )
+		batch.load( i, helis[i] );
+
+	for( int s=0 ; s<steps ; s++ )
+	{
+		for( int i=0 ; i<n ; i++ )
+			helis[i].step( dt, U[i] );
+
+		batch.step( dt, U );
+	}
+
+	int			wrong = 0;
+	int			first = -1;
+
+	for( int i=0 ; i<n ; i++ )
+	{
+		Heli			out( helis[i] );
+		const Forces &		a = helis[i].cg;
+		const Forces &		b = out.cg;
+		bool			same = true;
+
+		batch.store( i, out );
+
+		for( int k=0 ; k<3 ; k++ )
+		{
+			if( a.NED[k] != b.NED[k]
+			||  a.V[k] != b.V[k]
+			||  a.uvw[k] != b.uvw[k]
+			||  a.THETA[k] != b.THETA[k]
+			||  a.pqr[k] != b.pqr[k]
+			||  a.F[k] != b.F[k]
+			||  a.M[k] != b.M[k]
+			)
+				same = false;
+		}
+
+		if( same )
+			continue;
+
+		if( first < 0 )
+			first = i;
+		wrong++;
+	}
+
+	int			failed	= 0;
+
+	printf( "%d airframes, %d steps of %f sec: %d differ from Heli\n",
+		n,
+		steps,
+		dt,
+		wrong
+	);
+
+	if( wrong )
+	{
+		printf( "FAILED: airframe %d is the first that differs\n",
+			first
+		);
+		failed++;
+	}
+
+	failed += check_kernels( 11 );
+	failed += check_load();
+	failed += check_diverged();
+
+	delete[] U;
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,414 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Compare the blade element kernels against the scalar version
+ * and against the original single running sum over the flight
+ * envelope of the XCell main and tail rotors and time each of them.  Also times the cost of a call with and
+ * without the cached station geometry.
+ *
+ * Usage: testblade [iterations]
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <stdint.h>
+
+#include "Heli.h"
+#include "Blade.h"
+#include <mat/Conversions.h>
+#include <timer.h>
+
+using namespace std;
+using namespace sim;
+
+
+static const char *	kernel_names[] = {
+	"auto",
+	"scalar",
+	"sse2",
+	"avx2",
+};
+
+
+/*
+ *  Distance between two doubles in units in the last place.
+ * Doubles of different sign are measured through zero.
+ */
+static uint64_t
+ulps(
+	double			a,
+	double			b
+)
+{
+	int64_t			ia;
+	int64_t			ib;
+
+	memcpy( &ia, &a, sizeof(ia) );
+	memcpy( &ib, &b, sizeof(ib) );
+
+	if( ia < 0 )
+		ia = INT64_MIN - ia;
+	if( ib < 0 )
+		ib = INT64_MIN - ib;
+
+	return ia > ib ? uint64_t(ia) - uint64_t(ib) : uint64_t(ib) - uint64_t(ia);
+}
+
+
+/*
+ *  The station loop as it was before the kernels: every station is
+ * added to a single running sum in station order, and the geometry
+ * is computed inline.  The kernels only change the order of the
+ * additions, so they agree with this to within rounding.
+ *
+ * mag[] is the sum of the magnitudes of the station terms, which
+ * is what bounds how far reordering the additions can move each
+ * output.  The error is measured in DBL_EPSILON of it rather than in
+ * ULP of the output, since T passes through zero in the envelope and
+ * the ULP error of a cancelling sum has no useful bound.
+ */
+static void
+sequential(
+	const Blade &		blade,
+	double			out[4],
+	double			mag[4]
+)
+{
+	double			T	= 0.0;
+	double			Q	= 0.0;
+	double			P	= 0.0;
+	double			avg_v1	= 0.0;
+
+	for( int j=0 ; j<4 ; j++ )
+		mag[j] = 0.0;
+
+	// abcOmega/2 + 4piVperp
+	const double		vv	=
+		blade.a * blade.b * blade.c * blade.omega / 2.0
+		+ 4.0 * C_PI * blade.Vperp;
+
+	// thickness of the blade element
+	const double		dR	=
+		(blade.R - blade.R0) / 100.0;
+
+	// root collective angle
+	const double		theta0	=
+		fabs(blade.collective)
+		- blade.twst * (0.75 - (blade.R0/blade.R));
+
+	const double		omega2	= blade.omega * blade.omega;
+	const double		vv2	= vv * vv;
+	const double		proudy	= 
+		8.0 * C_PI * omega2 * blade.a * blade.b * blade.c;
+	const double		keys1	=
+		blade.Cd0 * blade.rho * blade.c * dR / 2.0;
+	const double		keys2	=
+		4.0 * C_PI * blade.rho * dR;
+
+	for( int i=0 ;  i<Blade::num_stations ;  ++i )
+	{
+		const double	r_R	= (blade.R0 + double(i+1)*dR) / blade.R;
+		const double	r	= r_R * blade.R;
+		const double	theta_r	= theta0 + blade.twst*r_R;
+		const double	omega_r	= blade.omega*r;
+		const double	alpha	= theta_r - blade.Vperp/omega_r;
+		const double	temp	= vv2 + proudy * r * alpha;
+		const double	v1	= 
+			( sqrt(fabs(temp)) - vv ) / ( 8.0 * C_PI );
+		const double	temp2	= blade.Vperp + v1;
+		const double	dT	= keys2 * temp2 * v1 * r;
+		const double	dD	= keys1 * omega_r * omega_r;
+		const double	dQ	= r * ( dT*temp2/omega_r + dD );
+		const double	dP	= dQ * blade.omega;
+
+		T	+= dT;
+		Q	+= dQ;
+		P	+= dP;
+		avg_v1	+= v1;
+
+		mag[0]	+= fabs( dT );
+		mag[1]	+= fabs( dQ );
+		mag[2]	+= fabs( dP );
+		mag[3]	+= fabs( v1 );
+	}
+
+	avg_v1	= avg_v1 / Blade::num_stations;
+	mag[3]	= mag[3] / Blade::num_stations;
+
+	if( blade.collective < 0.0 )
+	{
+		T	*= -1.0;
+		avg_v1	*= -1.0;
+	}
+
+	out[0]	= T;
+	out[1]	= Q;
+	out[2]	= P;
+	out[3]	= avg_v1;
+}
+
+
+/*
+ *  Fill in the blades the same way Heli::do_forces() does
+ */
+static void
+setup(
+	const Heli &		heli,
+	Blade &			mb,
+	Blade &			tb
+)
+{
+	const double		rho = 0.0023769;
+
+	mb.a		= heli.m.a;
+	mb.b		= heli.m.b;
+	mb.c		= heli.m.c;
+	mb.Cd0		= heli.m.cd0;
+	mb.e		= 0.7;
+	mb.omega	= heli.c.mr_rev*C_TWOPI/60.0;
+	mb.R		= heli.m.r;
+	mb.R0		= heli.m.ro;
+	mb.rho		= rho;
+	mb.twst		= heli.m.twst;
+
+	tb.a		= heli.t.a;
+	tb.b		= heli.t.b;
+	tb.c		= heli.t.c;
+	tb.Cd0		= heli.t.cd0;
+	tb.e		= 0.7;
+	tb.omega	= heli.c.tr_rev*C_TWOPI/60.0;
+	tb.R		= heli.t.r;
+	tb.R0		= heli.t.r0;
+	tb.rho		= rho;
+	tb.twst		= heli.t.twst;
+}
+
+
+/*
+ *  Time one rotor with the station geometry recomputed on every
+ * call (as it was before the cache) and with it cached.  Returns
+ * the number of outputs where the two disagree, which should be
+ * none since the cache holds the same values.
+ */
+static int
+time_cache(
+	const char *		name,
+	const Blade &		blade,
+	int			iterations
+)
+{
+	Blade			cold( blade );
+	Blade			warm( blade );
+	stopwatch_t		timer;
+	unsigned long		cold_usec = 0;
+	unsigned long		warm_usec = 0;
+	int			calls = 0;
+	int			mismatches = 0;
+
+	for( double col = -12.5 ; col <= 18.0 ; col += 0.5 )
+	{
+		cold.collective	= warm.collective = col * C_DEG2RAD;
+
+		for( double vp = -30.0 ; vp <= 30.0 ; vp += 1.0 )
+		{
+			cold.Vperp	= warm.Vperp = vp;
+
+			start( &timer );
+			for( int i=0 ; i<iterations ; i++ )
+			{
+				cold.invalidate();
+				cold.step();
+			}
+			cold_usec += stop( &timer );
+
+			start( &timer );
+			for( int i=0 ; i<iterations ; i++ )
+				warm.step();
+			warm_usec += stop( &timer );
+
+			calls += iterations;
+
+			if( cold.T != warm.T
+			||  cold.Q != warm.Q
+			||  cold.P != warm.P
+			||  cold.avg_v1 != warm.avg_v1
+			)
+				mismatches++;
+		}
+	}
+
+	printf( "%-18s uncached %6.1f nsec/call, cached %6.1f nsec/call\n",
+		name,
+		cold_usec * 1000.0 / calls,
+		warm_usec * 1000.0 / calls
+	);
+
+	return mismatches;
+}
+
+
+int
+main(
+	int			argc,
+	char **			argv
+)
+{
+	const int		iterations = argc > 1 ? atoi( argv[1] ) : 200;
+
+	const Heli		heli;
+	Blade			blades[2];
+	uint64_t		max_ulps = 0;
+	double			max_reorder = 0;
+	int			cases = 0;
+
+	setup( heli, blades[0], blades[1] );
+
+	printf( "Best kernel: %s\n", kernel_names[Blade::best_kernel()] );
+
+	for( int k=Blade::KERNEL_SCALAR ; k<=Blade::KERNEL_AVX2 ; k++ )
+	{
+		const Blade::kernel_t	kernel = Blade::kernel_t( k );
+
+		if( !Blade::have_kernel( kernel ) )
+		{
+			printf( "%-8s not supported\n", kernel_names[k] );
+			continue;
+		}
+
+		uint64_t		kernel_ulps = 0;
+		uint64_t		seq_ulps = 0;
+		double			seq_err = 0;
+		stopwatch_t		timer;
+		unsigned long		usec = 0;
+
+		for( int b=0 ; b<2 ; b++ )
+		{
+			for( double col = -12.5 ; col <= 18.0 ; col += 0.5 )
+			{
+				for( double vp = -30.0 ; vp <= 30.0 ; vp += 1.0 )
+				{
+					Blade		ref( blades[b] );
+					Blade		test( blades[b] );
+
+					ref.collective	= test.collective = col * C_DEG2RAD;
+					ref.Vperp	= test.Vperp = vp;
+
+					ref.step( Blade::KERNEL_SCALAR );
+
+					start( &timer );
+					for( int i=0 ; i<iterations ; i++ )
+						test.step( kernel );
+					usec += stop( &timer );
+
+					const uint64_t	err[] = {
+						ulps( ref.T, test.T ),
+						ulps( ref.Q, test.Q ),
+						ulps( ref.P, test.P ),
+						ulps( ref.avg_v1, test.avg_v1 ),
+					};
+
+					for( int j=0 ; j<4 ; j++ )
+						if( err[j] > kernel_ulps )
+							kernel_ulps = err[j];
+
+					// Against the original station order
+					double		seq[4];
+					double		mag[4];
+
+					sequential( test, seq, mag );
+
+					const double	out[] = {
+						test.T,
+						test.Q,
+						test.P,
+						test.avg_v1,
+					};
+
+					for( int j=0 ; j<4 ; j++ )
+					{
+						const uint64_t	u = ulps( seq[j], out[j] );
+						const double	e = fabs( seq[j] - out[j] )
+							/ ( mag[j] * DBL_EPSILON );
+
+						if( u > seq_ulps )
+							seq_ulps = u;
+						if( e > seq_err )
+							seq_err = e;
+					}
+
+					cases++;
+				}
+			}
+		}
+
+		printf( "%-8s %8lu usec, max error %llu ulp,"
+			" sequential %.1f eps (%llu ulp)\n",
+			kernel_names[k],
+			usec,
+			(unsigned long long) kernel_ulps,
+			seq_err,
+			(unsigned long long) seq_ulps
+		);
+
+		if( kernel_ulps > max_ulps )
+			max_ulps = kernel_ulps;
+		if( seq_err > max_reorder )
+			max_reorder = seq_err;
+	}
+
+	printf( "%d cases, max error %llu ulp\n",
+		cases,
+		(unsigned long long) max_ulps
+	);
+
+	const int		mismatches =
+		time_cache( "main_rotor_blade", blades[0], iterations )
+		+ time_cache( "tail_rotor_blade", blades[1], iterations );
+
+	if( mismatches )
+	{
+		printf( "FAILED: %d cached results differ\n", mismatches );
+		return EXIT_FAILURE;
+	}
+
+	if( max_ulps > uint64_t( Blade::max_ulp_error ) )
+	{
+		printf( "FAILED: tolerance is %d ulp\n", Blade::max_ulp_error );
+		return EXIT_FAILURE;
+	}
+
+	if( max_reorder > Blade::max_reorder_error )
+	{
+		printf( "FAILED: sequential tolerance is %d eps\n",
+			Blade::max_reorder_error
+		);
+		return EXIT_FAILURE;
+	}
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,342 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Compare the fixed step RK4 and adaptive DOPRI5 integrators.  The
+ * airframe lifts off, then each integrator flies a pitch and roll
+ * doublet from the same airborne state.  The reference is DOPRI5
+ * with a very tight tolerance and short steps.
+ *
+ * The lift off itself is flown by both integrators from the ground,
+ * where advance() takes RK4 steps for both, against RK4 with very
+ * short steps.  DOPRI5 must be no slower there than RK4.
+ *
+ * Usage: testdopri [seconds]
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include "Heli.h"
+#include <mat/Conversions.h>
+#include <timer.h>
+
+using namespace std;
+using namespace sim;
+
+
+// Output rate of the comparison, the same as heli-sim
+static const double	frame_dt	= 0.02;
+
+// Time to lift off before the comparison starts
+static const double	liftoff		= 2.0;
+
+
+typedef struct
+{
+	double			NED[3];
+	double			THETA[3];
+} sample_t;
+
+
+typedef struct
+{
+	unsigned long		steps;
+	unsigned long		rejected;
+	unsigned long		forces;
+	unsigned long		usec;
+	double			pos;
+	double			att;
+} result_t;
+
+
+/*
+ *  Control inputs for the test flight.  U is in the same order as
+ * Heli::step(): [B1 (pitch), A1 (roll), mr_coll, tr_coll].
+ */
+static void
+controls(
+	double			t,
+	double			U[4]
+)
+{
+	U[0]	= 0;
+	U[1]	= 0;
+	U[2]	= ( t < 2.0 ? 11.0 : 9.5 ) * C_DEG2RAD;
+	U[3]	= 4.5 * C_DEG2RAD;
+
+	if( 3.0 <= t && t < 3.5 )
+		U[0] =  2.0 * C_DEG2RAD;
+	else
+	if( 3.5 <= t && t < 4.0 )
+		U[0] = -2.0 * C_DEG2RAD;
+
+	if( 5.0 <= t && t < 5.5 )
+		U[1] =  2.0 * C_DEG2RAD;
+	else
+	if( 5.5 <= t && t < 6.0 )
+		U[1] = -2.0 * C_DEG2RAD;
+}
+
+
+/*
+ *  Fly the test from t0 and record the state at every frame.
+ * The number of times the rotor and gear forces were computed
+ * is in result->forces: once per RK4 step, and once per DOPRI5
+ * stage including the rejected steps, less the first stages that
+ * were reused.
+ */
+static void
+fly(
+	Heli &			heli,
+	double			t0,
+	sample_t *		samples,
+	int			frames,
+	result_t *		result
+)
+{
+	stopwatch_t		timer;
+	double			U[4];
+
+	const unsigned long	steps0		= heli.steps_accepted;
+	const unsigned long	rejected0	= heli.steps_rejected;
+	const unsigned long	forces0		= heli.force_evaluations;
+
+	start( &timer );
+
+	for( int i=0 ; i<frames ; i++ )
+	{
+		controls( t0 + i * frame_dt, U );
+		heli.advance( frame_dt, U );
+
+		if( !samples )
+			continue;
+
+		for( int k=0 ; k<3 ; k++ )
+		{
+			samples[i].NED[k]	= heli.cg.NED[k];
+			samples[i].THETA[k]	= heli.cg.THETA[k];
+		}
+	}
+
+	result->usec		= stop( &timer );
+	result->steps		= heli.steps_accepted - steps0;
+	result->rejected	= heli.steps_rejected - rejected0;
+	result->forces		= heli.force_evaluations - forces0;
+}
+
+
+/*
+ *  Largest position (ft) and attitude (deg) error over the flight
+ */
+static void
+compare(
+	const sample_t *	a,
+	const sample_t *	b,
+	int			frames,
+	result_t *		result
+)
+{
+	result->pos = 0;
+	result->att = 0;
+
+	for( int i=0 ; i<frames ; i++ )
+	{
+		for( int k=0 ; k<3 ; k++ )
+		{
+			const double	p = fabs( a[i].NED[k] - b[i].NED[k] );
+			double		t = fabs( a[i].THETA[k] - b[i].THETA[k] );
+
+			if( t > C_PI )
+				t = 2 * C_PI - t;
+
+			if( p > result->pos )
+				result->pos = p;
+			if( t * C_RAD2DEG > result->att )
+				result->att = t * C_RAD2DEG;
+		}
+	}
+}
+
+
+static void
+print(
+	const char *		name,
+	const result_t *	r,
+	double			seconds
+)
+{
+	printf( "%-16s %8lu %8lu %10.0f %10.0f %10.2g %10.2g\n",
+		name,
+		r->steps,
+		r->rejected,
+		r->forces / seconds,
+		r->usec / seconds,
+		r->pos,
+		r->att
+	);
+}
+
+
+int
+main(
+	int			argc,
+	char **			argv
+)
+{
+	const double		seconds	= argc > 1 ? atof( argv[1] ) : 6.0;
+	const int		frames	= int( seconds / frame_dt + 0.5 );
+	const int		ground	= int( liftoff / frame_dt + 0.5 );
+
+	sample_t *		reference	= new sample_t[frames];
+	sample_t *		samples		= new sample_t[ frames > ground ? frames : ground ];
+	result_t		result;
+
+	printf( "%-16s %8s %8s %10s %10s %10s %10s\n",
+		"integrator",
+		"steps",
+		"rejected",
+		"forces/sec",
+		"usec/sec",
+		"pos ft",
+		"att deg"
+	);
+
+	/* Lift off from the ground with each integrator */
+	sample_t *		ground_reference = new sample_t[ground];
+	result_t		ground_rk4;
+	int			failed = 0;
+
+	{
+		Heli			heli;
+
+		heli.fixed_dt	= 0.0001;
+		fly( heli, 0, ground_reference, ground, &result );
+	}
+
+	{
+		Heli			heli;
+
+		fly( heli, 0, samples, ground, &ground_rk4 );
+		compare( ground_reference, samples, ground, &ground_rk4 );
+		print( "ground rk4", &ground_rk4, liftoff );
+	}
+
+	{
+		Heli			heli;
+
+		heli.integrator	= Heli::INTEGRATOR_DOPRI5;
+
+		fly( heli, 0, samples, ground, &result );
+		compare( ground_reference, samples, ground, &result );
+		print( "ground dopri5", &result, liftoff );
+	}
+
+	/*
+	 * On the gear DOPRI5 takes the same RK4 steps, and in the air
+	 * longer ones, so it must be as accurate and compute the forces
+	 * no more often.
+	 */
+	if( result.pos > 2 * ground_rk4.pos || result.att > 2 * ground_rk4.att )
+	{
+		printf( "FAILED: less accurate than RK4 from the ground\n" );
+		failed++;
+	}
+
+	if( result.forces > ground_rk4.forces )
+	{
+		printf( "FAILED: more force evaluations than RK4 from the ground\n" );
+		failed++;
+	}
+
+	delete[] ground_reference;
+
+	/* Lift off and save the airborne state for every run */
+	Heli			airborne;
+
+	fly( airborne, 0, 0, ground, &result );
+
+	Heli			heli( airborne );
+
+	heli.integrator	= Heli::INTEGRATOR_DOPRI5;
+	heli.tolerance	= 1e-11;
+	heli.max_dt	= 0.001;
+
+	fly( heli, liftoff, reference, frames, &result );
+
+	/* The normal fixed step that heli-sim uses */
+	result_t		rk4;
+
+	heli = airborne;
+	fly( heli, liftoff, samples, frames, &rk4 );
+	compare( reference, samples, frames, &rk4 );
+	print( "rk4 dt=0.002", &rk4, seconds );
+
+	/* The adaptive integrator at a range of tolerances */
+	static const double	tolerances[] = { 1e-4, 1e-6, 1e-8 };
+
+	for( unsigned i=0 ; i < sizeof(tolerances)/sizeof(*tolerances) ; i++ )
+	{
+		char			name[32];
+
+		heli		= airborne;
+		heli.integrator	= Heli::INTEGRATOR_DOPRI5;
+		heli.tolerance	= tolerances[i];
+
+		fly( heli, liftoff, samples, frames, &result );
+		compare( reference, samples, frames, &result );
+
+		snprintf( name, sizeof(name), "dopri5 tol=%g", tolerances[i] );
+		print( name, &result, seconds );
+
+		/*
+		 * At the default tolerance DOPRI5 should be at least as
+		 * accurate as RK4 at the normal step, without computing
+		 * the forces any more often.
+		 */
+		if( tolerances[i] != 1e-6 )
+			continue;
+
+		if( result.pos > rk4.pos || result.att > rk4.att )
+		{
+			printf( "FAILED: less accurate than RK4\n" );
+			failed++;
+		}
+
+		if( result.forces > rk4.forces )
+		{
+			printf( "FAILED: more force evaluations than RK4\n" );
+			failed++;
+		}
+	}
+
+	delete[] reference;
+	delete[] samples;
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,194 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Check that a NaN in the model is reported by step() and advance()
+ * under each health check policy instead of stopping the process,
+ * and time the checks.  The policies are timed in interleaved rounds
+ * and the median round of each is reported, since a single run of
+ * each one mostly measures what else the machine was doing.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include "Heli.h"
+#include <mat/Conversions.h>
+#include <timer.h>
+
+using namespace std;
+using namespace sim;
+
+
+static const double	U[4] = {
+	0,
+	0,
+	9.5 * C_DEG2RAD,
+	4.5 * C_DEG2RAD,
+};
+
+
+static const char *	names[] = {
+	"none",
+	"frame",
+	"full",
+};
+
+
+/*
+ *  Inject a NaN into the body velocity and check that the step
+ * and advance() calls return what the policy says they should.
+ */
+static int
+check(
+	Heli::health_t		health
+)
+{
+	const int		expected = health == Heli::HEALTH_NONE ? 0 : -1;
+	int			failed = 0;
+	Heli			heli;
+
+	heli.health = health;
+
+	if( heli.step( 0.002, U ) != 0 )
+	{
+		printf( "FAILED: %s: healthy step returned an error\n",
+			names[health]
+		);
+		failed++;
+	}
+
+	heli.cg.uvw[0] = NAN;
+
+	if( heli.step( 0.002, U ) != expected )
+	{
+		printf( "FAILED: %s: step() did not return %d\n",
+			names[health],
+			expected
+		);
+		failed++;
+	}
+
+	heli.reset();
+	heli.cg.uvw[1] = NAN;
+
+	const int		rc = heli.advance( 0.02, U );
+
+	if( ( rc < 0 ? -1 : 0 ) != expected )
+	{
+		printf( "FAILED: %s: advance() returned %d\n",
+			names[health],
+			rc
+		);
+		failed++;
+	}
+
+	if( heli.is_finite() )
+	{
+		printf( "FAILED: %s: state should not be finite\n",
+			names[health]
+		);
+		failed++;
+	}
+
+	return failed;
+}
+
+
+static int
+compare_usec(
+	const void *		a,
+	const void *		b
+)
+{
+	const unsigned long	x = *(const unsigned long*) a;
+	const unsigned long	y = *(const unsigned long*) b;
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+
+int
+main( void )
+{
+	int			failed = 0;
+	const int		rounds = 21;
+	const int		iters = 1000;
+	const int		policies = Heli::HEALTH_FULL + 1;
+	unsigned long		usec[Heli::HEALTH_FULL + 1][21];
+	Heli			helis[Heli::HEALTH_FULL + 1];
+
+	for( int h = 0 ; h < policies ; h++ )
+	{
+		failed += check( (Heli::health_t) h );
+		helis[h].health = (Heli::health_t) h;
+	}
+
+	for( int r = 0 ; r < rounds ; r++ )
+	{
+		for( int h = 0 ; h < policies ; h++ )
+		{
+			// Rotate the order so no policy always runs first
+			const int		p = ( h + r ) % policies;
+			stopwatch_t		timer;
+			int			errors = 0;
+
+			// Time a healthy model every round
+			helis[p].reset();
+
+			start( &timer );
+			for( int i=0 ; i<iters ; i++ )
+				errors += helis[p].step( 0.002, U ) != 0;
+			usec[p][r] = stop( &timer );
+
+			if( errors )
+			{
+				printf( "FAILED: %s: %d steps failed while timing\n",
+					names[p],
+					errors
+				);
+				failed++;
+			}
+		}
+	}
+
+	for( int h = 0 ; h < policies ; h++ )
+	{
+		qsort( usec[h], rounds, sizeof(usec[h][0]), compare_usec );
+
+		printf( "%-6s %.3f usec/step median, %.3f to %.3f over %d rounds\n",
+			names[h],
+			double( usec[h][rounds/2] ) / iters,
+			double( usec[h][0] ) / iters,
+			double( usec[h][rounds-1] ) / iters,
+			rounds
+		);
+	}
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
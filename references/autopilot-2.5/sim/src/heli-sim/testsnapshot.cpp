@@ -0,0 +1,287 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Check that a run restarted from a Heli::snapshot_t matches the
+ * original exactly, with wind and with both integrators, that a run
+ * with a parameter changed matches a new Heli given the same snapshot
+ * and change, and time restore() against building a new Heli.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Heli.h"
+#include <mat/Conversions.h>
+#include <timer.h>
+
+using namespace std;
+using namespace sim;
+
+
+static const double	frame_dt	= 0.02;
+static const int	frames		= 150;
+
+
+typedef struct
+{
+	double			NED[3];
+	double			THETA[3];
+	double			uvw[3];
+	double			pqr[3];
+	double			a1;
+	double			b1;
+	double			servo;
+} sample_t;
+
+
+/*
+ *  Lift off, then a pitch doublet that starts after the snapshot
+ */
+static void
+controls(
+	double			t,
+	double			U[4]
+)
+{
+	U[0]	= 0;
+	U[1]	= 0;
+	U[2]	= ( t < 2.0 ? 11.0 : 9.5 ) * C_DEG2RAD;
+	U[3]	= 4.5 * C_DEG2RAD;
+
+	if( 2.5 <= t && t < 3.0 )
+		U[0] =  2.0 * C_DEG2RAD;
+	else
+	if( 3.0 <= t && t < 3.5 )
+		U[0] = -2.0 * C_DEG2RAD;
+}
+
+
+static void
+fly(
+	Heli &			heli,
+	double			t0,
+	sample_t *		samples
+)
+{
+	double			U[4];
+
+	for( int i=0 ; i<frames ; i++ )
+	{
+		controls( t0 + i * frame_dt, U );
+		heli.advance( frame_dt, U );
+
+		sample_t &		s = samples[i];
+
+		memset( &s, 0, sizeof(s) );
+
+		for( int k=0 ; k<3 ; k++ )
+		{
+			s.NED[k]	= heli.cg.NED[k];
+			s.THETA[k]	= heli.cg.THETA[k];
+			s.uvw[k]	= heli.cg.uvw[k];
+			s.pqr[k]	= heli.cg.pqr[k];
+		}
+
+		s.a1		= heli.m.a1;
+		s.b1		= heli.m.b1;
+		s.servo		= heli.c.B1;
+	}
+}
+
+
+static int
+check(
+	const char *		name,
+	Heli::integrator_t	integrator
+)
+{
+	Heli			heli;
+	double			U[4];
+
+	heli.integrator			= integrator;
+	heli.wind_params.wind_max	= Velocity<Frame::NED>( 5, 5, 2 );
+	wind_init( &heli.wind_params, &heli.wind_state );
+
+	// Fly to the branch point
+	const int		ground = int( 2.0 / frame_dt + 0.5 );
+
+	for( int i=0 ; i<ground ; i++ )
+	{
+		controls( i * frame_dt, U );
+		heli.advance( frame_dt, U );
+	}
+
+	Heli::snapshot_t	snapshot;
+	sample_t		original[frames];
+	sample_t		restored[frames];
+
+	heli.save( snapshot );
+	fly( heli, 2.0, original );
+
+	// Wander off somewhere else, then come back
+	for( int i=0 ; i<50 ; i++ )
+	{
+		controls( 4.0, U );
+		U[1] = 3.0 * C_DEG2RAD;
+		heli.advance( frame_dt, U );
+	}
+
+	heli.restore( snapshot );
+	fly( heli, 2.0, restored );
+
+	if( memcmp( original, restored, sizeof(original) ) != 0 )
+	{
+		printf( "FAILED: %s restored run differs\n", name );
+		return 1;
+	}
+
+	printf( "%s: %d frames match\n", name, frames );
+	return 0;
+}
+
+
+/*
+ *  Change a parameter at the snapshot and fly on.  This has to match
+ * a new Heli given the same snapshot and change, which has nothing
+ * left over from the steps before it.
+ *
+ * With restore the model takes one step and is restored to its start,
+ * so the DOPRI5 stage kept from that step has the same state, commands
+ * and wind, and only the parameters tell it apart.  Without it, the
+ * lift curve slope is changed through compute_main_rotor() right where
+ * the last step ended.
+ */
+static int
+check_perturbed(
+	const char *		name,
+	bool			restore
+)
+{
+	Heli			heli;
+	Heli			fresh;
+	double			U[4];
+
+	heli.integrator			= Heli::INTEGRATOR_DOPRI5;
+	fresh.integrator		= Heli::INTEGRATOR_DOPRI5;
+
+	// One frame past the change in collective, so that the commands
+	// are the same on both sides of the snapshot
+	const int		branch = int( 2.0 / frame_dt + 0.5 ) + 1;
+	const double		t0 = branch * frame_dt;
+
+	for( int i=0 ; i<branch ; i++ )
+	{
+		controls( i * frame_dt, U );
+		heli.advance( frame_dt, U );
+	}
+
+	Heli::snapshot_t	snapshot;
+	sample_t		changed[frames];
+	sample_t		expected[frames];
+
+	heli.save( snapshot );
+
+	if( restore )
+	{
+		// One step, shorter than any advance() would take here
+		controls( t0, U );
+		heli.advance( 0.001, U );
+
+		heli.restore( snapshot );
+		heli.m.cd0 *= 1.5;
+		fresh.restore( snapshot );
+		fresh.m.cd0 *= 1.5;
+	} else {
+		heli.m.a *= 1.1;
+		heli.compute_main_rotor();
+		fresh.restore( snapshot );
+		fresh.m.a *= 1.1;
+		fresh.compute_main_rotor();
+	}
+
+	fly( heli, t0, changed );
+	fly( fresh, t0, expected );
+
+	if( memcmp( changed, expected, sizeof(changed) ) != 0 )
+	{
+		printf( "FAILED: %s: run differs from a new model\n", name );
+		return 1;
+	}
+
+	// And the change has to have done something
+	heli.restore( snapshot );
+	fly( heli, t0, changed );
+
+	if( memcmp( changed, expected, sizeof(changed) ) == 0 )
+	{
+		printf( "FAILED: %s: the change did nothing\n", name );
+		return 1;
+	}
+
+	printf( "%s: %d frames match a new model\n", name, frames );
+	return 0;
+}
+
+
+int
+main( void )
+{
+	int			failed = 0;
+
+	failed += check( "rk4", Heli::INTEGRATOR_RK4 );
+	failed += check( "dopri5", Heli::INTEGRATOR_DOPRI5 );
+	failed += check_perturbed( "restore and change cd0", true );
+	failed += check_perturbed( "change lift slope", false );
+
+	// Compare the cost of restore() to starting a new model
+	const int		iters	= 10000;
+	Heli			heli;
+	Heli::snapshot_t	snapshot;
+	stopwatch_t		timer;
+
+	heli.save( snapshot );
+
+	start( &timer );
+	for( int i=0 ; i<iters ; i++ )
+		heli.restore( snapshot );
+	const unsigned long	restore_usec = stop( &timer );
+
+	start( &timer );
+	for( int i=0 ; i<iters ; i++ )
+		heli.reset();
+	const unsigned long	reset_usec = stop( &timer );
+
+	printf( "snapshot %lu bytes, restore %.3f usec, reset %.3f usec\n",
+		(unsigned long) sizeof(snapshot),
+		double( restore_usec ) / iters,
+		double( reset_usec ) / iters
+	);
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Trim the model in hover and in forward flight, check that the
+ * solution is an equilibrium, and time the solver.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include "Heli.h"
+#include <mat/Conversions.h>
+#include <timer.h>
+
+using namespace std;
+using namespace sim;
+
+
+/*
+ *  Trim at speed ft/s north and fly the trim controls for a second.
+ * Returns the number of failures.
+ */
+static int
+check(
+	double			speed
+)
+{
+	Heli			heli;
+	trim_inputs_def		in;
+	trim_state_def		out;
+	stopwatch_t		timer;
+
+	in.V			= Velocity<Frame::NED>( speed, 0, 0 );
+	in.NED			= Position<Frame::NED>( 0, 0, -50 );
+	in.psi			= 0;
+	in.tolerance		= 1e-8;
+	in.max_iterations	= 50;
+
+	start( &timer );
+	const int		rc	= heli.trim( &in, &out );
+	const unsigned long	usec	= stop( &timer );
+
+	printf( "%5.1f ft/s: %d iterations %3d evaluations %5lu usec"
+		" residual %.2g\n",
+		speed,
+		out.iterations,
+		out.evaluations,
+		usec,
+		out.residual
+	);
+
+	printf( "    U = %6.3f %6.3f %6.3f %6.3f deg"
+		" phi %6.3f theta %6.3f deg a1 %6.3f b1 %6.3f deg\n",
+		out.U[0] * C_RAD2DEG,
+		out.U[1] * C_RAD2DEG,
+		out.U[2] * C_RAD2DEG,
+		out.U[3] * C_RAD2DEG,
+		out.THETA[0] * C_RAD2DEG,
+		out.THETA[1] * C_RAD2DEG,
+		out.a1 * C_RAD2DEG,
+		out.b1 * C_RAD2DEG
+	);
+
+	if( rc < 0 )
+	{
+		printf( "FAILED: did not converge\n" );
+		return 1;
+	}
+
+	int			failed = 0;
+
+	if( usec > 10000 )
+	{
+		printf( "FAILED: took more than 10 msec\n" );
+		failed++;
+	}
+
+	// The model should stay put with the trim controls
+	const Velocity<Frame::NED>	V0( heli.cg.V );
+
+	for( int i=0 ; i<50 ; i++ )
+		heli.advance( 0.02, out.U );
+
+	double			dV = 0;
+
+	for( int i=0 ; i<3 ; i++ )
+		dV += fabs( heli.cg.V[i] - V0[i] );
+
+	printf( "    velocity change after 1 sec %.3g ft/s\n", dV );
+
+	if( !( dV < 1.0 ) )
+	{
+		printf( "FAILED: model does not hold the trim\n" );
+		failed++;
+	}
+
+	return failed;
+}
+
+
+int
+main( void )
+{
+	int			failed = 0;
+
+	failed += check( 0 );
+	failed += check( 20 );
+	failed += check( 40 );
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
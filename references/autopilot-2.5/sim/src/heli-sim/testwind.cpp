@@ -0,0 +1,285 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Check that the wind model gives the same gusts for a seed however
+ * it is stepped and whichever thread runs it, that the gusts have
+ * the requested RMS, that a change to the inputs is used, and time
+ * it.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include "wind_model.h"
+#include "WorkPool.h"
+#include <timer.h>
+
+using namespace std;
+using namespace sim;
+
+
+static const double	dt	= 0.01;
+static const int	steps	= 1000;
+static const int	seeds	= 8;
+
+
+static void
+setup(
+	wind_inputs_def *	in,
+	wind_state_def *	state,
+	int			seed
+)
+{
+	in->wind_max	= Velocity<Frame::NED>( 5, 5, 2 );
+	in->scale	= Vector<3>( 30, 30, 10 );
+	in->airspeed	= 30;
+	in->seed	= seed;
+
+	wind_init( in, state );
+}
+
+
+/*
+ *  The north gust for each step of a run, one step at a time
+ */
+static void
+run(
+	int			seed,
+	double *		out
+)
+{
+	wind_inputs_def		in;
+	wind_state_def		state;
+
+	setup( &in, &state, seed );
+
+	for( int i=0 ; i<steps ; i++ )
+	{
+		wind_model( &in, &state, dt );
+		out[i] = state.Ve[0];
+	}
+}
+
+
+static double		threaded[seeds][steps];
+
+static void
+run_job(
+	void *			priv,
+	size_t			index,
+	int			worker
+)
+{
+	(void) priv;
+	(void) worker;
+
+	run( index, threaded[index] );
+}
+
+
+/*
+ *  Same gusts stepped one at a time, in uneven batches, and on a
+ * thread pool.  Different seeds must give different gusts.
+ */
+static int
+check_repeat( void )
+{
+	static double		serial[seeds][steps];
+	int			failed = 0;
+
+	for( int s=0 ; s<seeds ; s++ )
+		run( s, serial[s] );
+
+	WorkPool		pool( 4 );
+
+	pool.run( run_job, 0, seeds );
+
+	for( int s=0 ; s<seeds ; s++ )
+	{
+		for( int i=0 ; i<steps ; i++ )
+		{
+			if( threaded[s][i] == serial[s][i] )
+				continue;
+
+			printf( "FAILED: seed %d differs on a thread\n", s );
+			failed++;
+			break;
+		}
+	}
+
+	wind_inputs_def		in;
+	wind_state_def		state;
+	Velocity<Frame::NED>	Ve[steps];
+	int			done = 0;
+
+	setup( &in, &state, 3 );
+
+	for( int n=1 ; done < steps ; n = n * 3 + 1 )
+	{
+		const int		count = min( n, steps - done );
+
+		wind_batch( &in, &state, dt, Ve + done, count );
+		done += count;
+	}
+
+	for( int i=0 ; i<steps ; i++ )
+	{
+		if( Ve[i][0] == serial[3][i] )
+			continue;
+
+		printf( "FAILED: batches differ at step %d\n", i );
+		failed++;
+		break;
+	}
+
+	if( serial[0][steps-1] == serial[1][steps-1] )
+	{
+		printf( "FAILED: seeds 0 and 1 gave the same gusts\n" );
+		failed++;
+	}
+
+	return failed;
+}
+
+
+/*
+ *  The RMS of each axis over a long run should be wind_max,
+ * whatever the step size.
+ */
+static int
+check_rms(
+	double			step_dt
+)
+{
+	wind_inputs_def		in;
+	wind_state_def		state;
+	const int		n = int( 20000 / step_dt );
+	double			sum[3] = { 0, 0, 0 };
+	Velocity<Frame::NED>	Ve[WIND_BATCH];
+
+	setup( &in, &state, 42 );
+
+	for( int i=0 ; i<n ; i+=WIND_BATCH )
+	{
+		wind_batch( &in, &state, step_dt, Ve, WIND_BATCH );
+
+		for( int j=0 ; j<WIND_BATCH ; j++ )
+			for( int k=0 ; k<3 ; k++ )
+				sum[k] += Ve[j][k] * Ve[j][k];
+	}
+
+	int			failed = 0;
+
+	printf( "dt %.3f RMS:", step_dt );
+
+	for( int k=0 ; k<3 ; k++ )
+	{
+		const double		rms = sqrt( sum[k] / n );
+
+		printf( " %.3f / %.1f", rms, in.wind_max[k] );
+
+		if( fabs( rms / in.wind_max[k] - 1 ) > 0.05 )
+			failed++;
+	}
+
+	printf( " ft/s\n" );
+
+	if( failed )
+		printf( "FAILED: RMS is not wind_max\n" );
+
+	return failed;
+}
+
+
+/*
+ *  Changing an input without wind_init() must change the gains.
+ * The filter states do not depend on wind_max, so after the change
+ * the gusts must be the same as a run that had it from the start.
+ */
+static int
+check_inputs( void )
+{
+	wind_inputs_def		in;
+	wind_inputs_def		ref_in;
+	wind_state_def		state;
+	wind_state_def		ref;
+
+	setup( &in, &state, 7 );
+	setup( &ref_in, &ref, 7 );
+
+	ref_in.wind_max = Velocity<Frame::NED>( 10, 10, 4 );
+
+	for( int i=0 ; i<steps ; i++ )
+	{
+		if( i == steps / 2 )
+			in.wind_max = ref_in.wind_max;
+
+		wind_model( &in, &state, dt );
+		wind_model( &ref_in, &ref, dt );
+	}
+
+	for( int k=0 ; k<3 ; k++ )
+	{
+		if( state.Ve[k] == ref.Ve[k] )
+			continue;
+
+		printf( "FAILED: a new wind_max was not used\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+int
+main( void )
+{
+	int			failed = 0;
+
+	failed += check_repeat();
+	failed += check_rms( 0.01 );
+	failed += check_rms( 0.05 );
+	failed += check_inputs();
+
+	wind_inputs_def		in;
+	wind_state_def		state;
+	stopwatch_t		timer;
+	const int		times = 1000000;
+
+	setup( &in, &state, 1 );
+
+	start( &timer );
+	for( int i=0 ; i<times ; i++ )
+		wind_model( &in, &state, dt );
+	const unsigned long	usec = stop( &timer );
+
+	printf( "wind_model: %.1f nsec per step\n", usec * 1000.0 / times );
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
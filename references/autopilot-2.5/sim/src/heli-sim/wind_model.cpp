@@ -4,18 +4,19 @@
  * (c) Aaron Kahn
  * (c) Trammell Hudson
  *
- * This is a basic wind/gust model.  It is a dynamic system that will
- * generate random winds, up to a maximum value, in both vertical and
- * horizontal directions.
+ * This is a Dryden turbulence model.  See wind_model.h for how it
+ * works and wind_inputs_def for the parameters.
  *
- * To make this model work, like the servo and 6-DOF models, it is
- * propogated over time for the dynamics.
+ * The north axis is the first order Dryden form and the east and down
+ * axes the second order one,
  *
- * See the structures for information
+ *	Hu(s) = 1 / (1 + tau s)
+ *	Hv(s) = (1 + sqrt(3) tau s) / (1 + tau s)^2
  *
- * There are two functions.  The first, wind_init is used to initalize
- * the wind model.  The second, wind, is used to propograte the state
- * of the wind model.
+ * with tau = scale / airspeed.  Each is built from two first order
+ * lags with the pole a = exp(-dt / tau), and the output is scaled by
+ * the exact stationary variance of that discrete filter so that the
+ * RMS gust is wind_max for any dt.
  *
  *************
  *
@@ -43,12 +44,11 @@
 
 #include <cstdio>
 #include <cstdlib>
-#include <cstring>
 #include <cmath>
 
 #include "wind_model.h"
 #include "macros.h"
-#include <mat/rk4.h>
+#include <mat/Random.h>
 
 namespace sim
 {
@@ -58,44 +58,138 @@ using namespace util;
 
 void
 wind_init(
-	wind_inputs_def *	pIn,
+	wind_inputs_def *	UNUSED( pIn ),
 	wind_state_def *	pX
 )
 {
 	int			i;
 
 	for( i=0 ; i < 3 ; i++ )
+	{
 		pX->Ve[i] = 0;
-	for( i=0 ; i < 6 ; i++ )
-		pX->X[i] = 0;
+		pX->X[i][0] = 0;
+		pX->X[i][1] = 0;
+	}
+
+	/* The coefficients are computed on the first step */
+	for( i=0 ; i < 8 ; i++ )
+		pX->key[i] = 0;
 
-	srand( pIn->seed );		/* seed the random number generator */
+	/* Start the stream and draw the first block on the first step */
+	pX->counter = (uint64_t) -( 3 * WIND_BATCH );
+	pX->next = 3 * WIND_BATCH;
 }
 
 
+/*
+ *  Pole and output weights for each axis at this dt.  x1 is white
+ * noise through the lag and x2 is x1 through it again; the second
+ * order axes output x2 + sqrt(3) * tau * x2', which is
+ * sqrt(3) * x1 + (1 - sqrt(3)) * x2.
+ */
 static void
-wind_derivs(
-	Vector<6> &		Xdot,
-	const Vector<6> &	X,
-	const double 		UNUSED( t ),
-	const Vector<3> &	u,
-	const Vector<2> &	args
+wind_coefficients(
+	const wind_inputs_def *	pIn,
+	wind_state_def *	pX,
+	double			dt
 )
 {
-	double			wn	= args[0];
-	double			zeta	= args[1];
-
-	/* Vn component */
-	Xdot[0] = X[1];
-	Xdot[1] = -2.0*zeta*wn*X[1] - wn*wn*X[0] + u[0];
+	for( int i=0 ; i < 3 ; i++ )
+	{
+		const double		tau = pIn->scale[i] / pIn->airspeed;
+		const double		a = exp( -dt / tau );
+		const double		c1 = i == 0 ? 1.0 : sqrt( 3.0 );
+		const double		c2 = i == 0 ? 0.0 : 1.0 - sqrt( 3.0 );
+
+		/*
+		 * Stationary covariance of (x1,x2) with unit noise, from
+		 * x1 = a x1 + (1-a) n, x2 = a x2 + (1-a) x1
+		 */
+		const double		s11 = ( 1 - a ) / ( 1 + a );
+		const double		s12 = a * s11 / ( 1 + a );
+		const double		s22 =
+			( 2 * a * s12 + ( 1 - a ) * s11 ) / ( 1 + a );
+
+		const double		var =
+			c1 * c1 * s11 + 2 * c1 * c2 * s12 + c2 * c2 * s22;
+
+		// With no airspeed the filter is frozen at zero
+		const double		gain = var > 0
+			? pIn->wind_max[i] / sqrt( var )
+			: 0;
+
+		pX->a[i]	= a;
+		pX->c[i][0]	= c1 * gain;
+		pX->c[i][1]	= c2 * gain;
+	}
+}
 
-	/* Ve component */
-	Xdot[2] = X[3];
-	Xdot[3] = -2.0*zeta*wn*X[3] - wn*wn*X[2] + u[1];
 
-	/* Vd component */
-	Xdot[4] = X[5];
-	Xdot[5] = -2.0*zeta*wn*X[5] - wn*wn*X[4] + u[2];
+void
+wind_batch(
+	wind_inputs_def *	pIn,
+	wind_state_def *	pX,
+	double			dt,
+	Velocity<Frame::NED> *	Ve,
+	int			steps
+)
+{
+	double *		key = pX->key;
+
+	if( key[7] != dt
+	||  key[6] != pIn->airspeed
+	||  key[0] != pIn->wind_max[0]
+	||  key[1] != pIn->wind_max[1]
+	||  key[2] != pIn->wind_max[2]
+	||  key[3] != pIn->scale[0]
+	||  key[4] != pIn->scale[1]
+	||  key[5] != pIn->scale[2]
+	) {
+		key[0] = pIn->wind_max[0];
+		key[1] = pIn->wind_max[1];
+		key[2] = pIn->wind_max[2];
+		key[3] = pIn->scale[0];
+		key[4] = pIn->scale[1];
+		key[5] = pIn->scale[2];
+		key[6] = pIn->airspeed;
+		key[7] = dt;
+
+		wind_coefficients( pIn, pX, dt );
+	}
+
+	for( int step=0 ; step < steps ; step++ )
+	{
+		if( pX->next == 3 * WIND_BATCH )
+		{
+			pX->counter += 3 * WIND_BATCH;
+			pX->next = 0;
+
+			random_normals(
+				pIn->seed,
+				pX->counter,
+				pX->noise,
+				3 * WIND_BATCH
+			);
+		}
+
+		const double *		n = &pX->noise[ pX->next ];
+
+		pX->next += 3;
+
+		for( int i=0 ; i < 3 ; i++ )
+		{
+			const double		a = pX->a[i];
+			double *		X = pX->X[i];
+
+			X[1] = a * X[1] + ( 1 - a ) * X[0];
+			X[0] = a * X[0] + ( 1 - a ) * n[i];
+
+			pX->Ve[i] = pX->c[i][0] * X[0] + pX->c[i][1] * X[1];
+		}
+
+		if( Ve )
+			Ve[step] = pX->Ve;
+	}
 }
 
 
@@ -106,23 +200,7 @@ wind_model(
 	double			dt
 )
 {
-	Vector<2>		args;
-	args[0]		= 1.5;
-	args[1]		= 0.00005;
-
-	const Vector<3>		U(
- 		10.0 * ((double)(rand())/( (double)(RAND_MAX)/2.0) - 1.0),
- 		10.0 * ((double)(rand())/( (double)(RAND_MAX)/2.0) - 1.0),
- 		10.0 * ((double)(rand())/( (double)(RAND_MAX)/2.0) - 1.0)
-	);
-
-	Vector<6>		Xdot;
-
-	RK4( pX->X, Xdot, 0, U, args, dt, &wind_derivs );
-
-	pX->Ve[0] = pX->X[0] * sqr(args[0]) * pIn->wind_max[0];
-	pX->Ve[1] = pX->X[2] * sqr(args[0]) * pIn->wind_max[1];
-	pX->Ve[2] = pX->X[4] * sqr(args[0]) * pIn->wind_max[2];
+	wind_batch( pIn, pX, dt, 0, 1 );
 }
 
 }
@@ -4,17 +4,29 @@
  * (c) Aaron Kahn
  * (c) Trammell Hudson
  *
- * This is a basic wind/gust model.
+ * This is a Dryden turbulence model.
  *
- * It is a dynamic system that will generate random winds, up to a
- * maximum value, in both vertical and horizontal directions.
+ * Each NED axis is white noise through a shaping filter with the
+ * Dryden spectrum: first order for the north (along wind) axis and
+ * second order for the east and down axes.  The filters are stepped
+ * in discrete time and scaled so that each axis has the requested
+ * RMS gust for any dt.
  *
- * To make this model work, like the servo and 6-DOF models, it is
- * propogated over time for the dynamics.
+ * The noise comes from the counter based generator in mat/Random.h,
+ * keyed by the seed.  Draws are made in blocks of WIND_BATCH steps
+ * and kept in the state, so each model has its own stream and the
+ * same seed gives the same gusts in any thread, and after a
+ * save()/restore() of the state.
  *
- * There are two functions.  The first, wind_init is used to initalize
- * the wind model. The second, wind_model, is used to propograte the
- * state of the wind model.
+ * wind_init() initializes the model and wind_model() propagates it
+ * by one step.  wind_batch() propagates it several steps at once.
+ *
+ * Only the noise is made in blocks.  The hashes for a block vectorize,
+ * but the Box-Muller libm calls do not, and they are most of the
+ * cost.  Each shaping filter is a recurrence in time, so wind_batch()
+ * steps it one sample at a time exactly like wind_model(); it saves
+ * the calls, not the arithmetic.  Heli and HeliBatch call
+ * wind_model() once per step.
  *
  *************
  *
@@ -53,12 +65,21 @@ namespace sim
 
 using namespace libmat;
 
+/* Steps of noise drawn at once */
+#define WIND_BATCH	64
+
 typedef struct
 {
-	/* maximum wind vector */
+	/* RMS gust in each NED axis (ft/s) */
 	Velocity<Frame::NED>	wind_max;
 
-	/* seed variable for the random number generator */
+	/* turbulence scale length in each NED axis (ft) */
+	Vector<3>		scale;
+
+	/* airspeed that the scale lengths are flown through (ft/s) */
+	double			airspeed;
+
+	/* key for the random number generator */
 	int			seed;
 } wind_inputs_def;
 
@@ -68,8 +89,23 @@ typedef struct
 	/* components of wind in earth TP frame [Vn Ve Vd] (ft/s) */
 	Velocity<Frame::NED>	Ve;
 
-	/* internal state */
-	Vector<6>		X;
+	/* two filter states for each axis */
+	double			X[3][2];
+
+	/*
+	 * filter pole and output weights, and the dt and inputs that
+	 * they were computed for: wind_max, scale, airspeed and dt.
+	 * They are recomputed on any step where one of those differs,
+	 * which with a variable step integrator is every step.
+	 */
+	double			key[8];
+	double			a[3];
+	double			c[3][2];
+
+	/* noise for the next steps, from draw number counter on */
+	double			noise[3 * WIND_BATCH];
+	uint64_t		counter;
+	int			next;
 } wind_state_def;
 
 
@@ -87,6 +123,20 @@ wind_model(
 	double			dt
 );
 
+
+/*
+ *  steps calls to wind_model(), with the wind after each one in
+ * Ve[0] to Ve[steps-1].  pX->Ve is left at the last one.
+ */
+extern void
+wind_batch(
+	wind_inputs_def *	pIn,
+	wind_state_def *	pX,
+	double			dt,
+	Velocity<Frame::NED> *	Ve,
+	int			steps
+);
+
 }
 
 #endif
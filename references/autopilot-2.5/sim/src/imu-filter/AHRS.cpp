@@ -0,0 +1,420 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ *  $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * AHRS based on Kalman filtering of the gyro and accelerometer data.
+ *
+ * The implementation of AHRS.h is not part of this tree, and every
+ * program that links libimu-filter needs one since IMU_filter holds
+ * an AHRS.  This one is written here, not converted from the
+ * original: the state is the attitude quaternion and the gyro bias,
+ * which is the attitude half of the INS, so it takes the INS A matrix
+ * rows and its attitude and compass measurements, with the tuning of
+ * onboard/rev2/ahrs.c.
+ *
+ **************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <AHRS.h>
+
+#include <mat/Vector.h>
+#include <mat/Matrix.h>
+#include <mat/Matrix_Sparse.h>
+#include <mat/Quat.h>
+#include <mat/Nav.h>
+#include <mat/Conversions.h>
+#include <mat/Kalman.h>
+
+#include <cmath>
+
+#include "macros.h"
+
+namespace imufilter
+{
+
+using namespace util;
+using namespace libmat;
+using namespace std;
+
+
+template<
+	class			T
+>
+AHRSFilter<T>::AHRSFilter(
+	double			dt
+) :
+	dt( dt )
+{
+	this->reset();
+}
+
+
+template<
+	class			T
+>
+void
+AHRSFilter<T>::reset()
+{
+	this->trace		= 0;
+	this->P.fill();
+
+	for( int i=0 ; i<N ; i++ )
+		this->P[i][i]	= 1;
+
+	Matrix<N,N,T> &		Q( this->Q );
+
+	Q.fill();
+
+	// Quaterion attitude estimate noise
+	Q[0][0] = 0.0001;
+	Q[1][1] = 0.0001;
+	Q[2][2] = 0.0001;
+	Q[3][3] = 0.0001;
+
+	// Gyro bias
+	Q[4][4] = 0.03;
+	Q[5][5] = 0.03;
+	Q[6][6] = 0.03;
+
+	this->R_attitude.fill();
+	this->R_attitude[0][0] = 0.3;	// phi
+	this->R_attitude[1][1] = 0.3;	// theta
+
+	this->R_heading[0][0] = 0.5;	// psi
+
+	this->state.q		= Vector<4,T>( 1, 0, 0, 0 );
+	this->state.bias.fill();
+}
+
+
+/**
+ *  We assume that the vehicle is still during the first sample
+ * and use the values to help us determine the zero point for the
+ * gyro bias and accelerometers.
+ */
+template<
+	class			T
+>
+void
+AHRSFilter<T>::initialize(
+	const Vector<3,T> &	accel,
+	const Vector<3,T> &	pqr,
+	T			heading
+)
+{
+	this->state.q		= euler2quat( accel2euler( accel, heading ) );
+	this->state.bias	= pqr;
+
+	this->accel		= accel;
+	this->bias		= pqr;
+	this->pqr.fill();
+
+	// Give the user an estimate of our orientation
+	this->theta		= quat2euler( this->state.q );
+}
+
+
+/*
+ *  The quaternion rows of the INS A matrix: Q by Q and Q by the
+ * gyro bias.  The bias rows are all zero.
+ */
+template<
+	class			T
+>
+void
+AHRSFilter<T>::make_a_matrix(
+	Matrix<N,N,T> &		A,
+	const Vector<3,T> &	pqr
+) const
+{
+	const Matrix<4,4,T>	Wxq( quatW( pqr ) );
+
+	const T			q0 = this->state.q[0];
+	const T			q1 = this->state.q[1];
+	const T			q2 = this->state.q[2];
+	const T			q3 = this->state.q[3];
+
+	A.fill();
+
+	for( int i=0 ; i<4 ; i++ )
+		for( int j=0 ; j<4 ; j++ )
+			A[i][j] = Wxq[i][j];
+
+	A[0][4] =  q1;		// dq0 / d(phi bias)
+	A[0][5] =  q2;		// dq0 / d(theta bias)
+	A[0][6] =  q3;		// dq0 / d(psi bias)
+
+	A[1][4] = -q0;		// dq1 / d(phi bias)
+	A[1][5] =  q3;		// dq1 / d(theta bias)
+	A[1][6] = -q2;		// dq1 / d(psi bias)
+
+	A[2][4] = -q3;		// dq2 / d(phi bias)
+	A[2][5] = -q0;		// dq2 / d(theta bias)
+	A[2][6] =  q1;		// dq2 / d(psi bias)
+
+	A[3][4] =  q2;		// dq3 / d(phi bias)
+	A[3][5] = -q1;		// dq3 / d(theta bias)
+	A[3][6] = -q0;		// dq3 / d(psi bias)
+}
+
+
+template<
+	class			T
+>
+void
+AHRSFilter<T>::propagate_state(
+	const Vector<3,T> &	pqr
+)
+{
+	const Vector<4,T>	Qdot( quatW( pqr ) * this->state.q );
+
+	this->state.q += Qdot * this->dt;
+	this->state.q.norm_self();
+}
+
+
+/*
+ *  P += ( A*P + P*A' + Q ) * dt, filling in the upper triangle and
+ * mirroring it, the same as the INS.
+ */
+template<
+	class			T
+>
+void
+AHRSFilter<T>::propagate_covariance(
+	const Matrix<N,N,T> &	A
+)
+{
+	const Matrix<N,N,T>	AP( A * this->P );
+
+	propagate_symmetric( this->P, AP, this->Q, this->dt );
+
+	this->trace = 0;
+
+	for( int i=0 ; i<N ; i++ )
+		this->trace += this->P[i][i];
+}
+
+
+template<
+	class			T
+>
+template<
+	int			m
+>
+void
+AHRSFilter<T>::do_kalman(
+	const Matrix<m,N,T> &	C,
+	const Matrix<m,m,T> &	R,
+	const Vector<m,T> &	eTHETA
+)
+{
+	// Serialize the state for Kalman_sequential() and extract it
+	// afterwards
+	Vector<N,T>		X_vect;
+
+	X_vect[0]	= this->state.q[0];
+	X_vect[1]	= this->state.q[1];
+	X_vect[2]	= this->state.q[2];
+	X_vect[3]	= this->state.q[3];
+
+	X_vect[4]	= this->state.bias[0];
+	X_vect[5]	= this->state.bias[1];
+	X_vect[6]	= this->state.bias[2];
+
+	// R is diagonal; the Joseph form keeps P positive definite
+	Kalman_sequential(
+		this->P,
+		X_vect,
+		C,
+		R,
+		eTHETA
+	);
+
+	this->state.q[0]	= X_vect[0];
+	this->state.q[1]	= X_vect[1];
+	this->state.q[2]	= X_vect[2];
+	this->state.q[3]	= X_vect[3];
+
+	this->state.bias[0]	= X_vect[4];
+	this->state.bias[1]	= X_vect[5];
+	this->state.bias[2]	= X_vect[6];
+
+	this->state.q.norm_self();
+}
+
+
+template<
+	class			T
+>
+void
+AHRSFilter<T>::kalman_attitude_update(
+	const Vector<3,T> &	accel,
+	const Matrix<3,3,T> &	DCM,
+	const Vector<3,T> &	THETAe
+)
+{
+	T			err;
+	const T			q0 = this->state.q[0];
+	const T			q1 = this->state.q[1];
+	const T			q2 = this->state.q[2];
+	const T			q3 = this->state.q[3];
+
+	const T			DCM_0_2( DCM[0][2] );
+	const T			DCM_1_2( DCM[1][2] );
+	const T			DCM_2_2( DCM[2][2] );
+
+	// compute the euler angles from the accelerometers
+	const Vector<3,T>	THETAm( accel2euler( accel, THETAe[2] ) );
+
+	// make the C matrix
+	Matrix<2,N,T>		C;
+
+	// PHI section
+	err = 2.0 / ( sqr(DCM_2_2) + sqr(DCM_1_2) );
+
+	C[0][0] = err * ( q1 * DCM_2_2 );
+	C[0][1] = err * ( q0 * DCM_2_2 + 2.0 * q1 * DCM_1_2 );
+	C[0][2] = err * ( q3 * DCM_2_2 + 2.0 * q2 * DCM_1_2 );
+	C[0][3] = err * ( q2 * DCM_2_2 );
+
+	// THETA section
+	err = -1.0 / sqrt(1.0 - sqr(DCM_0_2) );
+
+	C[1][0] = -2.0 * q2 * err;
+	C[1][1] =  2.0 * q3 * err;
+	C[1][2] = -2.0 * q0 * err;
+	C[1][3] =  2.0 * q1 * err;
+
+	// Only the pitch and roll angles can be measured here
+	Vector<2,T>		eTHETA;
+	eTHETA[0] = THETAm[0] - THETAe[0];
+	eTHETA[1] = THETAm[1] - THETAe[1];
+
+	this->do_kalman(
+		C,
+		this->R_attitude,
+		eTHETA
+	);
+}
+
+
+template<
+	class			T
+>
+void
+AHRSFilter<T>::kalman_compass_update(
+	T			heading,
+	const Matrix<3,3,T> &	DCM,
+	const Vector<3,T> &	THETAe
+)
+{
+	const T			DCM_0_0( DCM[0][0] );
+	const T			DCM_0_1( DCM[0][1] );
+
+	const T			q0 = this->state.q[0];
+	const T			q1 = this->state.q[1];
+	const T			q2 = this->state.q[2];
+	const T			q3 = this->state.q[3];
+
+	Matrix<1,N,T>		C( 0 );
+
+	// PSI section
+	const T			err = 2 / (sqr(DCM_0_0) + sqr(DCM_0_1));
+
+	C[0][0] = err * ( q3 * DCM_0_0 );
+	C[0][1] = err * ( q2 * DCM_0_0 );
+	C[0][2] = err * ( q1 * DCM_0_0 + 2.0 * q2 * DCM_0_1 );
+	C[0][3] = err * ( q0 * DCM_0_0 + 2.0 * q3 * DCM_0_1 );
+
+	// The shortest way around the compass to the current heading
+	Vector<1,T>		eTHETA;
+
+	eTHETA[0] = heading - THETAe[2];
+	if( eTHETA[0] > C_PI )
+		eTHETA[0] -= 2.0 * C_PI;
+	else
+	if( eTHETA[0] < -C_PI )
+		eTHETA[0] += 2.0 * C_PI;
+
+	this->do_kalman(
+		C,
+		this->R_heading,
+		eTHETA
+	);
+}
+
+
+template<
+	class			T
+>
+void
+AHRSFilter<T>::imu_update(
+	const Vector<3,T> &	accel,
+	const Vector<3,T> &	pqr_raw
+)
+{
+	const Vector<3,T>	pqr_measured( pqr_raw - this->state.bias );
+	Matrix<N,N,T>		A;
+
+	this->make_a_matrix( A, pqr_measured );
+	this->propagate_state( pqr_measured );
+	this->propagate_covariance( A );
+
+	this->kalman_attitude_update(
+		accel,
+		quatDC( this->state.q ),
+		quat2euler( this->state.q )
+	);
+
+	this->theta	= quat2euler( this->state.q );
+	this->accel	= accel;
+	this->bias	= this->state.bias;
+	this->pqr	= pqr_raw - this->bias;
+}
+
+
+template<
+	class			T
+>
+void
+AHRSFilter<T>::compass_update(
+	T			heading
+)
+{
+	this->kalman_compass_update(
+		heading,
+		quatDC( this->state.q ),
+		this->theta
+	);
+
+	this->theta	= quat2euler( this->state.q );
+	this->bias	= this->state.bias;
+}
+
+
+/*
+ *  Both precisions are built into the library
+ */
+template class AHRSFilter<float>;
+template class AHRSFilter<double>;
+
+}
@@ -38,10 +38,17 @@ namespace imufilter
 
 using namespace libmat;
 
-class AHRS
+/*
+ *  T is the precision of the whole filter, as with INSFilter.  AHRS
+ * is the usual double version.
+ */
+template<
+	class			T = double
+>
+class AHRSFilter
 {
 public:
-	AHRS(
+	AHRSFilter(
 		double			dt = 32768.0 / 1000000.0
 	);
 
@@ -50,63 +57,63 @@ public:
 
 	void
 	initialize(
-		const Vector<3> &	accel,
-		const Vector<3> &	pqr,
-		double			heading
+		const Vector<3,T> &	accel,
+		const Vector<3,T> &	pqr,
+		T			heading
 	);
 
 
 	void
 	imu_update(
-		const Vector<3> &	accel,
-		const Vector<3> &	pqr
+		const Vector<3,T> &	accel,
+		const Vector<3,T> &	pqr
 	);
 
 
 	void
 	compass_update(
-		double			heading
+		T			heading
 	);
 
 
-	Vector<3>		accel;
-	Vector<3>		theta;
-	Vector<3>		pqr;
-	Vector<3>		bias;
+	Vector<3,T>		accel;
+	Vector<3,T>		theta;
+	Vector<3,T>		pqr;
+	Vector<3,T>		bias;
 
-	const double		dt;
-	double			trace;
+	const T			dt;
+	T			trace;
 
 	static const int	N = 7;
 
 	// Covariance matrix
-	Matrix<N,N>		P;
+	Matrix<N,N,T>		P;
 
 private:
 
 	void make_a_matrix(
-		Matrix<N,N> &		A,
-		const Vector<3> &	pqr
+		Matrix<N,N,T> &		A,
+		const Vector<3,T> &	pqr
 	) const;
 
 	void propagate_state(
-		const Vector<3> &	pqr
+		const Vector<3,T> &	pqr
 	);
 
 	void propagate_covariance(
-		const Matrix<N,N> &	A
+		const Matrix<N,N,T> &	A
 	);
 
 	void kalman_attitude_update(
-		const Vector<3> &	accel,
-		const Matrix<3,3> &	DCM,
-		const Vector<3> &	THETAe
+		const Vector<3,T> &	accel,
+		const Matrix<3,3,T> &	DCM,
+		const Vector<3,T> &	THETAe
 	);
 
 	void kalman_compass_update(
-		double			heading,
-		const Matrix<3,3> &	DCM,
-		const Vector<3> &	THETAe
+		T			heading,
+		const Matrix<3,3,T> &	DCM,
+		const Vector<3,T> &	THETAe
 	);
 
 
@@ -118,22 +125,22 @@ private:
 	{
 	public:
 		// Quaternion state estimate
-		Vector<4>		q;
+		Vector<4,T>		q;
 
 		// Gyro bias estimate
-		Vector<3>		bias;
+		Vector<3,T>		bias;
 	};
 
 	state_t 		state;
 
 	// Noise estimate
-	Matrix<N,N>		Q;
+	Matrix<N,N,T>		Q;
 
 	// State estimate for attitude
-	Matrix<2,2>		R_attitude;
+	Matrix<2,2,T>		R_attitude;
 
 	// State estimate for heading
-	Matrix<1,1>		R_heading;
+	Matrix<1,1,T>		R_heading;
 
 
 	// Wrapper to serialize our state and jump into the kalman filter
@@ -142,12 +149,15 @@ private:
 	>
 	void
 	do_kalman(
-		const Matrix<m,N> &	C,
-		const Matrix<m,m> &	R,
-		const Vector<m> &	eTHETA
+		const Matrix<m,N,T> &	C,
+		const Matrix<m,m,T> &	R,
+		const Vector<m,T> &	eTHETA
 	);
 
 };
 
+
+typedef AHRSFilter<double>	AHRS;
+
 }
 #endif
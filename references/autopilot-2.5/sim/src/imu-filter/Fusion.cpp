@@ -0,0 +1,403 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Multi-rate scheduler for the INS.  See Fusion.h.
+ *
+ **************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <imu-filter/Fusion.h>
+#include <mat/Quat.h>
+
+namespace imufilter
+{
+
+using namespace libmat;
+using namespace std;
+
+
+template<
+	class			T
+>
+FusionFilter<T>::FusionFilter(
+	double			cov_dt,
+	int			snapshots
+) :
+	now			( 0 ),
+	late			( 0 ),
+	dropped			( 0 ),
+	replayed		( 0 ),
+	cov_dt			( cov_dt ),
+	cov_time		( 0 ),
+	imu_count		( 0 ),
+	imu_base		( 0 ),
+	history			( snapshots ),
+	head			( 0 ),
+	count			( 0 )
+{
+}
+
+
+template<
+	class			T
+>
+void
+FusionFilter<T>::initialize(
+	double			t,
+	const Vector<3,T> &	ned,
+	const Vector<3,T> &	uvw,
+	const Vector<3,T> &	accel,
+	const Vector<3,T> &	pqr,
+	T			heading
+)
+{
+	this->ins.reset();
+	this->ins.initialize( ned, uvw, accel, pqr, heading );
+
+	this->now		= t;
+	this->cov_time		= 0;
+	this->last.t		= t;
+	this->last.accel	= accel;
+	this->last.pqr		= pqr;
+
+	this->imu_count		= 0;
+	this->imu_base		= 0;
+	this->imu.clear();
+	this->queue.clear();
+
+	this->head		= 0;
+	this->count		= 0;
+	this->save();
+}
+
+
+/*
+ *  Move the state to the sample and run the covariance if it is due.
+ * A measurement that was taken between the last sample and this one
+ * is applied at its own time: the state is moved to it with this
+ * sample's rates, it is fused, and then the rest of the way.
+ */
+template<
+	class			T
+>
+void
+FusionFilter<T>::step(
+	const imu_sample_t &	s
+)
+{
+	const double		prev = this->now;
+
+	this->last		= s;
+	this->imu_count++;
+
+	for( typename queue_t::const_iterator i = this->queue.upper_bound( prev ) ;
+		i != this->queue.end() && i->first <= s.t ;
+		i++
+	) {
+		this->advance( i->first );
+		this->fuse( i->second );
+	}
+
+	this->advance( s.t );
+
+	if( this->cov_time < this->cov_dt )
+		return;
+
+	this->ins.covariance_update( s.pqr, this->cov_time );
+	this->ins.attitude_update( s.accel );
+	this->cov_time = 0;
+
+	this->save();
+}
+
+
+/*
+ *  Propagate the state to t with the rates of the newest sample
+ */
+template<
+	class			T
+>
+void
+FusionFilter<T>::advance(
+	double			t
+)
+{
+	const T			dt = t - this->now;
+
+	if( !( dt > 0 ) )
+		return;
+
+	this->ins.propagate( this->last.accel, this->last.pqr, dt );
+
+	this->now		= t;
+	this->cov_time		+= dt;
+}
+
+
+/*
+ *  P has to be brought up to the time of the measurement before
+ * the gain is computed.  A velocity in the NED frame is turned into
+ * the body frame with the attitude as of the measurement, which
+ * after a rewind is the replayed one.
+ */
+template<
+	class			T
+>
+void
+FusionFilter<T>::fuse(
+	const measurement_t &	m
+)
+{
+	if( this->cov_time > 0 )
+	{
+		this->ins.covariance_update( this->last.pqr, this->cov_time );
+		this->cov_time = 0;
+	}
+
+	if( m.type == COMPASS )
+		this->ins.compass_update( m.heading );
+	else
+	if( m.type == GPS_NED )
+		this->ins.gps_update( m.ned, quatDC( this->ins.q ) * m.uvw );
+	else
+	if( m.type == GPS_POSITION )
+		this->ins.gps_position_update( m.ned );
+	else
+		this->ins.gps_update( m.ned, m.uvw );
+}
+
+
+/*
+ *  Add a copy of the filter to the ring, pushing out the oldest
+ * when it is full, and forget the IMU samples and measurements
+ * that are already part of the oldest copy.
+ */
+template<
+	class			T
+>
+void
+FusionFilter<T>::save()
+{
+	const int		size = this->history.size();
+
+	if( this->count == size )
+	{
+		this->head = ( this->head + 1 ) % size;
+		this->count--;
+	}
+
+	snapshot_t &		s = this->snapshot( this->count++ );
+
+	s.ins		= this->ins;
+	s.now		= this->now;
+	s.cov_time	= this->cov_time;
+	s.last		= this->last;
+	s.imu_count	= this->imu_count;
+
+	const snapshot_t &	oldest = this->snapshot( 0 );
+
+	while( this->imu_base < oldest.imu_count )
+	{
+		this->imu.pop_front();
+		this->imu_base++;
+	}
+
+	this->queue.erase(
+		this->queue.begin(),
+		this->queue.upper_bound( oldest.now )
+	);
+}
+
+
+/*
+ *  Go back to the newest copy from before t and replay the IMU
+ * samples since then.  The replay makes new copies as it goes, so
+ * the ones after it are thrown away.
+ */
+template<
+	class			T
+>
+void
+FusionFilter<T>::rewind(
+	double			t
+)
+{
+	int			n = this->count;
+
+	while( n > 1 && this->snapshot( n - 1 ).now >= t )
+		n--;
+
+	const snapshot_t &	s = this->snapshot( n - 1 );
+	const unsigned long	end = this->imu_count;
+
+	this->ins		= s.ins;
+	this->now		= s.now;
+	this->cov_time		= s.cov_time;
+	this->last		= s.last;
+	this->imu_count		= s.imu_count;
+	this->count		= n;
+
+	while( this->imu_count < end )
+	{
+		this->step( this->imu[ this->imu_count - this->imu_base ] );
+		this->replayed++;
+	}
+}
+
+
+template<
+	class			T
+>
+int
+FusionFilter<T>::add(
+	double			t,
+	const measurement_t &	m
+)
+{
+	if( this->count == 0 || t <= this->snapshot( 0 ).now )
+	{
+		this->dropped++;
+		return -1;
+	}
+
+	this->queue.insert( typename queue_t::value_type( t, m ) );
+
+	// The IMU has not got there yet, so step() will apply it
+	if( t > this->now )
+		return 0;
+
+	this->late++;
+	this->rewind( t );
+
+	return 0;
+}
+
+
+template<
+	class			T
+>
+int
+FusionFilter<T>::imu_update(
+	double			t,
+	const Vector<3,T> &	accel,
+	const Vector<3,T> &	pqr
+)
+{
+	if( this->count == 0 || !( t > this->now ) )
+		return -1;
+
+	imu_sample_t		s;
+
+	s.t		= t;
+	s.accel		= accel;
+	s.pqr		= pqr;
+
+	this->imu.push_back( s );
+	this->step( s );
+
+	return 0;
+}
+
+
+template<
+	class			T
+>
+int
+FusionFilter<T>::compass_update(
+	double			t,
+	T			heading
+)
+{
+	measurement_t		m;
+
+	m.type		= COMPASS;
+	m.heading	= heading;
+
+	return this->add( t, m );
+}
+
+
+template<
+	class			T
+>
+int
+FusionFilter<T>::gps_update(
+	double			t,
+	const Vector<3,T> &	ned,
+	const Vector<3,T> &	uvw
+)
+{
+	measurement_t		m;
+
+	m.type		= GPS;
+	m.ned		= ned;
+	m.uvw		= uvw;
+
+	return this->add( t, m );
+}
+
+
+template<
+	class			T
+>
+int
+FusionFilter<T>::gps_ned_update(
+	double			t,
+	const Vector<3,T> &	ned,
+	const Vector<3,T> &	v_ned
+)
+{
+	measurement_t		m;
+
+	m.type		= GPS_NED;
+	m.ned		= ned;
+	m.uvw		= v_ned;
+
+	return this->add( t, m );
+}
+
+
+template<
+	class			T
+>
+int
+FusionFilter<T>::gps_position_update(
+	double			t,
+	const Vector<3,T> &	ned
+)
+{
+	measurement_t		m;
+
+	m.type		= GPS_POSITION;
+	m.ned		= ned;
+
+	return this->add( t, m );
+}
+
+
+/*
+ *  Both precisions are built into the library
+ */
+template class FusionFilter<float>;
+template class FusionFilter<double>;
+
+}
@@ -0,0 +1,239 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Multi-rate scheduler for the INS.
+ *
+ * Every sample is stamped with the time it was measured, not the
+ * time that it arrived.  Each IMU sample moves the state forward at
+ * once, so the estimate is never more than one IMU sample old.  The
+ * covariance and the accelerometer attitude correction only run
+ * every cov_dt seconds, so a faster IMU costs one propagate() per
+ * sample rather than a 14x14 A*P.
+ *
+ * A copy of the filter is kept at each covariance step, along with
+ * the IMU samples since the oldest copy.  A GPS fix or heading that
+ * arrives after IMU samples newer than it goes into the measurement
+ * queue.  The filter is then put back to the newest copy from before
+ * the fix and the IMU samples are replayed.  The fix is applied at
+ * its own time on the way: the IMU sample after it is split at the
+ * time of the fix.  A measurement from the future waits in
+ * the queue until the IMU catches up with it.  Anything older than
+ * the oldest copy is dropped.
+ *
+ * A late fix gives exactly the same estimate as the same fix on time.
+ *
+ **************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _FUSION_H_
+#define _FUSION_H_
+
+#include <imu-filter/INS.h>
+#include <mat/Vector.h>
+#include <deque>
+#include <vector>
+#include <map>
+
+namespace imufilter
+{
+
+using namespace libmat;
+
+template<
+	class			T = double
+>
+class FusionFilter
+{
+public:
+	/*
+	 *  cov_dt is the covariance period in seconds.  The history
+	 * reaches back snapshots * cov_dt seconds, which must be longer
+	 * than the worst GPS latency.
+	 */
+	FusionFilter(
+		double			cov_dt		= 0.02,
+		int			snapshots	= 64
+	);
+
+	void
+	initialize(
+		double			t,
+		const Vector<3,T> &	ned,
+		const Vector<3,T> &	uvw,
+		const Vector<3,T> &	accel,
+		const Vector<3,T> &	pqr,
+		T			heading
+	);
+
+	/*
+	 *  These return 0 if the sample was used and -1 if it was not:
+	 * an IMU sample that is not newer than the last one, a
+	 * measurement older than the history, or anything before
+	 * initialize().
+	 */
+	int
+	imu_update(
+		double			t,
+		const Vector<3,T> &	accel,
+		const Vector<3,T> &	pqr
+	);
+
+	int
+	compass_update(
+		double			t,
+		T			heading
+	);
+
+	int
+	gps_update(
+		double			t,
+		const Vector<3,T> &	ned,
+		const Vector<3,T> &	uvw
+	);
+
+	/*
+	 *  A fix with its velocity in the NED frame, as a receiver
+	 * reports it.  The body velocity is found with the attitude of
+	 * the filter at time t, not with the newest one.
+	 */
+	int
+	gps_ned_update(
+		double			t,
+		const Vector<3,T> &	ned,
+		const Vector<3,T> &	v_ned
+	);
+
+	// A fix with no velocity at all
+	int
+	gps_position_update(
+		double			t,
+		const Vector<3,T> &	ned
+	);
+
+	// The estimate as of the newest IMU sample
+	INSFilter<T>		ins;
+
+	// Time of the newest IMU sample
+	double			now;
+
+	int			late;		// Applied in the past
+	int			dropped;	// Older than the history
+	int			replayed;	// IMU samples propagated again
+
+private:
+	struct imu_sample_t
+	{
+		double			t;
+		Vector<3,T>		accel;
+		Vector<3,T>		pqr;
+	};
+
+	enum measurement_type_t
+	{
+		COMPASS,
+		GPS,
+		GPS_NED,
+		GPS_POSITION,
+	};
+
+	struct measurement_t
+	{
+		measurement_type_t	type;
+		Vector<3,T>		ned;
+		Vector<3,T>		uvw;		// NED for GPS_NED
+		T			heading;
+	};
+
+	struct snapshot_t
+	{
+		INSFilter<T>		ins;
+		double			now;
+		double			cov_time;
+		imu_sample_t		last;
+		unsigned long		imu_count;
+	};
+
+	const double		cov_dt;
+
+	// Time since the covariance was last propagated
+	double			cov_time;
+
+	// The newest IMU sample, for the covariance step
+	imu_sample_t		last;
+
+	// Number of IMU samples since initialize()
+	unsigned long		imu_count;
+
+	// IMU samples since the oldest snapshot; the first is imu_base
+	std::deque<imu_sample_t>	imu;
+	unsigned long		imu_base;
+
+	// Measurements since the oldest snapshot, in time order
+	typedef std::multimap<double,measurement_t>	queue_t;
+	queue_t			queue;
+
+	// Ring of filter copies, oldest at head
+	std::vector<snapshot_t>	history;
+	int			head;
+	int			count;
+
+	snapshot_t &
+	snapshot(
+		int			i
+	) {
+		return this->history[ (this->head + i) % this->history.size() ];
+	}
+
+	void
+	step(
+		const imu_sample_t &	s
+	);
+
+	void
+	advance(
+		double			t
+	);
+
+	void
+	fuse(
+		const measurement_t &	m
+	);
+
+	void
+	save();
+
+	void
+	rewind(
+		double			t
+	);
+
+	int
+	add(
+		double			t,
+		const measurement_t &	m
+	);
+};
+
+
+typedef FusionFilter<double>	Fusion;
+
+}
+#endif
@@ -55,7 +55,8 @@ GPS::GPS(
 	altitude	(0),
 	wgs_alt		(0),
 	track		(0),
-	ground_speed	(0)
+	ground_speed	(0),
+	velocity_fixes	(0)
 {
 }
 
@@ -68,7 +69,7 @@ GPS::update(
 	if( line[3] == 'G' )
 		this->gpgga_update( line );
 	else
-		this->gpvgt_update( line );
+		this->gpvtg_update( line );
 }
 
 
@@ -179,12 +180,48 @@ GPS::gpgga_update(
 }
 
 
+/*
+ * $GPVTG,054.7,T,034.4,M,005.5,N,010.2,K*48
+ *
+ * True track, magnetic track, speed in knots and in km/h, each
+ * followed by its unit.  Any of them may be empty.
+ */
 void
-GPS::gpvgt_update(
-	const char *		line
+GPS::gpvtg_update(
+	const char *		line_in
 )
 {
-	// Don't do anything yet
+	// Gross hack to get around strtod's non-const second argument
+	char *			line = (char*) line_in;
+	double			value[4];
+	bool			have[4];
+
+	for( int i=0 ; i<4 ; i++ )
+	{
+		// Skip to the value after the last unit
+		line = index( line, ',' );
+		if( !line )
+			return;
+		line++;
+
+		char *			end;
+
+		value[i]	= strtod( line, &end );
+		have[i]		= end != line;
+
+		// Skip to the unit
+		line = index( end, ',' );
+		if( !line )
+			return;
+		line++;
+	}
+
+	if( !have[2] && !have[3] )
+		return;
+
+	this->track		= have[1] ? value[1] : value[0];
+	this->ground_speed	= have[3] ? value[3] : value[2] * 1.852;
+	this->velocity_fixes++;
 }
 
 }
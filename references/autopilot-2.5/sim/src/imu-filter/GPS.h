@@ -65,9 +65,15 @@ public:
 	double			altitude;	// meters, if available
 	double			wgs_alt;	// meters
 
-	/* These are GPVTG sentences */
-	double			track;		// magnetic
+	/*
+	 * These come from GPVTG sentences.  The track is magnetic if
+	 * the receiver reports it and true if not.  velocity_fixes
+	 * counts the sentences that had a speed, so a caller can tell
+	 * a fresh velocity from one that was never sent.
+	 */
+	double			track;		// degrees
 	double			ground_speed;	// km/h
+	int			velocity_fixes;
 	
 private:
 
@@ -78,7 +84,7 @@ private:
 
 
 	void
-	gpvgt_update(
+	gpvtg_update(
 		const char *		line
 	);
 
@@ -57,30 +57,43 @@ using namespace std;
 
 
 
+template<
+	class			T
+>
 void
-INS::make_a_matrix(
-	Matrix<N,N> &		A,
-	const Vector<3> &	uvw,
-	const Vector<3> &	UNUSED( pqr ),
-	const Matrix<3,3> &	DCM,
-	const Matrix<4,4> &	Wxq,
-	const Matrix<3,3> &	Wx
+INSFilter<T>::make_a_matrix(
+	SparseMatrix<N,N,T> &	A,
+	const Vector<3,T> &	uvw,
+	const Vector<3,T> &	UNUSED( pqr ),
+	const Matrix<3,3,T> &	DCM,
+	const Matrix<4,4,T> &	Wxq,
+	const Matrix<3,3,T> &	Wx
 ) const
 {
-	const double		q0 = this->q[0];
-	const double		q1 = this->q[1];
-	const double		q2 = this->q[2];
-	const double		q3 = this->q[3];
+	const T			q0 = this->q[0];
+	const T			q1 = this->q[1];
+	const T			q2 = this->q[2];
+	const T			q3 = this->q[3];
 
-	const double		u = uvw[0];
-	const double		v = uvw[1];
-	const double		w = uvw[2];
+	const T			u = uvw[0];
+	const T			v = uvw[1];
+	const T			w = uvw[2];
 
-	const double		g = this->g;
+	const T			g = this->g;
 
 
 	A.fill();
 
+	/*
+	 * Everything below is inside these blocks.  Rows 10 to 13 and
+	 * columns 0 to 2 are all zero, and the covariance products
+	 * skip them.
+	 */
+	A.block(  0,  3,  3,  7 );	// xyz by uvw and Q
+	A.block(  3,  3,  3, 11 );	// uvw by uvw, Q, g and bias
+	A.block(  6,  6,  4,  4 );	// Q by Q
+	A.block(  6, 11,  4,  3 );	// Q by bias
+
 	/*
 	 * xyz relative to uvw
 	 */
@@ -180,44 +193,48 @@ INS::make_a_matrix(
 }
 
 
+template<
+	class			T
+>
 void
-INS::propagate_state(
-	const Vector<3> &	uvw,
-	const Vector<3> &	accel,
-	const Vector<3> &	UNUSED( pqr ),
-	const Matrix<3,3> &	DCM,
-	const Matrix<4,4> &	Wxq,
-	const Matrix<3,3> &	Wx
+INSFilter<T>::propagate_state(
+	const Vector<3,T> &	uvw,
+	const Vector<3,T> &	accel,
+	const Vector<3,T> &	UNUSED( pqr ),
+	const Matrix<3,3,T> &	DCM,
+	const Matrix<4,4,T> &	Wxq,
+	const Matrix<3,3,T> &	Wx,
+	T			dt
 )
 {
 	/*
 	 *  Propagate attitude state
 	 */
-	const Vector<4>		Qdot( Wxq * q );
+	const Vector<4,T>	Qdot( Wxq * q );
 
-	this->q += Qdot * this->dt;
+	this->q += Qdot * dt;
 	this->q.norm_self();
 
 
 	/*
 	 *  Propigate position state
 	 */
-	const Vector<3>		Xdot( DCM.transpose() * uvw );
-	this->xyz += Xdot * this->dt;
+	const Vector<3,T>	Xdot( DCM.transpose() * uvw );
+	this->xyz += Xdot * dt;
 
 	/*
 	 *  Popagate velocity state
 	 */
-	const double		g( this->g );
+	const T			g( this->g );
 
-	const Vector<3>		G(
+	const Vector<3,T>	G(
 		DCM[0][2] * g,
 		DCM[1][2] * g,
 		DCM[2][2] * g
 	);
 
-	const Vector<3>		Vdot( accel - Wx * uvw + G );
-	this->uvw += Vdot * this->dt;
+	const Vector<3,T>	Vdot( accel - Wx * uvw + G );
+	this->uvw += Vdot * dt;
 }
 
 
@@ -236,23 +253,36 @@ INS::propagate_state(
 
 #define SPLIT_COVARIANCE	0
 
+/*
+ * A is mostly zero, so A * P only multiplies its blocks, and P is
+ * symmetric, so P * A' is just the transpose of that.  A*P is kept
+ * from the first stage, so P does not need to be copied.
+ * propagate_symmetric() adds the two and only fills in the upper
+ * triangle of P, which it mirrors to keep P exactly symmetric.
+ */
+template<
+	class			T
+>
 void
-INS::propagate_covariance()
+INSFilter<T>::propagate_covariance()
 {
 #ifdef SPLIT_COVARIANCE
 	switch( this->stage )
 	{
 	case 0:
 		// The A matrix was generated by imu_update
-		this->Pdot = this->Q;
-		this->Pdot += this->A * this->Ptemp;
+		mult( this->AP, this->A, this->P );
 		this->stage = 1;
 		break;
 
 	case 1:
-		this->Pdot += this->Ptemp * this->A.transpose();
-		this->Pdot *= this->dt * 2.0;
-		this->P += this->Pdot;
+		propagate_symmetric(
+			this->P,
+			this->AP,
+			this->Q,
+			this->dt * 2
+		);
+
 		this->trace = 0;
 
 		for( int i=0 ; i<N ; i++ )
@@ -264,11 +294,8 @@ INS::propagate_covariance()
 	}
 #else
 	// The A matrix was generated by imu_update
-	this->Pdot = this->Q;
-	this->Pdot += this->A * this->Ptemp;
-	this->Pdot += this->Ptemp * this->A.transpose();
-	this->Pdot *= this->dt;
-	this->P += this->Pdot;
+	mult( this->AP, this->A, this->P );
+	propagate_symmetric( this->P, this->AP, this->Q, this->dt );
 
 	this->trace = 0;
 
@@ -280,23 +307,23 @@ INS::propagate_covariance()
 
 
 
+template<
+	class			T
+>
 template<
 	int			m
 >
 void
-INS::do_kalman(
-	const Matrix<m,N> &	C,
-	const Matrix<m,m> &	R,
-	const Vector<m> &	eTHETA
+INSFilter<T>::do_kalman(
+	const Matrix<m,N,T> &	C,
+	const Matrix<m,m,T> &	R,
+	const Vector<m,T> &	eTHETA
 )
 {
-	// We throw away the K result
-	Matrix<N,m>		K;
-
-	// Kalman() wants a vector, not an object.  Serialize the
+	// Kalman_sequential() wants a vector, not an object.  Serialize the
 	// state data into this vector, then extract it out again
 	// once we're done with the loop.
-	Vector<N>		X_vect;
+	Vector<N,T>		X_vect;
 
 	X_vect[0]	= this->xyz[0];
 	X_vect[1]	= this->xyz[1];
@@ -317,13 +344,15 @@ INS::do_kalman(
 	X_vect[12]	= this->bias[1];
 	X_vect[13]	= this->bias[2];
 
-	Kalman(
+	// The R matrices are all diagonal, so the measurements can be
+	// applied one at a time.  The Joseph form keeps P positive
+	// definite in float, which P -= K*C*P in Kalman() does not.
+	Kalman_sequential(
 		this->P,
 		X_vect,
 		C,
 		R,
-		eTHETA,
-		K
+		eTHETA
 	);
 
 	this->xyz[0]	= X_vect[0];
@@ -349,32 +378,35 @@ INS::do_kalman(
 }
 
 
+template<
+	class			T
+>
 void
-INS::kalman_attitude_update(
-	const Vector<3> &	UNUSED( pqr ),
-	const Vector<3> &	accel,
-	const Matrix<3,3> &	DCM,
-	const Vector<3> &	THETAe
+INSFilter<T>::kalman_attitude_update(
+	const Vector<3,T> &	UNUSED( pqr ),
+	const Vector<3,T> &	accel,
+	const Matrix<3,3,T> &	DCM,
+	const Vector<3,T> &	THETAe
 )
 {
-	double			err;
-	const double		q0 = this->q[0];
-	const double		q1 = this->q[1];
-	const double		q2 = this->q[2];
-	const double		q3 = this->q[3];
+	T			err;
+	const T			q0 = this->q[0];
+	const T			q1 = this->q[1];
+	const T			q2 = this->q[2];
+	const T			q3 = this->q[3];
 
-	const double		DCM_0_2( DCM[0][2] );
-	const double		DCM_1_2( DCM[1][2] );
-	const double		DCM_2_2( DCM[2][2] );
+	const T			DCM_0_2( DCM[0][2] );
+	const T			DCM_1_2( DCM[1][2] );
+	const T			DCM_2_2( DCM[2][2] );
 
 
 	// compute the euler angles from the accelerometers
-	const Vector<3>		THETAm(
+	const Vector<3,T>	THETAm(
 		accel2euler( accel, THETAe[2] )
 	);
 
 	// make the C matrix
-	Matrix<2,N>		C;
+	Matrix<2,N,T>		C;
 
 	// PHI section
 	err = 2.0 / ( sqr(DCM_2_2) + sqr(DCM_1_2) );
@@ -395,7 +427,7 @@ INS::kalman_attitude_update(
 
 	// compute the error; this should be ( THETAm - THETAe ),
 	// but we can only use the pitch and roll angles here
-	Vector<2>		eTHETA;
+	Vector<2,T>		eTHETA;
 	eTHETA[0] = THETAm[0] - THETAe[0];
 	eTHETA[1] = THETAm[1] - THETAe[1];
 
@@ -409,7 +441,10 @@ INS::kalman_attitude_update(
 
 
 
-INS::INS(
+template<
+	class			T
+>
+INSFilter<T>::INSFilter(
 	double			dt
 ) :
 	dt( dt )
@@ -418,8 +453,11 @@ INS::INS(
 }
 
 
+template<
+	class			T
+>
 void
-INS::reset()
+INSFilter<T>::reset()
 {
 	this->stage		= 0;
 	this->P.fill();
@@ -427,7 +465,7 @@ INS::reset()
 	this->P[1][1]		= 1;
 	this->P[2][2]		= 1;
 
-	Matrix<N,N> &		Q( this->Q );
+	Matrix<N,N,T> &		Q( this->Q );
 
 	// Position estimate noise
 	Q[0][0]	= 0;
@@ -477,38 +515,44 @@ INS::reset()
  * and compass.  Perhaps throw away the first few to let things
  * stabilize.
  */
+template<
+	class			T
+>
 void
-INS::initialize(
-	const Vector<3> &	position,
-	const Vector<3> &	velocity,
-	const Vector<3> &	accel,
-	const Vector<3> &	pqr,
-	double			heading
+INSFilter<T>::initialize(
+	const Vector<3,T> &	position,
+	const Vector<3,T> &	velocity,
+	const Vector<3,T> &	accel,
+	const Vector<3,T> &	pqr,
+	T			heading
 )
 {
 	this->xyz		= position;
 	this->uvw		= velocity;
 	this->q			= euler2quat( accel2euler( accel, heading ) );
 	this->bias		= pqr;
-	this->g			= 19.81;
+	this->g			= 9.81;
 
 	// Give the user an estimate of our orientation
 	this->theta		= quat2euler( this->q );
 }
 
 
+template<
+	class			T
+>
 void
-INS::imu_update(
-	const Vector<3> &	accel_measured,
-	const Vector<3> &	pqr_raw
+INSFilter<T>::imu_update(
+	const Vector<3,T> &	accel_measured,
+	const Vector<3,T> &	pqr_raw
 )
 {
-	const Vector<3>		pqr_measured( pqr_raw - this->bias );
+	const Vector<3,T>	pqr_measured( pqr_raw - this->bias );
 
 	/* Compute the DCM and other values for the current estimate */
-	const Matrix<3,3> 	DCM( quatDC( this->q ) );
-	const Matrix<4,4>	Wxq( quatW( pqr_measured ) );
-	const Matrix<3,3>	Wx( eulerWx( pqr_measured ) );
+	const Matrix<3,3,T> 	DCM( quatDC( this->q ) );
+	const Matrix<4,4,T>	Wxq( quatW( pqr_measured ) );
+	const Matrix<3,3,T>	Wx( eulerWx( pqr_measured ) );
 
 
 	if( this->stage == 0 )
@@ -521,8 +565,6 @@ INS::imu_update(
 			Wxq,
 			Wx
 		);
-
-		this->Ptemp = this->P;
 	}
 
 	this->propagate_state(
@@ -531,14 +573,15 @@ INS::imu_update(
 		pqr_measured,
 		DCM,
 		Wxq,
-		Wx
+		Wx,
+		this->dt
 	);
 
 	this->propagate_covariance();
 
 	/* Compute the DCM and angle for the new estimate */
-	const Matrix<3,3> 	new_DCM( quatDC( this->q ) );
-	const Vector<3>		new_THETAe( quat2euler( this->q ) );
+	const Matrix<3,3,T> 	new_DCM( quatDC( this->q ) );
+	const Vector<3,T>	new_THETAe( quat2euler( this->q ) );
 
 	this->kalman_attitude_update(
 		pqr_measured,
@@ -555,27 +598,110 @@ INS::imu_update(
 }
 
 
+template<
+	class			T
+>
 void
-INS::compass_update(
-	double			heading
+INSFilter<T>::propagate(
+	const Vector<3,T> &	accel,
+	const Vector<3,T> &	pqr_raw,
+	T			dt
+)
+{
+	const Vector<3,T>	pqr_measured( pqr_raw - this->bias );
+
+	this->propagate_state(
+		this->uvw,
+		accel,
+		pqr_measured,
+		quatDC( this->q ),
+		quatW( pqr_measured ),
+		eulerWx( pqr_measured ),
+		dt
+	);
+
+	this->theta	= quat2euler( this->q );
+	this->pqr	= pqr_measured;
+}
+
+
+/*
+ *  The same A*P + P*A' + Q as propagate_covariance(), but with A
+ * built from the current state and one Euler step over dt.
+ */
+template<
+	class			T
+>
+void
+INSFilter<T>::covariance_update(
+	const Vector<3,T> &	pqr_raw,
+	T			dt
+)
+{
+	const Vector<3,T>	pqr_measured( pqr_raw - this->bias );
+
+	this->make_a_matrix(
+		this->A,
+		this->uvw,
+		pqr_measured,
+		quatDC( this->q ),
+		quatW( pqr_measured ),
+		eulerWx( pqr_measured )
+	);
+
+	mult( this->AP, this->A, this->P );
+	propagate_symmetric( this->P, this->AP, this->Q, dt );
+
+	this->trace = 0;
+
+	for( int i=0 ; i<N ; i++ )
+		this->trace += this->P[i][i];
+}
+
+
+template<
+	class			T
+>
+void
+INSFilter<T>::attitude_update(
+	const Vector<3,T> &	accel
+)
+{
+	this->kalman_attitude_update(
+		this->pqr,
+		accel,
+		quatDC( this->q ),
+		quat2euler( this->q )
+	);
+
+	this->theta	= quat2euler( this->q );
+}
+
+
+template<
+	class			T
+>
+void
+INSFilter<T>::compass_update(
+	T			heading
 )
 {
 	/* Should we reuse from the previous time step? */
-	const Vector<3> &	THETAe( this->theta );
+	const Vector<3,T> &	THETAe( this->theta );
 
-	const Matrix<3,3> 	DCM( quatDC( this->q ) );
-	const double		DCM_0_0( DCM[0][0] );
-	const double		DCM_0_1( DCM[0][1] );
+	const Matrix<3,3,T> 	DCM( quatDC( this->q ) );
+	const T			DCM_0_0( DCM[0][0] );
+	const T			DCM_0_1( DCM[0][1] );
 
-	const double		q0 = this->q[0];
-	const double		q1 = this->q[1];
-	const double		q2 = this->q[2];
-	const double		q3 = this->q[3];
+	const T			q0 = this->q[0];
+	const T			q1 = this->q[1];
+	const T			q2 = this->q[2];
+	const T			q3 = this->q[3];
 
-	Matrix<1,N>		C( 0 );
+	Matrix<1,N,T>		C( 0 );
 
 	// PSI section
-	const double		err = 2 / (sqr(DCM_0_0) + sqr(DCM_0_1));
+	const T			err = 2 / (sqr(DCM_0_0) + sqr(DCM_0_1));
 
 	C[0][6] = err * ( q3 * DCM_0_0 );
 	C[0][7] = err * ( q2 * DCM_0_0 );
@@ -584,7 +710,7 @@ INS::compass_update(
 
 	// Compute the error, which is the shortest way around the
 	// compass to the current heading.
-	Vector<1>		eTHETA;
+	Vector<1,T>		eTHETA;
 
 	eTHETA[0] = heading - THETAe[2];
 	if( eTHETA[0] > C_PI )
@@ -601,18 +727,21 @@ INS::compass_update(
 }
 
 
+template<
+	class			T
+>
 void
-INS::gps_update(
-	const Vector<3> &	ned,
-	const Vector<3> &	uvw
+INSFilter<T>::gps_update(
+	const Vector<3,T> &	ned,
+	const Vector<3,T> &	uvw
 )
 {
-	Matrix<6,N>		C;
+	Matrix<6,N,T>		C;
 
 	for( int i=0 ; i<6 ; i++ )
 		C[i][i] = 1;
 
-	Vector<6>		error;
+	Vector<6,T>		error;
 
 	error[0]	= ned[0] - this->xyz[0];
 	error[1]	= ned[1] - this->xyz[1];
@@ -630,5 +759,39 @@ INS::gps_update(
 }
 
 
+template<
+	class			T
+>
+void
+INSFilter<T>::gps_position_update(
+	const Vector<3,T> &	ned
+)
+{
+	Matrix<3,N,T>		C;
+	Matrix<3,3,T>		R;
+	Vector<3,T>		error;
+
+	for( int i=0 ; i<3 ; i++ )
+	{
+		C[i][i]		= 1;
+		R[i][i]		= this->R_position[i][i];
+		error[i]	= ned[i] - this->xyz[i];
+	}
+
+	this->do_kalman(
+		C,
+		R,
+		error
+	);
+}
+
+
+
+
+/*
+ *  Both precisions are built into the library
+ */
+template class INSFilter<float>;
+template class INSFilter<double>;
 
 }
@@ -32,16 +32,26 @@
 
 #include <mat/Vector.h>
 #include <mat/Matrix.h>
+#include <mat/Matrix_Sparse.h>
 
 namespace imufilter
 {
 
 using namespace libmat;
 
-class INS
+/*
+ *  T is the precision of the whole filter: its state, covariance and
+ * all of the matrices used to update them.  INS is the usual double
+ * version; INSFilter<float> halves the size of P and doubles the
+ * SIMD width.  Run test-precision on a log before trusting float.
+ */
+template<
+	class			T = double
+>
+class INSFilter
 {
 public:
-	INS(
+	INSFilter(
 		double			dt = 32768.0 / 1000000.0
 	);
 
@@ -50,109 +60,149 @@ public:
 
 	void
 	initialize(
-		const Vector<3> &	ned,
-		const Vector<3> &	uvw,
-		const Vector<3> &	accel,
-		const Vector<3> &	pqr,
-		double			heading
+		const Vector<3,T> &	ned,
+		const Vector<3,T> &	uvw,
+		const Vector<3,T> &	accel,
+		const Vector<3,T> &	pqr,
+		T			heading
 	);
 
 
 	void
 	imu_update(
-		const Vector<3> &	accel,
-		const Vector<3> &	pqr
+		const Vector<3,T> &	accel,
+		const Vector<3,T> &	pqr
 	);
 
 
 	void
 	compass_update(
-		double			heading
+		T			heading
 	);
 
 
 	void
 	gps_update(
-		const Vector<3> &	ned,
-		const Vector<3> &	uvw
+		const Vector<3,T> &	ned,
+		const Vector<3,T> &	uvw
+	);
+
+	// A fix from a receiver that does not report its velocity
+	void
+	gps_position_update(
+		const Vector<3,T> &	ned
+	);
+
+	/*
+	 *  imu_update() in pieces, for a caller with its own clock like
+	 * FusionFilter.  propagate() only moves the state, so it is cheap
+	 * enough for every IMU sample.  covariance_update() propagates P
+	 * over however long it has been since the last one, and
+	 * attitude_update() corrects pitch and roll from the
+	 * accelerometers.  Both can run at a lower rate than the IMU.
+	 */
+	void
+	propagate(
+		const Vector<3,T> &	accel,
+		const Vector<3,T> &	pqr,
+		T			dt
+	);
+
+
+	void
+	covariance_update(
+		const Vector<3,T> &	pqr,
+		T			dt
+	);
+
+
+	void
+	attitude_update(
+		const Vector<3,T> &	accel
 	);
 
 	// Position and velocity estimate
-	Vector<3>		xyz;
-	Vector<3>		uvw;
+	Vector<3,T>		xyz;
+	Vector<3,T>		uvw;
 
 	// Quaternion state estimate (and shadow copy theta)
-	Vector<4>		q;
-	Vector<3>		theta;
+	Vector<4,T>		q;
+	Vector<3,T>		theta;
 
 	// Body rate estimate (unbiased)
-	Vector<3>		pqr;
+	Vector<3,T>		pqr;
 
 	// Gravity estimate
-	double			g;
+	T			g;
 
 	// Gyro bias estimate
-	Vector<3>		bias;
+	Vector<3,T>		bias;
 
-	const double		dt;
-	double			trace;
+	// IMU period for imu_update().  Not const, so that a filter
+	// can be saved and restored by assignment.
+	T			dt;
+	T			trace;
 
 	static const int	N = 3 + 3 + 4 + 1 + 3;
 
 	// Covariance matrix
-	Matrix<N,N>		P;
-
-private:
+	Matrix<N,N,T>		P;
 
+	/*
+	 *  The system derivative matrix for the current q and g, with
+	 * its nonzero blocks declared.  Public so that test-blocks can
+	 * check that nothing is left outside of them.
+	 */
 	void make_a_matrix(
-		Matrix<N,N> &		A,
-		const Vector<3> &	uvw,
-		const Vector<3> &	pqr,
-		const Matrix<3,3> &	DCM,
-		const Matrix<4,4> &	Wxq,
-		const Matrix<3,3> &	Wx
+		SparseMatrix<N,N,T> &	A,
+		const Vector<3,T> &	uvw,
+		const Vector<3,T> &	pqr,
+		const Matrix<3,3,T> &	DCM,
+		const Matrix<4,4,T> &	Wxq,
+		const Matrix<3,3,T> &	Wx
 	) const;
 
+private:
 
 	void propagate_state(
-		const Vector<3> &	uvw,
-		const Vector<3> &	accel,
-		const Vector<3> &	pqr,
-		const Matrix<3,3> &	DCM,
-		const Matrix<4,4> &	Wxq,
-		const Matrix<3,3> &	Wx
+		const Vector<3,T> &	uvw,
+		const Vector<3,T> &	accel,
+		const Vector<3,T> &	pqr,
+		const Matrix<3,3,T> &	DCM,
+		const Matrix<4,4,T> &	Wxq,
+		const Matrix<3,3,T> &	Wx,
+		T			dt
 	);
 
 
 	void propagate_covariance();
 
 	// The system derivative matrix
-	Matrix<N,N>			A;
-	Matrix<N,N>			Pdot;
-	Matrix<N,N>			Ptemp;
+	SparseMatrix<N,N,T>		A;
+	Matrix<N,N,T>			AP;
 	int				stage;
 
 
 	void
 	kalman_attitude_update(
-		const Vector<3> &	pqr,
-		const Vector<3> &	accel,
-		const Matrix<3,3> &	DCM,
-		const Vector<3> &	THETAe
+		const Vector<3,T> &	pqr,
+		const Vector<3,T> &	accel,
+		const Matrix<3,3,T> &	DCM,
+		const Vector<3,T> &	THETAe
 	);
 
 
 	// Noise estimate
-	Matrix<N,N>		Q;
+	Matrix<N,N,T>		Q;
 
 	// State estimate for attitude
-	Matrix<2,2>		R_attitude;
+	Matrix<2,2,T>		R_attitude;
 
 	// State estimate for heading
-	Matrix<1,1>		R_heading;
+	Matrix<1,1,T>		R_heading;
 
 	// Estimate for the GPS
-	Matrix<6,6>		R_position;
+	Matrix<6,6,T>		R_position;
 
 
 	// Wrapper to serialize our state and jump into the kalman filter
@@ -161,12 +211,15 @@ private:
 	>
 	void
 	do_kalman(
-		const Matrix<m,N> &	C,
-		const Matrix<m,m> &	R,
-		const Vector<m> &	eTHETA
+		const Matrix<m,N,T> &	C,
+		const Matrix<m,m,T> &	R,
+		const Vector<m,T> &	eTHETA
 	);
 
 };
 
+
+typedef INSFilter<double>	INS;
+
 }
 #endif
@@ -30,6 +30,8 @@
 
 #include <imu-filter/imu-filter.h>
 #include <imu-filter/INS.h>
+#include <imu-filter/Fusion.h>
+#include <getoptions/getoptions.h>
 
 #include <controller/Attitude.h>
 
@@ -58,6 +60,12 @@ static bool		real_time	= false;
 static int		dt_usec		= 32768;
 static double		dt		= double(dt_usec) / 1000000.0;
 
+/*
+ *  How long after the fix the GGA sentence shows up.  This is a
+ * guess; set it for the receiver in use with --gps-latency.
+ */
+static double		gps_latency	= 0.2;
+
 static int		serial_fd;
 
 
@@ -91,34 +99,76 @@ gps2xyz(
 
 
 /*
- *  Convert a GPS object into a body frame velocity.
- * We need an attitude estimate for this to work.
+ *  Convert a GPS object into an NED velocity.  The fix is
+ * gps_latency old by the time it gets here, so it is up to the
+ * fusion filter to turn it into the body frame with the attitude
+ * from back then.
  *
- * XXX: Faked until I talk with Aaron
+ * The track is magnetic unless the receiver only sends the true
+ * one, and there is no climb rate.  Only use this when the GPS has
+ * a velocity_fixes newer than the last fix; otherwise it is zero or
+ * stale.
  */
 const Vector<3>
-gps2uvw(
-	const GPS &		/* gps */,
-	const Vector<3> &	/* theta */
+gps2vned(
+	const GPS &		gps
 )
 {
-	return Vector<3>( 0, 0, 0 );
+	const double		speed = gps.ground_speed / 3.6;
+	const double		track = gps.track * C_DEG2RAD;
+
+	return Vector<3>(
+		speed * cos( track ),
+		speed * sin( track ),
+		0
+	);
+}
+
+
+static int
+help( void )
+{
+	cerr <<
+"Usage: gps-flyer [options] [serial_dev]\n"
+"\n"
+"	-h | --help			This help\n"
+"	-l | --gps-latency sec		Age of a GPS fix when it arrives\n"
+"	-r | --realtime			Run in real time\n"
+"\n"
+	<< endl;
+
+	return -10;
 }
 
 
 int
 main(
 	int			argc,
-	const char **		argv
+	char **			argv
 )
 {
 	const char *		serial_dev = "/dev/ttyS0";
+	int			realtime = real_time;
+
+	int rc = getoptions( &argc, &argv,
+		"h|?|help&",		help,
+		"l|gps-latency=d",	&gps_latency,
+		"r|realtime!",		&realtime,
+		0
+	);
+
+	if( rc == -10 )
+		return EXIT_FAILURE;
+	if( rc < 0 )
+		return help();
 
-	if( argc > 1 )
-		serial_dev = argv[1];
+	real_time = realtime;
+
+	if( argv[0] )
+		serial_dev = argv[0];
 
 	serial_fd = open( serial_dev, O_RDWR, 0666 );
-	if( !serial_fd )
+	if( serial_fd < 0 )
 	{
 		perror( serial_dev );
 		return -1;
@@ -131,7 +181,8 @@ main(
 		dt
 	);
 
-	INS 			ins( dt );
+	Fusion			fusion;
+	INS &			ins( fusion.ins );
 	IMU &			imu( interface.imu );
 	GPS &			gps( interface.gps );
 
@@ -149,6 +200,7 @@ main(
 	int		last_heading_sample	= interface.heading_samples;
 	int		last_imu_sample		= interface.imu_samples;
 	int		last_gps_sample		= interface.gps_samples;
+	int		last_velocity_fix	= gps.velocity_fixes;
 
 
 	/* Throw away a few samples first */
@@ -204,9 +256,11 @@ main(
 	cout << "angles = " << accel2euler( imu.accel, interface.heading ) * C_RAD2DEG << endl;
 	cout << endl;
 
-	ins.initialize(
+	fusion.initialize(
+		interface.time,
 		gps2xyz( gps ),
-		gps2uvw( gps, Vector<3>(0,0,0) ),
+		eulerDC( accel2euler( imu.accel, interface.heading ) )
+			* gps2vned( gps ),
 		imu.accel,
 		imu.pqr,
 		interface.heading
@@ -225,7 +279,8 @@ main(
 			last_imu_sample = interface.imu_samples;
 
 			cout << "IMU update: " << imu.accel << endl;
-			ins.imu_update(
+			fusion.imu_update(
+				interface.time,
 				imu.accel,
 				imu.pqr
 			);
@@ -236,7 +291,8 @@ main(
 			last_heading_sample = interface.heading_samples;
 
 			cout << "Compass update: " << interface.heading << endl;
-			ins.compass_update(
+			fusion.compass_update(
+				interface.heading_time,
 				interface.heading
 			);
 		}
@@ -247,10 +303,22 @@ main(
 			const Vector<3> xyz( gps2xyz( gps ) );
 			cout << "GPS: " << xyz << endl;
 
-			ins.gps_update(
-				xyz,
-				gps2uvw( gps, ins.theta )
-			);
+			// Without a new GPVTG the speed would be fused as zero
+			if( gps.velocity_fixes != last_velocity_fix )
+			{
+				last_velocity_fix = gps.velocity_fixes;
+
+				fusion.gps_ned_update(
+					interface.gps_time - gps_latency,
+					xyz,
+					gps2vned( gps )
+				);
+			} else {
+				fusion.gps_position_update(
+					interface.gps_time - gps_latency,
+					xyz
+				);
+			}
 		}
 
 		printf( "Time:     %3.2f\n",
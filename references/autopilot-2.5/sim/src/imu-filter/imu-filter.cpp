@@ -49,6 +49,21 @@ namespace imufilter
 
 
 
+/*
+ *  Time stamp for a line that has just arrived.  In real time this
+ * is the clock.  Replaying a log, time only moves with the IMU
+ * samples, so anything else goes with the next one.
+ */
+double
+IMU_filter::arrival_time( void )
+{
+	if( this->real_time )
+		return double(stop( &this->start_time )) / 1000000.0;
+
+	return this->time + this->dt;
+}
+
+
 /*
  *  ADC data gets handed off to the IMU class
  */
@@ -169,40 +184,30 @@ read_char_line(
 
 
 
+void
+IMU_filter::serial_handler(
+	int			UNUSED( fd ),
+	void *			priv
+)
+{
+	IMU_filter *		filter = (IMU_filter*) priv;
+
+	filter->serial_ready = true;
+}
+
+
 bool
 IMU_filter::step( void )
 {
-	fd_set			fds;
-	int			rc;
-	int			max_fd = this->serial_fd;
-
-	FD_ZERO( &fds );
-	FD_SET( this->serial_fd, &fds );
+	this->serial_ready = false;
 
-	FOR_ALL_CONST( handler_map_t, i, this->handlers,
+	if( this->loop.poll() < 0 )
 	{
-		FD_SET( i->first, &fds );
-		if( max_fd < i->first )
-			max_fd = i->first;
-	} );
-
-	
-	rc = select( max_fd+1, &fds, 0, 0, 0 );
-	if( rc < 0 )
-	{
-		perror( "select" );
+		perror( "poll" );
 		return true;
 	}
 
-	FOR_ALL_CONST( handler_map_t, i, this->handlers,
-	{
-		const handler_t &	h = i->second;
-
-		if( FD_ISSET( i->first, &fds ) )
-			h.handler( i->first, h.priv );
-	} );
-
-	if( !FD_ISSET( this->serial_fd, &fds ) )
+	if( !this->serial_ready )
 		return true;
 
 	char			line[ 256 ];
@@ -218,8 +223,14 @@ IMU_filter::step( void )
 	line[len++] = '\n';
 	line[len] = '\0';
 
-	if( this->log_fd >= 0 )
-		write( this->log_fd, line, len );
+	if( this->recorder )
+		libstate::recorder_write(
+			this->recorder,
+			libstate::RECORD_SENSOR,
+			this->arrival_time(),
+			line,
+			len
+		);
 
 	if( strncmp( line, "$GPADC", 6 ) == 0 )
 	{
@@ -236,6 +247,7 @@ IMU_filter::step( void )
 	if( strncmp( line, "$GPHDM", 6 ) == 0 )
 	{
 		this->handle_compass( line );
+		this->heading_time = this->arrival_time();
 		this->heading_samples++;
 	} else
 
@@ -253,10 +265,11 @@ IMU_filter::step( void )
 	if( strncmp( line, "$GPGGA", 6 ) == 0 )
 	{
 		this->gps.update( line );
+		this->gps_time = this->arrival_time();
 		this->gps_samples++;
 	} else
 
-	if( strncmp( line, "$GPVGT", 6 ) == 0 )
+	if( strncmp( line, "$GPVTG", 6 ) == 0 )
 	{
 		this->gps.update( line );
 		// Don't increment the sample count
@@ -285,29 +298,40 @@ IMU_filter::IMU_filter(
 	gps_samples		( 0 ),
 
 	serial_fd		( fd ),
-	log_fd			( -1 ),
+	recorder		( 0 ),
 
 	real_time		( real_time ),
-	dt			( dt )
+	dt			( dt ),
+	serial_ready		( false )
 {
+	this->loop.add_fd( fd, serial_handler, (void*) this );
+
 	// Start our timer so we know how much time has elapsed
 	// between samples
 	start( &this->start_time );
 	this->time = 0;
+	this->heading_time = 0;
+	this->gps_time = 0;
+}
+
+
+IMU_filter::~IMU_filter()
+{
+	libstate::recorder_close( this->recorder );
 }
 
 
 bool
 IMU_filter::logfile(
-	const char *		filename
+	const char *		filename,
+	uint64_t		records
 )
 {
-	if( this->log_fd >= 0 )
-		close( this->log_fd );
+	libstate::recorder_close( this->recorder );
 
-	this->log_fd = open( filename, O_WRONLY | O_CREAT, 0666 );
+	this->recorder = libstate::recorder_open( filename, records );
 
-	if( this->log_fd < 0 )
+	if( !this->recorder )
 	{
 		perror( filename );
 		return false;
@@ -31,9 +31,10 @@
 #include <imu-filter/GPS.h>
 #include <imu-filter/AHRS.h>
 #include <imu-filter/Radio.h>
+#include <state/Loop.h>
+#include <state/recorder.h>
 #include "timer.h"
 #include <iostream>
-#include <map>
 
 namespace imufilter
 {
@@ -47,6 +48,8 @@ public:
 		double			dt		= 32768.0 / 1000000.0
 	);
 
+	~IMU_filter();
+
 	IMU			imu;
 	AHRS			ahrs;
 	Radio			radio;
@@ -61,9 +64,20 @@ public:
 
 	double			time;
 
+	// When the last heading and GPS lines arrived, on the same
+	// clock as time
+	double			heading_time;
+	double			gps_time;
+
+	/*
+	 * Record every line from the board in a flight recorder log
+	 * with room for that many lines.  log2txt --type sensor turns
+	 * it back into the lines to replay.
+	 */
 	bool
 	logfile(
-		const char *		file_name
+		const char *		file_name,
+		uint64_t		records		= 1 << 18
 	);
 
 	bool
@@ -71,12 +85,10 @@ public:
 
 
 	/*
-	 * File descriptor handlers
+	 * File descriptor handlers, called from step() as the
+	 * descriptors become readable
 	 */
-	typedef void (*handler_func)(
-		int			fd,
-		void *			priv
-	);
+	typedef libstate::Loop::handler_t	handler_func;
 
 	void
 	add_fd(
@@ -84,10 +96,7 @@ public:
 		handler_func		handler,
 		void *			priv
 	) {
-		handler_t &		h = this->handlers[fd];
-
-		h.handler		= handler;
-		h.priv			= priv;
+		this->loop.add_fd( fd, handler, priv );
 	}
 
 
@@ -95,10 +104,13 @@ public:
 	remove_fd(
 		int			fd
 	) {
-		this->handlers.erase( fd );
+		this->loop.remove_fd( fd );
 	}
 
 private:
+	double
+	arrival_time( void );
+
 	void
 	handle_adc(
 		const char *		line
@@ -121,19 +133,21 @@ private:
 
 
 	int			serial_fd;
-	int			log_fd;
+	libstate::recorder_t *	recorder;
 
 	const bool		real_time;
 	const double		dt;
 	stopwatch_t		start_time;
 
 
-	struct handler_t {
-		handler_func		handler;
-		void *			priv;
-	};
-	typedef std::map<int,handler_t>	handler_map_t;
-	handler_map_t		handlers;
+	libstate::Loop		loop;
+	bool			serial_ready;
+
+	static void
+	serial_handler(
+		int			fd,
+		void *			priv
+	);
 };
 
 }
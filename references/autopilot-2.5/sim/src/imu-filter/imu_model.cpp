@@ -46,139 +46,109 @@
  *
  */
 
-#include <stdio.h>
 #include <cmath>
-#include <stdlib.h>
-#include <string.h>
 
 #include "imu_model.h"
-#include "wgs_model.h"
-#include "fe_model.h"
-#include "macros.h"
 
+#include <mat/Nav.h>
+#include <mat/Quat.h>
 #include <mat/Conversions.h>
-#include <mat/rk4.h>
 
 
 namespace sim
 {
 
-using namespace matlib;
+using namespace libmat;
 
 
-void
-imu_model(
-	imu_inputs_def *	pIn,
+/*
+ *  One sample, with the body -> IMU matrix cIB and the CG -> IMU
+ * vector of the mount.
+ */
+static inline void
+imu_sample(
+	const Matrix<3,3> &	cIB,
+	const Vector<3> &	cg2imu,
+	const imu_cg_def &	cg,
 	imu_outputs_def *	pOut
 )
 {
-	// omega-cross matrix
-	double			wx[MAXSIZE][MAXSIZE];
-
 	// earth -> body transformation matrix
-	double			cBE[MAXSIZE][MAXSIZE];
-
-	// body -> earth transformation matrix
-	double			cEB[MAXSIZE][MAXSIZE];
+	const Matrix<3,3>	cBE( eulerDC( cg.THETA ) );
 
-	// IMU -> body transformation matrix
-	double			cBI[MAXSIZE][MAXSIZE];
+	// w X pos, used for both the acceleration and the velocity
+	const Vector<3>		w_pos( cross( cg.pqr, cg2imu ) );
 
-	// body -> IMU transformation matrix
-	double			cIB[MAXSIZE][MAXSIZE];
+	// get the CG LLH values
+	const Vector<3>		LLHcg( ECEF2llh( cg.pos * C_FT2M ) );
 
-	// lat, long, alt of the cg (rad)(rad)(ft)
-	double			LLHcg[MAXSIZE];
-
-	double			tempM1[MAXSIZE][MAXSIZE];
-	double			tempV1[MAXSIZE];
-	double			tempV2[MAXSIZE];
-	double			tempV3[MAXSIZE];
-
-	int			i;
-	int			j;
-	double			lat;
-	double			lon;
-
-	// make some of the matricies that will be needed
-	// make the omega-cross matrix 
-	eulerWx(
-		wx,
-		pIn->cg_pqr[0],
-		pIn->cg_pqr[1],
-		pIn->cg_pqr[2]
-	);
+	const double		lat = LLHcg[0];
+	const double		lon = LLHcg[1];
 
-	// make the cBE matrix
-	eulerDC(
-		cBE,
-		pIn->cg_THETA[0],
-		pIn->cg_THETA[1],
-		pIn->cg_THETA[2]
+	// compute the accelerations at the IMU
+	// a_imu = cIB(a_cg + alpha X pos + w X w X pos)
+	pOut->accel = cIB * (
+		cross( cg.alpha, cg2imu )
+		+ cross( cg.pqr, w_pos )
+		+ cg.accel
 	);
 
-	// make the cEB matrix
-	transpose( cBE, cEB, 3, 3 );
-
-	// make the cIB matrix
-	for(i=0; i<3; ++i)
-		for(j=0; j<3; ++j)
-			cIB[i][j] = pIn->body2imu[i][j];
-
-	// make the cBI matrix
-	transpose( cIB, cBI, 3, 3 );
+	// compute the velocity at the IMU
+	// v_imu = cIB(v_cg + w X pos)
+	pOut->uvw = cIB * ( cg.uvw + w_pos );
 
-	// get the CG LLH values in ft
-	for(i=0; i<3; ++i)
-		tempV1[i] = pIn->cg_pos[i]*C_FT2M;
+	// compute the position of the IMU: rotate the body cg->imu
+	// vector to TP coordinates, then into ECEF and add the CG.
+	pOut->ECEFpos = Tangent2ECEF(
+		cBE.transpose() * cg2imu,
+		lat,
+		lon
+	) + cg.pos;
 
-	ECEF2llh( tempV1, LLHcg );
-	LLHcg[2] = LLHcg[2]*C_M2FT;
-	
+	// compute the LLH position of the IMU
+	pOut->LLHpos = ECEF2llh( pOut->ECEFpos * C_FT2M );
+	pOut->LLHpos[2] *= C_M2FT;
 
-	lat = LLHcg[0];
-	lon = LLHcg[1];
+	// compute the angular velocity of the IMU
+	pOut->pqr = cIB * cg.pqr;
 
+	// compute the attitude of the IMU
+	const Matrix<3,3>	cIE( cIB * cBE );
 
-	// NOW DO SOME MATH
+	pOut->THETA[0] = atan2( cIE[1][2], cIE[2][2] );
+	pOut->THETA[1] = -asin( cIE[0][2] );
+	pOut->THETA[2] = atan2( cIE[0][1], cIE[0][0] );
+}
 
-	// compute the accelerations at the IMU
-	// a_imu = cIB(a_cg + alpha X pos + w X w X pos)
-	cross( pIn->cg_alpha, pIn->cg2imu, tempV1 );
-	MMmult(wx, wx, tempM1, 3, 3, 3);
-	MVmult(tempM1, pIn->cg2imu, tempV2, 3, 3);
-	VVadd(tempV1, tempV2, tempV3, 3);
-	VVadd(tempV3, pIn->cg_accel, tempV1, 3);
-	MVmult(cIB, tempV1, pOut->accel, 3, 3);
 
-	// compute the velocity at the IMU
-	// v_imu = cIB(v_cg + w X pos)
-	MVmult(wx, pIn->cg2imu, tempV1, 3, 3);
-	VVadd(pIn->cg_uvw, tempV1, tempV2, 3);
-	MVmult(cIB, tempV2, pOut->uvw, 3, 3);
-
-	// compute the position of the IMU
-	// rotate the body cg->imu vector to TP coordinates
-	MVmult(cEB, pIn->cg2imu, tempV1, 3, 3);
-	// rotate the TP cg->imu vector into ECEF coordinates
-	Tangent2ECEF(tempV2, tempV1, lat, lon);
-	// compute the ECEF position of the IMU
-	VVadd(tempV2, pIn->cg_pos, pOut->ECEFpos, 3);
-	// compute the LLH position of the IMU
-	for(i=0; i<3; ++i)
-		tempV1[i] = pOut->ECEFpos[i]*C_FT2M;
+void
+imu_model(
+	const imu_inputs_def *	pIn,
+	imu_outputs_def *	pOut
+)
+{
+	imu_sample(
+		pIn->mount.body2imu,
+		pIn->mount.cg2imu,
+		pIn->cg,
+		pOut
+	);
+}
 
-	ECEF2llh(tempV1, pOut->LLHpos);
-	pOut->LLHpos[2] = pOut->LLHpos[2]*C_M2FT;
 
-	// compute the angular velocity of the IMU
-	MVmult(cIB, pIn->cg_pqr, pOut->pqr, 3, 3);
+void
+imu_model_batch(
+	const imu_mount_def *	pMount,
+	const imu_cg_def *	pCG,
+	imu_outputs_def *	pOut,
+	size_t			count
+)
+{
+	const Matrix<3,3>	cIB( pMount->body2imu );
+	const Vector<3>		cg2imu( pMount->cg2imu );
 
-	// compute the attitude of the IMU
-	MMmult(cIB, cBE, tempM1, 3, 3, 3);
-	pOut->THETA[0] = atan2(tempM1[1][2], tempM1[2][2]);
-	pOut->THETA[1] = -asin(tempM1[0][2]);
-	pOut->THETA[2] = atan2(tempM1[0][1], tempM1[0][0]);
+	for( size_t i=0 ; i<count ; i++ )
+		imu_sample( cIB, cg2imu, pCG[i], &pOut[i] );
 }
 
 }
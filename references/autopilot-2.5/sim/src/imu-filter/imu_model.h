@@ -50,65 +50,105 @@
 #ifndef _IMU_MODEL_H_
 #define _IMU_MODEL_H_
 
+#include <mat/Vector.h>
+#include <mat/Matrix.h>
+#include <cstddef>
+
 namespace sim
 {
 
+using libmat::Vector;
+using libmat::Matrix;
+
+
+/*
+ *  Where the IMU is mounted.  This does not change during a flight,
+ * so imu_model_batch() takes it once for the whole trajectory.
+ */
 typedef struct
 {
 	// position vector from CG->IMU body axis [X Y Z] (ft)
-	double			cg2imu[MAXSIZE];
+	Vector<3>		cg2imu;
 
 	// rotation matrix body axis->IMU axis
-	double			body2imu[MAXSIZE][MAXSIZE];
+	Matrix<3,3>		body2imu;
+} imu_mount_def;
+
 
+/*
+ *  One sample of the CG trajectory
+ */
+typedef struct
+{
 	// body axis accel. at CG [X Y Z] (ft/s/s)
-	double			cg_accel[MAXSIZE];
+	Vector<3>		accel;
 
 	// body axis veloctiy at CG [X Y Z] (ft/s)
-	double			cg_uvw[MAXSIZE];
+	Vector<3>		uvw;
 
 	// ECEF pos. at CG [X Y Z] (ft)
-	double			cg_pos[MAXSIZE];
+	Vector<3>		pos;
 
 	// body axis angular accel. at CG [Pdot Qdot Rdot] (rad/s/s)
-	double			cg_alpha[MAXSIZE];
+	Vector<3>		alpha;
 
 	// body axis angular rates at CG [P Q R] (rad/s)
-	double			cg_pqr[MAXSIZE];
+	Vector<3>		pqr;
 
 	// body axis attitude at CG [phi theta psi] (rad)
-	double			cg_THETA[MAXSIZE];
+	Vector<3>		THETA;
+} imu_cg_def;
+
+
+typedef struct
+{
+	imu_mount_def		mount;
+	imu_cg_def		cg;
 } imu_inputs_def;
 
 
 typedef struct
 {
 	// IMU axis accel at IMU [X Y Z] (ft/s/s)
-	double			accel[MAXSIZE];
+	Vector<3>		accel;
 
 	// IMU axis velocity at IMU [X Y Z] (ft/s)
-	double			uvw[MAXSIZE];
+	Vector<3>		uvw;
 
 	// ECEF pos of IMU [X Y Z] (ft)
-	double			ECEFpos[MAXSIZE];
+	Vector<3>		ECEFpos;
 
 	// LLH pos of IMU [latitude longitude altitude] (rad)(rad)(ft MSL + up)
-	double			LLHpos[MAXSIZE];
+	Vector<3>		LLHpos;
 
 	// IMU axis angular rate at IMU [P Q R] (rad/s)
-	double			pqr[MAXSIZE];
+	Vector<3>		pqr;
 
 	// IMU axis attitude at IMU [phi thata psi] (rad)
-	double			THETA[MAXSIZE];
+	Vector<3>		THETA;
 } imu_outputs_def;
 
 
 extern void
 imu_model(
-	imu_inputs_def *	pIn,
+	const imu_inputs_def *	pIn,
 	imu_outputs_def *	pOut
 );
 
+
+/*
+ *  The IMU samples for count CG samples from the same mount.  pOut[i]
+ * is exactly what imu_model() gives for pCG[i].  Nothing is
+ * allocated, so the buffers can be reused for a whole flight.
+ */
+extern void
+imu_model_batch(
+	const imu_mount_def *	pMount,
+	const imu_cg_def *	pCG,
+	imu_outputs_def *	pOut,
+	size_t			count
+);
+
 }
 
-#endif  
+#endif
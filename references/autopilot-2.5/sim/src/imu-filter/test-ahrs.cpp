@@ -0,0 +1,102 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ *  $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * AHRS object test code.  A level, stationary IMU whose gyros read
+ * a constant bias must stay level and the filter must learn the bias.
+ *
+ **************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+#include <AHRS.h>
+#include <mat/Vector.h>
+#include <mat/Conversions.h>
+
+using namespace imufilter;
+using namespace libmat;
+using namespace std;
+
+
+int
+main( void )
+{
+	const double		dt	= 32768.0 / 1000000.0;
+	const Vector<3>		accel( 0, 0, -9.81 );
+	const Vector<3>		bias( 0.02, -0.03, 0.01 );
+	int			failed	= 0;
+
+	AHRS			ahrs( dt );
+
+	// Start with no bias estimate, so that it has to be learned
+	ahrs.initialize( accel, Vector<3>( 0, 0, 0 ), 0 );
+
+	for( int i=1 ; i <= 2000 ; i++ )
+	{
+		ahrs.imu_update( accel, bias );
+
+		if( i % 6 == 0 )
+			ahrs.compass_update( 0 );
+	}
+
+	printf( "theta = % 8.4f % 8.4f % 8.4f deg\n",
+		ahrs.theta[0] * C_RAD2DEG,
+		ahrs.theta[1] * C_RAD2DEG,
+		ahrs.theta[2] * C_RAD2DEG
+	);
+
+	printf( "bias  = % 8.4f % 8.4f % 8.4f rad/s, trace %g\n",
+		ahrs.bias[0],
+		ahrs.bias[1],
+		ahrs.bias[2],
+		ahrs.trace
+	);
+
+	for( int i=0 ; i<3 ; i++ )
+	{
+		if( !( fabs( ahrs.theta[i] ) < 1.0 * C_DEG2RAD ) )
+		{
+			printf( "FAILED: theta[%d] drifted\n", i );
+			failed++;
+		}
+
+		if( !( fabs( ahrs.bias[i] - bias[i] ) < 0.002 ) )
+		{
+			printf( "FAILED: bias[%d] was not learned\n", i );
+			failed++;
+		}
+
+		if( !( fabs( ahrs.pqr[i] ) < 0.002 ) )
+		{
+			printf( "FAILED: pqr[%d] is not unbiased\n", i );
+			failed++;
+		}
+	}
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * The covariance products only multiply the blocks of A that
+ * make_a_matrix() declares.  Build the real INS and GPSINS A matrices
+ * in both precisions from random states and check that every nonzero
+ * element is inside a block.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <INS.h>
+#include <gpsins/GPSINS.h>
+#include <mat/Vector.h>
+#include <mat/Matrix_Sparse.h>
+#include <mat/Quat.h>
+#include <mat/Nav.h>
+
+using namespace std;
+using namespace libmat;
+
+
+static const int	trials		= 100;
+
+
+template<
+	class			T
+>
+static const Vector<3,T>
+noise(
+	double			scale
+)
+{
+	return Vector<3,T>(
+		T( ( drand48() * 2 - 1 ) * scale ),
+		T( ( drand48() * 2 - 1 ) * scale ),
+		T( ( drand48() * 2 - 1 ) * scale )
+	);
+}
+
+
+/*
+ *  Report the worst trial.  Returns 1 if anything was outside.
+ */
+static int
+report(
+	const char *		name,
+	int			outside,
+	int			nonzeros,
+	int			blocks
+)
+{
+	printf( "%s: %d nonzeros in %d block elements, %d outside\n",
+		name,
+		nonzeros,
+		blocks,
+		outside
+	);
+
+	if( outside == 0 )
+		return 0;
+
+	printf( "FAILED: %s has nonzeros outside its blocks\n", name );
+	return 1;
+}
+
+
+template<
+	int			n,
+	class			T
+>
+static int
+count_nonzeros(
+	const SparseMatrix<n,n,T> &	A
+)
+{
+	int			count = 0;
+
+	for( int i=0 ; i<n ; i++ )
+		for( int j=0 ; j<n ; j++ )
+			if( A[i][j] != T() )
+				count++;
+
+	return count;
+}
+
+
+template<
+	class			T
+>
+static int
+check_ins(
+	const char *		name
+)
+{
+	typedef imufilter::INSFilter<T>	Filter;
+
+	const int		N = Filter::N;
+	Filter			ins;
+	SparseMatrix<N,N,T>	A;
+	int			outside = 0;
+	int			nonzeros = 0;
+
+	for( int t=0 ; t<trials ; t++ )
+	{
+		const Vector<3,T>	uvw( noise<T>( 20 ) );
+		const Vector<3,T>	pqr( noise<T>( 2 ) );
+
+		ins.q = euler2quat( noise<T>( 3 ) );
+		ins.g = T( 32.2 + drand48() );
+
+		ins.make_a_matrix(
+			A,
+			uvw,
+			pqr,
+			quatDC( ins.q ),
+			quatW( pqr ),
+			eulerWx( pqr )
+		);
+
+		outside = max( outside, A.outside() );
+		nonzeros = max( nonzeros, count_nonzeros( A ) );
+	}
+
+	return report( name, outside, nonzeros, A.nonzeros() );
+}
+
+
+/*
+ *  The GPSINS state is private, so it is moved about with the
+ * updates instead.
+ */
+template<
+	class			T
+>
+static int
+check_gpsins(
+	const char *		name
+)
+{
+	gpsins::GPSINSFilter<T>	filter;
+	SparseMatrix<11,11,T>	A;
+	int			outside = 0;
+	int			nonzeros = 0;
+
+	for( int t=0 ; t<trials ; t++ )
+	{
+		const Vector<3,T>	pqr( noise<T>( 2 ) );
+
+		filter.imu_update( noise<T>( 32 ), pqr, T(0.01) );
+		filter.gps_update( noise<T>( 100 ), noise<T>( 20 ), T(0.01) );
+		filter.make_a_matrix( A, pqr );
+
+		outside = max( outside, A.outside() );
+		nonzeros = max( nonzeros, count_nonzeros( A ) );
+	}
+
+	return report( name, outside, nonzeros, A.nonzeros() );
+}
+
+
+int
+main( void )
+{
+	int			failed = 0;
+
+	srand48( 1 );
+
+	failed += check_ins<double>( "INS double" );
+	failed += check_ins<float>( "INS float" );
+	failed += check_gpsins<double>( "GPSINS double" );
+	failed += check_gpsins<float>( "GPSINS float" );
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
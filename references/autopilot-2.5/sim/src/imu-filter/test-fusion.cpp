@@ -0,0 +1,329 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Fusion scheduler test.  A 500 Hz IMU with a compass and a GPS whose
+ * fixes show up 0.2 seconds late must end up with exactly the same
+ * estimate as the same fixes on time.  That has to hold for fixes
+ * between IMU samples with an NED velocity, too, which are fused at
+ * their own time with the attitude the filter had then, and for fixes
+ * with no velocity at all.  Also times the IMU samples and the
+ * replays.
+ *
+ **************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <imu-filter/Fusion.h>
+#include <mat/Vector.h>
+#include <mat/SixDOF.h>
+#include <mat/Quat.h>
+#include <mat/Nav.h>
+#include "timer.h"
+
+using namespace imufilter;
+using namespace std;
+using namespace libmat;
+
+
+static const double	dt		= 0.002;	// 500 Hz IMU
+static const int	steps		= 10000;
+static const int	compass_rate	= 50;		// 10 Hz
+static const int	gps_rate	= 250;		// 2 Hz
+static const int	gps_delay	= 100;		// 0.2 sec
+
+
+struct sample_t
+{
+	double			t;
+	Vector<3>		accel;
+	Vector<3>		pqr;
+	Vector<3>		xyz;
+	Vector<3>		theta;
+	Vector<3>		uvw;
+	double			heading;
+};
+
+
+/*
+ *  Twenty seconds of gentle rolling, pitching and yawing, with
+ * seeded noise on the IMU and compass.
+ */
+static void
+trajectory(
+	vector<sample_t> &	samples
+)
+{
+	SixDOF			sixdof(
+		1,	// mass
+		1,	// Ixx
+		1,	// Iyy
+		1,	// Izz
+		0	// Ixz
+	);
+
+	srand48( 1 );
+
+	for( int i=0 ; i <= steps ; i++ )
+	{
+		const Vector<3>	G( 0, 0, -9.81 );
+		const Vector<3>	force( eulerDC( sixdof.theta ) * G );
+
+		sixdof.step(
+			dt,
+			9.81,
+			force,
+			Vector<3>(
+				0.02 * cos( i * dt ),
+				0.02 * sin( 0.5 * i * dt ),
+				0.05 * cos( 0.3 * i * dt )
+			)
+		);
+
+		sample_t		s;
+
+		s.t		= i * dt;
+		s.accel		= sixdof.force + noise<3>( 0.2, -0.2 );
+		s.pqr		= sixdof.pqr + noise<3>( 0.4, -0.3 );
+		s.xyz		= sixdof.xyz;
+		s.theta		= sixdof.theta;
+		s.uvw		= sixdof.uvw;
+		s.heading	= sixdof.theta[2] + drand48() * 0.2 - 0.1;
+
+		samples.push_back( s );
+	}
+}
+
+
+typedef enum {
+	FIX_BODY,		// Velocity in the body frame
+	FIX_NED,		// Velocity in the NED frame, between samples
+	FIX_POSITION,		// No velocity
+} fix_t;
+
+
+/*
+ *  Run the filter over the samples.  Each GPS fix is handed over
+ * delay samples after it was taken.  FIX_NED fixes are taken half
+ * way between IMU samples and have their velocity in the NED frame.
+ * Returns the worst attitude error after the first two seconds.
+ */
+static double
+run(
+	Fusion &		fusion,
+	const vector<sample_t> & samples,
+	int			delay,
+	fix_t			kind,
+	unsigned long *		usec
+)
+{
+	const sample_t &	s0 = samples[0];
+	double			worst = 0;
+	stopwatch_t		timer;
+
+	*usec = 0;
+
+	fusion.initialize( s0.t, s0.xyz, s0.uvw, s0.accel, s0.pqr, s0.heading );
+
+	for( int i=1 ; i<steps ; i++ )
+	{
+		const sample_t &	s = samples[i];
+
+		start( &timer );
+
+		// A measurement handed over before the IMU sample that
+		// goes with it is on time
+		if( i % compass_rate == 0 )
+			fusion.compass_update( s.t, s.heading );
+
+		const int		fix = i - delay;
+
+		if( fix > 0 && fix % gps_rate == 0 && kind == FIX_BODY )
+			fusion.gps_update(
+				samples[ fix ].t,
+				samples[ fix ].xyz,
+				samples[ fix ].uvw
+			);
+
+		if( fix > 0 && fix % gps_rate == 0 && kind == FIX_NED )
+			fusion.gps_ned_update(
+				samples[ fix ].t - dt / 2,
+				samples[ fix ].xyz,
+				eulerDC( samples[ fix ].theta ).transpose()
+					* samples[ fix ].uvw
+			);
+
+		if( fix > 0 && fix % gps_rate == 0 && kind == FIX_POSITION )
+			fusion.gps_position_update(
+				samples[ fix ].t,
+				samples[ fix ].xyz
+			);
+
+		fusion.imu_update( s.t, s.accel, s.pqr );
+
+		*usec += stop( &timer );
+
+		if( s.t < 2.0 )
+			continue;
+
+		for( int k=0 ; k<3 ; k++ )
+			worst = max( worst, fabs( fusion.ins.theta[k] - s.theta[k] ) );
+	}
+
+	return worst;
+}
+
+
+static double
+diff(
+	const Fusion &		a,
+	const Fusion &		b
+)
+{
+	const INS &		x = a.ins;
+	const INS &		y = b.ins;
+	double			worst = 0;
+
+	for( int i=0 ; i<3 ; i++ )
+	{
+		worst = max( worst, fabs( x.xyz[i] - y.xyz[i] ) );
+		worst = max( worst, fabs( x.uvw[i] - y.uvw[i] ) );
+		worst = max( worst, fabs( x.bias[i] - y.bias[i] ) );
+	}
+
+	for( int i=0 ; i<4 ; i++ )
+		worst = max( worst, fabs( x.q[i] - y.q[i] ) );
+
+	for( int i=0 ; i<INS::N ; i++ )
+		for( int j=0 ; j<INS::N ; j++ )
+			worst = max( worst, fabs( x.P[i][j] - y.P[i][j] ) );
+
+	return worst;
+}
+
+
+int
+main( void )
+{
+	vector<sample_t>	samples;
+	int			failed = 0;
+
+	trajectory( samples );
+
+	Fusion			on_time;
+	Fusion			late;
+	Fusion			ned_on_time;
+	Fusion			ned_late;
+	Fusion			pos_on_time;
+	Fusion			pos_late;
+	unsigned long		usec_on_time;
+	unsigned long		usec_late;
+	unsigned long		usec_ned;
+	unsigned long		usec_pos;
+
+	const double		err_on_time = run( on_time, samples, 0, FIX_BODY, &usec_on_time );
+	const double		err_late = run( late, samples, gps_delay, FIX_BODY, &usec_late );
+	const double		err_ned = run( ned_on_time, samples, 0, FIX_NED, &usec_ned );
+	const double		err_pos = run( pos_on_time, samples, 0, FIX_POSITION, &usec_pos );
+
+	run( ned_late, samples, gps_delay, FIX_NED, &usec_ned );
+	run( pos_late, samples, gps_delay, FIX_POSITION, &usec_pos );
+
+	printf( "on time: %.3f rad, %.2f usec per sample\n",
+		err_on_time,
+		double( usec_on_time ) / steps
+	);
+
+	printf( "late:    %.3f rad, %.2f usec per sample, %d late, %d replayed\n",
+		err_late,
+		double( usec_late ) / steps,
+		late.late,
+		late.replayed
+	);
+
+	if( late.late == 0 || on_time.late != 0 )
+	{
+		printf( "FAILED: late fixes were not replayed\n" );
+		failed++;
+	}
+
+	if( diff( on_time, late ) != 0 )
+	{
+		printf( "FAILED: late fixes differ by %g\n", diff( on_time, late ) );
+		failed++;
+	}
+
+	printf( "ned:     %.3f rad, %d late\n", err_ned, ned_late.late );
+
+	if( ned_late.late == 0 || diff( ned_on_time, ned_late ) != 0 )
+	{
+		printf( "FAILED: late NED fixes differ by %g\n",
+			diff( ned_on_time, ned_late )
+		);
+		failed++;
+	}
+
+	if( !( err_ned < 0.5 ) )
+	{
+		printf( "FAILED: attitude error with NED fixes %g rad\n", err_ned );
+		failed++;
+	}
+
+	printf( "pos:     %.3f rad, %d late\n", err_pos, pos_late.late );
+
+	if( pos_late.late == 0 || diff( pos_on_time, pos_late ) != 0 )
+	{
+		printf( "FAILED: late position fixes differ by %g\n",
+			diff( pos_on_time, pos_late )
+		);
+		failed++;
+	}
+
+	if( !( err_pos < 0.5 ) )
+	{
+		printf( "FAILED: attitude error with position fixes %g rad\n", err_pos );
+		failed++;
+	}
+
+	// The gyros are very noisy, so this only catches a diverged filter
+	if( !( err_on_time < 0.5 ) )
+	{
+		printf( "FAILED: attitude error %g rad\n", err_on_time );
+		failed++;
+	}
+
+	// Older than the history must be refused
+	if( late.gps_update( late.now - 10, samples[0].xyz, samples[0].uvw ) == 0
+	||  late.dropped != 1
+	) {
+		printf( "FAILED: a stale fix was not dropped\n" );
+		failed++;
+	}
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
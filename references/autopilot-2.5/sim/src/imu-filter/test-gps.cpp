@@ -3,7 +3,8 @@
  *
  * (c) Trammell Hudson
  *
- * GPS aided INS object test code.
+ * GPS aided INS object test code, and a check that the GPS object
+ * parses the velocity from GPVTG sentences.
  *
  **************
  *
@@ -26,7 +27,10 @@
  */
 
 #include <iostream>
+#include <cstdlib>
+#include <cmath>
 #include <INS.h>
+#include <GPS.h>
 #include <mat/Vector.h>
 #include <mat/SixDOF.h>
 #include <mat/Quat.h>
@@ -37,8 +41,56 @@ using namespace imufilter;
 using namespace std;
 using namespace libmat;
 
+/*
+ *  A full sentence uses the magnetic track and the km/h speed.  One
+ * with only the true track and knots falls back to those, and one
+ * with no speed is not counted as a velocity.
+ */
+static int
+check_vtg( void )
+{
+	GPS			gps;
+	int			failed = 0;
+
+	gps.update( "$GPVTG,054.7,T,034.4,M,005.5,N,010.2,K*48" );
+
+	if( gps.velocity_fixes != 1
+	||  fabs( gps.track - 34.4 ) > 1e-9
+	||  fabs( gps.ground_speed - 10.2 ) > 1e-9
+	) {
+		cerr << "FAILED: full GPVTG parsed as " << gps.track
+			<< " deg " << gps.ground_speed << " km/h" << endl;
+		failed++;
+	}
+
+	gps.update( "$GPVTG,054.7,T,,M,005.5,N,,K*48" );
+
+	if( gps.velocity_fixes != 2
+	||  fabs( gps.track - 54.7 ) > 1e-9
+	||  fabs( gps.ground_speed - 5.5 * 1.852 ) > 1e-9
+	) {
+		cerr << "FAILED: partial GPVTG parsed as " << gps.track
+			<< " deg " << gps.ground_speed << " km/h" << endl;
+		failed++;
+	}
+
+	gps.update( "$GPVTG,,T,,M,,N,,K*4E" );
+
+	if( gps.velocity_fixes != 2 )
+	{
+		cerr << "FAILED: empty GPVTG counted as a velocity" << endl;
+		failed++;
+	}
+
+	return failed;
+}
+
+
 int main( void )
 {
+	if( check_vtg() )
+		return EXIT_FAILURE;
+
 	const double		mass	= 1;
 	const double		heading	= 0;
 	const double		dt	= 32768.0 / 1000000.0;
@@ -135,5 +187,7 @@ int main( void )
 	cerr << i << " samples in " << total_time << " usec" << endl;
 	cerr << double(i) * 1000000.0 / double(total_time) << " Hz" << endl;
 	cerr << "Trace=" << ins.trace << endl;
+	cerr << "PASSED" << endl;
 
+	return EXIT_SUCCESS;
 }
@@ -0,0 +1,249 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * IMU model test code.  An IMU at the CG sees the CG, an offset IMU
+ * on a spinning airframe sees the centripetal acceleration, and the
+ * batch gives the same samples as one call at a time.
+ *
+ **************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include "imu_model.h"
+#include <mat/Nav.h>
+#include <mat/Quat.h>
+#include <mat/Matrix_Invert.h>
+#include <mat/Conversions.h>
+#include "timer.h"
+
+using namespace std;
+using namespace libmat;
+using namespace sim;
+
+
+static const int	samples = 1000;
+
+
+static double
+diff(
+	const Vector<3> &	a,
+	const Vector<3> &	b
+)
+{
+	double			worst = 0;
+
+	for( int i=0 ; i<3 ; i++ )
+		worst = max( worst, fabs( a[i] - b[i] ) );
+
+	return worst;
+}
+
+
+/*
+ *  A one second hover over a point, yawing at 90 deg/s with a little
+ * pitch and roll wobble.
+ */
+static void
+trajectory(
+	imu_cg_def *		cg,
+	int			count
+)
+{
+	const Vector<3>		llh( 0.6, -1.3, 100 );
+	const Vector<3>		pos( llh2ECEF( llh ) * C_M2FT );
+
+	for( int i=0 ; i<count ; i++ )
+	{
+		const double	t = i * 0.001;
+
+		cg[i].accel	= Vector<3>( 0, 0, -32.2 );
+		cg[i].uvw	= Vector<3>( 1, 0, 0 );
+		cg[i].pos	= pos;
+		cg[i].alpha	= Vector<3>( 0.1 * cos( t ), 0, 0 );
+		cg[i].pqr	= Vector<3>( 0.1 * sin( t ), 0, C_PI / 2 );
+		cg[i].THETA	= Vector<3>( 0.05 * sin( 2 * t ), 0.02, t );
+	}
+}
+
+
+/*
+ *  At the CG with no rotation, the IMU sees exactly the CG
+ */
+static int
+check_at_cg( void )
+{
+	imu_inputs_def		in;
+	imu_outputs_def		out;
+
+	in.mount.cg2imu.fill();
+	in.mount.body2imu = eye<3,double>();
+
+	trajectory( &in.cg, 1 );
+	imu_model( &in, &out );
+
+	const Vector<3>		llh( ECEF2llh( in.cg.pos * C_FT2M ) );
+	const double		err = max(
+		max( diff( out.accel, in.cg.accel ), diff( out.uvw, in.cg.uvw ) ),
+		max( diff( out.pqr, in.cg.pqr ), diff( out.THETA, in.cg.THETA ) )
+	);
+
+	printf( "at cg: error %.2g, position %.2g ft, altitude %.3f ft\n",
+		err,
+		diff( out.ECEFpos, in.cg.pos ),
+		out.LLHpos[2]
+	);
+
+	if( err > 1e-12
+	||  diff( out.ECEFpos, in.cg.pos ) != 0
+	||  fabs( out.LLHpos[2] - llh[2] * C_M2FT ) > 1e-6
+	) {
+		printf( "FAILED: the IMU does not see the CG\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  One foot forward of the CG, turned 90 degrees in yaw, spinning at
+ * 2 rad/s in yaw.  The IMU y axis is body -x, so the centripetal
+ * acceleration of -w^2 r along body x shows up as +4 on IMU y.
+ */
+static int
+check_offset( void )
+{
+	imu_inputs_def		in;
+	imu_outputs_def		out;
+
+	in.mount.cg2imu = Vector<3>( 1, 0, 0 );
+	in.mount.body2imu = Matrix<3,3>(
+		Vector<3>(  0, 1, 0 ),
+		Vector<3>( -1, 0, 0 ),
+		Vector<3>(  0, 0, 1 )
+	);
+
+	trajectory( &in.cg, 1 );
+	in.cg.accel.fill();
+	in.cg.uvw.fill();
+	in.cg.alpha.fill();
+	in.cg.pqr	= Vector<3>( 0, 0, 2 );
+	in.cg.THETA.fill();
+
+	imu_model( &in, &out );
+
+	const Vector<3>		accel( 0, 4, 0 );
+	const Vector<3>		uvw( 2, 0, 0 );
+	const Vector<3>		pqr( 0, 0, 2 );
+
+	printf( "offset: accel %.2g, uvw %.2g, pqr %.2g, moved %.4f ft\n",
+		diff( out.accel, accel ),
+		diff( out.uvw, uvw ),
+		diff( out.pqr, pqr ),
+		( out.ECEFpos - in.cg.pos ).mag()
+	);
+
+	if( diff( out.accel, accel ) > 1e-12
+	||  diff( out.uvw, uvw ) > 1e-12
+	||  diff( out.pqr, pqr ) > 1e-12
+	||  fabs( ( out.ECEFpos - in.cg.pos ).mag() - 1 ) > 1e-9
+	) {
+		printf( "FAILED: offset IMU is wrong\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  The batch must match imu_model() one sample at a time.
+ */
+static int
+check_batch( void )
+{
+	static imu_cg_def	cg[samples];
+	static imu_outputs_def	batch[samples];
+	imu_inputs_def		in;
+
+	in.mount.cg2imu = Vector<3>( 0.3, -0.1, 0.5 );
+	in.mount.body2imu = eulerDC( Vector<3>( 0.01, -0.02, 0.03 ) );
+
+	trajectory( cg, samples );
+	imu_model_batch( &in.mount, cg, batch, samples );
+
+	for( int i=0 ; i<samples ; i++ )
+	{
+		imu_outputs_def		out;
+
+		in.cg = cg[i];
+		imu_model( &in, &out );
+
+		if( diff( out.accel, batch[i].accel ) == 0
+		&&  diff( out.uvw, batch[i].uvw ) == 0
+		&&  diff( out.ECEFpos, batch[i].ECEFpos ) == 0
+		&&  diff( out.LLHpos, batch[i].LLHpos ) == 0
+		&&  diff( out.pqr, batch[i].pqr ) == 0
+		&&  diff( out.THETA, batch[i].THETA ) == 0
+		)
+			continue;
+
+		printf( "FAILED: batch differs at sample %d\n", i );
+		return 1;
+	}
+
+	stopwatch_t		timer;
+	const int		times = 20;
+
+	start( &timer );
+	for( int i=0 ; i<times ; i++ )
+		imu_model_batch( &in.mount, cg, batch, samples );
+	const unsigned long	usec = stop( &timer );
+
+	const double		per_sample = double( usec ) / ( times * samples );
+
+	printf( "batch: %.2f usec per sample, %.1f sec per hour at 1 kHz\n",
+		per_sample,
+		per_sample * 3600.0 * 1000.0 / 1000000.0
+	);
+
+	return 0;
+}
+
+
+int
+main( void )
+{
+	int			failed = 0;
+
+	failed += check_at_cg();
+	failed += check_offset();
+	failed += check_batch();
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
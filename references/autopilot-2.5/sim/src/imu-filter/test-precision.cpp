@@ -0,0 +1,430 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Replay the same IMU, compass and GPS samples through INSFilter<double>
+ * and INSFilter<float> side by side and report how far the float
+ * filter drifts from the double one.  The IMU and compass samples
+ * go through AHRSFilter<double> and AHRSFilter<float> the same way.
+ *
+ * With no arguments a built in trajectory is used.  Otherwise the
+ * argument is a text log from the simulator, or - for stdin:
+ *
+ *	heli-sim -b script -T -o flight.log
+ *	test-precision flight.log
+ *
+ * Each line of the log is time, body accelerations, pqr, NED position,
+ * euler angles, NED velocity and two rotor moments.  The IMU is fed
+ * every sample, the compass every 6th and the GPS every 30th, the
+ * same as test-gps.
+ *
+ **************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <INS.h>
+#include <AHRS.h>
+#include <mat/Vector.h>
+#include <mat/SixDOF.h>
+#include <mat/Quat.h>
+#include <mat/Nav.h>
+#include "timer.h"
+
+using namespace imufilter;
+using namespace std;
+using namespace libmat;
+
+
+/*
+ *  How far the float filter may wander from the double one on the
+ * built in trajectory.
+ */
+static const double	theta_bound	= 1e-3;		// rad
+static const double	xyz_bound	= 1e-2;
+static const double	uvw_bound	= 1e-2;
+static const double	P_bound		= 1e-3;		// relative
+
+static const int	compass_rate	= 6;
+static const int	gps_rate	= 30;
+
+
+struct sample_t
+{
+	double			t;
+	Vector<3>		accel;
+	Vector<3>		pqr;
+	Vector<3>		xyz;
+	Vector<3>		theta;
+	Vector<3>		uvw;
+};
+
+
+/*
+ *  One line per sample, as written by heli-sim -T
+ */
+static int
+read_log(
+	FILE *			file,
+	vector<sample_t> &	samples
+)
+{
+	char			line[ 1024 ];
+
+	while( fgets( line, sizeof(line), file ) )
+	{
+		sample_t		s;
+		double			mx;
+		double			my;
+
+		if( sscanf( line,
+			"%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf"
+			" %lf %lf %lf %lf %lf %lf %lf %lf",
+			&s.t,
+			&s.accel[0], &s.accel[1], &s.accel[2],
+			&s.pqr[0], &s.pqr[1], &s.pqr[2],
+			&s.xyz[0], &s.xyz[1], &s.xyz[2],
+			&s.theta[0], &s.theta[1], &s.theta[2],
+			&s.uvw[0], &s.uvw[1], &s.uvw[2],
+			&mx, &my
+		) != 18 )
+			continue;
+
+		samples.push_back( s );
+	}
+
+	if( samples.size() < 2 )
+	{
+		fprintf( stderr, "Not enough samples in the log\n" );
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  Thirty seconds of gentle rolling, pitching and yawing, with noise
+ * on the IMU and compass.  The noise is seeded so every run sees
+ * the same samples.
+ */
+static void
+trajectory(
+	vector<sample_t> &	samples
+)
+{
+	const double		dt = 32768.0 / 1000000.0;
+	SixDOF			sixdof(
+		1,	// mass
+		1,	// Ixx
+		1,	// Iyy
+		1,	// Izz
+		0	// Ixz
+	);
+
+	srand48( 1 );
+
+	for( int i=0 ; i < 900 ; i++ )
+	{
+		const Vector<3>	G( 0, 0, -9.81 );
+		const Vector<3>	force( eulerDC( sixdof.theta ) * G );
+
+		sixdof.step(
+			dt,
+			9.81,
+			force,
+			Vector<3>(
+				0.02 * cos( i * dt ),
+				0.02 * sin( 0.5 * i * dt ),
+				0.05 * cos( 0.3 * i * dt )
+			)
+		);
+
+		sample_t		s;
+
+		s.t	= i * dt;
+		s.accel	= sixdof.force + noise<3>( 0.2, -0.2 );
+		s.pqr	= sixdof.pqr + noise<3>( 0.4, -0.3 );
+		s.xyz	= sixdof.xyz;
+		s.theta	= sixdof.theta;
+		s.theta[2] += drand48() * 0.2 - 0.1;
+		s.uvw	= sixdof.uvw;
+
+		samples.push_back( s );
+	}
+}
+
+
+template<
+	class			T
+>
+static const Vector<3,T>
+cast(
+	const Vector<3> &	v
+)
+{
+	return Vector<3,T>( v[0], v[1], v[2] );
+}
+
+
+static double
+diff(
+	const Vector<3> &	a,
+	const Vector<3,float> &	b
+)
+{
+	double			worst = 0;
+
+	for( int i=0 ; i<3 ; i++ )
+		worst = max( worst, fabs( a[i] - b[i] ) );
+
+	return worst;
+}
+
+
+/*
+ *  Feed one sample to either filter.  Returns the time it took.
+ */
+template<
+	class			T
+>
+static unsigned long
+update(
+	INSFilter<T> &		ins,
+	const sample_t &	s,
+	int			i
+)
+{
+	stopwatch_t		timer;
+
+	start( &timer );
+
+	if( i == 0 )
+		ins.initialize(
+			cast<T>( s.xyz ),
+			cast<T>( s.uvw ),
+			cast<T>( s.accel ),
+			cast<T>( s.pqr ),
+			s.theta[2]
+		);
+	else
+		ins.imu_update(
+			cast<T>( s.accel ),
+			cast<T>( s.pqr )
+		);
+
+	if( i % compass_rate == 0 )
+		ins.compass_update( s.theta[2] );
+
+	if( i % gps_rate == 0 )
+		ins.gps_update(
+			cast<T>( s.xyz ),
+			cast<T>( s.uvw )
+		);
+
+	return stop( &timer );
+}
+
+
+/*
+ *  The same for the AHRS, which has no GPS
+ */
+template<
+	class			T
+>
+static unsigned long
+update(
+	AHRSFilter<T> &		ahrs,
+	const sample_t &	s,
+	int			i
+)
+{
+	stopwatch_t		timer;
+
+	start( &timer );
+
+	if( i == 0 )
+		ahrs.initialize(
+			cast<T>( s.accel ),
+			cast<T>( s.pqr ),
+			s.theta[2]
+		);
+	else
+		ahrs.imu_update(
+			cast<T>( s.accel ),
+			cast<T>( s.pqr )
+		);
+
+	if( i % compass_rate == 0 )
+		ahrs.compass_update( s.theta[2] );
+
+	return stop( &timer );
+}
+
+
+/*
+ *  Largest difference between the two covariance matrices relative
+ * to the largest variance, and whether float P has a negative or NaN
+ * variance where double P does not.  The INS and AHRS updates are in
+ * Joseph form, but the time update can still take a variance that is
+ * near zero slightly below it, in either one.
+ */
+template<
+	int			n
+>
+static double
+divergence(
+	const Matrix<n,n> &	d,
+	const Matrix<n,n,float> & f,
+	int *			bad_diagonal
+)
+{
+	double			worst = 0;
+	double			scale = 0;
+
+	for( int i=0 ; i<n ; i++ )
+	{
+		scale = max( scale, fabs( d[i][i] ) );
+
+		if( !( f[i][i] >= 0 || d[i][i] < 0 ) )
+			*bad_diagonal = 1;
+
+		for( int j=0 ; j<n ; j++ )
+			worst = max( worst, fabs( d[i][j] - f[i][j] ) );
+	}
+
+	return scale > 0 ? worst / scale : worst;
+}
+
+
+int
+main(
+	int			argc,
+	char **			argv
+)
+{
+	vector<sample_t>	samples;
+
+	if( argc > 1 )
+	{
+		FILE *			file = stdin;
+
+		if( strcmp( argv[1], "-" ) != 0 )
+			file = fopen( argv[1], "r" );
+
+		if( !file )
+		{
+			perror( argv[1] );
+			return EXIT_FAILURE;
+		}
+
+		if( read_log( file, samples ) < 0 )
+			return EXIT_FAILURE;
+	} else
+		trajectory( samples );
+
+	const double		dt = samples[1].t - samples[0].t;
+	INSFilter<double>	ins_d( dt );
+	INSFilter<float>	ins_f( dt );
+	AHRSFilter<double>	ahrs_d( dt );
+	AHRSFilter<float>	ahrs_f( dt );
+
+	unsigned long		usec_d = 0;
+	unsigned long		usec_f = 0;
+	double			theta_err = 0;
+	double			xyz_err = 0;
+	double			uvw_err = 0;
+	double			P_err = 0;
+	unsigned long		ahrs_usec_d = 0;
+	unsigned long		ahrs_usec_f = 0;
+	double			ahrs_theta_err = 0;
+	double			ahrs_P_err = 0;
+	int			bad_diagonal = 0;
+	const int		count = samples.size();
+
+	for( int i=0 ; i<count ; i++ )
+	{
+		usec_d += update( ins_d, samples[i], i );
+		usec_f += update( ins_f, samples[i], i );
+
+		theta_err	= max( theta_err, diff( ins_d.theta, ins_f.theta ) );
+		xyz_err		= max( xyz_err, diff( ins_d.xyz, ins_f.xyz ) );
+		uvw_err		= max( uvw_err, diff( ins_d.uvw, ins_f.uvw ) );
+		P_err		= max( P_err, divergence( ins_d.P, ins_f.P, &bad_diagonal ) );
+
+		ahrs_usec_d += update( ahrs_d, samples[i], i );
+		ahrs_usec_f += update( ahrs_f, samples[i], i );
+
+		ahrs_theta_err	= max( ahrs_theta_err, diff( ahrs_d.theta, ahrs_f.theta ) );
+		ahrs_P_err	= max( ahrs_P_err, divergence( ahrs_d.P, ahrs_f.P, &bad_diagonal ) );
+	}
+
+	printf( "%d samples at %.4f sec\n", count, dt );
+	printf( "double: %.2f usec per sample\n", double( usec_d ) / count );
+	printf( "float:  %.2f usec per sample\n", double( usec_f ) / count );
+	printf( "max drift: theta %.3g rad, xyz %.3g, uvw %.3g\n",
+		theta_err,
+		xyz_err,
+		uvw_err
+	);
+	printf( "max covariance divergence %.3g, trace %g / %g\n",
+		P_err,
+		double( ins_d.trace ),
+		double( ins_f.trace )
+	);
+	printf( "ahrs double: %.2f usec, float: %.2f usec per sample\n",
+		double( ahrs_usec_d ) / count,
+		double( ahrs_usec_f ) / count
+	);
+	printf( "ahrs max drift: theta %.3g rad, covariance %.3g, trace %g / %g\n",
+		ahrs_theta_err,
+		ahrs_P_err,
+		double( ahrs_d.trace ),
+		double( ahrs_f.trace )
+	);
+
+	if( bad_diagonal )
+	{
+		printf( "FAILED: float P has a negative variance and double does not\n" );
+		return EXIT_FAILURE;
+	}
+
+	// A replayed log is only reported, not judged
+	if( argc > 1 )
+		return EXIT_SUCCESS;
+
+	if( !( theta_err <= theta_bound )
+	||  !( xyz_err <= xyz_bound )
+	||  !( uvw_err <= uvw_bound )
+	||  !( P_err <= P_bound )
+	||  !( ahrs_theta_err <= theta_bound )
+	||  !( ahrs_P_err <= P_bound )
+	) {
+		printf( "FAILED: float drifted too far from double\n" );
+		return EXIT_FAILURE;
+	}
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Tabulated standard atmosphere.  See Atmosphere.h for the error
+ * bounds.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#include <mat/Atmosphere.h>
+#include <mat/Nav.h>
+#include <cmath>
+
+namespace libmat
+{
+
+static const int	samples = int(
+	( ATMOSPHERE_MAX - ATMOSPHERE_MIN ) / ATMOSPHERE_STEP
+) + 1;
+
+
+/*
+ *  [density pressure temperature sp_sound] at each sample
+ */
+class AtmosphereSamples
+{
+public:
+	AtmosphereSamples()
+	{
+		for( int i=0 ; i<samples ; i++ )
+			atmosphere(
+				ATMOSPHERE_MIN + i * ATMOSPHERE_STEP,
+				&this->y[i][0],
+				&this->y[i][1],
+				&this->y[i][2],
+				&this->y[i][3]
+			);
+	}
+
+	double			y[samples][4];
+};
+
+
+/*
+ *  Built on first use, so that nothing depends on the order of the
+ * static constructors.  The compiler guards the construction if two
+ * threads get here at once.
+ */
+static const AtmosphereSamples &
+atmosphere_samples( void )
+{
+	static const AtmosphereSamples	table;
+
+	return table;
+}
+
+
+void
+atmosphere_table(
+	double			altitude,
+	double *		density,
+	double *		pressure,
+	double *		temperature,
+	double *		sp_sound,
+	AtmosphereCache *	cache
+)
+{
+	const double		x = ( altitude - ATMOSPHERE_MIN )
+		* ( 1.0 / ATMOSPHERE_STEP );
+
+	// Outside of the envelope, or not a number
+	if( !( x >= 0 && x < samples - 1 ) )
+	{
+		atmosphere(
+			altitude,
+			density,
+			pressure,
+			temperature,
+			sp_sound
+		);
+		return;
+	}
+
+	const int		cell = int( x );
+	AtmosphereCache		local;
+
+	if( !cache )
+		cache = &local;
+
+	if( cache->cell != cell )
+	{
+		const double *	y0 = atmosphere_samples().y[cell];
+		const double *	y1 = atmosphere_samples().y[cell+1];
+
+		cache->cell	= cell;
+		cache->base	= ATMOSPHERE_MIN + cell * ATMOSPHERE_STEP;
+
+		for( int k=0 ; k<4 ; k++ )
+		{
+			cache->value[k] = y0[k];
+			cache->slope[k] = ( y1[k] - y0[k] )
+				* ( 1.0 / ATMOSPHERE_STEP );
+		}
+	}
+
+	const double		dh = altitude - cache->base;
+
+	*density	= cache->value[0] + cache->slope[0] * dh;
+	*pressure	= cache->value[1] + cache->slope[1] * dh;
+	*temperature	= cache->value[2] + cache->slope[2] * dh;
+	*sp_sound	= cache->value[3] + cache->slope[3] * dh;
+}
+
+
+void
+atmosphere(
+	atmosphere_model_t	model,
+	double			altitude,
+	double *		density,
+	double *		pressure,
+	double *		temperature,
+	double *		sp_sound,
+	AtmosphereCache *	cache
+)
+{
+	if( model == ATMOSPHERE_TABLE )
+		atmosphere_table(
+			altitude,
+			density,
+			pressure,
+			temperature,
+			sp_sound,
+			cache
+		);
+	else
+		atmosphere(
+			altitude,
+			density,
+			pressure,
+			temperature,
+			sp_sound
+		);
+}
+
+}
@@ -0,0 +1,132 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Tabulated standard atmosphere.
+ *
+ * atmosphere() in Nav.cpp takes a pow() and a sqrt() per call, and the
+ * simulator asks for the density several times per substep.  This
+ * samples the same model every ATMOSPHERE_STEP feet over the flight
+ * envelope and interpolates linearly between the samples.  Outside
+ * of the envelope the analytic model is used.
+ *
+ * The worst case error of linear interpolation is step^2/8 * |f''|.
+ * At 100 ft over -2000 to 20000 ft that is, relative to atmosphere():
+ *
+ *	density		1.2e-6
+ *	pressure	2e-6
+ *	temperature	1e-9
+ *	sp_sound	2e-8
+ *
+ * The largest errors are at the top of the envelope, where the
+ * curvature is greatest.  testatmos checks these bounds.  That is
+ * far below what the model itself is good for.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _Atmosphere_h_
+#define _Atmosphere_h_
+
+namespace libmat
+{
+
+/*
+ *  The table spans ATMOSPHERE_MIN to ATMOSPHERE_MAX ft MSL with a
+ * sample every ATMOSPHERE_STEP ft.
+ */
+#define ATMOSPHERE_MIN		-2000.0
+#define ATMOSPHERE_MAX		20000.0
+#define ATMOSPHERE_STEP		100.0
+
+/*
+ *  Relative error bounds of the table against atmosphere() inside
+ * of the envelope.
+ */
+#define ATMOSPHERE_DENSITY_ERROR	1.2e-6
+#define ATMOSPHERE_PRESSURE_ERROR	2e-6
+#define ATMOSPHERE_TEMPERATURE_ERROR	1e-9
+#define ATMOSPHERE_SP_SOUND_ERROR	2e-8
+
+
+typedef enum
+{
+	ATMOSPHERE_ANALYTIC,		// atmosphere() every time
+	ATMOSPHERE_TABLE,		// Interpolate the table
+} atmosphere_model_t;
+
+
+/**
+ *  The table cell that was used last, as its base altitude and the
+ * value and slope of each output [density pressure temperature
+ * sp_sound].  A query in the same cell is four multiply-adds.  The
+ * output depends only on the altitude, not on what was cached, so a
+ * copied or stale cache still gives the same answer.
+ */
+class AtmosphereCache
+{
+public:
+	AtmosphereCache() :
+		cell( -1 )
+	{
+	}
+
+	int			cell;
+	double			base;
+	double			value[4];
+	double			slope[4];
+};
+
+
+/**
+ *  atmosphere() from the table, with the same outputs.  cache
+ * may be NULL.
+ */
+extern void
+atmosphere_table(
+	double			altitude,
+	double *		density,
+	double *		pressure,
+	double *		temperature,
+	double *		sp_sound,
+	AtmosphereCache *	cache = 0
+);
+
+
+/**
+ *  atmosphere() or atmosphere_table(), whichever model selects
+ */
+extern void
+atmosphere(
+	atmosphere_model_t	model,
+	double			altitude,
+	double *		density,
+	double *		pressure,
+	double *		temperature,
+	double *		sp_sound,
+	AtmosphereCache *	cache = 0
+);
+
+}
+#endif
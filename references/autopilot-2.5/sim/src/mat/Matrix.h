@@ -34,6 +34,7 @@
 
 #include "Vector.h"
 #include "fast_float.h"
+#include "Matrix_Expr.h"
 
 
 namespace libmat
@@ -44,11 +45,12 @@ template<
 	const int		m,		// Cols
 	class			T = double	// Type of the components
 >
-class Matrix
+class Matrix : public MatrixExpr< Matrix<n,m,T>, n, m, T >
 {
 protected:
 	//Vector<n,Vector<m,T> >		M;
-	Vector<m,T>		M[n];
+	// The rows are contiguous, so the simd kernels see n*m T's
+	Vector<m,T>		M[n] MAT_ALIGN;
 
 	typedef typename Vector<m,T>::index_t index_t;
 
@@ -64,10 +66,38 @@ public:
 		this->fill( value );
 	}
 
+	/**
+	 *  Evaluate an expression; see Matrix_Expr.h
+	 */
+	template<
+		class			E
+	>
 	Matrix(
-		const Vector<m> &	v0,
-		const Vector<m> &	v1,
-		const Vector<m> &	v2
+		const MatrixExpr<E,n,m,T> &	e
+	)
+	{
+		this->assign( e.expr() );
+	}
+
+	template<
+		class			E
+	>
+	Matrix &
+	operator = (
+		const MatrixExpr<E,n,m,T> &	e
+	)
+	{
+		if( e.expr().aliases( this ) )
+			return (*this) = Matrix( e );
+
+		this->assign( e.expr() );
+		return (*this);
+	}
+
+	Matrix(
+		const Vector<m,T> &	v0,
+		const Vector<m,T> &	v1,
+		const Vector<m,T> &	v2
 	)
 	{
 		M[0] = v0;
@@ -76,10 +106,10 @@ public:
 	}
 
 	Matrix(
-		const Vector<m> &	v0,
-		const Vector<m> &	v1,
-		const Vector<m> &	v2,
-		const Vector<m> &	v3
+		const Vector<m,T> &	v0,
+		const Vector<m,T> &	v1,
+		const Vector<m,T> &	v2,
+		const Vector<m,T> &	v3
 	)
 	{
 		M[0] = v0;
@@ -185,63 +215,58 @@ public:
 	 *  Insert a submatrix into the larger matrix
 	 */
 	template<
-		class		T2,
+		class		E,
 		int		n2,
-		int		m2
+		int		m2,
+		class		T2
 	>
 	void
 	insert(
 		int		base_n,
 		int		base_m,
-		const Matrix<n2,m2,T2> &M
+		const MatrixExpr<E,n2,m2,T2> &M
 	)
 	{
-		for( index_t i=0 ; i<n2 ; i++ )
-			for( index_t j=0 ; j<m2 ; j++ )
-				(*this)[i+base_n][j+base_m] = M[i][j];
+		for( int i=0 ; i<n2 ; i++ )
+		{
+			T2		tmp[m2];
+			const T2 *	M_i = M.expr().eval_row( i, tmp );
+
+			for( int j=0 ; j<m2 ; j++ )
+				(*this)[i+base_n][j+base_m] = M_i[j];
+		}
 	}
 
 
 	/**
-	 *  Negate a matrix
+	 *  The leaf of an expression; see Matrix_Expr.h
 	 */
-	const Matrix
-	operator - () const
+	MAT_INLINE const T *
+	eval_row(
+		int			i,
+		T *			/* tmp */
+	) const
 	{
-		Matrix		M;
-
-		for( index_t i=0 ; i<n ; i++ )
-			for( index_t j=0 ; j<m ; j++ )
-			{
-#ifdef NO_FPU
-				decrement( M[i][j], (*this)[i][j] );
-#else
-				M[i][j] = -(*this)[i][j];
-#endif
-			}
-		return M;
+		return &this->M[i][0];
 	}
 
-
-	/**
-	 *  Add two vectors, returning the sum of the two
-	 */
-	const Matrix &
-	operator+ (
-		const Matrix &	that
+	bool
+	uses(
+		const void *		p
 	) const
 	{
-		return Matrix(*this) += that;
+		return this == p;
 	}
 
-	const Matrix &
-	operator- (
-		const Matrix &	that
+	bool
+	aliases(
+		const void *		/* p */
 	) const
 	{
-		return Matrix(*this) -= that;
+		return false;
 	}
 
+
 	/**
 	 *  Update the matrix in place
 	 */
@@ -250,8 +275,12 @@ public:
 		const Matrix &	that
 	)
 	{
+#ifdef NO_FPU
 		for( index_t i=0 ; i < n ; i++ )
 			(*this)[i] += that[i];
+#else
+		simd::add( &this->M[0][0], &that.M[0][0], n*m );
+#endif
 
 		return (*this);
 	}
@@ -261,62 +290,66 @@ public:
 		const Matrix &	that
 	)
 	{
+#ifdef NO_FPU
 		for( index_t i=0 ; i < n ; i++ )
 			(*this)[i] -= that[i];
+#else
+		simd::sub( &this->M[0][0], &that.M[0][0], n*m );
+#endif
 
 		return (*this);
 	}
 
-
-
-	/**
-	 *  Matrix multiplication
-	 */
 	template<
-		int			p
+		class			E
 	>
-	const Matrix<n,p,T>
-	operator * (
-		const Matrix<m,p,T> &	B
-	) const
+	Matrix &
+	operator+= (
+		const MatrixExpr<E,n,m,T> &	e
+	)
 	{
-		Matrix<n,p,T>		C;
-		const Matrix<n,m,T> &	A( *this );
+		if( e.expr().aliases( this ) )
+			return (*this) += Matrix( e );
 
-		for( index_t i=0 ; i<n ; i++ )
+		for( int i=0 ; i<n ; i++ )
 		{
-			const Vector<m,T> &	A_i = A[i];
-			Vector<p,T> &		C_i = C[i];
+			T		tmp[m];
+			Vector<m,T> &	M_i( this->M[i] );
+			const T *	e_i = e.expr().eval_row( i, tmp );
 
-			for( index_t j=0 ; j<p ; j++ )
-			{
-				T		s = T();
+			for( int j=0 ; j<m ; j++ )
+				expr_add::apply( M_i[j], e_i[j] );
+		}
 
-				for( index_t k=0 ; k<m ; k++ )
-				{
-#ifdef NO_FPU
-					const T & B_k_j( B[k][j] );
-					const T & A_i_k( A_i[k] );
+		return (*this);
+	}
 
-					if( is_zero( B_k_j )
-					||  is_zero( A_i_k )
-					)
-						continue;
+	template<
+		class			E
+	>
+	Matrix &
+	operator-= (
+		const MatrixExpr<E,n,m,T> &	e
+	)
+	{
+		if( e.expr().aliases( this ) )
+			return (*this) -= Matrix( e );
 
-					s += B_k_j * A_i_k;
-#else
-					s += B[k][j] * A_i[k];
-#endif
-				}
+		for( int i=0 ; i<n ; i++ )
+		{
+			T		tmp[m];
+			Vector<m,T> &	M_i( this->M[i] );
+			const T *	e_i = e.expr().eval_row( i, tmp );
 
-				C_i[j] = s;
-			}
+			for( int j=0 ; j<m ; j++ )
+				expr_sub::apply( M_i[j], e_i[j] );
 		}
 
-		return C;
+		return (*this);
 	}
 
 
+
 	Matrix &
 	operator *= (
 		const Matrix &		B
@@ -329,44 +362,45 @@ public:
 	/**
 	 *  Scale a matrix
 	 */
-	const Matrix
-	operator * (
-		const T &		s
-	) const
-	{
-		return Matrix(*this) *= s;
-	}
-
 	Matrix &
 	operator *= (
 		const T &		s
 	)
 	{
+#ifdef NO_FPU
 		for( index_t i=0 ; i<n ; i++ )
 			(*this)[i] *= s;
+#else
+		simd::scale( &this->M[0][0], s, n*m );
+#endif
 
 		return (*this);
 	}
 
+private:
 	/**
-	 *  Return the transpose of the matrix
+	 *  Evaluate e straight into this matrix, a row at a time
 	 */
-	const Matrix<m,n,T>
-	transpose() const
+	template<
+		class			E
+	>
+	MAT_INLINE void
+	assign(
+		const E &		e
+	)
 	{
-		const Matrix<n,m,T> &	A( *this );
-		Matrix<m,n,T>		B;
-
-		for( index_t i=0 ; i<n ; i++ )
+		for( int i=0 ; i<n ; i++ )
 		{
-			const Vector<m,T> &	A_i(A[i]);
-			for( index_t j=0 ; j<m ; j++ )
-				B[j][i] = A_i[j];
-		}
+			T *		M_i = &this->M[i][0];
+			const T *	e_i = e.eval_row( i, M_i );
 
-		return B;
-	}
+			if( e_i == M_i )
+				continue;
 
+			for( int j=0 ; j<m ; j++ )
+				M_i[j] = e_i[j];
+		}
+	}
 };
 
 
@@ -376,33 +410,54 @@ public:
  */
 
 /**
- *  Vector<n> = Matrix<n,m> * Vector<m>
+ *  Vector<n> = Matrix<n,m> * Vector<m>, for a Matrix or any
+ * expression.  Each row of an expression is evaluated once and not
+ * stored.
  */
 template<
+	class			E,
 	const int		n,
 	const int		m,
 	class			T
 >
 const Vector<n,T>
 operator * (
-	const Matrix<n,m,T> &	A,
+	const MatrixExpr<E,n,m,T> &	A,
 	const Vector<m,T> &	b
 )
 {
-	typedef typename Vector<n,T>::index_t index_t;
 	Vector<n,T>		c;
 
-	for( index_t i=0 ; i<n ; i++ )
-		c[i] = A[i] * b;
+	for( int i=0 ; i<n ; i++ )
+	{
+		T			tmp[m];
+		const T *		A_i = A.expr().eval_row( i, tmp );
+		T			dot = T();
+
+		for( int k=0 ; k<m ; k++ )
+		{
+#ifdef NO_FPU
+			if( is_zero( A_i[k] )
+			||  is_zero( b[k] )
+			)
+				continue;
+#endif
+			dot += A_i[k] * b[k];
+		}
+
+		c[i] = dot;
+	}
 
 	return c;
 }
 
 
 /**
- *  Vector<m> = Vector<n> * Matrix<n,m>
+ *  Vector<m> = Vector<n> * Matrix<n,m>.  An expression on the right
+ * is evaluated first, since all of it is needed for every element.
  */
 template<
+	class			E,
 	const int		n,
 	const int		m,
 	class			T
@@ -410,18 +465,21 @@ template<
 const Vector<m,T>
 operator* (
 	const Vector<n,T> &	a,
-	const Matrix<n,m,T> &	B
+	const MatrixExpr<E,n,m,T> &	B_expr
 )
 {
-	typedef typename Vector<n,T>::index_t index_t;
+	typename expr_matrix<E,n,m,T>::type	B( B_expr.expr() );
 	Vector<m,T>		c;
 
-	for( index_t i=0 ; i<m ; i++ )
+#ifndef NO_FPU
+	// One row of Matrix * Matrix, with a as the left row
+	simd::mult( &c[0], &a[0], &B[0][0], 1, n, m );
+#else
+	for( int i=0 ; i<m ; i++ )
 	{
 		T			s(0);
-		for( index_t j=0 ; j<n ; j++ )
+		for( int j=0 ; j<n ; j++ )
 		{
-#ifdef NO_FPU
 			const T &		a_j( a[j] );
 			const T &		B_j_i( B[j][i] );
 
@@ -431,22 +489,50 @@ operator* (
 				continue;
 
 			s += a_j * B_j_i;
-#else
-			s += a[j] * B[j][i];
-#endif
 		}
 
 		c[i] = s;
 	}
+#endif
 
 	return c;
 }
 
 
 /**
- *  Output a matrix to the stream with a little bit of formatting.
+ *  Matrix<m,p> = transpose( Matrix<n,m> ) * Matrix<n,p>, without
+ * building the transpose.  Same result as A.transpose() * B.
+ */
+template<
+	const int		n,
+	const int		m,
+	const int		p,
+	class			T
+>
+const Matrix<m,p,T>
+transpose_mult(
+	const Matrix<n,m,T> &	A,
+	const Matrix<n,p,T> &	B
+)
+{
+#ifdef NO_FPU
+	return A.transpose() * B;
+#else
+	Matrix<m,p,T>		C;
+
+	simd::transpose_mult( &C[0][0], &A[0][0], &B[0][0], n, m, p );
+
+	return C;
+#endif
+}
+
+
+/**
+ *  Output a matrix or an expression to the stream with a little bit
+ * of formatting.
  */
 template<
+	class			E,
 	const int		n,
 	const int		m,
 	class			T
@@ -454,15 +540,21 @@ template<
 std::ostream &
 operator<<(
 	std::ostream &		out,
-	const Matrix<n,m,T> &	M
+	const MatrixExpr<E,n,m,T> &	M
 )
 {
-	typedef typename Matrix<n,m,T>::index_t index_t;
-
 	out << '[' << std::endl;
 
-	for( index_t i=0 ; i < M.rows() ; i++ )
-		out << M[i] << std::endl;
+	for( int i=0 ; i < n ; i++ )
+	{
+		Vector<m,T>		M_i;
+		const T *		e_i = M.expr().eval_row( i, &M_i[0] );
+
+		for( int j=0 ; j<m ; j++ )
+			M_i[j] = e_i[j];
+
+		out << M_i << std::endl;
+	}
 
 	out << ']';
 	return out;
@@ -0,0 +1,897 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Lazy matrix expressions.  A + B, A - B, -A, A * s, A * B and
+ * A.transpose() build a small tree of nodes that hold references to
+ * their operands.  Nothing is computed until the tree is assigned to
+ * a Matrix, multiplied by a Vector or added to a Matrix.  The whole
+ * expression is then evaluated one row at a time, straight into the
+ * destination, without any full size temporaries except for the
+ * products of 7x7 and up; see MatrixProduct.
+ *
+ * Each element is computed with the same operations in the same
+ * order as the eager operators did, so the results do not change.
+ *
+ * Never keep a node past the end of the statement that built it.
+ * It holds references to its operands, and those may be temporaries.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _Matrix_Expr_h_
+#define _Matrix_Expr_h_
+
+#include <cstddef>
+#include "Vector.h"
+#include "fast_float.h"
+#include "simd.h"
+
+
+namespace libmat
+{
+
+template<
+	const int		n,
+	const int		m,
+	class			T
+>
+class Matrix;
+
+template<
+	class			A,
+	const int		n,
+	const int		m,
+	class			T
+>
+class MatrixTranspose;
+
+
+/**
+ *  Base of everything that can stand in for a Matrix<n,m,T>.  E is
+ * the node type.  Every node has:
+ *
+ *	const T * eval_row( int i, T * tmp ) const
+ *		Return row i of the result.  A Matrix returns its own
+ *		row; everything else computes it into tmp[0..m).  Each
+ *		element is written after the same element of the
+ *		operands is read, since tmp may be row i of the matrix
+ *		being assigned to.
+ *
+ *	bool uses( const void * p ) const
+ *		True if the Matrix at p is one of the leaves.
+ *
+ *	bool aliases( const void * p ) const
+ *		True if row i of the result reads anything but the
+ *		same element of the Matrix at p.  If so, assigning to p
+ *		has to go through a temporary.
+ */
+template<
+	class			E,
+	const int		n,
+	const int		m,
+	class			T
+>
+class MatrixExpr
+{
+public:
+	typedef T		value_t;
+
+	const E &
+	expr() const
+	{
+		return static_cast<const E &>( *this );
+	}
+
+	size_t
+	rows() const
+	{
+		return n;
+	}
+
+	size_t
+	cols() const
+	{
+		return m;
+	}
+
+	/**
+	 *  Evaluate one column
+	 */
+	const Vector<n,T>
+	col(
+		int			j
+	) const
+	{
+		Vector<n,T>		v;
+
+		for( int i=0 ; i<n ; i++ )
+		{
+			T		tmp[m];
+
+			v[i] = this->expr().eval_row( i, tmp )[j];
+		}
+
+		return v;
+	}
+
+	/**
+	 *  A strided view of the transpose; no copy is made.
+	 */
+	const MatrixTranspose<E,m,n,T>
+	transpose() const
+	{
+		return MatrixTranspose<E,m,n,T>( this->expr() );
+	}
+};
+
+
+/*
+ *  How a node holds an operand.  Matrices are held by reference and
+ * everything else, which is just another node, by value.
+ */
+template<
+	class			E
+>
+struct expr_operand
+{
+	typedef const E		type;
+};
+
+template<
+	const int		n,
+	const int		m,
+	class			T
+>
+struct expr_operand< Matrix<n,m,T> >
+{
+	typedef const Matrix<n,m,T> &	type;
+};
+
+
+/*
+ *  Whether eval_row() of a node returns storage of its own instead of
+ * writing tmp.  Only a Matrix and an evaluated product do.  Anything
+ * else writes the destination row while it is being evaluated.
+ */
+template<
+	class			E
+>
+struct expr_leaf
+{
+	static const bool	value = false;
+};
+
+template<
+	const int		n,
+	const int		m,
+	class			T
+>
+struct expr_leaf< Matrix<n,m,T> >
+{
+	static const bool	value = true;
+};
+
+
+/*
+ *  An operand that has to be read out of order, like the right side
+ * of a product.  Matrices are still held by reference; anything else
+ * is evaluated once into a Matrix when the node is built.
+ */
+template<
+	class			E,
+	const int		n,
+	const int		m,
+	class			T
+>
+struct expr_matrix
+{
+	typedef const Matrix<n,m,T>	type;
+};
+
+template<
+	const int		n,
+	const int		m,
+	class			T
+>
+struct expr_matrix< Matrix<n,m,T>, n, m, T >
+{
+	typedef const Matrix<n,m,T> &	type;
+};
+
+
+/*
+ *  Element by element operations
+ */
+struct expr_add
+{
+	template<
+		class		T
+	>
+	static void
+	apply(
+		T &		a,
+		const T &	b
+	)
+	{
+#ifdef NO_FPU
+		increment( a, b );
+#else
+		a += b;
+#endif
+	}
+};
+
+struct expr_sub
+{
+	template<
+		class		T
+	>
+	static void
+	apply(
+		T &		a,
+		const T &	b
+	)
+	{
+#ifdef NO_FPU
+		decrement( a, b );
+#else
+		a -= b;
+#endif
+	}
+};
+
+
+/**
+ *  A + B and A - B
+ */
+template<
+	class			A,
+	class			B,
+	class			Op,
+	const int		n,
+	const int		m,
+	class			T
+>
+class MatrixBinary : public MatrixExpr< MatrixBinary<A,B,Op,n,m,T>, n, m, T >
+{
+	typename expr_operand<A>::type	a;
+	typename expr_operand<B>::type	b;
+
+public:
+	MatrixBinary(
+		const A &		a,
+		const B &		b
+	) :
+		a			( a ),
+		b			( b )
+	{
+	}
+
+	MAT_INLINE const T *
+	eval_row(
+		int			i,
+		T *			tmp
+	) const
+	{
+		T			b_tmp[m];
+		const T *		a_i = this->a.eval_row( i, tmp );
+		const T *		b_i = this->b.eval_row( i, b_tmp );
+
+		for( int j=0 ; j<m ; j++ )
+		{
+			T		x = a_i[j];
+
+			Op::apply( x, b_i[j] );
+			tmp[j] = x;
+		}
+
+		return tmp;
+	}
+
+	bool
+	uses(
+		const void *		p
+	) const
+	{
+		return this->a.uses( p ) || this->b.uses( p );
+	}
+
+	/**
+	 *  Row i of a is written into tmp, the destination row, before
+	 * row i of b is read.  So unless a is a leaf, b can not read the
+	 * destination at all.
+	 */
+	bool
+	aliases(
+		const void *		p
+	) const
+	{
+		if( this->a.aliases( p ) || this->b.aliases( p ) )
+			return true;
+
+		return !expr_leaf<A>::value && this->b.uses( p );
+	}
+};
+
+
+/**
+ *  -A
+ */
+template<
+	class			A,
+	const int		n,
+	const int		m,
+	class			T
+>
+class MatrixNegate : public MatrixExpr< MatrixNegate<A,n,m,T>, n, m, T >
+{
+	typename expr_operand<A>::type	a;
+
+public:
+	MatrixNegate(
+		const A &		a
+	) :
+		a			( a )
+	{
+	}
+
+	MAT_INLINE const T *
+	eval_row(
+		int			i,
+		T *			tmp
+	) const
+	{
+		const T *		a_i = this->a.eval_row( i, tmp );
+
+		for( int j=0 ; j<m ; j++ )
+		{
+#ifdef NO_FPU
+			T		x = T();
+			decrement( x, a_i[j] );
+			tmp[j] = x;
+#else
+			tmp[j] = -a_i[j];
+#endif
+		}
+
+		return tmp;
+	}
+
+	bool
+	uses(
+		const void *		p
+	) const
+	{
+		return this->a.uses( p );
+	}
+
+	bool
+	aliases(
+		const void *		p
+	) const
+	{
+		return this->a.aliases( p );
+	}
+};
+
+
+/**
+ *  A * s
+ */
+template<
+	class			A,
+	const int		n,
+	const int		m,
+	class			T
+>
+class MatrixScale : public MatrixExpr< MatrixScale<A,n,m,T>, n, m, T >
+{
+	typename expr_operand<A>::type	a;
+	const T				s;
+
+public:
+	MatrixScale(
+		const A &		a,
+		const T &		s
+	) :
+		a			( a ),
+		s			( s )
+	{
+	}
+
+	MAT_INLINE const T *
+	eval_row(
+		int			i,
+		T *			tmp
+	) const
+	{
+		const T *		a_i = this->a.eval_row( i, tmp );
+
+		for( int j=0 ; j<m ; j++ )
+		{
+#ifdef NO_FPU
+			if( is_zero( a_i[j] ) )
+			{
+				tmp[j] = a_i[j];
+				continue;
+			}
+#endif
+			tmp[j] = a_i[j] * this->s;
+		}
+
+		return tmp;
+	}
+
+	bool
+	uses(
+		const void *		p
+	) const
+	{
+		return this->a.uses( p );
+	}
+
+	bool
+	aliases(
+		const void *		p
+	) const
+	{
+		return this->a.aliases( p );
+	}
+};
+
+
+/**
+ *  transpose( A ), where A is m by n.  Row i of the result is column
+ * i of A, read in place if A is a Matrix.
+ */
+template<
+	class			A,
+	const int		n,
+	const int		m,
+	class			T
+>
+class MatrixTranspose : public MatrixExpr< MatrixTranspose<A,n,m,T>, n, m, T >
+{
+	typename expr_matrix<A,m,n,T>::type	a;
+
+public:
+	MatrixTranspose(
+		const A &		a
+	) :
+		a			( a )
+	{
+	}
+
+	/**
+	 *  The matrix that is being viewed
+	 */
+	const Matrix<m,n,T> &
+	source() const
+	{
+		return this->a;
+	}
+
+	MAT_INLINE const T *
+	eval_row(
+		int			i,
+		T *			tmp
+	) const
+	{
+		for( int j=0 ; j<m ; j++ )
+			tmp[j] = this->a[j][i];
+
+		return tmp;
+	}
+
+	bool
+	uses(
+		const void *		p
+	) const
+	{
+		return this->a.uses( p );
+	}
+
+	bool
+	aliases(
+		const void *		p
+	) const
+	{
+		return this->a.uses( p );
+	}
+};
+
+
+/*
+ *  The right side of a product.  mult_row() computes one row of the
+ * product from a row of the left side, summing each element in order
+ * of k like the eager multiply did.
+ *
+ * in_place says whether a transpose on the right is read in place.
+ * It never aliases the destination, since aliases() on the product
+ * already sends an operand that is also the destination through a
+ * temporary.  The dot products win while the row kernel is in use,
+ * up to MAT_SIMD_MAX columns: 3x faster at 3x3 in double, 1.25-1.5x
+ * at 7x7, and as fast to 1.45x for CP * C' with six measurements in
+ * Kalman().  Past that the plain row loops vectorize across the
+ * columns of the copy, and the in place read is only 0.5-0.7x as
+ * fast at 10x10 and 14x14 (see transpose_product in benchmark).
+ */
+template<
+	class			B,
+	const int		m,
+	const int		p,
+	class			T,
+	bool			in_place = ( p <= MAT_SIMD_MAX )
+>
+class expr_rhs
+{
+	typename expr_matrix<B,m,p,T>::type	b;
+
+public:
+	expr_rhs(
+		const B &		b
+	) :
+		b			( b )
+	{
+	}
+
+	MAT_INLINE void
+	mult_row(
+		T *			out,
+		const T *		a_i
+	) const
+	{
+#ifdef NO_FPU
+		for( int j=0 ; j<p ; j++ )
+		{
+			T		s = T();
+
+			for( int k=0 ; k<m ; k++ )
+			{
+				const T &	b_k_j( this->b[k][j] );
+
+				if( is_zero( b_k_j ) || is_zero( a_i[k] ) )
+					continue;
+
+				s += b_k_j * a_i[k];
+			}
+
+			out[j] = s;
+		}
+#else
+		simd::row( out, a_i, 1, &this->b[0][0], m, p );
+#endif
+	}
+
+	bool
+	uses(
+		const void *		ptr
+	) const
+	{
+		return this->b.uses( ptr );
+	}
+};
+
+
+/*
+ *  A * transpose( B ) reads the rows of B in place instead of making
+ * a transposed copy.
+ */
+template<
+	const int		m,
+	const int		p,
+	class			T
+>
+class expr_rhs< MatrixTranspose<Matrix<p,m,T>,m,p,T>, m, p, T, true >
+{
+	const Matrix<p,m,T> &	b;
+
+public:
+	expr_rhs(
+		const MatrixTranspose<Matrix<p,m,T>,m,p,T> & b
+	) :
+		b			( b.source() )
+	{
+	}
+
+	MAT_INLINE void
+	mult_row(
+		T *			out,
+		const T *		a_i
+	) const
+	{
+#ifdef NO_FPU
+		for( int j=0 ; j<p ; j++ )
+		{
+			T		s = T();
+
+			for( int k=0 ; k<m ; k++ )
+			{
+				const T &	b_j_k( this->b[j][k] );
+
+				if( is_zero( b_j_k ) || is_zero( a_i[k] ) )
+					continue;
+
+				s += b_j_k * a_i[k];
+			}
+
+			out[j] = s;
+		}
+#else
+		simd::row_dot( out, a_i, &this->b[0][0], m, p );
+#endif
+	}
+
+	bool
+	uses(
+		const void *		ptr
+	) const
+	{
+		return this->b.uses( ptr );
+	}
+};
+
+
+/**
+ *  A * B, with A n by m and B m by p.  Only row i of A is needed for
+ * row i of the product, so A is never evaluated on its own.  The row
+ * of the product is written while the row of A is still being read,
+ * so A can not be the destination either.
+ *
+ * whole says whether the product is done all at once when the node
+ * is built; see below.
+ */
+template<
+	class			A,
+	class			B,
+	const int		n,
+	const int		m,
+	const int		p,
+	class			T,
+	bool			whole = ( n * p >= 49 )
+>
+class MatrixProduct : public MatrixExpr< MatrixProduct<A,B,n,m,p,T,whole>, n, p, T >
+{
+	typename expr_operand<A>::type	a;
+	expr_rhs<B,m,p,T>		b;
+
+public:
+	MatrixProduct(
+		const A &		a,
+		const B &		b
+	) :
+		a			( a ),
+		b			( b )
+	{
+	}
+
+	MAT_INLINE const T *
+	eval_row(
+		int			i,
+		T *			tmp
+	) const
+	{
+		T			a_tmp[m];
+
+		this->b.mult_row( tmp, this->a.eval_row( i, a_tmp ) );
+
+		return tmp;
+	}
+
+	bool
+	uses(
+		const void *		ptr
+	) const
+	{
+		return this->a.uses( ptr ) || this->b.uses( ptr );
+	}
+
+	bool
+	aliases(
+		const void *		ptr
+	) const
+	{
+		return this->a.uses( ptr ) || this->b.uses( ptr );
+	}
+};
+
+
+/**
+ *  A * B at 7x7 and up.  Done a row at a time inside a longer
+ * expression, a product that size is slower than the eager operators
+ * were: the sums and scales around it run over one short row at a
+ * time.  So it is done once, into storage in the node, when the node
+ * is built, and the rest of the expression reads it like a Matrix.
+ * That is one temporary instead of the five the eager operators made.
+ */
+template<
+	class			A,
+	class			B,
+	const int		n,
+	const int		m,
+	const int		p,
+	class			T
+>
+class MatrixProduct<A,B,n,m,p,T,true> : public MatrixExpr< MatrixProduct<A,B,n,m,p,T,true>, n, p, T >
+{
+	T			c[n][p] MAT_ALIGN;
+
+public:
+	MatrixProduct(
+		const A &		a,
+		const B &		b
+	)
+	{
+		const MatrixProduct<A,B,n,m,p,T,false>	rows( a, b );
+
+		for( int i=0 ; i<n ; i++ )
+			rows.eval_row( i, this->c[i] );
+	}
+
+	MAT_INLINE const T *
+	eval_row(
+		int			i,
+		T *			/* tmp */
+	) const
+	{
+		return this->c[i];
+	}
+
+	bool
+	uses(
+		const void *		/* ptr */
+	) const
+	{
+		return false;
+	}
+
+	bool
+	aliases(
+		const void *		/* ptr */
+	) const
+	{
+		return false;
+	}
+};
+
+
+/*
+ *  An evaluated product is held by reference, like a Matrix, so the
+ * nodes built on it do not copy it, and it is a leaf.
+ */
+template<
+	class			A,
+	class			B,
+	const int		n,
+	const int		m,
+	const int		p,
+	class			T
+>
+struct expr_operand< MatrixProduct<A,B,n,m,p,T,true> >
+{
+	typedef const MatrixProduct<A,B,n,m,p,T,true> &	type;
+};
+
+template<
+	class			A,
+	class			B,
+	const int		n,
+	const int		m,
+	const int		p,
+	class			T
+>
+struct expr_leaf< MatrixProduct<A,B,n,m,p,T,true> >
+{
+	static const bool	value = true;
+};
+
+
+/*
+ *  The operators that build the nodes.
+ */
+template<
+	class			A,
+	class			B,
+	const int		n,
+	const int		m,
+	class			T
+>
+const MatrixBinary<A,B,expr_add,n,m,T>
+operator + (
+	const MatrixExpr<A,n,m,T> &	a,
+	const MatrixExpr<B,n,m,T> &	b
+)
+{
+	return MatrixBinary<A,B,expr_add,n,m,T>( a.expr(), b.expr() );
+}
+
+
+template<
+	class			A,
+	class			B,
+	const int		n,
+	const int		m,
+	class			T
+>
+const MatrixBinary<A,B,expr_sub,n,m,T>
+operator - (
+	const MatrixExpr<A,n,m,T> &	a,
+	const MatrixExpr<B,n,m,T> &	b
+)
+{
+	return MatrixBinary<A,B,expr_sub,n,m,T>( a.expr(), b.expr() );
+}
+
+
+template<
+	class			A,
+	const int		n,
+	const int		m,
+	class			T
+>
+const MatrixNegate<A,n,m,T>
+operator - (
+	const MatrixExpr<A,n,m,T> &	a
+)
+{
+	return MatrixNegate<A,n,m,T>( a.expr() );
+}
+
+
+template<
+	class			A,
+	const int		n,
+	const int		m,
+	class			T
+>
+const MatrixScale<A,n,m,T>
+operator * (
+	const MatrixExpr<A,n,m,T> &	a,
+	const typename MatrixExpr<A,n,m,T>::value_t & s
+)
+{
+	return MatrixScale<A,n,m,T>( a.expr(), s );
+}
+
+
+template<
+	class			A,
+	class			B,
+	const int		n,
+	const int		m,
+	const int		p,
+	class			T
+>
+const MatrixProduct<A,B,n,m,p,T>
+operator * (
+	const MatrixExpr<A,n,m,T> &	a,
+	const MatrixExpr<B,m,p,T> &	b
+)
+{
+	return MatrixProduct<A,B,n,m,p,T>( a.expr(), b.expr() );
+}
+
+};
+#endif
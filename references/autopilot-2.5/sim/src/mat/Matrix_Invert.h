@@ -35,6 +35,7 @@
 #define _Matrix_Invert_h_
 
 #include <mat/Matrix.h>
+#include <cmath>
 
 namespace libmat
 {
@@ -235,6 +236,299 @@ solve_lower(
 
 
 
+/**
+ *  LU factorization with partial pivoting, in place.  Afterwards
+ * the strict lower triangle of A is L, whose unit diagonal is not
+ * stored, the rest of A is U, and row i of L*U is row perm[i] of
+ * the original A.  Returns -1 if A is singular.
+ */
+template<
+	const int		n,
+	class			T
+>
+int
+lu(
+	Matrix<n,n,T> &		A,
+	int			perm[n]
+)
+{
+	for( int i=0 ; i<n ; i++ )
+		perm[i] = i;
+
+	for( int k=0 ; k<n ; k++ )
+	{
+		int			pivot = k;
+		T			biggest( A[k][k] < 0 ? -A[k][k] : A[k][k] );
+
+		for( int i=k+1 ; i<n ; i++ )
+		{
+			const T		a( A[i][k] < 0 ? -A[i][k] : A[i][k] );
+
+			if( a > biggest )
+			{
+				pivot = i;
+				biggest = a;
+			}
+		}
+
+		if( is_zero( biggest ) )
+			return -1;
+
+		if( pivot != k )
+		{
+			const Vector<n,T>	row( A[k] );
+			const int		p( perm[k] );
+
+			A[k]		= A[pivot];
+			A[pivot]	= row;
+			perm[k]		= perm[pivot];
+			perm[pivot]	= p;
+		}
+
+		const Vector<n,T> &	A_k( A[k] );
+
+		for( int i=k+1 ; i<n ; i++ )
+		{
+			Vector<n,T> &		A_i( A[i] );
+			const T			l( A_i[k] / A_k[k] );
+
+			A_i[k] = l;
+
+			if( is_zero( l ) )
+				continue;
+
+			for( int j=k+1 ; j<n ; j++ )
+				A_i[j] -= l * A_k[j];
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ *  B = inverse(A) * B, from the factors that lu() left in A.  Each
+ * column of B is a separate right hand side.
+ */
+template<
+	const int		n,
+	const int		p,
+	class			T
+>
+void
+lu_solve(
+	const Matrix<n,n,T> &	A,
+	const int		perm[n],
+	Matrix<n,p,T> &		B
+)
+{
+	Matrix<n,p,T>		Y;
+
+	for( int i=0 ; i<n ; i++ )
+		Y[i] = B[perm[i]];
+
+	// L * Z = Y
+	for( int i=0 ; i<n ; i++ )
+	{
+		for( int k=0 ; k<i ; k++ )
+		{
+			const T &	l( A[i][k] );
+
+			if( is_zero( l ) )
+				continue;
+
+			for( int j=0 ; j<p ; j++ )
+				Y[i][j] -= l * Y[k][j];
+		}
+	}
+
+	// U * X = Z
+	for( int i=n-1 ; i>=0 ; i-- )
+	{
+		for( int k=i+1 ; k<n ; k++ )
+		{
+			const T &	u( A[i][k] );
+
+			if( is_zero( u ) )
+				continue;
+
+			for( int j=0 ; j<p ; j++ )
+				Y[i][j] -= u * Y[k][j];
+		}
+
+		for( int j=0 ; j<p ; j++ )
+			Y[i][j] /= A[i][i];
+	}
+
+	B = Y;
+}
+
+
+/**
+ *  Cholesky factorization A = L * L' of a symmetric positive
+ * definite matrix, in place.  Only the lower triangle of A is read
+ * and only it is replaced with L; the strict upper triangle is left
+ * alone.  Returns -1 if A is not positive definite.
+ */
+template<
+	const int		n,
+	class			T
+>
+int
+llt(
+	Matrix<n,n,T> &		A
+)
+{
+	for( int j=0 ; j<n ; j++ )
+	{
+		Vector<n,T> &		A_j( A[j] );
+		T			d( A_j[j] );
+
+		for( int k=0 ; k<j ; k++ )
+			d -= A_j[k] * A_j[k];
+
+		if( !( d > T() ) )
+			return -1;
+
+		d = std::sqrt( d );
+		A_j[j] = d;
+
+		for( int i=j+1 ; i<n ; i++ )
+		{
+			Vector<n,T> &		A_i( A[i] );
+			T			s( A_i[j] );
+
+			for( int k=0 ; k<j ; k++ )
+				s -= A_i[k] * A_j[k];
+
+			A_i[j] = s / d;
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ *  B = inverse(A) * B, from the L that llt() left in A.
+ */
+template<
+	const int		n,
+	const int		p,
+	class			T
+>
+void
+llt_solve(
+	const Matrix<n,n,T> &	L,
+	Matrix<n,p,T> &		B
+)
+{
+	// L * Y = B
+	for( int i=0 ; i<n ; i++ )
+	{
+		for( int k=0 ; k<i ; k++ )
+		{
+			const T &	l( L[i][k] );
+
+			for( int j=0 ; j<p ; j++ )
+				B[i][j] -= l * B[k][j];
+		}
+
+		for( int j=0 ; j<p ; j++ )
+			B[i][j] /= L[i][i];
+	}
+
+	// L' * X = Y
+	for( int i=n-1 ; i>=0 ; i-- )
+	{
+		for( int k=i+1 ; k<n ; k++ )
+		{
+			const T &	l( L[k][i] );
+
+			for( int j=0 ; j<p ; j++ )
+				B[i][j] -= l * B[k][j];
+		}
+
+		for( int j=0 ; j<p ; j++ )
+			B[i][j] /= L[i][i];
+	}
+}
+
+
+/**
+ *  B = inverse(A) * B without forming the inverse.  A is not
+ * changed.  Returns -1 and leaves B alone if A is singular.
+ */
+template<
+	const int		n,
+	const int		p,
+	class			T
+>
+int
+solve(
+	const Matrix<n,n,T> &	A,
+	Matrix<n,p,T> &		B
+)
+{
+	Matrix<n,n,T>		LU( A );
+	int			perm[n];
+
+	if( lu( LU, perm ) < 0 )
+		return -1;
+
+	lu_solve( LU, perm, B );
+	return 0;
+}
+
+
+template<
+	const int		n,
+	class			T
+>
+int
+solve(
+	const Matrix<n,n,T> &	A,
+	Vector<n,T> &		b
+)
+{
+	Matrix<n,1,T>		B;
+
+	B.col( 0, b );
+
+	if( solve( A, B ) < 0 )
+		return -1;
+
+	b = B.col( 0 );
+	return 0;
+}
+
+
+/**
+ *  solve() for a symmetric positive definite A, with llt().  About
+ * half the work of the LU version.  Returns -1 and leaves B alone if
+ * A is not positive definite.
+ */
+template<
+	const int		n,
+	const int		p,
+	class			T
+>
+int
+solve_spd(
+	const Matrix<n,n,T> &	A,
+	Matrix<n,p,T> &		B
+)
+{
+	Matrix<n,n,T>		L( A );
+
+	if( llt( L ) < 0 )
+		return -1;
+
+	llt_solve( L, B );
+	return 0;
+}
+
+
 template<
 	const int		n,
 	class			T
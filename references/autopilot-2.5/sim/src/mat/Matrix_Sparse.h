@@ -0,0 +1,261 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Block sparse matrix for the Kalman filter system matrices.
+ *
+ * The A matrices of the INS filters are mostly zero, with a fixed
+ * layout of nonzero blocks.  A SparseMatrix is an ordinary Matrix
+ * that also knows which columns of each row can be nonzero, so the
+ * products only touch those.  It is filled just like a Matrix; the
+ * blocks are declared with block() by whatever fills it.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _Matrix_Sparse_h_
+#define _Matrix_Sparse_h_
+
+#include <mat/Matrix.h>
+
+namespace libmat
+{
+
+template<
+	const int		n,		// Rows
+	const int		m,		// Cols
+	class			T = double	// Type of the components
+>
+class SparseMatrix : public Matrix<n,m,T>
+{
+public:
+	SparseMatrix()
+	{
+		this->clear_blocks();
+	}
+
+	/**
+	 *  Forget all of the blocks.  Every row is empty until block()
+	 * is called again.  The values are not changed.
+	 */
+	void
+	clear_blocks()
+	{
+		for( int i=0 ; i<n ; i++ )
+		{
+			this->lo[i] = m;
+			this->hi[i] = 0;
+		}
+	}
+
+	/**
+	 *  Mark the rows x cols block at (row,col) as possibly nonzero.
+	 * The nonzero columns of each row are kept as one span, so a
+	 * gap between two blocks on the same rows is still multiplied.
+	 * Declaring the same block again does nothing.
+	 */
+	void
+	block(
+		int			row,
+		int			col,
+		int			rows,
+		int			cols
+	)
+	{
+		for( int i=row ; i<row+rows ; i++ )
+		{
+			if( col < this->lo[i] )
+				this->lo[i] = col;
+			if( col + cols > this->hi[i] )
+				this->hi[i] = col + cols;
+		}
+	}
+
+	/**
+	 *  The first and one past the last column of row i that
+	 * can be nonzero.  first() >= last() for an empty row.
+	 */
+	int
+	first(
+		int			i
+	) const
+	{
+		return this->lo[i];
+	}
+
+	int
+	last(
+		int			i
+	) const
+	{
+		return this->hi[i];
+	}
+
+	/**
+	 *  The number of elements inside the blocks
+	 */
+	int
+	nonzeros() const
+	{
+		int			count = 0;
+
+		for( int i=0 ; i<n ; i++ )
+			if( this->hi[i] > this->lo[i] )
+				count += this->hi[i] - this->lo[i];
+
+		return count;
+	}
+
+	/**
+	 *  The number of nonzero elements that are outside of the
+	 * blocks.  Anything counted here is ignored by the products,
+	 * so it should always be zero; the tests check it.
+	 */
+	int
+	outside() const
+	{
+		int			count = 0;
+
+		for( int i=0 ; i<n ; i++ )
+			for( int j=0 ; j<m ; j++ )
+				if( ( j < this->lo[i] || j >= this->hi[i] )
+				&&  (*this)[i][j] != T() )
+					count++;
+
+		return count;
+	}
+
+private:
+	int			lo[n];
+	int			hi[n];
+};
+
+
+/**
+ *  C = A * B, using only the blocks of A.  Each sum is over the
+ * same k in the same order as the dense product, less the terms
+ * where A is zero, so the result is the same.
+ */
+template<
+	const int		n,
+	const int		m,
+	const int		p,
+	class			T
+>
+void
+mult(
+	Matrix<n,p,T> &		C,
+	const SparseMatrix<n,m,T> &	A,
+	const Matrix<m,p,T> &	B
+)
+{
+	for( int i=0 ; i<n ; i++ )
+	{
+		const int		k0 = A.first(i);
+		const int		k1 = A.last(i);
+
+		if( k1 <= k0 )
+		{
+			C[i].fill();
+			continue;
+		}
+
+#ifdef NO_FPU
+		for( int j=0 ; j<p ; j++ )
+		{
+			T			s = T();
+
+			for( int k=k0 ; k<k1 ; k++ )
+			{
+				if( is_zero( A[i][k] )
+				||  is_zero( B[k][j] )
+				)
+					continue;
+
+				s += A[i][k] * B[k][j];
+			}
+
+			C[i][j] = s;
+		}
+#else
+		simd::row( &C[i][0], &A[i][k0], 1, &B[k0][0], k1 - k0, p );
+#endif
+	}
+}
+
+
+template<
+	const int		n,
+	const int		m,
+	const int		p,
+	class			T
+>
+const Matrix<n,p,T>
+operator * (
+	const SparseMatrix<n,m,T> &	A,
+	const Matrix<m,p,T> &	B
+)
+{
+	Matrix<n,p,T>		C;
+
+	mult( C, A, B );
+
+	return C;
+}
+
+
+/**
+ *  Covariance propagation, P += ( A*P + P*A' + Q ) * dt, from
+ * AP = A * P.  P is symmetric, so P*A' is the transpose of A*P and
+ * does not need a second product.  Only the upper triangle is
+ * computed; it is copied to the lower one so that P stays exactly
+ * symmetric.  Q is assumed to be symmetric too.  For a symmetric P
+ * this is the same, bit for bit, as the dense expression.
+ */
+template<
+	const int		n,
+	class			T
+>
+void
+propagate_symmetric(
+	Matrix<n,n,T> &		P,
+	const Matrix<n,n,T> &	AP,
+	const Matrix<n,n,T> &	Q,
+	const T &		dt
+)
+{
+	for( int i=0 ; i<n ; i++ )
+	{
+		for( int j=i ; j<n ; j++ )
+		{
+			const T		Pdot = AP[i][j] + AP[j][i] + Q[i][j];
+
+			P[i][j] += Pdot * dt;
+			P[j][i] = P[i][j];
+		}
+	}
+}
+
+};
+#endif
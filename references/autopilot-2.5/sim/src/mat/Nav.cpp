@@ -193,25 +193,24 @@ atmosphere(
 )
 {
 	double			temp;
-	double			temp1;
-	double			temp2;
+	double			theta;
 
 	// compute density first
 	temp = (1 - (0.68753 - 0.003264*altitude*1e-5)*altitude*1e-5);
 	*density = pow( temp, 4.256)*0.0023769;
 
+	// temperature ratio, shared by the rest
+	theta = 1 - 0.687532*altitude*1e-5 + 0.003298*sqr(altitude*1e-5);
+
 	// compute pressure
-	temp = (1-(0.68753 - 0.003264*altitude*1e-5)*altitude*1e-5);
-	temp1 = pow( temp, 4.256)*0.0023769;
-	temp2 = 1716.5*(1 - 0.687532*altitude*1e-5 + 0.003298*sqr(altitude*1e-5))*518.69;
-	*pressure = temp1*temp2;
+	*pressure = *density * (1716.5*theta*518.69);
 
 	// compute temp
-	*temperature = (1 - 0.687532*altitude*1e-5 + 0.003298*sqr(altitude*1e-5))*518.69;
+	*temperature = theta*518.69;
 
 	// compute speed of sound
-	*sp_sound = 1116.45*sqrt( 1 - 0.687532*altitude*1e-5 + 0.003298*sqr(altitude*1e-5));
-}			
+	*sp_sound = 1116.45*sqrt( theta );
+}
 
 
 }
@@ -22,15 +22,18 @@ namespace libmat
 /**
  *  Convert accelerations to euler angles
  */
-static inline const Vector<3>
+template<
+	class			T
+>
+static inline const Vector<3,T>
 accel2euler(
-	const Vector<3> &	a,
-	double			heading
+	const Vector<3,T> &	a,
+	typename Vector<3,T>::value_t heading
 )
 {
-	const double		g = a.mag();
+	const T			g = a.mag();
 
-	return Vector<3>(
+	return Vector<3,T>(
 		-std::atan2( a[1], -a[2] ),	// Roll
 		-std::asin( a[0] / -g ),	// Pitch
 		heading				// Yaw
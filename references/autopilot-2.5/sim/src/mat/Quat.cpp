@@ -28,35 +28,38 @@ using std::cos;
  *
  * body = tBL(3,3)*NED
  */
-const Matrix<3,3>
+template<
+	class			T
+>
+const Matrix<3,3,T>
 eulerDC(
-        const Vector<3> &       euler
+        const Vector<3,T> &       euler
 )
 {
-	const double &		phi	= euler[0];
-	const double &		theta	= euler[1];
-	const double &		psi	= euler[2];
+	const T &		phi	= euler[0];
+	const T &		theta	= euler[1];
+	const T &		psi	= euler[2];
 
-	const double		cpsi	= cos(psi);
-	const double		cphi	= cos(phi);
-	const double		ctheta	= cos(theta);
+	const T			cpsi	= cos(psi);
+	const T			cphi	= cos(phi);
+	const T			ctheta	= cos(theta);
 
-	const double		spsi	= sin(psi);
-	const double		sphi	= sin(phi);
-	const double		stheta	= sin(theta);
+	const T			spsi	= sin(psi);
+	const T			sphi	= sin(phi);
+	const T			stheta	= sin(theta);
 
-	return Matrix<3,3>(
-		Vector<3>(
+	return Matrix<3,3,T>(
+		Vector<3,T>(
 			 cpsi*ctheta,
 			 spsi*ctheta,
 			 -stheta
 		),
-		Vector<3>(
+		Vector<3,T>(
 			 -spsi*cphi + cpsi*stheta*sphi,
 			  cpsi*cphi + spsi*stheta*sphi,
 			                   ctheta*sphi
 		),
-		Vector<3>(
+		Vector<3,T>(
 			  spsi*sphi + cpsi*stheta*cphi,
 			 -cpsi*sphi + spsi*stheta*cphi,
 			                   ctheta*cphi
@@ -73,28 +76,31 @@ eulerDC(
  * body = tBL(3,3)*NED
  * q(4,1)
  */
-const Matrix<3,3>
+template<
+	class			T
+>
+const Matrix<3,3,T>
 quatDC(
-	const Quat &		q
+	const Vector<4,T> &	q
 )
 {
-	const double &		q0 = q[0];
-	const double &		q1 = q[1];
-	const double &		q2 = q[2];
-	const double &		q3 = q[3];
+	const T &		q0 = q[0];
+	const T &		q1 = q[1];
+	const T &		q2 = q[2];
+	const T &		q3 = q[3];
 
-	return Matrix<3,3>(
-		Vector<3>(
+	return Matrix<3,3,T>(
+		Vector<3,T>(
 			1.0-2*(q2*q2 + q3*q3),
 			    2*(q1*q2 + q0*q3),
 			    2*(q1*q3 - q0*q2)
 		),
-		Vector<3>(
+		Vector<3,T>(
 			    2*(q1*q2 - q0*q3),
 			1.0-2*(q1*q1 + q3*q3),
 			    2*(q2*q3 + q0*q1)
 		),
-		Vector<3>(
+		Vector<3,T>(
 			    2*(q1*q3 + q0*q2),
 			    2*(q2*q3 - q0*q1),
 			1.0-2*(q1*q1 + q2*q2)
@@ -108,19 +114,22 @@ quatDC(
  * wx(3,3)
  * p, q, r (rad/sec)
  */
-const Matrix<3,3>
+template<
+	class			T
+>
+const Matrix<3,3,T>
 eulerWx(
-        const Vector<3> &	euler
+        const Vector<3,T> &	euler
 )
 {
-	const double &		p = euler[0];
-	const double &		q = euler[1];
-	const double &		r = euler[2];
-
-	return Matrix<3,3>(
-		Vector<3>(  0, -r,  q ),
-		Vector<3>(  r,  0, -p ),
-		Vector<3>( -q,  p,  0 )
+	const T &		p = euler[0];
+	const T &		q = euler[1];
+	const T &		r = euler[2];
+
+	return Matrix<3,3,T>(
+		Vector<3,T>(  0, -r,  q ),
+		Vector<3,T>(  r,  0, -p ),
+		Vector<3,T>( -q,  p,  0 )
 	);
 }
 
@@ -130,20 +139,23 @@ eulerWx(
  * W(4,4)
  * p, q, r (rad/sec)
  */
-const Matrix<4,4>
+template<
+	class			T
+>
+const Matrix<4,4,T>
 quatW(
-	const Vector<3>		euler
+	const Vector<3,T>	euler
 )
 {
-	const double		p = euler[0] / 2.0;
-	const double		q = euler[1] / 2.0;
-	const double		r = euler[2] / 2.0;
-
-	return Matrix<4,4>(
-		Vector<4>(  0, -p, -q, -r ),
-		Vector<4>(  p,  0,  r, -q ),
-		Vector<4>(  q, -r,  0,  p ),
-		Vector<4>(  r,  q, -p,  0 )
+	const T			p = euler[0] / 2.0;
+	const T			q = euler[1] / 2.0;
+	const T			r = euler[2] / 2.0;
+
+	return Matrix<4,4,T>(
+		Vector<4,T>(  0, -p, -q, -r ),
+		Vector<4,T>(  p,  0,  r, -q ),
+		Vector<4,T>(  q, -r,  0,  p ),
+		Vector<4,T>(  r,  q, -p,  0 )
 	);
 }
 
@@ -153,31 +165,34 @@ quatW(
  * This will convert from quaternions to euler angles
  * q(4,1) -> euler[phi;theta;psi] (rad)
  */
-const Vector<3>
+template<
+	class			T
+>
+const Vector<3,T>
 quat2euler(
-	const Quat &		q
+	const Vector<4,T> &	q
 )
 {
-	const double &		q0 = q[0];
-	const double &		q1 = q[1];
-	const double &		q2 = q[2];
-	const double &		q3 = q[3];
+	const T &		q0 = q[0];
+	const T &		q1 = q[1];
+	const T &		q2 = q[2];
+	const T &		q3 = q[3];
 
-	double			theta	= -asin(
+	T			theta	= -asin(
 		  2*(q1*q3 - q0*q2)
 	);
 
-	double			phi	= atan2(
+	T			phi	= atan2(
 	 	  2*(q2*q3 + q0*q1),
 		1-2*(q1*q1 + q2*q2)
 	);
 
-	double			psi	= atan2(
+	T			psi	= atan2(
 		  2*(q1*q2 + q0*q3),
 		1-2*(q2*q2 + q3*q3)
 	);
  
-	return Vector<3>( phi, theta, psi );
+	return Vector<3,T>( phi, theta, psi );
 }
 
 
@@ -186,25 +201,28 @@ quat2euler(
  * phi, theta, psi -> q(4,1)
  * euler angles in radians
  */
-const Quat
+template<
+	class			T
+>
+const Vector<4,T>
 euler2quat(
-	const Vector<3> &       euler
+	const Vector<3,T> &       euler
 )
 {
-	const double		phi	= euler[0] / 2.0;
-	const double		theta	= euler[1] / 2.0;
-	const double		psi	= euler[2] / 2.0;
+	const T			phi	= euler[0] / 2.0;
+	const T			theta	= euler[1] / 2.0;
+	const T			psi	= euler[2] / 2.0;
 
-	const double		shphi0   = sin( phi );
-	const double		chphi0   = cos( phi );
+	const T			shphi0   = sin( phi );
+	const T			chphi0   = cos( phi );
 
-	const double		shtheta0 = sin( theta );
-	const double		chtheta0 = cos( theta );
+	const T			shtheta0 = sin( theta );
+	const T			chtheta0 = cos( theta );
 
-	const double		shpsi0   = sin( psi );
-	const double		chpsi0   = cos( psi );
+	const T			shpsi0   = sin( psi );
+	const T			chpsi0   = cos( psi );
 
-	return Quat(
+	return Vector<4,T>(
 		  chphi0 * chtheta0 * chpsi0 + shphi0 * shtheta0 * shpsi0,
 		 -chphi0 * shtheta0 * shpsi0 + shphi0 * chtheta0 * chpsi0,
 		  chphi0 * shtheta0 * chpsi0 + shphi0 * chtheta0 * shpsi0,
@@ -222,21 +240,24 @@ euler2quat(
  * d(psi)/d(q2)
  * d(psi)/d(q3)
  */
-const Quat
+template<
+	class			T
+>
+const Vector<4,T>
 dpsi_dq(
-	const Quat &		q
+	const Vector<4,T> &	q
 )
 {
-	const double		q0 = q[0];
-	const double		q1 = q[1];
-	const double		q2 = q[2];
-	const double		q3 = q[3];
+	const T			q0 = q[0];
+	const T			q1 = q[1];
+	const T			q2 = q[2];
+	const T			q3 = q[3];
 
-	const double		t1 = 1 - 2 * (q2*q2 + q3*q2);
-	const double		t2 = 2 * (q1*q2 + q0*q3);
-	const double		err = 2 / ( t1*t1 + t2*t2 );
+	const T			t1 = 1 - 2 * (q2*q2 + q3*q2);
+	const T			t2 = 2 * (q1*q2 + q0*q3);
+	const T			err = 2 / ( t1*t1 + t2*t2 );
 
-	return Quat(
+	return Vector<4,T>(
 		err * (q3 * t1),
 		err * (q2 * t1),
 		err * (q1 * t1 + 2 * q2 * t2),
@@ -245,4 +266,23 @@ dpsi_dq(
 }
 
 
+
+/*
+ *  The filters run in either precision
+ */
+template const Matrix<3,3,float> eulerDC( const Vector<3,float> & );
+template const Matrix<3,3,float> quatDC( const Vector<4,float> & );
+template const Matrix<3,3,float> eulerWx( const Vector<3,float> & );
+template const Matrix<4,4,float> quatW( const Vector<3,float> );
+template const Vector<3,float> quat2euler( const Vector<4,float> & );
+template const Vector<4,float> euler2quat( const Vector<3,float> & );
+template const Vector<4,float> dpsi_dq( const Vector<4,float> & );
+template const Matrix<3,3,double> eulerDC( const Vector<3,double> & );
+template const Matrix<3,3,double> quatDC( const Vector<4,double> & );
+template const Matrix<3,3,double> eulerWx( const Vector<3,double> & );
+template const Matrix<4,4,double> quatW( const Vector<3,double> );
+template const Vector<3,double> quat2euler( const Vector<4,double> & );
+template const Vector<4,double> euler2quat( const Vector<3,double> & );
+template const Vector<4,double> dpsi_dq( const Vector<4,double> & );
+
 }
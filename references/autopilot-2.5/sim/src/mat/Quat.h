@@ -45,9 +45,12 @@ namespace libmat
  *
  * body = tBL(3,3)*NED
  */
-extern const Matrix<3,3>
+template<
+	class			T
+>
+const Matrix<3,3,T>
 eulerDC(
-	const Vector<3> &	euler
+	const Vector<3,T> &	euler
 );
 
 
@@ -59,9 +62,12 @@ eulerDC(
  * body = tBL(3,3)*NED
  * q(4,1)
  */
-extern const Matrix<3,3>
+template<
+	class			T
+>
+const Matrix<3,3,T>
 quatDC(
-        const Quat &		q
+        const Vector<4,T> &	q
 );
 
 
@@ -70,9 +76,12 @@ quatDC(
  * wx(3,3)
  * p, q, r (rad/sec)
  */
-extern const Matrix<3,3>
+template<
+	class			T
+>
+const Matrix<3,3,T>
 eulerWx(
-        const Vector<3> &	euler
+        const Vector<3,T> &	euler
 );
 
 
@@ -82,9 +91,12 @@ eulerWx(
  * W(4,4)
  * p, q, r (rad/sec)
  */
-extern const Matrix<4,4>
+template<
+	class			T
+>
+const Matrix<4,4,T>
 quatW(
-	const Vector<3>		euler
+	const Vector<3,T>	euler
 );
 
 
@@ -92,9 +104,12 @@ quatW(
  * This will convert from quaternions to euler angles
  * q(4,1) -> euler[phi;theta;psi] (rad)
  */
-extern const Vector<3>
+template<
+	class			T
+>
+const Vector<3,T>
 quat2euler(
-	const Quat &		q
+	const Vector<4,T> &	q
 );
 
 
@@ -103,9 +118,12 @@ quat2euler(
  * phi, theta, psi -> q(4,1)
  * euler angles in radians
  */
-extern const Quat
+template<
+	class			T
+>
+const Vector<4,T>
 euler2quat(
-	const Vector<3> &	euler
+	const Vector<3,T> &	euler
 );
 
 
@@ -118,9 +136,12 @@ euler2quat(
  * d(psi)/d(q2)
  * d(psi)/d(q3)
  */
-extern const Quat
+template<
+	class			T
+>
+const Vector<4,T>
 dpsi_dq(
-	const Quat &		q
+	const Vector<4,T> &	q
 );
 
 }
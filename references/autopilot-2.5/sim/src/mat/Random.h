@@ -0,0 +1,160 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Counter based random numbers.
+ *
+ * Draw number i from the stream with a given key is a hash of the
+ * key and i, so there is no hidden state: each model keeps its own
+ * key and counter, any draw can be made in any order, and a block
+ * of draws is a plain loop with no dependency between elements.
+ * The hash is the splitmix64 finalizer, which is the same sequence
+ * as a splitmix64 generator started from the mixed key.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _Random_h_
+#define _Random_h_
+
+#include <cmath>
+#include <stdint.h>
+
+namespace libmat
+{
+
+static inline uint64_t
+random_mix(
+	uint64_t		z
+)
+{
+	z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+	z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+	return z ^ ( z >> 31 );
+}
+
+
+/**
+ *  64 random bits, draw counter of stream key
+ */
+static inline uint64_t
+random_bits(
+	uint64_t		key,
+	uint64_t		counter
+)
+{
+	return random_mix(
+		random_mix( key ) + ( counter + 1 ) * 0x9E3779B97F4A7C15ULL
+	);
+}
+
+
+/**
+ *  Uniform on (0,1]; never zero so that it can be passed to log()
+ */
+static inline double
+random_uniform(
+	uint64_t		key,
+	uint64_t		counter
+)
+{
+	return ( ( random_bits( key, counter ) >> 11 ) + 1 )
+		* ( 1.0 / 9007199254740992.0 );
+}
+
+
+/**
+ *  The Box-Muller pair from uniform draws 2k and 2k+1
+ */
+static inline void
+random_normal_pair(
+	uint64_t		key,
+	uint64_t		k,
+	double &		n0,
+	double &		n1
+)
+{
+	const double		r = std::sqrt(
+		-2.0 * std::log( random_uniform( key, 2*k ) )
+	);
+	const double		theta = 2.0 * M_PI
+		* random_uniform( key, 2*k + 1 );
+
+	n0 = r * std::cos( theta );
+	n1 = r * std::sin( theta );
+}
+
+
+/**
+ *  Unit normal draws, count of them starting with draw number first.
+ * Normals 2k and 2k+1 come from random_normal_pair( key, k ), so
+ * draw i is the same no matter how the draws are split into blocks.
+ *
+ * Normal i of an aligned pair uses uniform draw i, so the uniforms
+ * for all of the whole pairs are made first, in a loop of integer
+ * hashes with no calls that the compiler vectorizes.  The log, sqrt,
+ * cos and sin of the Box-Muller step are still one libm call each per
+ * pair and are most of the cost.
+ */
+static inline void
+random_normals(
+	uint64_t		key,
+	uint64_t		first,
+	double *		out,
+	int			count
+)
+{
+	uint64_t		i = first;
+	const uint64_t		end = first + count;
+	double			spare;
+
+	if( i < end && ( i & 1 ) )
+	{
+		random_normal_pair( key, i / 2, spare, *out++ );
+		i++;
+	}
+
+	const int		whole = int( ( end - i ) & ~(uint64_t) 1 );
+
+	for( int j=0 ; j < whole ; j++ )
+		out[j] = random_uniform( key, i + j );
+
+	for( int j=0 ; j < whole ; j += 2 )
+	{
+		const double		r = std::sqrt( -2.0 * std::log( out[j] ) );
+		const double		theta = 2.0 * M_PI * out[j+1];
+
+		out[j]		= r * std::cos( theta );
+		out[j+1]	= r * std::sin( theta );
+	}
+
+	i += whole;
+	out += whole;
+
+	if( i < end )
+		random_normal_pair( key, i / 2, *out, spare );
+}
+
+}
+#endif
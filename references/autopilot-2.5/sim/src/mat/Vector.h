@@ -53,6 +53,8 @@ protected:
 	typedef unsigned int	index_t;
 
 public:
+	typedef T		value_t;
+
 	Vector()
 	{
 		this->fill();
@@ -330,17 +332,18 @@ public:
 
 
 /*
- *  Multiplication is commutative.
+ *  Multiplication is commutative.  The scalar is converted to the
+ * type of the vector rather than matched against anything, so this
+ * does not compete with Matrix * Vector.
  */
 template<
 	const int		n,
-	class			T1,
-	class			T2
+	class			T
 >
-Vector<n,T1> &
+const Vector<n,T>
 operator * (
-	const T2 &		s,
-	const Vector<n,T1> &	v
+	const typename Vector<n,T>::value_t & s,
+	const Vector<n,T> &	v
 )
 {
 	return v * s;
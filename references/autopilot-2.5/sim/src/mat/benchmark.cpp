@@ -1,8 +1,11 @@
 #include <iostream>
 #include <cstdlib>
+#include <cmath>
 #include <mat/Vector.h>
 #include <mat/Matrix.h>
 #include <mat/Matrix_Invert.h>
+#include <mat/Matrix_Sparse.h>
+#include <mat/Kalman.h>
 #include "timer.h"
 
 using namespace std;
@@ -101,17 +104,511 @@ dense_matrix_mult2(
 
 
 
+/*
+ *  The element by element multiply that Matrix used before the simd
+ * kernels, to compare against.
+ */
+template<
+	int			n,
+	int			m,
+	int			p,
+	class			T
+>
+const Matrix<n,p,T>
+plain_mult(
+	const Matrix<n,m,T> &	A,
+	const Matrix<m,p,T> &	B
+)
+{
+	Matrix<n,p,T>		C;
+
+	for( int i=0 ; i<n ; i++ )
+	{
+		for( int j=0 ; j<p ; j++ )
+		{
+			T		s = T();
+
+			for( int k=0 ; k<m ; k++ )
+				s += B[k][j] * A[i][k];
+
+			C[i][j] = s;
+		}
+	}
+
+	return C;
+}
+
+
+/*
+ *  Time A*B, transpose(A)*B and A+B*s with the simd kernels against
+ * the plain loops, and check that they get the same answer.  Each
+ * pass feeds the last result back in so none of it can be hoisted
+ * out of the loop; A is scaled down to keep the values bounded.
+ * Above MAT_SIMD_MAX both sides are plain loops and should be even.
+ */
+template<
+	int			n,
+	class			T
+>
+void
+simd_vs_plain(
+	int			times
+)
+{
+	const Matrix<n,n,T>	A( noise<n,n,T>( -1, 1 ) * T(1.0/n) );
+	const Matrix<n,n,T>	B( noise<n,n,T>( -1, 1 ) );
+	Matrix<n,n,T>		C( B );
+	Matrix<n,n,T>		D( B );
+	stopwatch_t		timer;
+
+	start( &timer );
+	for( int i=0 ; i<times ; i++ )
+	{
+		C = plain_mult( A, C );
+		C = plain_mult( Matrix<n,n,T>( A.transpose() ), C );
+		for( int j=0 ; j<n ; j++ )
+			for( int k=0 ; k<n ; k++ )
+				C[j][k] = C[j][k] + B[j][k] * T(0.5);
+	}
+	const unsigned long	plain = stop( &timer );
+
+	start( &timer );
+	for( int i=0 ; i<times ; i++ )
+	{
+		D = A * D;
+		D = transpose_mult( A, D );
+		D += B * T(0.5);
+	}
+	const unsigned long	fast = stop( &timer );
+
+	bool			same = true;
+
+	for( int j=0 ; j<n ; j++ )
+		for( int k=0 ; k<n ; k++ )
+			if( C[j][k] != D[j][k] )
+				same = false;
+
+	cout
+		<< n << "x" << n
+		<< ( sizeof(T) == sizeof(float) ? " float " : " double" )
+		<< ": plain " << double(plain) / times
+		<< " usec, simd " << double(fast) / times
+		<< " usec, " << double(plain) / double(fast) << "x"
+		<< ( n > MAT_SIMD_MAX ? " (plain loops)" : "" )
+		<< ( same ? "" : " RESULTS DIFFER" )
+		<< endl;
+}
+
+
+/*
+ *  A * transpose( B ) with the transpose read in place by the dot
+ * product rows, against a transposed copy of B and the row kernel.
+ * The in place side calls simd::row_dot() itself, since the lazy
+ * product only reads in place up to MAT_SIMD_MAX columns and this
+ * is where that limit comes from.  The two sum each element in the
+ * same order, so the results have to be the same.  Each pass feeds
+ * an element of the result back into B so the product can not be
+ * hoisted out of the loop.  They take turns and the best round of
+ * each is kept, as in lazy_vs_eager().
+ */
+#define TRANSPOSE_ROUNDS	8
+
+template<
+	int			n,
+	int			m,
+	int			p,
+	class			T
+>
+void
+transpose_product(
+	int			times
+)
+{
+	const Matrix<n,m,T>	A( noise<n,m,T>( -1, 1 ) );
+	Matrix<p,m,T>		B1( noise<p,m,T>( -1, 1 ) );
+	Matrix<p,m,T>		B2( B1 );
+	const int		per_round = times / TRANSPOSE_ROUNDS;
+	Matrix<n,p,T>		C1;
+	Matrix<n,p,T>		C2;
+	stopwatch_t		timer;
+	unsigned long		copy = ~0UL;
+	unsigned long		view = ~0UL;
+
+	for( int r=0 ; r<TRANSPOSE_ROUNDS ; r++ )
+	{
+		start( &timer );
+		for( int i=0 ; i<per_round ; i++ )
+		{
+			const Matrix<m,p,T>	Bt( B1.transpose() );
+
+			C1 = A * Bt;
+			B1[0][0] = C1[0][0] * T(1.0/m);
+		}
+		copy = min( copy, stop( &timer ) );
+
+		start( &timer );
+		for( int i=0 ; i<per_round ; i++ )
+		{
+			for( int j=0 ; j<n ; j++ )
+				simd::row_dot( &C2[j][0], &A[j][0], &B2[0][0], m, p );
+			B2[0][0] = C2[0][0] * T(1.0/m);
+		}
+		view = min( view, stop( &timer ) );
+	}
+
+	bool			same = true;
+
+	for( int j=0 ; j<n ; j++ )
+		for( int k=0 ; k<p ; k++ )
+			if( C1[j][k] != C2[j][k] )
+				same = false;
+
+	cout
+		<< n << "x" << m << " * (" << p << "x" << m << ")'"
+		<< ( sizeof(T) == sizeof(float) ? " float " : " double" )
+		<< ": copy " << double(copy) / per_round
+		<< " usec, in place " << double(view) / per_round
+		<< " usec, " << double(copy) / double(view) << "x"
+		<< ( same ? "" : " RESULTS DIFFER" )
+		<< endl;
+}
+
+
+/*
+ *  Covariance propagation, Pdot = (A*P + P*A' + Q) * dt; P += Pdot,
+ * as the eager operators did it, with a named temporary for each
+ * intermediate, and as one lazy expression.  A is kept stable so P
+ * settles instead of growing.  From 7x7 up the lazy expression still
+ * has a temporary for each of the two products.
+ *
+ * The two are timed in turns and the best round of each is kept,
+ * since one slow round on a busy machine is bigger than the
+ * difference being measured.
+ */
+#define LAZY_ROUNDS		8
+
+template<
+	int			n,
+	class			T
+>
+void
+lazy_vs_eager(
+	int			times
+)
+{
+	typedef Matrix<n,n,T>	M;
+
+	const M			A( eye<n,T>() * T(-0.5) + noise<n,n,T>( -1, 1 ) * T(0.1/n) );
+	const M			Q( eye<n,T>() * T(0.01) );
+	const T			dt( 0.01 );
+	const int		per_round = times / LAZY_ROUNDS;
+	M			P1( eye<n,T>() );
+	M			P2( P1 );
+	M			Pdot;
+	stopwatch_t		timer;
+	unsigned long		eager = ~0UL;
+	unsigned long		lazy = ~0UL;
+
+	for( int r=0 ; r<LAZY_ROUNDS ; r++ )
+	{
+		start( &timer );
+		for( int i=0 ; i<per_round ; i++ )
+		{
+			const M		At( A.transpose() );
+			const M		AP( A * P1 );
+			const M		PAt( P1 * At );
+			const M		S1( AP + PAt );
+			const M		S2( S1 + Q );
+
+			Pdot = S2 * dt;
+			P1 += Pdot;
+		}
+		eager = min( eager, stop( &timer ) );
+
+		start( &timer );
+		for( int i=0 ; i<per_round ; i++ )
+		{
+			Pdot = (A * P2 + P2 * A.transpose() + Q) * dt;
+			P2 += Pdot;
+		}
+		lazy = min( lazy, stop( &timer ) );
+	}
+
+	bool			same = true;
+
+	for( int j=0 ; j<n ; j++ )
+		for( int k=0 ; k<n ; k++ )
+			if( P1[j][k] != P2[j][k] )
+				same = false;
+
+	cout
+		<< n << "x" << n
+		<< ( sizeof(T) == sizeof(float) ? " float " : " double" )
+		<< ": eager " << double(eager) / per_round
+		<< " usec and 5 temporaries of " << sizeof(M)
+		<< " bytes, lazy " << double(lazy) / per_round
+		<< " usec and " << ( n * n >= 49 ? 2 : 0 )
+		<< ", " << double(eager) / double(lazy) << "x"
+		<< ( same ? "" : " RESULTS DIFFER" )
+		<< endl;
+}
+
+
+/*
+ *  Covariance propagation with the block layout of the 14 state INS
+ * A matrix, dense and with SparseMatrix and propagate_symmetric().
+ * P starts out symmetric and both ways should keep it that way and
+ * get exactly the same answer.
+ */
+template<
+	class			T
+>
+void
+sparse_vs_dense(
+	int			times
+)
+{
+	typedef Matrix<14,14,T>	M;
+
+	SparseMatrix<14,14,T>	A;
+	const M &		A_dense( A );
+	const M			Q( eye<14,T>() * T(0.01) );
+	const T			dt( 0.01 );
+	M			P1( eye<14,T>() );
+	M			P2( P1 );
+	M			AP;
+	stopwatch_t		timer;
+
+	A.block(  0,  3,  3,  7 );
+	A.block(  3,  3,  3, 11 );
+	A.block(  6,  6,  4,  4 );
+	A.block(  6, 11,  4,  3 );
+
+	for( int i=0 ; i<14 ; i++ )
+		for( int j=A.first(i) ; j<A.last(i) ; j++ )
+			A[i][j] = ( i == j ? -0.5 : drand48() * 0.1 - 0.05 );
+
+	start( &timer );
+	for( int i=0 ; i<times ; i++ )
+		P1 += (A_dense * P1 + P1 * A_dense.transpose() + Q) * dt;
+	const unsigned long	dense = stop( &timer );
+
+	start( &timer );
+	for( int i=0 ; i<times ; i++ )
+	{
+		mult( AP, A, P2 );
+		propagate_symmetric( P2, AP, Q, dt );
+	}
+	const unsigned long	sparse = stop( &timer );
+
+	bool			same = A.outside() == 0;
+
+	for( int j=0 ; j<14 ; j++ )
+		for( int k=0 ; k<14 ; k++ )
+			if( P1[j][k] != P2[j][k] )
+				same = false;
+
+	cout
+		<< "14x14"
+		<< ( sizeof(T) == sizeof(float) ? " float " : " double" )
+		<< " INS covariance: dense " << double(dense) / times
+		<< " usec, sparse " << double(sparse) / times
+		<< " usec with " << A.nonzeros() << " of " << 14*14
+		<< " elements, " << double(dense) / double(sparse) << "x"
+		<< ( same ? "" : " RESULTS DIFFER" )
+		<< endl;
+}
+
+
+/*
+ *  Kalman() as it was, with the explicit inverse of E
+ */
+template<
+	const int		n,
+	const int		m,
+	class			T
+>
+void
+invert_kalman(
+	Matrix<n,n,T> &		P,
+	Vector<n,T> &		X,
+	const Matrix<m,n,T> &	C,
+	const Matrix<m,m,T> &	R,
+	const Vector<m,T> &	err,
+	Matrix<n,m,T> &		K
+)
+{
+	const Matrix<n,m,T>	C_transpose( C.transpose() );
+
+	Matrix<m,m,T>		E( R );
+	E += mult3( C, P, C_transpose );
+
+	K = mult3( P, C_transpose,  invert( E ) );
+
+	X += K * err;
+
+	P -= mult3( K, C, P );
+}
+
+
+/*
+ *  The cost of one 14 state measurement update with m measurements,
+ * with the explicit inverse and with the Cholesky solve in Kalman().
+ * A 3x3 E is the smallest that the old code inverted with LU.
+ */
+template<
+	int			m,
+	class			T
+>
+void
+kalman_update(
+	int			times
+)
+{
+	const int		n = 14;
+	const Matrix<n,n,T>	B( noise<n,n,T>( -1, 1 ) );
+	const Matrix<n,n,T>	P0( B * B.transpose() * T(1.0/n) + eye<n,T>() );
+	const Matrix<m,n,T>	C( noise<m,n,T>( -1, 1 ) );
+	const Matrix<m,m,T>	R( eye<m,T>() * T(0.1) );
+	const Vector<m,T>	err;
+	Matrix<n,n,T>		P1;
+	Matrix<n,n,T>		P2;
+	Vector<n,T>		X;
+	Matrix<n,m,T>		K1;
+	Matrix<n,m,T>		K2;
+	stopwatch_t		timer;
+
+	start( &timer );
+	for( int i=0 ; i<times ; i++ )
+	{
+		P1 = P0;
+		invert_kalman( P1, X, C, R, err, K1 );
+	}
+	const unsigned long	inverse = stop( &timer );
+
+	start( &timer );
+	for( int i=0 ; i<times ; i++ )
+	{
+		P2 = P0;
+		Kalman( P2, X, C, R, err, K2 );
+	}
+	const unsigned long	solved = stop( &timer );
+
+	double			worst = 0;
+
+	for( int i=0 ; i<n ; i++ )
+		for( int j=0 ; j<m ; j++ )
+			worst = max( worst, fabs( double( K1[i][j] - K2[i][j] ) ) );
+
+	cout
+		<< "14 state m=" << m
+		<< ( sizeof(T) == sizeof(float) ? " float " : " double" )
+		<< ": inverse " << double(inverse) / times
+		<< " usec, solve " << double(solved) / times
+		<< " usec, " << double(inverse) / double(solved) << "x"
+		<< ", gain differs by " << worst
+		<< endl;
+}
+
+
+/*
+ *  One 14 state update with m independent measurements by each of
+ * the three forms in Kalman.h.  Like the GPS rows of the INS, each
+ * row of C sees one state directly and one attitude term.  With a
+ * dense C the sequential update takes about 2.5 times as long.  They take turns over short rounds and
+ * the best round of each is kept, as in lazy_vs_eager().  The full
+ * update subtracts K*C*P; the other two are there to keep P positive
+ * definite in float, and this is what that costs.
+ */
+#define KALMAN_ROUNDS		100
+
+template<
+	int			m,
+	class			T
+>
+void
+kalman_forms(
+	int			times
+)
+{
+	const int		n = 14;
+	const Matrix<n,n,T>	B( noise<n,n,T>( -1, 1 ) );
+	const Matrix<n,n,T>	P0( B * B.transpose() * T(1.0/n) + eye<n,T>() );
+	const Matrix<m,m,T>	R( eye<m,T>() * T(0.1) );
+	const Vector<m,T>	err;
+	const int		per_round = times / KALMAN_ROUNDS;
+	Matrix<m,n,T>		C;
+	Matrix<n,n,T>		P;
+	Matrix<n,n,T>		U0;
+	Vector<n,T>		D0;
+	Matrix<n,n,T>		U;
+	Vector<n,T>		D;
+	Vector<n,T>		X;
+	Matrix<n,m,T>		K;
+	stopwatch_t		timer;
+	unsigned long		full = ~0UL;
+	unsigned long		seq = ~0UL;
+	unsigned long		ud = ~0UL;
+
+	for( int i=0 ; i<m ; i++ )
+	{
+		C[i][i] = 1;
+		C[i][6 + i % 4] = drand48() - 0.5;
+	}
+
+	ud_factor( P0, U0, D0 );
+
+	for( int r=0 ; r<KALMAN_ROUNDS ; r++ )
+	{
+		start( &timer );
+		for( int i=0 ; i<per_round ; i++ )
+		{
+			P = P0;
+			Kalman( P, X, C, R, err, K );
+		}
+		full = min( full, stop( &timer ) );
+
+		start( &timer );
+		for( int i=0 ; i<per_round ; i++ )
+		{
+			P = P0;
+			Kalman_sequential( P, X, C, R, err );
+		}
+		seq = min( seq, stop( &timer ) );
+
+		start( &timer );
+		for( int i=0 ; i<per_round ; i++ )
+		{
+			U = U0;
+			D = D0;
+			Kalman_UD( U, D, X, C, R, err );
+		}
+		ud = min( ud, stop( &timer ) );
+	}
+
+	cout
+		<< "14 state m=" << m
+		<< ( sizeof(T) == sizeof(float) ? " float " : " double" )
+		<< ": full " << double(full) / per_round
+		<< " usec, sequential " << double(seq) / per_round
+		<< " usec, ud " << double(ud) / per_round
+		<< " usec, " << double(full) / double(seq) << "x"
+		<< endl;
+}
+
+
 template<
 	class			T
 >
 void
 scalar_mult(
 	const int		iters,
-	volatile const T &	a,
-	volatile const T &	b
+	const T			a_in,
+	const T			b_in
 )
 {
-
+	volatile T	a( a_in );
+	volatile T	b( b_in );
 	volatile T	val;
 
 	for( int i=0 ; i<iters ; i++ )
@@ -157,6 +654,52 @@ int main( void )
 	time_this( iters, ( matrix_mult3<2,7,7,2,double>( iters ) ) );
 	time_this( iters, ( matrix_mult3<2,7,7,2,float>( iters ) ) );
 
+	const int		simd_iters = 100000;
+
+	simd_vs_plain<3,double>( simd_iters );
+	simd_vs_plain<3,float>( simd_iters );
+	simd_vs_plain<4,double>( simd_iters );
+	simd_vs_plain<4,float>( simd_iters );
+	simd_vs_plain<7,double>( simd_iters );
+	simd_vs_plain<7,float>( simd_iters );
+	simd_vs_plain<11,double>( simd_iters );
+	simd_vs_plain<11,float>( simd_iters );
+	simd_vs_plain<14,double>( simd_iters );
+	simd_vs_plain<14,float>( simd_iters );
+
+	transpose_product<3,3,3,double>( simd_iters );
+	transpose_product<3,3,3,float>( simd_iters );
+	transpose_product<7,7,7,double>( simd_iters );
+	transpose_product<7,7,7,float>( simd_iters );
+	transpose_product<6,14,6,double>( simd_iters );
+	transpose_product<6,14,6,float>( simd_iters );
+	transpose_product<10,10,10,double>( simd_iters );
+	transpose_product<10,10,10,float>( simd_iters );
+	transpose_product<14,14,14,double>( simd_iters );
+	transpose_product<14,14,14,float>( simd_iters );
+
+	lazy_vs_eager<3,double>( simd_iters );
+	lazy_vs_eager<3,float>( simd_iters );
+	lazy_vs_eager<7,double>( simd_iters );
+	lazy_vs_eager<7,float>( simd_iters );
+	lazy_vs_eager<11,double>( simd_iters );
+	lazy_vs_eager<11,float>( simd_iters );
+	lazy_vs_eager<14,double>( simd_iters );
+	lazy_vs_eager<14,float>( simd_iters );
+
+	sparse_vs_dense<double>( simd_iters );
+	sparse_vs_dense<float>( simd_iters );
+
+	kalman_update<1,double>( simd_iters );
+	kalman_update<1,float>( simd_iters );
+	kalman_update<2,double>( simd_iters );
+	kalman_update<2,float>( simd_iters );
+	kalman_update<3,double>( simd_iters );
+	kalman_update<3,float>( simd_iters );
+
+	kalman_forms<6,double>( simd_iters );
+	kalman_forms<6,float>( simd_iters );
+
 	time_this( 1<<20, ( scalar_mult<uint16_t>( iters, 0xDEAD, 0x200 ) ) );
 	time_this( 1<<20, ( scalar_mult<uint32_t>( iters, 0xDEADBEEF, 0x200 ) ) );
 	time_this( 1<<20, ( scalar_mult<double>( iters, 3.15159, 0.0 ) ) );
@@ -0,0 +1,240 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Dormand-Prince 5(4) embedded Runge Kutta code
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _DOPRI5_H_
+#define _DOPRI5_H_
+
+#include <cmath>
+#include "Vector.h"
+
+namespace libmat
+{
+
+/*
+ *  X += k * c, one element at a time and without any temporaries
+ */
+template<
+	const int		n,
+	class			T
+>
+static inline void
+rk_axpy(
+	Vector<n,T> &		X,
+	const Vector<n,T> &	k,
+	double			c
+)
+{
+	for( int i=0 ; i<n ; i++ )
+		X[i] += k[i] * c;
+}
+
+
+/*
+ * This is the Dormand-Prince 5(4) integration routine.  It takes a
+ * 5th order step, and also returns the difference between the 5th
+ * and the embedded 4th order solution in error.  The caller can use
+ * that to accept or reject the step and pick the next dt; see
+ * rk_error_norm() and rk_next_dt().
+ *
+ * The method is "first same as last": its seventh stage is the
+ * derivative at the new state, which is the first stage of the next
+ * step.  So state_dot must already be the derivative at the start of
+ * the step, and the one at the end is left in next_dot.  If nothing
+ * but the state has changed in between, pass next_dot back in as
+ * state_dot for the next step and a step costs six derivative
+ * evaluations instead of seven.  After a rejected step state_dot is
+ * still good for the retry.
+ *
+ * That is still half again the four for RK4, so it only pays off
+ * when the error control allows steps that are more than half again
+ * as long.
+ */
+template<
+	class			state_t,		// State object
+	class			force_t,		// Forcing values
+	class			args_t			// Misc params
+>
+void
+DOPRI5(
+	state_t &		state,
+	const state_t &		state_dot,
+	state_t &		next_dot,
+	state_t &		error,
+	double			t,
+	const force_t &		force,
+	const args_t &		args,
+	double			dt,
+	void			(*func)(
+		state_t &		Xdot_out,	// Derivative output
+		const state_t &		X_in,		// Current state
+		const double 		t_in,		// Current time
+		const force_t &		U_in,		// Forcing values
+		const args_t &		args		// Misc params
+	)
+)
+{
+	/* backup the original state vector */
+	const state_t		X0( state );
+
+	state_t			X;
+	state_t			k2;
+	state_t			k3;
+	state_t			k4;
+	state_t			k5;
+	state_t			k6;
+	state_t &		k7( next_dot );
+
+	/* the first step was the last one of the previous step */
+	const state_t &		k1( state_dot );
+
+	/* the second step */
+	X = X0;
+	rk_axpy( X, k1, dt * (1.0/5.0) );
+	func( k2, X, t + dt * (1.0/5.0), force, args );
+
+	/* the third step */
+	X = X0;
+	rk_axpy( X, k1, dt * (3.0/40.0) );
+	rk_axpy( X, k2, dt * (9.0/40.0) );
+	func( k3, X, t + dt * (3.0/10.0), force, args );
+
+	/* the forth step */
+	X = X0;
+	rk_axpy( X, k1, dt * (44.0/45.0) );
+	rk_axpy( X, k2, dt * (-56.0/15.0) );
+	rk_axpy( X, k3, dt * (32.0/9.0) );
+	func( k4, X, t + dt * (4.0/5.0), force, args );
+
+	/* the fifth step */
+	X = X0;
+	rk_axpy( X, k1, dt * (19372.0/6561.0) );
+	rk_axpy( X, k2, dt * (-25360.0/2187.0) );
+	rk_axpy( X, k3, dt * (64448.0/6561.0) );
+	rk_axpy( X, k4, dt * (-212.0/729.0) );
+	func( k5, X, t + dt * (8.0/9.0), force, args );
+
+	/* the sixth step */
+	X = X0;
+	rk_axpy( X, k1, dt * (9017.0/3168.0) );
+	rk_axpy( X, k2, dt * (-355.0/33.0) );
+	rk_axpy( X, k3, dt * (46732.0/5247.0) );
+	rk_axpy( X, k4, dt * (49.0/176.0) );
+	rk_axpy( X, k5, dt * (-5103.0/18656.0) );
+	func( k6, X, t + dt, force, args );
+
+	/* the 5th order result */
+	X = X0;
+	rk_axpy( X, k1, dt * (35.0/384.0) );
+	rk_axpy( X, k3, dt * (500.0/1113.0) );
+	rk_axpy( X, k4, dt * (125.0/192.0) );
+	rk_axpy( X, k5, dt * (-2187.0/6784.0) );
+	rk_axpy( X, k6, dt * (11.0/84.0) );
+
+	/* the seventh step is at the new state */
+	func( k7, X, t + dt, force, args );
+
+	/* difference between the 5th and 4th order results */
+	(error = k1) *= dt * (71.0/57600.0);
+	rk_axpy( error, k3, dt * (-71.0/16695.0) );
+	rk_axpy( error, k4, dt * (71.0/1920.0) );
+	rk_axpy( error, k5, dt * (-17253.0/339200.0) );
+	rk_axpy( error, k6, dt * (22.0/525.0) );
+	rk_axpy( error, k7, dt * (-1.0/40.0) );
+
+	state = X;
+}
+
+
+/*
+ *  Scaled RMS norm of a DOPRI5 error estimate.  Each component
+ * is scaled by tolerance * (1 + the larger of its old and new
+ * magnitudes), so the tolerance is absolute for small values and
+ * relative for large ones.  The step is good if the norm is <= 1.
+ */
+template<
+	const int		n,
+	class			T
+>
+double
+rk_error_norm(
+	const Vector<n,T> &	error,
+	const Vector<n,T> &	X0,
+	const Vector<n,T> &	X1,
+	double			tolerance
+)
+{
+	double			sum = 0;
+
+	for( int i=0 ; i<n ; i++ )
+	{
+		const double	a	= std::fabs( X0[i] );
+		const double	b	= std::fabs( X1[i] );
+		const double	scale	= tolerance * ( 1.0 + ( a > b ? a : b ) );
+		const double	e	= error[i] / scale;
+
+		sum += e * e;
+	}
+
+	return std::sqrt( sum / n );
+}
+
+
+/*
+ *  Standard step size controller for a 5th order method.  Returns
+ * the dt to try next given the error norm of the last step, never
+ * changing the step by more than a factor of five.
+ */
+static inline double
+rk_next_dt(
+	double			dt,
+	double			error_norm
+)
+{
+	const double		safety	= 0.9;
+	const double		min_scale = 0.2;
+	const double		max_scale = 5.0;
+
+	if( !( error_norm < HUGE_VAL ) )
+		return dt * min_scale;
+	if( error_norm <= 0 )
+		return dt * max_scale;
+
+	double			scale = safety * std::pow( error_norm, -0.2 );
+
+	if( scale < min_scale )
+		scale = min_scale;
+	if( scale > max_scale )
+		scale = max_scale;
+
+	return dt * scale;
+}
+
+}
+#endif
@@ -0,0 +1,525 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * SIMD kernels for the small fixed size matrices in Matrix.h.
+ *
+ * The products are done a row of the output at a time, with a few
+ * columns in each register and a separate multiply and add for every
+ * element.  Each output element is still summed in the same order as
+ * the plain loops, so the results are bit for bit the same with or
+ * without SIMD.
+ *
+ * The instruction set is picked at compile time: AVX if the compiler
+ * was told it can use it (-mavx or -march=...), SSE2 on any x86-64,
+ * NEON on ARM.  Anything else, or any build with NO_SIMD or NO_FPU,
+ * uses the portable loops.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef _mat_simd_h_
+#define _mat_simd_h_
+
+#if !defined(NO_SIMD) && !defined(NO_FPU)
+#  if defined(__AVX__)
+#    define MAT_SIMD_AVX
+#    define MAT_SIMD_SSE2
+#    include <immintrin.h>
+#  elif defined(__SSE2__)
+#    define MAT_SIMD_SSE2
+#    include <emmintrin.h>
+#  elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#    define MAT_SIMD_NEON
+#    include <arm_neon.h>
+#  endif
+#endif
+
+/*
+ *  Alignment of the matrix storage.  16 bytes is what malloc() and
+ * new return on the machines we care about, so matrices inside heap
+ * objects are aligned, too.  The kernels use unaligned loads anyway,
+ * since a row of an odd width matrix is never aligned.
+ */
+#if defined(__GNUC__)
+#  define MAT_ALIGN	__attribute__((aligned(16)))
+#else
+#  define MAT_ALIGN
+#endif
+
+/*
+ *  The kernels and the expression nodes in Matrix_Expr.h are only
+ * fast if they all end up inlined into one loop.  gcc gives up on
+ * that in a big translation unit unless it is told to.
+ */
+#if defined(__GNUC__)
+#  define MAT_INLINE	inline __attribute__((always_inline))
+#else
+#  define MAT_INLINE	inline
+#endif
+
+
+namespace libmat
+{
+namespace simd
+{
+
+/*
+ *  Register types for the row kernel below.  Each one says how many
+ * T fit in a register and how to load, store and accumulate them.
+ * madd() is a separate multiply and add, never a fused one, so it
+ * rounds the same as the scalar code.
+ */
+template<
+	class			T
+>
+struct scalar_reg
+{
+	typedef T		reg_t;
+	enum { width = 1 };
+
+	static reg_t zero() { return T(); }
+	static reg_t load( const T * p ) { return *p; }
+	static void store( T * p, reg_t r ) { *p = r; }
+	static reg_t madd( reg_t acc, const T & a, reg_t b ) { return acc + b * a; }
+};
+
+#if defined(MAT_SIMD_AVX)
+struct avx_double
+{
+	typedef __m256d		reg_t;
+	enum { width = 4 };
+
+	static reg_t zero() { return _mm256_setzero_pd(); }
+	static reg_t load( const double * p ) { return _mm256_loadu_pd( p ); }
+	static void store( double * p, reg_t r ) { _mm256_storeu_pd( p, r ); }
+	static reg_t madd( reg_t acc, const double & a, reg_t b )
+	{
+		return _mm256_add_pd( acc, _mm256_mul_pd( b, _mm256_set1_pd( a ) ) );
+	}
+};
+
+struct avx_float
+{
+	typedef __m256		reg_t;
+	enum { width = 8 };
+
+	static reg_t zero() { return _mm256_setzero_ps(); }
+	static reg_t load( const float * p ) { return _mm256_loadu_ps( p ); }
+	static void store( float * p, reg_t r ) { _mm256_storeu_ps( p, r ); }
+	static reg_t madd( reg_t acc, const float & a, reg_t b )
+	{
+		return _mm256_add_ps( acc, _mm256_mul_ps( b, _mm256_set1_ps( a ) ) );
+	}
+};
+#endif
+
+#if defined(MAT_SIMD_SSE2)
+struct sse2_double
+{
+	typedef __m128d		reg_t;
+	enum { width = 2 };
+
+	static reg_t zero() { return _mm_setzero_pd(); }
+	static reg_t load( const double * p ) { return _mm_loadu_pd( p ); }
+	static void store( double * p, reg_t r ) { _mm_storeu_pd( p, r ); }
+	static reg_t madd( reg_t acc, const double & a, reg_t b )
+	{
+		return _mm_add_pd( acc, _mm_mul_pd( b, _mm_set1_pd( a ) ) );
+	}
+};
+
+struct sse2_float
+{
+	typedef __m128		reg_t;
+	enum { width = 4 };
+
+	static reg_t zero() { return _mm_setzero_ps(); }
+	static reg_t load( const float * p ) { return _mm_loadu_ps( p ); }
+	static void store( float * p, reg_t r ) { _mm_storeu_ps( p, r ); }
+	static reg_t madd( reg_t acc, const float & a, reg_t b )
+	{
+		return _mm_add_ps( acc, _mm_mul_ps( b, _mm_set1_ps( a ) ) );
+	}
+};
+#endif
+
+#if defined(MAT_SIMD_NEON)
+#if defined(__aarch64__)
+struct neon_double
+{
+	typedef float64x2_t	reg_t;
+	enum { width = 2 };
+
+	static reg_t zero() { return vdupq_n_f64( 0 ); }
+	static reg_t load( const double * p ) { return vld1q_f64( p ); }
+	static void store( double * p, reg_t r ) { vst1q_f64( p, r ); }
+	static reg_t madd( reg_t acc, const double & a, reg_t b )
+	{
+		return vaddq_f64( acc, vmulq_f64( b, vdupq_n_f64( a ) ) );
+	}
+};
+#endif
+
+struct neon_float
+{
+	typedef float32x4_t	reg_t;
+	enum { width = 4 };
+
+	static reg_t zero() { return vdupq_n_f32( 0 ); }
+	static reg_t load( const float * p ) { return vld1q_f32( p ); }
+	static void store( float * p, reg_t r ) { vst1q_f32( p, r ); }
+	static reg_t madd( reg_t acc, const float & a, reg_t b )
+	{
+		return vaddq_f32( acc, vmulq_f32( b, vdupq_n_f32( a ) ) );
+	}
+};
+#endif
+
+
+/*
+ *  c[j] = sum over k of a[k*stride] * B[k][j], for the columns from
+ * *j on that fill whole registers of V.  Two registers are done at
+ * once so the adds of one can overlap the other.  The sum for each
+ * column starts at zero and goes in order of k, exactly like the
+ * dot product of a row and a column.
+ */
+template<
+	class			V,
+	class			T
+>
+static MAT_INLINE void
+row_cols(
+	T *			c,
+	const T *		a,
+	int			stride,
+	const T *		B,
+	int			m,
+	int			p,
+	int &			j
+)
+{
+	typedef typename V::reg_t	reg_t;
+	const int			w = V::width;
+
+	for( ; j + 2*w <= p ; j += 2*w )
+	{
+		reg_t		s0 = V::zero();
+		reg_t		s1 = V::zero();
+
+		for( int k=0 ; k<m ; k++ )
+		{
+			const T &	a_k = a[k*stride];
+			const T *	B_k = B + k*p + j;
+
+			s0 = V::madd( s0, a_k, V::load( B_k ) );
+			s1 = V::madd( s1, a_k, V::load( B_k + w ) );
+		}
+
+		V::store( c + j, s0 );
+		V::store( c + j + w, s1 );
+	}
+
+	for( ; j + w <= p ; j += w )
+	{
+		reg_t		s0 = V::zero();
+
+		for( int k=0 ; k<m ; k++ )
+			s0 = V::madd( s0, a[k*stride], V::load( B + k*p + j ) );
+
+		V::store( c + j, s0 );
+	}
+}
+
+
+/*
+ *  The same row as plain loops, for the matrices that are too big
+ * for the kernels above to help.  Past MAT_SIMD_MAX columns the
+ * leftover columns and the reloads of a_k cost more than the wider
+ * registers save, and gcc does as well on its own with these.
+ */
+#define MAT_SIMD_MAX		7
+
+template<
+	class			T
+>
+static MAT_INLINE void
+row_plain(
+	T *			c,
+	const T *		a,
+	int			stride,
+	const T *		B,
+	int			m,
+	int			p
+)
+{
+	for( int j=0 ; j<p ; j++ )
+	{
+		T			s = T();
+
+		for( int k=0 ; k<m ; k++ )
+			s += B[k*p + j] * a[k*stride];
+
+		c[j] = s;
+	}
+}
+
+
+/*
+ *  One output row, using the widest registers first and finishing
+ * the leftover columns with narrower ones.
+ */
+template<
+	class			T
+>
+static MAT_INLINE void
+row(
+	T *			c,
+	const T *		a,
+	int			stride,
+	const T *		B,
+	int			m,
+	int			p
+)
+{
+	int			j = 0;
+
+	row_cols<scalar_reg<T> >( c, a, stride, B, m, p, j );
+}
+
+static MAT_INLINE void
+row(
+	double *		c,
+	const double *		a,
+	int			stride,
+	const double *		B,
+	int			m,
+	int			p
+)
+{
+	int			j = 0;
+
+	if( p > MAT_SIMD_MAX )
+	{
+		row_plain( c, a, stride, B, m, p );
+		return;
+	}
+
+#if defined(MAT_SIMD_AVX)
+	row_cols<avx_double>( c, a, stride, B, m, p, j );
+#endif
+#if defined(MAT_SIMD_SSE2)
+	row_cols<sse2_double>( c, a, stride, B, m, p, j );
+#endif
+#if defined(MAT_SIMD_NEON) && defined(__aarch64__)
+	row_cols<neon_double>( c, a, stride, B, m, p, j );
+#endif
+	row_cols<scalar_reg<double> >( c, a, stride, B, m, p, j );
+}
+
+static MAT_INLINE void
+row(
+	float *			c,
+	const float *		a,
+	int			stride,
+	const float *		B,
+	int			m,
+	int			p
+)
+{
+	int			j = 0;
+
+	if( p > MAT_SIMD_MAX )
+	{
+		row_plain( c, a, stride, B, m, p );
+		return;
+	}
+
+#if defined(MAT_SIMD_AVX)
+	row_cols<avx_float>( c, a, stride, B, m, p, j );
+#endif
+#if defined(MAT_SIMD_SSE2)
+	row_cols<sse2_float>( c, a, stride, B, m, p, j );
+#endif
+#if defined(MAT_SIMD_NEON)
+	row_cols<neon_float>( c, a, stride, B, m, p, j );
+#endif
+	row_cols<scalar_reg<float> >( c, a, stride, B, m, p, j );
+}
+
+
+/*
+ *  c[j] = dot( a, B[j] ) for the p rows of B[p][m]; one row of
+ * A * transpose(B) without the transpose.  The rows are not next to
+ * each other in a register, so this stays scalar, but four dot
+ * products are run at once to keep the adder busy.
+ */
+template<
+	class			T
+>
+static MAT_INLINE void
+row_dot(
+	T *			c,
+	const T *		a,
+	const T *		B,
+	int			m,
+	int			p
+)
+{
+	int			j = 0;
+
+	for( ; j + 4 <= p ; j += 4 )
+	{
+		const T *	B0 = B + (j+0)*m;
+		const T *	B1 = B + (j+1)*m;
+		const T *	B2 = B + (j+2)*m;
+		const T *	B3 = B + (j+3)*m;
+		T		s0 = T();
+		T		s1 = T();
+		T		s2 = T();
+		T		s3 = T();
+
+		for( int k=0 ; k<m ; k++ )
+		{
+			s0 += B0[k] * a[k];
+			s1 += B1[k] * a[k];
+			s2 += B2[k] * a[k];
+			s3 += B3[k] * a[k];
+		}
+
+		c[j+0] = s0;
+		c[j+1] = s1;
+		c[j+2] = s2;
+		c[j+3] = s3;
+	}
+
+	for( ; j < p ; j++ )
+	{
+		const T *	B_j = B + j*m;
+		T		s = T();
+
+		for( int k=0 ; k<m ; k++ )
+			s += B_j[k] * a[k];
+
+		c[j] = s;
+	}
+}
+
+
+/*
+ *  y[0..len) op= x[0..len) and y[0..len) *= s.  These are plain
+ * loops that the compiler vectorizes on its own; they are here so
+ * that Matrix can run them over the whole matrix at once instead of
+ * one short row at a time.
+ */
+template<
+	class			T
+>
+static inline void
+add(
+	T *			y,
+	const T *		x,
+	int			len
+)
+{
+	for( int i=0 ; i<len ; i++ )
+		y[i] += x[i];
+}
+
+
+template<
+	class			T
+>
+static inline void
+sub(
+	T *			y,
+	const T *		x,
+	int			len
+)
+{
+	for( int i=0 ; i<len ; i++ )
+		y[i] -= x[i];
+}
+
+
+template<
+	class			T
+>
+static inline void
+scale(
+	T *			y,
+	const T &		s,
+	int			len
+)
+{
+	for( int i=0 ; i<len ; i++ )
+		y[i] *= s;
+}
+
+
+/*
+ *  C[n][p] = A[n][m] * B[m][p]
+ */
+template<
+	class			T
+>
+static inline void
+mult(
+	T *			C,
+	const T *		A,
+	const T *		B,
+	int			n,
+	int			m,
+	int			p
+)
+{
+	for( int i=0 ; i<n ; i++ )
+		row( C + i*p, A + i*m, 1, B, m, p );
+}
+
+
+/*
+ *  C[m][p] = transpose(A[n][m]) * B[n][p], without building the
+ * transpose.
+ */
+template<
+	class			T
+>
+static inline void
+transpose_mult(
+	T *			C,
+	const T *		A,
+	const T *		B,
+	int			n,
+	int			m,
+	int			p
+)
+{
+	for( int i=0 ; i<m ; i++ )
+		row( C + i*p, A + i, m, B, n, p );
+}
+
+}
+}
+#endif
@@ -0,0 +1,221 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Check the tabulated atmosphere against atmosphere() over the whole
+ * envelope, that the cache never changes the answer, and time both.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <mat/Nav.h>
+#include <mat/Atmosphere.h>
+#include "timer.h"
+
+using namespace std;
+using namespace libmat;
+
+
+static const char *	names[4] = {
+	"density",
+	"pressure",
+	"temperature",
+	"sp_sound",
+};
+
+static const double	bounds[4] = {
+	ATMOSPHERE_DENSITY_ERROR,
+	ATMOSPHERE_PRESSURE_ERROR,
+	ATMOSPHERE_TEMPERATURE_ERROR,
+	ATMOSPHERE_SP_SOUND_ERROR,
+};
+
+
+/*
+ *  Sweep the envelope at a tenth of a foot and a bit beyond it on
+ * each side, where the table should fall back to atmosphere().
+ */
+static int
+check_error( void )
+{
+	double			worst[4] = { 0, 0, 0, 0 };
+	int			failed = 0;
+	AtmosphereCache		cache;
+
+	for( double h = ATMOSPHERE_MIN - 500 ; h < ATMOSPHERE_MAX + 500 ; h += 0.1 )
+	{
+		double		a[4];
+		double		t[4];
+
+		atmosphere( h, &a[0], &a[1], &a[2], &a[3] );
+		atmosphere_table( h, &t[0], &t[1], &t[2], &t[3], &cache );
+
+		const int	inside = h >= ATMOSPHERE_MIN && h < ATMOSPHERE_MAX;
+
+		for( int k=0 ; k<4 ; k++ )
+		{
+			const double	err = fabs( t[k] / a[k] - 1 );
+
+			if( inside && err > worst[k] )
+				worst[k] = err;
+
+			if( !inside && t[k] != a[k] )
+			{
+				printf( "FAILED: %s at %.1f ft is not analytic\n",
+					names[k],
+					h
+				);
+				return 1;
+			}
+		}
+	}
+
+	for( int k=0 ; k<4 ; k++ )
+	{
+		printf( "%-12s max relative error %.2g (bound %.2g)\n",
+			names[k],
+			worst[k],
+			bounds[k]
+		);
+
+		if( !( worst[k] <= bounds[k] ) )
+		{
+			printf( "FAILED: %s is out of bounds\n", names[k] );
+			failed++;
+		}
+	}
+
+	return failed;
+}
+
+
+/*
+ *  The same altitudes in a random order, with a shared cache, with
+ * no cache and through the selector must all agree exactly.  A NaN
+ * altitude must come back as a NaN density.
+ */
+static int
+check_cache( void )
+{
+	AtmosphereCache		cache;
+
+	for( int i=0 ; i<100000 ; i++ )
+	{
+		const double	h = ATMOSPHERE_MIN
+			+ drand48() * ( ATMOSPHERE_MAX - ATMOSPHERE_MIN );
+		double		a[4];
+		double		b[4];
+		double		c[4];
+
+		atmosphere_table( h, &a[0], &a[1], &a[2], &a[3], &cache );
+		atmosphere_table( h, &b[0], &b[1], &b[2], &b[3] );
+		atmosphere( ATMOSPHERE_TABLE, h, &c[0], &c[1], &c[2], &c[3] );
+
+		for( int k=0 ; k<4 ; k++ )
+		{
+			if( a[k] == b[k] && a[k] == c[k] )
+				continue;
+
+			printf( "FAILED: the cache changed %s at %f ft\n",
+				names[k],
+				h
+			);
+			return 1;
+		}
+	}
+
+	double			rho;
+	double			p;
+	double			T;
+	double			a;
+
+	atmosphere_table( NAN, &rho, &p, &T, &a, &cache );
+
+	if( !isnan( rho ) )
+	{
+		printf( "FAILED: NaN altitude gave a density\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  A climb at 10 ft/s in 1 msec steps, asking twice per step like
+ * the rotor and fins do.
+ */
+static double
+timing(
+	atmosphere_model_t	model,
+	int			steps
+)
+{
+	AtmosphereCache		cache;
+	stopwatch_t		timer;
+	double			sum = 0;
+
+	start( &timer );
+	for( int i=0 ; i<steps ; i++ )
+	{
+		const double	h = 500 + i * 0.01;
+		double		rho;
+		double		p;
+		double		T;
+		double		a;
+
+		atmosphere( model, h, &rho, &p, &T, &a, &cache );
+		sum += rho;
+		atmosphere( model, h, &rho, &p, &T, &a, &cache );
+		sum += rho;
+	}
+	const unsigned long	usec = stop( &timer );
+
+	printf( "%-8s %.1f nsec per query (%g)\n",
+		model == ATMOSPHERE_TABLE ? "table" : "analytic",
+		usec * 1000.0 / ( 2 * steps ),
+		sum
+	);
+
+	return usec;
+}
+
+
+int
+main( void )
+{
+	int			failed = 0;
+
+	failed += check_error();
+	failed += check_cache();
+
+	timing( ATMOSPHERE_ANALYTIC, 1000000 );
+	timing( ATMOSPHERE_TABLE, 1000000 );
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,154 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Assign lazy matrix expressions to a matrix that is also one of their
+ * operands.  Each one has to give exactly what assigning the same
+ * expression to a fresh matrix does.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <mat/Matrix.h>
+
+using namespace std;
+using namespace libmat;
+
+
+template<
+	int			n,
+	class			T
+>
+const Matrix<n,n,T>
+noise( void )
+{
+	Matrix<n,n,T>		M;
+
+	for( int i=0 ; i<n ; i++ )
+		for( int j=0 ; j<n ; j++ )
+			M[i][j] = T( drand48() * 2 - 1 );
+
+	return M;
+}
+
+
+template<
+	int			n,
+	class			T
+>
+static int
+same(
+	const char *		name,
+	const Matrix<n,n,T> &	got,
+	const Matrix<n,n,T> &	want
+)
+{
+	for( int i=0 ; i<n ; i++ )
+		for( int j=0 ; j<n ; j++ )
+		{
+			if( got[i][j] == want[i][j] )
+				continue;
+
+			printf( "FAILED: %dx%d %s: [%d][%d] is %f, not %f\n",
+				n, n,
+				name,
+				i, j,
+				double( got[i][j] ),
+				double( want[i][j] )
+			);
+
+			return -1;
+		}
+
+	return 0;
+}
+
+
+/*
+ *  want is built from the same expression into a fresh matrix, so it
+ * never aliases.
+ */
+#define CHECK( expr )							\
+	do {								\
+		M		P( P0 );				\
+		const M		want( expr );				\
+									\
+		P = expr;						\
+		rc |= same( #expr, P, want );				\
+	} while(0)
+
+
+template<
+	int			n,
+	class			T
+>
+static int
+check_alias( void )
+{
+	typedef Matrix<n,n,T>	M;
+
+	const M			A( noise<n,T>() );
+	const M			Q( noise<n,T>() );
+	const M			P0( noise<n,T>() );
+	int			rc = 0;
+
+	/* The left side writes the destination row before P is read */
+	CHECK( A * T(2) + P );
+	CHECK( A * Q + P );
+	CHECK( A * A + P );
+	CHECK( A.transpose() + P );
+	CHECK( -A + P );
+	CHECK( -P + P );
+	CHECK( P * T(2) - P );
+	CHECK( (A * T(2) + P) - Q );
+	CHECK( Q + (A * T(2) + P) );
+
+	/* These were always safe */
+	CHECK( P + A * T(2) );
+	CHECK( A + P * A );
+	CHECK( (P + Q) * T(2) );
+
+	return rc;
+}
+
+#undef CHECK
+
+
+int
+main( void )
+{
+	int			rc = 0;
+
+	srand48( 1 );
+
+	rc |= check_alias<3,double>();
+	rc |= check_alias<3,float>();
+	rc |= check_alias<7,double>();
+	rc |= check_alias<14,float>();
+
+	if( rc < 0 )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,530 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Check the linear solvers, then compare the sequential and U-D
+ * Kalman updates with the full Kalman() update on a 14 state
+ * filter.  All three must agree in double.  Then run a long filter
+ * in float, where P -= K*C*P drifts and the other two should stay
+ * with a double reference, and one with measurements so accurate
+ * that P is close to singular, where the Joseph form has to hold up.
+ * Last, the sequential update has to leave the same P as Kalman().
+ * The timings are in benchmark.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <mat/Vector.h>
+#include <mat/Matrix.h>
+#include <mat/Matrix_Invert.h>
+#include <mat/Kalman.h>
+
+using namespace std;
+using namespace libmat;
+
+static const int	N = 14;
+static const int	M = 6;
+
+
+/*
+ *  A random positive definite covariance, a GPS style C that sees
+ * position and velocity and a few attitude terms, and a diagonal R.
+ */
+static void
+setup(
+	Matrix<N,N> &		P,
+	Matrix<M,N> &		C,
+	Matrix<M,M> &		R,
+	double			r
+)
+{
+	Matrix<N,N>		B;
+
+	for( int i=0 ; i<N ; i++ )
+		for( int j=0 ; j<N ; j++ )
+			B[i][j] = drand48() * 2 - 1;
+
+	P = B * B.transpose() * (1.0 / N) + eye<N,double>() * 0.1;
+
+	C.fill();
+	R.fill();
+
+	for( int i=0 ; i<M ; i++ )
+	{
+		C[i][i] = 1;
+		C[i][6 + i % 4] = drand48() - 0.5;
+		R[i][i] = r;
+	}
+}
+
+
+template<
+	int			n,
+	int			m,
+	class			T,
+	class			S
+>
+const Matrix<n,m,T>
+to(
+	const Matrix<n,m,S> &	A
+)
+{
+	Matrix<n,m,T>		B;
+
+	for( int i=0 ; i<n ; i++ )
+		for( int j=0 ; j<m ; j++ )
+			B[i][j] = T( A[i][j] );
+
+	return B;
+}
+
+
+template<
+	int			n,
+	int			m,
+	class			T
+>
+double
+diff(
+	const Matrix<n,m,T> &	A,
+	const Matrix<n,m> &	B
+)
+{
+	double			worst = 0;
+
+	for( int i=0 ; i<n ; i++ )
+		for( int j=0 ; j<m ; j++ )
+			worst = max( worst, fabs( double(A[i][j]) - B[i][j] ) );
+
+	return worst;
+}
+
+
+template<
+	int			n,
+	class			T
+>
+double
+asymmetry(
+	const Matrix<n,n,T> &	P
+)
+{
+	double			worst = 0;
+
+	for( int i=0 ; i<n ; i++ )
+		for( int j=i+1 ; j<n ; j++ )
+			worst = max( worst, fabs( double(P[i][j] - P[j][i]) ) );
+
+	return worst;
+}
+
+
+/*
+ *  solve() and solve_spd() must give A * X = B.  A[0][0] is zero, so
+ * the LU has to pivot.
+ */
+static int
+check_solve( void )
+{
+	Matrix<N,N>		A;
+	Matrix<N,3>		B;
+
+	for( int i=0 ; i<N ; i++ )
+	{
+		for( int j=0 ; j<N ; j++ )
+			A[i][j] = drand48() * 2 - 1;
+		for( int j=0 ; j<3 ; j++ )
+			B[i][j] = drand48() * 2 - 1;
+	}
+
+	A[0][0] = 0;
+
+	Matrix<N,3>		X( B );
+	const int		rc = solve( A, X );
+	const double		lu_err = diff( Matrix<N,3>( A * X ), B );
+
+	const Matrix<N,N>	S( A * A.transpose() + eye<N,double>() );
+	Matrix<N,3>		Y( B );
+	const int		spd_rc = solve_spd( S, Y );
+	const double		llt_err = diff( Matrix<N,3>( S * Y ), B );
+
+	Matrix<N,N>		singular( A );
+	const Matrix<N,N>	negative( eye<N,double>() * -1.0 );
+	Matrix<N,3>		Z( B );
+
+	singular[3] = singular[5];
+
+	printf( "solve: lu %.2g, llt %.2g\n", lu_err, llt_err );
+
+	if( rc < 0 || spd_rc < 0 || lu_err > 1e-10 || llt_err > 1e-10 )
+	{
+		printf( "FAILED: solve is wrong\n" );
+		return 1;
+	}
+
+	if( solve( singular, Z ) == 0 || solve_spd( negative, Z ) == 0 )
+	{
+		printf( "FAILED: a bad matrix was solved\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  One update with each method in double; they must agree.
+ */
+static int
+check_agree( void )
+{
+	Matrix<N,N>		P;
+	Matrix<M,N>		C;
+	Matrix<M,M>		R;
+	Vector<N>		X;
+	Vector<M>		err;
+
+	setup( P, C, R, 0.01 );
+
+	for( int i=0 ; i<M ; i++ )
+		err[i] = drand48() - 0.5;
+
+	Matrix<N,N>		P1( P );
+	Vector<N>		X1( X );
+	Matrix<N,M>		K;
+
+	Kalman( P1, X1, C, R, err, K );
+
+	Matrix<N,N>		P2( P );
+	Vector<N>		X2( X );
+
+	Kalman_sequential( P2, X2, C, R, err );
+
+	Matrix<N,N>		U;
+	Vector<N>		D;
+	Vector<N>		X3( X );
+
+	ud_factor( P, U, D );
+
+	const double		factor_err = diff( ud_compose( U, D ), P );
+
+	Kalman_UD( U, D, X3, C, R, err );
+
+	const Matrix<N,N>	P3( ud_compose( U, D ) );
+
+	double			dX2 = 0;
+	double			dX3 = 0;
+
+	for( int i=0 ; i<N ; i++ )
+	{
+		dX2 = max( dX2, fabs( X2[i] - X1[i] ) );
+		dX3 = max( dX3, fabs( X3[i] - X1[i] ) );
+	}
+
+	printf( "double: ud factor %.2g, sequential P %.2g X %.2g,"
+		" ud P %.2g X %.2g\n",
+		factor_err,
+		diff( P2, P1 ), dX2,
+		diff( P3, P1 ), dX3
+	);
+
+	if( factor_err > 1e-12
+	||  diff( P2, P1 ) > 1e-12 || dX2 > 1e-12
+	||  diff( P3, P1 ) > 1e-12 || dX3 > 1e-12
+	)
+	{
+		printf( "FAILED: updates do not agree\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  Run a filter with a very accurate measurement for many steps,
+ * growing P by Q each step and updating it, in float with each
+ * method, against the sequential update in double.  Returns the
+ * number of failures.
+ */
+static int
+check_float(
+	int			steps
+)
+{
+	typedef Matrix<N,N,float>	Pf;
+
+	Matrix<N,N>		P;
+	Matrix<M,N>		C;
+	Matrix<M,M>		R;
+
+	setup( P, C, R, 1e-4 );
+
+	const Matrix<N,N>	Q( eye<N,double>() * 1e-3 );
+	const Matrix<M,N,float>	Cf( to<M,N,float>( C ) );
+	const Matrix<M,M,float>	Rf( to<M,M,float>( R ) );
+	const Pf		Qf( to<N,N,float>( Q ) );
+	const Vector<M,float>	err_f;
+	const Vector<M>		err;
+
+	Matrix<N,N>		P_ref( P );
+	Pf			P_full( to<N,N,float>( P ) );
+	Pf			P_seq( P_full );
+	Pf			U;
+	Vector<N,float>		D;
+	Vector<N>		X;
+	Vector<N,float>		Xf;
+	Matrix<N,M,float>	K;
+
+	ud_factor( P_full, U, D );
+
+	for( int i=0 ; i<steps ; i++ )
+	{
+		P_ref += Q;
+		Kalman_sequential( P_ref, X, C, R, err );
+
+		P_full += Qf;
+		Kalman( P_full, Xf, Cf, Rf, err_f, K );
+
+		P_seq += Qf;
+		Kalman_sequential( P_seq, Xf, Cf, Rf, err_f );
+
+		ud_factor( Pf( ud_compose( U, D ) + Qf ), U, D );
+		Kalman_UD( U, D, Xf, Cf, Rf, err_f );
+	}
+
+	const Pf		P_ud( ud_compose( U, D ) );
+	double			scale = 0;
+
+	for( int i=0 ; i<N ; i++ )
+		scale = max( scale, P_ref[i][i] );
+
+	printf( "float after %d steps, error / max(P):"
+		" full %.2g (asymmetry %.2g),"
+		" sequential %.2g, ud %.2g\n",
+		steps,
+		diff( P_full, P_ref ) / scale,
+		asymmetry( P_full ) / scale,
+		diff( P_seq, P_ref ) / scale,
+		diff( P_ud, P_ref ) / scale
+	);
+
+	int			failed = 0;
+
+	if( asymmetry( P_seq ) != 0 )
+	{
+		printf( "FAILED: sequential P is not symmetric\n" );
+		failed++;
+	}
+
+	for( int i=0 ; i<N ; i++ )
+	{
+		if( !( P_seq[i][i] > 0 ) || !( D[i] > 0 ) )
+		{
+			printf( "FAILED: P is not positive at %d\n", i );
+			failed++;
+			break;
+		}
+	}
+
+	if( !( diff( P_seq, P_ref ) < 1e-3 * scale )
+	||  !( diff( P_ud, P_ref ) < 1e-3 * scale )
+	)
+	{
+		printf( "FAILED: float P drifted from the double one\n" );
+		failed++;
+	}
+
+	return failed;
+}
+
+
+/*
+ *  Measurements a 1e-7 of P, barely above the rounding of P in float,
+ * drive it close to singular.  Over a few random filters the Joseph
+ * form update has to stay symmetric, positive on the diagonal and
+ * near the double one.  Returns the number of failures.
+ */
+static int
+check_singular(
+	int			steps
+)
+{
+	typedef Matrix<N,N,float>	Pf;
+
+	const int		trials = 4;
+	double			joseph = 0;
+	int			failed = 0;
+
+	for( int t=0 ; t<trials ; t++ )
+	{
+		Matrix<N,N>		P;
+		Matrix<M,N>		C;
+		Matrix<M,M>		R;
+
+		setup( P, C, R, 1e-8 );
+
+		const Matrix<N,N>	Q( eye<N,double>() * 1e-9 );
+		const Matrix<M,N,float>	Cf( to<M,N,float>( C ) );
+		const Matrix<M,M,float>	Rf( to<M,M,float>( R ) );
+		const Pf		Qf( to<N,N,float>( Q ) );
+		const Vector<M,float>	err_f;
+		const Vector<M>		err;
+
+		Matrix<N,N>		P_ref( P );
+		Pf			P_joseph( to<N,N,float>( P ) );
+		Vector<N>		X;
+		Vector<N,float>		Xf;
+
+		for( int i=0 ; i<steps ; i++ )
+		{
+			P_ref += Q;
+			Kalman_sequential( P_ref, X, C, R, err );
+
+			P_joseph += Qf;
+			Kalman_sequential( P_joseph, Xf, Cf, Rf, err_f );
+		}
+
+		double			scale = 0;
+
+		for( int i=0 ; i<N ; i++ )
+			scale = max( scale, P_ref[i][i] );
+
+		joseph = max( joseph, diff( P_joseph, P_ref ) / scale );
+
+		if( asymmetry( P_joseph ) != 0 )
+		{
+			printf( "FAILED: Joseph form P is not symmetric\n" );
+			failed++;
+		}
+
+		for( int i=0 ; i<N ; i++ )
+		{
+			if( !( P_joseph[i][i] > 0 ) )
+			{
+				printf( "FAILED: Joseph form P is not positive"
+					" at %d\n",
+					i
+				);
+				failed++;
+				break;
+			}
+		}
+	}
+
+	printf( "float near singular, worst of %d after %d steps,"
+		" error / max(P): joseph %.2g\n",
+		trials,
+		steps,
+		joseph
+	);
+
+	if( !( joseph < 1e-4 ) )
+	{
+		printf( "FAILED: Joseph form P drifted from the double one\n" );
+		failed++;
+	}
+
+	return failed;
+}
+
+
+/*
+ *  The sequential update has to leave the same P as Kalman(), to
+ * within the rounding of T, on the setup() filter.  How long each
+ * update takes is in benchmark.  Returns the number of failures.
+ */
+template<
+	class			T
+>
+static int
+check_match(
+	double			tolerance
+)
+{
+	Matrix<N,N>		P;
+	Matrix<M,N>		C;
+	Matrix<M,M>		R;
+
+	setup( P, C, R, 0.01 );
+
+	const Matrix<N,N,T>	P0( to<N,N,T>( P ) );
+	const Matrix<M,N,T>	Ct( to<M,N,T>( C ) );
+	const Matrix<M,M,T>	Rt( to<M,M,T>( R ) );
+	const Vector<M,T>	err;
+	Matrix<N,N,T>		P_full( P0 );
+	Matrix<N,N,T>		P_seq( P0 );
+	Vector<N,T>		X;
+	Matrix<N,M,T>		K;
+
+	Kalman( P_full, X, Ct, Rt, err, K );
+	Kalman_sequential( P_seq, X, Ct, Rt, err );
+
+	double			scale = 0;
+
+	for( int i=0 ; i<N ; i++ )
+		scale = max( scale, double( P0[i][i] ) );
+
+	const double		dP = diff( P_seq, to<N,N,double>( P_full ) )
+					/ scale;
+
+	printf( "%dx%d %s: sequential P differs from Kalman() by %.2g\n",
+		N, M,
+		sizeof(T) == sizeof(float) ? "float " : "double",
+		dP
+	);
+
+	if( !( dP < tolerance ) )
+	{
+		printf( "FAILED: sequential P differs from Kalman()\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+int
+main(
+	int			argc,
+	char **			argv
+)
+{
+	const int		steps = argc > 1 ? atoi( argv[1] ) : 10000;
+	int			failed = 0;
+
+	failed += check_solve();
+	failed += check_agree();
+	failed += check_float( steps );
+	failed += check_singular( steps );
+
+	failed += check_match<double>( 1e-12 );
+	failed += check_match<float>( 1e-5 );
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
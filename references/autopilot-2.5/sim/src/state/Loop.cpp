@@ -0,0 +1,443 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Event loop for the simulator and the flyers.  See Loop.h.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <state/Loop.h>
+
+#include <vector>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#ifdef __linux__
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/prctl.h>
+#else
+#include <sys/select.h>
+#endif
+
+#include "macros.h"
+
+namespace libstate
+{
+
+using namespace std;
+
+
+/*
+ *  Microseconds on a clock that is not set by NTP or the user
+ */
+static long long
+now_usec( void )
+{
+#ifdef __linux__
+	struct timespec		ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	struct timeval		tv;
+
+	gettimeofday( &tv, 0 );
+	return (long long) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+
+/*
+ *  Spin until the clock reaches when
+ */
+static void
+spin_until(
+	long long		when
+)
+{
+	while( now_usec() < when )
+		;
+}
+
+
+Loop::Loop() :
+	wakeups(0),
+	ticks(0),
+	missed(0),
+	late_usec(0),
+	late_max(0),
+	always(0),
+	period(0),
+	next(0),
+	spin_usec(0),
+	old_slack(-1),
+	epoll_fd(-1),
+	timer_fd(-1)
+{
+#ifdef __linux__
+	struct epoll_event	ev;
+
+	this->epoll_fd = epoll_create( 16 );
+	this->timer_fd = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK );
+
+	ev.events		= EPOLLIN;
+	ev.data.fd		= this->timer_fd;
+
+	if( this->epoll_fd >= 0 && this->timer_fd >= 0 )
+		epoll_ctl( this->epoll_fd, EPOLL_CTL_ADD, this->timer_fd, &ev );
+#endif
+}
+
+
+Loop::~Loop()
+{
+	this->spin( 0 );
+
+	if( this->timer_fd >= 0 )
+		close( this->timer_fd );
+	if( this->epoll_fd >= 0 )
+		close( this->epoll_fd );
+}
+
+
+int
+Loop::add_fd(
+	int			fd,
+	handler_t		handler,
+	void *			priv
+)
+{
+	handler_rec		h;
+
+	this->remove_fd( fd );
+
+	h.handler		= handler;
+	h.priv			= priv;
+	h.always		= false;
+
+#ifdef __linux__
+	struct epoll_event	ev;
+
+	ev.events		= EPOLLIN;
+	ev.data.fd		= fd;
+
+	if( epoll_ctl( this->epoll_fd, EPOLL_CTL_ADD, fd, &ev ) < 0 )
+	{
+		// epoll refuses regular files, which are always readable
+		if( errno != EPERM )
+			return -1;
+
+		h.always = true;
+		this->always++;
+	}
+#endif
+
+	this->handlers[fd] = h;
+	return 0;
+}
+
+
+void
+Loop::remove_fd(
+	int			fd
+)
+{
+	handler_map_t::iterator	i = this->handlers.find( fd );
+
+	if( i == this->handlers.end() )
+		return;
+
+	if( i->second.always )
+		this->always--;
+#ifdef __linux__
+	else
+		epoll_ctl( this->epoll_fd, EPOLL_CTL_DEL, fd, 0 );
+#endif
+
+	this->handlers.erase( i );
+}
+
+
+int
+Loop::tick(
+	long			usec
+)
+{
+	this->period	= usec > 0 ? usec : 0;
+	this->next	= now_usec() + this->period;
+
+	return this->arm();
+}
+
+
+int
+Loop::spin(
+	long			usec
+)
+{
+	if( usec < 0 )
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+#ifdef __linux__
+	// Sleeps end within a nanosecond of when they were asked to
+	if( usec && this->old_slack < 0 )
+	{
+		this->old_slack = prctl( PR_GET_TIMERSLACK, 0, 0, 0, 0 );
+
+		if( this->old_slack < 0
+		||  prctl( PR_SET_TIMERSLACK, 1, 0, 0, 0 ) < 0
+		)
+		{
+			this->old_slack = -1;
+			return -1;
+		}
+	} else
+	if( !usec && this->old_slack >= 0 )
+	{
+		prctl( PR_SET_TIMERSLACK, this->old_slack, 0, 0, 0 );
+		this->old_slack = -1;
+	}
+#endif
+
+	this->spin_usec = usec;
+
+	if( !this->period )
+		return 0;
+
+	return this->arm();
+}
+
+
+/*
+ *  Set the timer to the schedule that tick() started
+ */
+int
+Loop::arm()
+{
+#ifdef __linux__
+	struct itimerspec	it;
+
+	// Wake up early enough to spin to the tick
+	const long long		wake = this->next - this->spin_usec;
+
+	it.it_interval.tv_sec	= this->period / 1000000;
+	it.it_interval.tv_nsec	= ( this->period % 1000000 ) * 1000;
+	it.it_value.tv_sec	= wake / 1000000;
+	it.it_value.tv_nsec	= ( wake % 1000000 ) * 1000;
+
+	// A zero it_value disarms the timer
+	if( this->period == 0 )
+		it.it_value = it.it_interval;
+
+	if( timerfd_settime( this->timer_fd, TFD_TIMER_ABSTIME, &it, 0 ) < 0 )
+		return -1;
+#endif
+
+	return 0;
+}
+
+
+/*
+ *  The handler may remove itself or any other, so look it up again
+ */
+void
+Loop::call(
+	int			fd
+)
+{
+	handler_map_t::iterator	i = this->handlers.find( fd );
+
+	if( i == this->handlers.end() )
+		return;
+
+	i->second.handler( fd, i->second.priv );
+}
+
+
+/*
+ *  count ticks were due, or are less than spin_usec away; the newest
+ * of them is the one we are late for
+ */
+int
+Loop::ticked(
+	unsigned long long	count
+)
+{
+	const long long		due = this->next + ( count - 1 ) * this->period;
+
+	spin_until( due );
+
+	const long long		late = now_usec() - due;
+
+	if( late > 0 )
+	{
+		this->late_usec += late;
+		if( this->late_max < (unsigned long) late )
+			this->late_max = late;
+	}
+
+	this->ticks	+= count;
+	this->missed	+= count - 1;
+	this->next	+= count * this->period;
+
+	return count;
+}
+
+
+int
+Loop::poll(
+	long			usec
+)
+{
+	vector<int>		ready;
+	int			count = 0;
+
+	this->wakeups++;
+
+#ifdef __linux__
+	struct epoll_event	events[ 32 ];
+	int			timeout = -1;
+
+	if( this->always )
+		timeout = 0;
+	else
+	if( usec >= 0 )
+		timeout = ( usec + 999 ) / 1000;
+
+	const int		n = epoll_wait( this->epoll_fd, events, 32, timeout );
+
+	if( n < 0 )
+		return errno == EINTR ? 0 : -1;
+
+	for( int i=0 ; i<n ; i++ )
+	{
+		const int		fd = events[i].data.fd;
+
+		if( fd != this->timer_fd )
+		{
+			ready.push_back( fd );
+			continue;
+		}
+
+		uint64_t		expired;
+
+		if( read( this->timer_fd, &expired, sizeof(expired) ) == sizeof(expired)
+		&&  expired > 0
+		)
+			count = this->ticked( expired );
+	}
+
+	FOR_ALL_CONST( handler_map_t, i, this->handlers,
+		if( i->second.always )
+			ready.push_back( i->first );
+	);
+#else
+	fd_set			fds;
+	int			max_fd = -1;
+	struct timeval		tv;
+	struct timeval *	tvp = 0;
+
+	FD_ZERO( &fds );
+
+	FOR_ALL_CONST( handler_map_t, i, this->handlers,
+		FD_SET( i->first, &fds );
+		if( max_fd < i->first )
+			max_fd = i->first;
+	);
+
+	if( this->period )
+	{
+		long long		left = this->next - this->spin_usec - now_usec();
+
+		if( left < 0 )
+			left = 0;
+		if( usec < 0 || left < usec )
+			usec = left;
+	}
+
+	if( usec >= 0 )
+	{
+		tv.tv_sec	= usec / 1000000;
+		tv.tv_usec	= usec % 1000000;
+		tvp		= &tv;
+	}
+
+	const int		n = select( max_fd + 1, &fds, 0, 0, tvp );
+
+	if( n < 0 )
+		return errno == EINTR ? 0 : -1;
+
+	FOR_ALL_CONST( handler_map_t, i, this->handlers,
+		if( FD_ISSET( i->first, &fds ) )
+			ready.push_back( i->first );
+	);
+
+	if( this->period )
+	{
+		const long long		now = now_usec() + this->spin_usec;
+
+		if( now >= this->next )
+			count = this->ticked( ( now - this->next ) / this->period + 1 );
+	}
+#endif
+
+	FOR_ALL_CONST( vector<int>, i, ready,
+		this->call( *i );
+	);
+
+	return count;
+}
+
+
+int
+Loop::wait_tick()
+{
+	// There is no tick to wait for
+	if( !this->period )
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	while( 1 )
+	{
+		const int		rc = this->poll( -1 );
+
+		if( rc != 0 )
+			return rc;
+	}
+}
+
+
+}
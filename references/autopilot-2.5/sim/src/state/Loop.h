@@ -0,0 +1,209 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Event loop for the simulator, the flyers and anything else that
+ * waits on sockets, serial ports and a fixed rate tick.
+ *
+ * On Linux the file descriptors are watched with epoll(7) and the
+ * tick is a timerfd(2), so waiting costs almost no CPU.  The tick is
+ * on an absolute schedule: a late frame does not push the following
+ * ones back.  Elsewhere it falls back to select(2) with a timeout to
+ * the next tick.
+ *
+ * The kernel wakes a sleeper late by up to the thread's timer slack
+ * and by however long it takes to schedule it, which is more than
+ * the old loop that spun on poll() was off by.  A caller that needs
+ * the ticks closer than that can ask with spin() for the Loop to
+ * wake early and spin on the clock for the rest of each tick.  By
+ * default it does not spin and leaves the timer slack alone.
+ *
+ * The handlers are the same as Fltk's add_fd() and Server::update(),
+ * so a Server is hooked up with:
+ *
+ *	loop.add_fd( server.sock, Server::update, (void*) &server );
+ *
+ * and Server::update() drains every waiting packet in one go.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _state_Loop_h_
+#define _state_Loop_h_
+
+#include <map>
+
+namespace libstate
+{
+
+class Loop
+{
+public:
+	Loop();
+
+	~Loop();
+
+
+	typedef void		(*handler_t)(
+		int			fd,
+		void *			priv
+	);
+
+
+	/*
+	 * Call handler whenever fd is readable.  Returns 0 or -1 on
+	 * an error.
+	 *
+	 * A regular file is always readable, so its handler is called
+	 * on every wakeup, which is how IMU_filter replays a recorded
+	 * sensor log as fast as it can be read.  While one is added
+	 * the loop never sleeps: poll() returns at once, and
+	 * wait_tick() spins at full CPU until the tick.  Remove it at
+	 * the end of the file.
+	 */
+	int
+	add_fd(
+		int			fd,
+		handler_t		handler,
+		void *			priv
+	);
+
+	void
+	remove_fd(
+		int			fd
+	);
+
+
+	/*
+	 * Tick every usec microseconds from now on, or stop ticking
+	 * if usec is 0.  Returns 0 or -1 on an error.
+	 */
+	int
+	tick(
+		long			usec
+	);
+
+
+	/*
+	 * Wait up to usec microseconds, or forever if it is negative,
+	 * and call the handlers for everything that is readable.
+	 *
+	 * Returns the number of ticks that went by, which is more than
+	 * one if the caller fell behind, 0 if only file descriptors
+	 * woke us up, or -1 on an error.
+	 */
+	int
+	poll(
+		long			usec = -1
+	);
+
+
+	/*
+	 * Wake usec microseconds before each tick and spin on the
+	 * clock for the rest of it, which costs that much CPU per
+	 * tick.  0, the default, sleeps right up to the tick.
+	 *
+	 * Spinning only helps if the sleep ends on time, so a nonzero
+	 * spin also sets the timer slack of the calling thread to the
+	 * least there is.  spin(0) and ~Loop() put the old slack back,
+	 * and have to be called on the same thread to do so.
+	 * Returns 0 or -1 on an error.
+	 */
+	int
+	spin(
+		long			usec
+	);
+
+
+	/*
+	 * Handle file descriptors until the next tick.  Returns the
+	 * number of ticks that went by, or -1 on an error, with errno
+	 * set to EINVAL if tick() has not been given a period.
+	 */
+	int
+	wait_tick();
+
+
+	/*
+	 * Wakeups so far, the ticks among them, the ticks that went by
+	 * while nobody was waiting, and how late the ticks were seen.
+	 */
+	unsigned long		wakeups;
+	unsigned long		ticks;
+	unsigned long		missed;
+	unsigned long		late_usec;
+	unsigned long		late_max;
+
+private:
+	struct handler_rec {
+		handler_t		handler;
+		void *			priv;
+		bool			always;
+	};
+
+	typedef std::map<int,handler_rec>	handler_map_t;
+	handler_map_t		handlers;
+
+	// Number of handlers that are always readable
+	int			always;
+
+	// The tick period and when the next one is due, in usec
+	long			period;
+	long long		next;
+
+	// How long before each tick to start spinning, in usec, and
+	// the timer slack to put back, or -1 if it was not changed
+	long			spin_usec;
+	int			old_slack;
+
+	int			epoll_fd;
+	int			timer_fd;
+
+	// The descriptors are ours alone; a copy would close them twice
+	Loop(
+		const Loop &
+	);
+
+	Loop &
+	operator=(
+		const Loop &
+	);
+
+	int
+	arm();
+
+	void
+	call(
+		int			fd
+	);
+
+	int
+	ticked(
+		unsigned long long	count
+	);
+};
+
+}
+#endif
@@ -42,6 +42,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include "macros.h"
+#include "timer.h"
 
 namespace libstate
 {
@@ -79,11 +80,70 @@ command_open(
 }
 
 
+static void
+command_open_shm(
+	void *			priv,
+	const host_t *		src,
+	int			UNUSED( type ),
+	const struct timeval *	UNUSED( when ),
+	const void *		UNUSED( data ),
+	size_t			UNUSED( len )
+)
+{
+	Server *		self = (Server*) priv;
+
+	self->add_client( src, true );
+}
+
+
+static void
+command_open_telemetry(
+	void *			priv,
+	const host_t *		src,
+	int			UNUSED( type ),
+	const struct timeval *	UNUSED( when ),
+	const void *		data,
+	size_t			len
+)
+{
+	Server *		self = (Server*) priv;
+	int			encoding;
+	uint32_t		mask;
+
+	/* A format that we do not know still gets the raw state */
+	if( telemetry_request_decode( data, len, &encoding, &mask ) < 0 )
+		self->add_client( src );
+	else
+		self->add_client( src, encoding, mask );
+}
+
+
 
 Server::Server(
 	int			port
 ) :
-	sock(-1)
+	ring_frames(0),
+	ring_lost(0),
+	telemetry_frames(0),
+	telemetry_dropped(0),
+	send_frames(0),
+	send_syscalls(0),
+	send_datagrams(0),
+	send_usec(0),
+	recv_packets(0),
+	recv_syscalls(0),
+	sock(-1),
+	tx_sequence(0),
+	tx_time(0),
+	rx_started(false),
+	rx_sequence(0),
+	rx_state(),
+	ring(0),
+	ring_port(0),
+	ring_writer(false),
+	ring_cursor(0),
+	rx(UDP_BATCH),
+	holding(false)
 {
 	this->serve( port );
 }
@@ -94,7 +154,28 @@ Server::Server(
 	int			server_port,
 	int			port
 ) :
-	sock(-1)
+	ring_frames(0),
+	ring_lost(0),
+	telemetry_frames(0),
+	telemetry_dropped(0),
+	send_frames(0),
+	send_syscalls(0),
+	send_datagrams(0),
+	send_usec(0),
+	recv_packets(0),
+	recv_syscalls(0),
+	sock(-1),
+	tx_sequence(0),
+	tx_time(0),
+	rx_started(false),
+	rx_sequence(0),
+	rx_state(),
+	ring(0),
+	ring_port(0),
+	ring_writer(false),
+	ring_cursor(0),
+	rx(UDP_BATCH),
+	holding(false)
 {
 	this->serve( port );
 	this->connect( server_host, server_port );
@@ -148,6 +229,8 @@ Server::serve(
 	this->handle( COMMAND_NOP, command_nop, 0 );
 	this->handle( COMMAND_ACK, command_nop, 0 );
 	this->handle( COMMAND_OPEN, command_open, (void*) this );
+	this->handle( COMMAND_OPEN_SHM, command_open_shm, (void*) this );
+	this->handle( COMMAND_OPEN_TELEMETRY, command_open_telemetry, (void*) this );
 }
 
 
@@ -163,23 +246,76 @@ Server::connect(
 		return;
 	}
 
+	ring_close( this->ring, this->ring_port, this->ring_writer );
+	this->ring = 0;
+
+	/* A server on this host may share its state */
+	if( ( ntohl( this->server.sin_addr.s_addr ) >> 24 ) == 127 )
+		this->ring = ring_open( port, &this->ring_cursor );
+
+	this->ring_port		= port;
+	this->ring_writer	= false;
+
+	/* A new server numbers its frames from zero */
+	this->rx_started	= false;
+
 	/* Try to connect */
 	udp_send(
 		this->sock,
 		&this->server,
-		COMMAND_OPEN,
+		this->ring ? COMMAND_OPEN_SHM : COMMAND_OPEN,
 		0,
 		0
 	);
 }
 
 
+void
+Server::telemetry(
+	int			encoding,
+	uint32_t		mask
+)
+{
+	char			buf[ TELEMETRY_REQUEST ];
+
+	if( this->shared() )
+		return;
+
+	telemetry_request_encode( buf, encoding, mask );
+	this->rx_started = false;
+
+	udp_send(
+		this->sock,
+		&this->server,
+		COMMAND_OPEN_TELEMETRY,
+		buf,
+		sizeof(buf)
+	);
+}
+
+
+int
+Server::share(
+	int			port
+)
+{
+	ring_close( this->ring, this->ring_port, this->ring_writer );
+
+	this->ring		= ring_create( port );
+	this->ring_port		= port;
+	this->ring_writer	= true;
+
+	return this->ring ? 0 : -1;
+}
+
+
 void
 Server::add_client(
-	const host_t *		src
+	const host_t *		src,
+	bool			local
 )
 {
-	cout << "Connection from " << *src << endl;
+	cout << "Connection from " << *src << ( local ? " (shared)" : "" ) << endl;
 	udp_send( this->sock, src, COMMAND_ACK, 0, 0 );
 
 	/* Don't add a client more than once */
@@ -191,6 +327,66 @@ Server::add_client(
 	);
 
 	this->clients.push_back( *src );
+
+	if( !local || !this->ring )
+		this->remote.push_back( *src );
+}
+
+
+/*
+ *  Erasing invalidates the iterators, so this can not be a FOR_ALL
+ */
+static void
+remove_host(
+	vector<host_t> &	hosts,
+	const host_t *		src
+)
+{
+	size_t			i = 0;
+
+	while( i < hosts.size() )
+	{
+		if( hosts[i].sin_addr.s_addr == src->sin_addr.s_addr
+		&&  hosts[i].sin_port == src->sin_port
+		)
+			hosts.erase( hosts.begin() + i );
+		else
+			i++;
+	}
+}
+
+
+void
+Server::add_client(
+	const host_t *		src,
+	int			encoding,
+	uint32_t		mask
+)
+{
+	this->add_client( src );
+
+	/* It may have asked for a different format before */
+	remove_host( this->remote, src );
+
+	FOR_ALL( std::vector<format_t>, f, this->formats,
+		remove_host( f->hosts, src );
+	);
+
+	FOR_ALL( std::vector<format_t>, f, this->formats,
+		if( f->encoding != encoding || f->mask != mask )
+			continue;
+
+		f->hosts.push_back( *src );
+		return;
+	);
+
+	format_t		f;
+
+	f.encoding		= encoding;
+	f.mask			= mask;
+	f.hosts.push_back( *src );
+
+	this->formats.push_back( f );
 }
 
 
@@ -201,17 +397,169 @@ Server::del_client(
 {
 	cout << "Deleting client " << *src << endl;
 
-	FOR_ALL( clientmap_t, client, this->clients,
-		if( client->sin_addr.s_addr == src->sin_addr.s_addr
-		&&  client->sin_port == src->sin_port
-		)
-			this->clients.erase( client );
-	);
+	remove_host( this->clients, src );
+	remove_host( this->remote, src );
+
+	size_t			i = 0;
+
+	while( i < this->formats.size() )
+	{
+		remove_host( this->formats[i].hosts, src );
+
+		if( this->formats[i].hosts.empty() )
+			this->formats.erase( this->formats.begin() + i );
+		else
+			i++;
+	}
 
 	udp_send( this->sock, src, COMMAND_ACK, 0, 0 );
 }
 
 
+int
+Server::send_to(
+	const clientmap_t &	hosts,
+	const udp_packet_t *	packets,
+	int			count,
+	int *			syscalls
+)
+{
+	if( hosts.empty() || count == 0 )
+		return 0;
+
+	return udp_send_many(
+		this->sock,
+		&hosts[0],
+		hosts.size(),
+		packets,
+		count,
+		syscalls
+	);
+}
+
+
+void
+Server::send_frame(
+	const udp_packet_t *	packets,
+	int			count
+)
+{
+	stopwatch_t		timer;
+	int			syscalls = 0;
+
+	if( this->clients.empty() && !this->ring_writer )
+		return;
+
+	start( &timer );
+
+	if( !this->ring_writer && this->formats.empty() )
+	{
+		this->send_datagrams += this->send_to(
+			this->clients,
+			packets,
+			count,
+			&syscalls
+		);
+	} else {
+		this->tx_state.clear();
+		this->tx_other.clear();
+
+		for( int i=0 ; i<count ; i++ )
+		{
+			const udp_packet_t &	p( packets[i] );
+
+			if( p.type != AHRS_STATE || p.len != sizeof(state_t) )
+			{
+				this->tx_other.push_back( p );
+				continue;
+			}
+
+			if( this->ring_writer )
+				ring_write( this->ring, &p.when, (const state_t*) p.buf );
+			this->tx_state.push_back( p );
+		}
+
+		if( !this->tx_other.empty() )
+			this->send_datagrams += this->send_to(
+				this->clients,
+				&this->tx_other[0],
+				this->tx_other.size(),
+				&syscalls
+			);
+
+		if( !this->tx_state.empty() )
+		{
+			this->send_datagrams += this->send_to(
+				this->remote,
+				&this->tx_state[0],
+				this->tx_state.size(),
+				&syscalls
+			);
+
+			this->send_telemetry(
+				&this->tx_state[0],
+				this->tx_state.size(),
+				&syscalls
+			);
+		}
+	}
+
+	this->send_usec += stop( &timer );
+	this->send_syscalls += syscalls;
+	this->send_frames++;
+}
+
+
+/*
+ *  Every frame has the next sequence number, whether or not there
+ * is anyone to send it to, so that a client can tell how many it
+ * did not get.
+ */
+void
+Server::send_telemetry(
+	const udp_packet_t *	packets,
+	int			count,
+	int *			syscalls
+)
+{
+	const uint32_t		sequence = this->tx_sequence;
+
+	this->tx_sequence += count;
+	this->tx_encoded.resize( count * TELEMETRY_MAX );
+
+	FOR_ALL_CONST( std::vector<format_t>, f, this->formats,
+		this->tx_telemetry.clear();
+
+		for( int i=0 ; i<count ; i++ )
+		{
+			udp_packet_t		p( packets[i] );
+			char *			buf = &this->tx_encoded[ i * TELEMETRY_MAX ];
+
+			p.type		= AHRS_TELEMETRY;
+			p.buf		= buf;
+			p.len		= telemetry_encode(
+				buf,
+				TELEMETRY_MAX,
+				(const state_t*) packets[i].buf,
+				f->encoding,
+				f->mask,
+				sequence + i,
+				this->tx_time
+			);
+
+			this->tx_telemetry.push_back( p );
+		}
+
+		this->send_datagrams += this->send_to(
+			f->hosts,
+			&this->tx_telemetry[0],
+			count,
+			syscalls
+		);
+	);
+}
+
+
 void
 Server::send_packet(
 	int			type,
@@ -219,21 +567,65 @@ Server::send_packet(
 	size_t			len
 )
 {
-	struct timeval		now;
-	gettimeofday( &now, 0 );
+	udp_packet_t		packet;
 
-	FOR_ALL_CONST( clientmap_t, i, this->clients,
-		const host_t &client( *i );
+	gettimeofday( &packet.when, 0 );
+	packet.type		= type;
+	packet.buf		= buf;
+	packet.len		= len;
 
-		udp_send_raw(
-			this->sock,
-			&client,
-			type,
-			&now,
-			buf,
-			len
-		);
+	if( !this->holding )
+	{
+		this->send_frame( &packet, 1 );
+		return;
+	}
+
+	// The caller's buffer may be gone by flush()
+	held_t			h;
+
+	h.packet		= packet;
+	h.offset		= this->held_data.size();
+
+	this->held_data.insert(
+		this->held_data.end(),
+		(const char*) buf,
+		(const char*) buf + len
 	);
+
+	this->held.push_back( h );
+}
+
+
+void
+Server::hold()
+{
+	this->holding = true;
+}
+
+
+void
+Server::flush()
+{
+	this->holding = false;
+
+	if( this->held.empty() )
+		return;
+
+	// held_data may have moved as it grew, so the pointers are
+	// only filled in now
+	this->held_packets.clear();
+
+	FOR_ALL_CONST( std::vector<held_t>, i, this->held,
+		udp_packet_t		packet( i->packet );
+
+		packet.buf = &this->held_data[0] + i->offset;
+		this->held_packets.push_back( packet );
+	);
+
+	this->send_frame( &this->held_packets[0], this->held_packets.size() );
+
+	this->held.clear();
+	this->held_data.clear();
 }
 
 
@@ -268,12 +660,78 @@ Server::send_parameter(
 }
 
 
+/*
+ *  Nothing wakes us up when a frame lands in the ring, so look at it
+ * every RING_WAIT usec while waiting on the socket.
+ */
 int
 Server::poll(
 	int			usec
 )
 {
-	return udp_poll( this->sock, usec );
+	if( !this->shared() )
+		return udp_poll( this->sock, usec );
+
+	while( 1 )
+	{
+		if( this->ring->head != this->ring_cursor )
+			return 1;
+
+		const int		slice = usec < 0 || usec > RING_WAIT
+			? RING_WAIT
+			: usec;
+
+		const int		rc = udp_poll( this->sock, slice );
+
+		if( rc != 0 )
+			return rc;
+
+		if( usec < 0 )
+			continue;
+
+		usec -= slice;
+		if( usec <= 0 )
+			return this->ring->head != this->ring_cursor;
+	}
+}
+
+
+/*
+ *  Hand up to max frames from the ring to the AHRS_STATE handler
+ */
+int
+Server::read_ring(
+	int			max
+)
+{
+	int			count = 0;
+	struct timeval		when;
+	state_t			state;
+
+	while( count < max && ring_read(
+		this->ring,
+		&this->ring_cursor,
+		&when,
+		&state,
+		&this->ring_lost
+	) ) {
+		count++;
+		this->ring_frames++;
+
+		if( !this->handlers[AHRS_STATE].func )
+			continue;
+
+		this->handlers[AHRS_STATE].func(
+			this->handlers[AHRS_STATE].data,
+			&this->server,
+			AHRS_STATE,
+			&when,
+			&state,
+			sizeof(state)
+		);
+	}
+
+	return count;
 }
 
 
@@ -282,12 +740,126 @@ Server::get_packet()
 {
 	int			len;
 	host_t			src;
-	char			buf[ 1024 ];
+	char			buf[ UDP_MAX_PACKET ];
+
+	if( this->shared() )
+	{
+		if( this->poll( -1 ) < 0 )
+			return -1;
+
+		if( this->read_ring( 1 ) )
+			return AHRS_STATE;
+	}
+
+	len = udp_read( this->sock, &src, buf, sizeof(buf) );
+
+	return this->dispatch( &src, buf, len );
+}
+
+
+int
+Server::drain()
+{
+	int			count = 0;
+
+	if( this->shared() )
+		count += this->read_ring( RING_FRAMES );
+
+	while( 1 )
+	{
+		int			syscalls = 0;
+		const int		rc = udp_read_many(
+			this->sock,
+			&this->rx[0],
+			this->rx.size(),
+			&syscalls
+		);
+
+		this->recv_syscalls += syscalls;
+
+		if( rc < 0 )
+			return -1;
+
+		for( int i=0 ; i<rc ; i++ )
+			this->dispatch(
+				&this->rx[i].src,
+				this->rx[i].buf,
+				this->rx[i].len
+			);
+
+		count += rc;
+		this->recv_packets += rc;
+
+		// A short read means there is nothing left
+		if( rc < (int) this->rx.size() )
+			return count;
+	}
+}
+
+
+/*
+ *  Decode AHRS_TELEMETRY into the last state and hand it to the
+ * AHRS_STATE handler.  Frames that come out of order are dropped,
+ * but a sequence number far behind the last one is a server that
+ * has restarted and the count starts over from it.
+ */
+void
+Server::receive_telemetry(
+	const host_t *		src,
+	const struct timeval *	when,
+	const void *		data,
+	size_t			len
+)
+{
+	telemetry_header_t	header;
+	state_t			state = this->rx_state;
+
+	if( telemetry_decode( data, len, &state, &header ) < 0 )
+	{
+		cerr << "Invalid telemetry packet from " << *src << endl;
+		return;
+	}
+
+	const int32_t		gap = header.sequence - this->rx_sequence;
+
+	if( this->rx_started && gap >= -TELEMETRY_REORDER )
+	{
+		if( gap <= 0 )
+			return;
+
+		this->telemetry_dropped += gap - 1;
+	}
+
+	this->rx_started	= true;
+	this->rx_sequence	= header.sequence;
+	this->rx_state		= state;
+	this->telemetry_frames++;
+
+	if( !this->handlers[AHRS_STATE].func )
+		return;
+
+	this->handlers[AHRS_STATE].func(
+		this->handlers[AHRS_STATE].data,
+		src,
+		AHRS_STATE,
+		when,
+		&this->rx_state,
+		sizeof(this->rx_state)
+	);
+}
+
+
+int
+Server::dispatch(
+	const host_t *		src,
+	char *			buf,
+	int			len
+)
+{
 	char *			data;
 	struct timeval *	when;
 	uint32_t		type;
 
-	len = udp_read( this->sock, &src, buf, sizeof(buf) );
 	len -= sizeof( struct timeval ) + sizeof( uint32_t );
 	data = udp_parse( buf, &when, &type );
 
@@ -296,23 +868,29 @@ Server::get_packet()
 		cerr << "Invalid packet of type "
 			<< type
 			<< " from "
-			<< src
+			<< *src
 			<< endl;
 		return -1;
 	}
 
+	// Decoded for the AHRS_STATE handler unless it is wanted raw
+	if( type == AHRS_TELEMETRY && !this->handlers[type].func )
+	{
+		this->receive_telemetry( src, when, data, len );
+		return AHRS_STATE;
+	}
 
 	if( !this->handlers[type].func )
 	{
 		cerr << "Unhandled packet of type "
 			<< type
 			<< " from "
-			<< src
+			<< *src
 			<< endl;
 	} else {
 		this->handlers[type].func(
 			this->handlers[type].data,
-			&src,
+			src,
 			type,
 			when,
 			data,
@@ -326,6 +904,7 @@ Server::get_packet()
 
 Server::~Server()
 {
+	ring_close( this->ring, this->ring_port, this->ring_writer );
 	close( this->sock );
 }
 
@@ -337,7 +916,7 @@ Server::update(
 )
 {
 	Server *		server = (Server*) voidp;
-	server->get_packet();
+	server->drain();
 }
 
 
@@ -37,6 +37,8 @@
 #include <state/commands.h>
 
 #include <state/udp.h>
+#include <state/ring.h>
+#include <state/telemetry.h>
 #include <map>
 #include <string>
 #include <vector>
@@ -61,7 +63,9 @@ public:
 
 
 	/*
-	 * Connect and send data to a server (not us)
+	 * Connect and send data to a server (not us).  If the server
+	 * is on this host and shares its state, AHRS_STATE is read
+	 * from the shared memory ring instead of the socket.
 	 */
 	void
 	connect(
@@ -81,7 +85,8 @@ public:
 	);
 
 	/*
-	 * Send a packet to all clients.
+	 * Send a packet to all clients.  It goes to all of them in one
+	 * system call, or waits for flush() if hold() has been called.
 	 */
 	void
 	send_packet
@@ -93,7 +98,75 @@ public:
 
 
 	/*
-	 * Check for a waiting packet
+	 * Also write every AHRS_STATE into a shared memory ring named
+	 * for port.  Clients on this host that read it are no longer
+	 * sent AHRS_STATE over UDP.  Returns 0 or -1 on an error.
+	 */
+	int
+	share(
+		int			port
+	);
+
+	/* True if this client reads AHRS_STATE from a ring */
+	bool
+	shared() const
+	{
+		return this->ring && !this->ring_writer;
+	}
+
+	unsigned long		ring_frames;
+	unsigned long		ring_lost;
+
+
+	/*
+	 * Ask the server for AHRS_TELEMETRY in encoding with the
+	 * fields in mask instead of AHRS_STATE.  It is decoded into a
+	 * state_t for the AHRS_STATE handler, with the fields that are
+	 * not sent left as they were.  Does nothing if the state comes
+	 * from a ring, since that is cheaper than any encoding.
+	 */
+	void
+	telemetry(
+		int			encoding,
+		uint32_t		mask = TELEMETRY_ALL
+	);
+
+	/* Frames missing from the telemetry sequence numbers */
+	unsigned long		telemetry_frames;
+	unsigned long		telemetry_dropped;
+
+	/* Simulation time for the telemetry headers, in seconds */
+	void
+	set_time(
+		double			time
+	) {
+		this->tx_time = time;
+	}
+
+
+	/*
+	 * Hold the packets from send_packet() until flush(), so that
+	 * a frame of several packets goes out in one system call.
+	 */
+	void
+	hold();
+
+	void
+	flush();
+
+
+	/*
+	 * Send cost so far.  A frame is one send_packet() outside of
+	 * hold(), or everything from hold() to flush().
+	 */
+	unsigned long		send_frames;
+	unsigned long		send_syscalls;
+	unsigned long		send_datagrams;
+	unsigned long		send_usec;
+
+
+	/*
+	 * Check for a waiting packet or a new frame in the ring
 	 */
 	int
 	poll(
@@ -108,9 +181,29 @@ public:
 	get_packet();
 
 
+	/*
+	 * Handle every packet that is already waiting, without
+	 * blocking.  Returns the number handled or -1 on an error.
+	 */
+	int
+	drain();
+
+	unsigned long		recv_packets;
+	unsigned long		recv_syscalls;
+
+
 	void
 	add_client(
-		const host_t *		src
+		const host_t *		src,
+		bool			local = false
+	);
+
+	/* A client that asked for AHRS_TELEMETRY */
+	void
+	add_client(
+		const host_t *		src,
+		int			encoding,
+		uint32_t		mask
 	);
 
 	void
@@ -143,7 +236,7 @@ public:
 	/* You can select(2) on this file descriptor */
 	int			sock;
 
-	/* Call back from Fltk or other mainloops */
+	/* Call back from Fltk, libstate::Loop or other mainloops */
 	static void
 	update(
 		int			fd,
@@ -172,6 +265,95 @@ private:
 	typedef std::vector<host_t>	clientmap_t;
 	clientmap_t		clients;
 
+	// The clients that do not read the ring
+	clientmap_t		remote;
+
+	void
+	send_frame(
+		const udp_packet_t *	packets,
+		int			count
+	);
+
+	int
+	send_to(
+		const clientmap_t &	hosts,
+		const udp_packet_t *	packets,
+		int			count,
+		int *			syscalls
+	);
+
+	// AHRS_STATE packets go through the ring, the rest do not
+	std::vector<udp_packet_t>	tx_state;
+	std::vector<udp_packet_t>	tx_other;
+
+	// The clients that get AHRS_TELEMETRY, one group per format
+	// so that each frame is only encoded once for all of them
+	struct format_t {
+		int			encoding;
+		uint32_t		mask;
+		clientmap_t		hosts;
+	};
+
+	std::vector<format_t>	formats;
+
+	void
+	send_telemetry(
+		const udp_packet_t *	packets,
+		int			count,
+		int *			syscalls
+	);
+
+	uint32_t		tx_sequence;
+	double			tx_time;
+	std::vector<char>	tx_encoded;
+	std::vector<udp_packet_t>	tx_telemetry;
+
+	// The last AHRS_TELEMETRY frame, since it may only have some
+	// of the fields
+	bool			rx_started;
+	uint32_t		rx_sequence;
+	state_t			rx_state;
+
+	void
+	receive_telemetry(
+		const host_t *		src,
+		const struct timeval *	when,
+		const void *		data,
+		size_t			len
+	);
+
+	ring_t *		ring;
+	int			ring_port;
+	bool			ring_writer;
+	uint32_t		ring_cursor;
+
+	int
+	read_ring(
+		int			max
+	);
+
+	// Packets waiting for flush(), with their data copied into
+	// held_data at offset
+	struct held_t {
+		udp_packet_t		packet;
+		size_t			offset;
+	};
+
+	int
+	dispatch(
+		const host_t *		src,
+		char *			buf,
+		int			len
+	);
+
+	// Buffers for drain()
+	std::vector<udp_datagram_t>	rx;
+
+	bool			holding;
+	std::vector<held_t>	held;
+	std::vector<char>	held_data;
+	std::vector<udp_packet_t>	held_packets;
+
 
 	struct {
 		handler_t		func;
@@ -43,6 +43,8 @@
 
 #include <state/state.h>
 #include <state/udp.h>
+#include <state/ring.h>
+#include <state/telemetry.h>
 #include <state/commands.h>
 
 
@@ -54,6 +56,10 @@
 static int		sock;
 static host_t		server;
 
+/* A server on this host may share its state in a ring */
+static ring_t *		ring;
+static uint32_t		ring_cursor;
+
 
 int
 host_lookup(
@@ -116,15 +122,29 @@ connect_state(
 	}
 
 
+	if( ( ntohl( server.sin_addr.s_addr ) >> 24 ) == 127 )
+		ring = ring_open( port, &ring_cursor );
+
 	/* Try to connect */
 	udp_send(
 		sock,
 		&server,
-		1,
+		ring ? COMMAND_OPEN_SHM : COMMAND_OPEN,
 		0,
 		0
 	);
 
+	if( getenv( "SIMTELEMETRY" ) )
+	{
+		const char *	name = getenv( "SIMTELEMETRY" );
+		const int	encoding = telemetry_encoding( name );
+
+		if( encoding < 0 )
+			fprintf( stderr, "SIMTELEMETRY: unknown encoding %s\n", name );
+		else
+			request_telemetry( encoding, TELEMETRY_ALL );
+	}
+
 	return sock;
 }
 
@@ -161,6 +181,73 @@ send_command(
 }
 
 
+int
+request_telemetry(
+	int			encoding,
+	uint32_t		mask
+)
+{
+	char			buf[ TELEMETRY_REQUEST ];
+
+	if( ring )
+		return 0;
+
+	telemetry_request_encode( buf, encoding, mask );
+
+	return udp_send(
+		sock,
+		&server,
+		COMMAND_OPEN_TELEMETRY,
+		buf,
+		sizeof(buf)
+	);
+}
+
+
+/*
+ *  Copy out every new frame, so that none are lost, and keep the
+ * last one.  Commands like SIM_QUIT still come over the socket.
+ */
+static int
+read_ring(
+	state_t *		state,
+	int			forever
+)
+{
+	int			frames_read = 0;
+	struct timeval		when;
+
+	while( 1 )
+	{
+		char			buf[ 1024 ];
+		uint32_t		type;
+		host_t			src;
+		int			rc;
+
+		while( ring_read( ring, &ring_cursor, &when, state, 0 ) )
+			frames_read++;
+
+		if( frames_read )
+			return frames_read;
+
+		rc = udp_poll( sock, forever ? RING_WAIT : 1 );
+
+		if( rc > 0 )
+		{
+			if( udp_read( sock, &src, buf, sizeof(buf) ) < 0 )
+				return -1;
+
+			udp_parse( buf, 0, &type );
+
+			if( type == SIM_QUIT )
+				return -1;
+		} else
+		if( rc < 0 || !forever )
+			return rc;
+	}
+}
+
+
 int
 read_state(
 	state_t *		state,
@@ -171,6 +258,9 @@ read_state(
 	int			frames_read = 0;
 	static struct timeval	last_packet;
 
+	if( ring )
+		return read_ring( state, forever );
+
 	while( udp_poll( sock, forever ? -1 : 1 ) > 0 && --frames > 0 )
 	{
 		int			len;
@@ -209,6 +299,18 @@ read_state(
 
 			memcpy( state, data, sizeof(*state) );
 		}
+
+		/* Only the fields in the packet are changed */
+		if( type == AHRS_TELEMETRY )
+		{
+			len -= sizeof( struct timeval ) + sizeof( uint32_t );
+
+			if( telemetry_decode( data, len, state, 0 ) < 0 )
+				continue;
+
+			frames_read++;
+			last_packet = *when;
+		}
 	}
 
 	return frames_read;
@@ -42,9 +42,12 @@ enum {
 	COMMAND_OPEN		= 1,
 	COMMAND_ACK		= 2,
 	COMMAND_CLOSE		= 3,
+	COMMAND_OPEN_SHM	= 4,	// Open, reading AHRS_STATE from the ring
+	COMMAND_OPEN_TELEMETRY	= 5,	// Open, with AHRS_TELEMETRY for AHRS_STATE
 	
 	AHRS_STATE		= 40,
 	AHRS_DT			= 41,
+	AHRS_TELEMETRY		= 42,	// state_t in a telemetry.h packet
 
 	ATTITUDE_GAIN_YAW	= 50,
 	ATTITUDE_GAIN_ROLL	= 51,
@@ -3,7 +3,10 @@
  *
  * (c) Trammell Hudson
  *
- * Convert v2 sensor data (packed binary) to v1 text.
+ * Convert a flight recorder log (see recorder.h) to text.  State and
+ * control records are one line each, with the time first.  Sensor
+ * records are written out as the lines that came from the board, so
+ * that the output can be replayed through the IMU filter.
  *
  *************
  *
@@ -27,64 +30,160 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
-#include <math.h>
 #include <string.h>
 #include "macros.h"
 #include "state.h"
+#include "recorder.h"
+#include <getoptions/getoptions.h>
+
+
+static int
+help( void )
+{
+	fprintf( stderr,
+"Usage: log2txt [options] log-file\n"
+"\n"
+"	-h | --help		This help\n"
+"	-t | --type type	state, controls or sensor (state)\n"
+"	-s | --start seconds	First time to convert\n"
+"	-e | --end seconds	Last time to convert\n"
+"\n"
+	);
+
+	return -10;
+}
+
+
+static void
+print_state(
+	double			time,
+	const state_t *		state
+)
+{
+	printf(
+		"%f "			/* time */
+		"%f %f %f "		/* body accelerations */
+		"%f %f %f "		/* body rotational rates */
+		"%f %f %f "		/* NED positions */
+		"%f %f %f "		/* NED euler angles */
+		"%f %f %f "		/* NED velocities */
+		"%f %f "		/* Rotor mass moments */
+		"\n",
+
+		time,
+
+		state->ax,
+		state->ay,
+		state->az,
+
+		state->p,
+		state->q,
+		state->r,
+
+		state->x,
+		state->y,
+		state->z,
+
+		state->phi,
+		state->theta,
+		state->psi,
+
+		state->vx,
+		state->vy,
+		state->vz,
+
+		state->mx,
+		state->my
+	);
+}
+
+
+static void
+print_controls(
+	double			time,
+	const record_t *	rec
+)
+{
+	unsigned		i;
+
+	printf( "%f", time );
+
+	for( i=0 ; i < rec->len / sizeof(double) ; i++ )
+		printf( " %f", rec->data.value[i] );
+
+	printf( "\n" );
+}
 
 
 int
 main(
-	int			UNUSED( argc ),
-	char **			UNUSED( argv )
+	int			argc,
+	char **			argv
 )
 {
-	while(1)
+	const char *		type_name	= "state";
+	double			start_time	= 0;
+	double			end_time	= -1;
+	recording_t		log;
+	uint64_t		i;
+	int			type;
+
+	int rc = getoptions( &argc, &argv,
+		"h|?|help&",		help,
+		"t|type=s",		&type_name,
+		"s|start=d",		&start_time,
+		"e|end=d",		&end_time,
+		0
+	);
+
+	if( rc == -10 )
+		return EXIT_FAILURE;
+	if( rc < 0 || !argv[0] )
+		return help();
+
+	if( strcmp( type_name, "state" ) == 0 )
+		type = RECORD_STATE;
+	else
+	if( strcmp( type_name, "controls" ) == 0 )
+		type = RECORD_CONTROLS;
+	else
+	if( strcmp( type_name, "sensor" ) == 0 )
+		type = RECORD_SENSOR;
+	else
+		return help();
+
+	if( recording_open( &log, argv[0] ) < 0 )
 	{
-		state_t			state;
+		fprintf( stderr, "%s: Not a flight recorder log\n", argv[0] );
+		return EXIT_FAILURE;
+	}
 
-		int rc = read_state( &state, 1 );
-		if( rc < 0 )
-			break;
-		if( rc == 0 )
-			continue;
+	fprintf( stderr, "%s: %lu records%s\n",
+		argv[0],
+		(unsigned long) log.count,
+		log.index ? "" : ", not closed"
+	);
 
-		printf(
-			"%f %f %f "		/* body accelerations */
-			"%f %f %f "		/* body rotational rates */
-			"%f %f %f "		/* NED positions */
-			"%f %f %f "		/* NED euler angles */
-			"%f %f %f "		/* NED velocities */
-			"%f %f "		/* Rotor mass moments */
-			"\n",
-	
-			state.ax,
-			state.ay,
-			state.az,
-	
-			state.p,
-			state.q,
-			state.r,
-	
-			state.x,
-			state.y,
-			state.z,
-	
-			state.phi,
-			state.theta,
-			state.psi,
-	
-			state.vx,
-			state.vy,
-			state.vz,
-	
-			state.mx,
-			state.my
-		);
+	for( i = recording_find( &log, start_time ) ; i < log.count ; i++ )
+	{
+		const record_t *	rec = &log.records[i];
 
+		if( end_time >= 0 && rec->time > end_time )
+			break;
+
+		if( (int) rec->type != type )
+			continue;
 
+		if( type == RECORD_STATE )
+			print_state( rec->time, &rec->data.state );
+		else
+		if( type == RECORD_CONTROLS )
+			print_controls( rec->time, rec );
+		else
+			fwrite( rec->data.line, rec->len, 1, stdout );
 	}
 
+	recording_close( &log );
+
 	return 0;
 }
@@ -0,0 +1,415 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Binary flight recorder.  See recorder.h.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <state/recorder.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+
+/*
+ *  Keeps the compiler and the CPU from moving loads and stores
+ * across it
+ */
+#define barrier()		__sync_synchronize()
+
+
+static uint64_t
+index_size(
+	uint64_t		capacity
+)
+{
+	return ( capacity / RECORDER_STRIDE + 1 ) * sizeof(record_index_t);
+}
+
+
+/*
+ *  Move everything in the ring into the file.  Returns the number
+ * of records moved.
+ */
+static int
+drain(
+	recorder_t *		r
+)
+{
+	const uint32_t		head = r->head;
+	uint32_t		tail = r->tail;
+	int			moved = 0;
+
+	barrier();
+
+	while( tail != head )
+	{
+		const record_t *	rec = &r->ring[ tail % RECORDER_RING ];
+
+		if( r->count >= r->header->capacity )
+		{
+			r->overflow++;
+		} else {
+			if( r->count % RECORDER_STRIDE == 0 )
+			{
+				record_index_t *	i = &r->index[ r->count / RECORDER_STRIDE ];
+
+				i->time		= rec->time;
+				i->record	= r->count;
+			}
+
+			r->records[ r->count++ ] = *rec;
+		}
+
+		tail++;
+		moved++;
+	}
+
+	/* The records are in the file before the reader is told */
+	barrier();
+	r->header->records	= r->count;
+	r->tail			= tail;
+
+	return moved;
+}
+
+
+static void *
+recorder_thread(
+	void *			priv
+)
+{
+	recorder_t *		r = (recorder_t*) priv;
+
+	while( 1 )
+	{
+		/* One last look after running is cleared */
+		const int		running = r->running;
+
+		barrier();
+
+		if( drain( r ) )
+			continue;
+
+		if( !running )
+			return 0;
+
+		usleep( RECORDER_WAIT );
+	}
+}
+
+
+recorder_t *
+recorder_open(
+	const char *		filename,
+	uint64_t		capacity
+)
+{
+	recorder_t *		r;
+	struct timeval		now;
+
+	r = (recorder_t*) calloc( 1, sizeof(*r) );
+	if( !r )
+		return 0;
+
+	r->map_size	= RECORDER_HEADER
+		+ capacity * sizeof(record_t)
+		+ index_size( capacity );
+
+	r->fd = open( filename, O_RDWR | O_CREAT | O_TRUNC, 0666 );
+	if( r->fd < 0 )
+		goto fail_alloc;
+
+	if( ftruncate( r->fd, r->map_size ) < 0 )
+		goto fail_open;
+
+	r->map = (char*) mmap(
+		0,
+		r->map_size,
+		PROT_READ | PROT_WRITE,
+		MAP_SHARED,
+		r->fd,
+		0
+	);
+
+	if( r->map == MAP_FAILED )
+		goto fail_open;
+
+	r->header	= (recorder_header_t*) r->map;
+	r->records	= (record_t*)( r->map + RECORDER_HEADER );
+	r->index	= (record_index_t*)( r->records + capacity );
+
+	gettimeofday( &now, 0 );
+
+	r->header->version	= RECORDER_VERSION;
+	r->header->header_size	= RECORDER_HEADER;
+	r->header->record_size	= sizeof(record_t);
+	r->header->stride	= RECORDER_STRIDE;
+	r->header->capacity	= capacity;
+	r->header->start_sec	= now.tv_sec;
+	r->header->start_usec	= now.tv_usec;
+
+	barrier();
+	r->header->magic	= RECORDER_MAGIC;
+
+	r->running = 1;
+
+	if( pthread_create( &r->thread, 0, recorder_thread, (void*) r ) != 0 )
+		goto fail_map;
+
+	return r;
+
+fail_map:
+	munmap( r->map, r->map_size );
+fail_open:
+	close( r->fd );
+	unlink( filename );
+fail_alloc:
+	free( r );
+	return 0;
+}
+
+
+int
+recorder_write(
+	recorder_t *		r,
+	int			type,
+	double			time,
+	const void *		data,
+	size_t			len
+)
+{
+	const uint32_t		head = r->head;
+	record_t *		rec;
+
+	if( head - r->tail >= RECORDER_RING )
+	{
+		r->dropped++;
+		return -1;
+	}
+
+	if( len > sizeof(rec->data) )
+		len = sizeof(rec->data);
+
+	rec = &r->ring[ head % RECORDER_RING ];
+
+	rec->type	= type;
+	rec->len	= len;
+	rec->time	= time;
+
+	memcpy( &rec->data, data, len );
+	memset( (char*) &rec->data + len, 0, sizeof(rec->data) - len );
+
+	barrier();
+	r->head		= head + 1;
+
+	return 0;
+}
+
+
+void
+recorder_wait(
+	recorder_t *		r,
+	uint32_t		records
+)
+{
+	while( r->head - r->tail > records )
+		usleep( RECORDER_WAIT );
+}
+
+
+void
+recorder_close(
+	recorder_t *		r
+)
+{
+	uint64_t		entries;
+	size_t			used;
+
+	if( !r )
+		return;
+
+	r->running = 0;
+	pthread_join( r->thread, 0 );
+
+	/* The index goes right after the last record */
+	entries = ( r->count + RECORDER_STRIDE - 1 ) / RECORDER_STRIDE;
+
+	memmove(
+		r->records + r->count,
+		r->index,
+		entries * sizeof(record_index_t)
+	);
+
+	r->header->index_entries = entries;
+
+	used = RECORDER_HEADER
+		+ r->count * sizeof(record_t)
+		+ entries * sizeof(record_index_t);
+
+	msync( r->map, r->map_size, MS_SYNC );
+	munmap( r->map, r->map_size );
+
+	if( ftruncate( r->fd, used ) < 0 )
+		perror( "recorder" );
+
+	close( r->fd );
+	free( r );
+}
+
+
+int
+recording_open(
+	recording_t *		rec,
+	const char *		filename
+)
+{
+	const recorder_header_t *	h;
+	struct stat		st;
+	uint64_t		room;
+	size_t			index_at;
+	int			fd;
+
+	memset( rec, 0, sizeof(*rec) );
+
+	fd = open( filename, O_RDONLY );
+	if( fd < 0 )
+		return -1;
+
+	if( fstat( fd, &st ) < 0 || st.st_size < RECORDER_HEADER )
+	{
+		close( fd );
+		return -1;
+	}
+
+	rec->map_size	= st.st_size;
+	rec->map	= mmap( 0, rec->map_size, PROT_READ, MAP_SHARED, fd, 0 );
+
+	close( fd );
+
+	if( rec->map == MAP_FAILED )
+		return -1;
+
+	h = (const recorder_header_t*) rec->map;
+
+	if( h->magic != RECORDER_MAGIC
+	||  h->version != RECORDER_VERSION
+	||  h->record_size != sizeof(record_t)
+	||  h->header_size < sizeof(*h)
+	||  h->header_size > rec->map_size
+	) {
+		munmap( rec->map, rec->map_size );
+		return -1;
+	}
+
+	rec->header	= h;
+	rec->records	= (const record_t*)( (const char*) rec->map + h->header_size );
+
+	/* A log that was not closed may be cut short */
+	room		= ( rec->map_size - h->header_size ) / sizeof(record_t);
+	rec->count	= h->records < room ? h->records : room;
+
+	index_at	= h->header_size + rec->count * sizeof(record_t);
+
+	if( h->index_entries
+	&&  rec->count == h->records
+	&&  index_at + h->index_entries * sizeof(record_index_t) <= rec->map_size
+	) {
+		rec->index		= (const record_index_t*)( (const char*) rec->map + index_at );
+		rec->index_entries	= h->index_entries;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  The records are in time order, so both of these are a search for
+ * the first one that is not before time.
+ */
+uint64_t
+recording_find(
+	const recording_t *	rec,
+	double			time
+)
+{
+	uint64_t		low = 0;
+	uint64_t		high = rec->count;
+
+	if( rec->index )
+	{
+		uint64_t		i = 0;
+		uint64_t		n = rec->index_entries;
+
+		/* The last entry that is before time */
+		while( i < n )
+		{
+			const uint64_t	mid = ( i + n ) / 2;
+
+			if( rec->index[mid].time < time )
+				i = mid + 1;
+			else
+				n = mid;
+		}
+
+		if( i > 0 )
+			low = rec->index[i-1].record;
+		if( i < rec->index_entries )
+			high = rec->index[i].record;
+	}
+
+	while( low < high )
+	{
+		const uint64_t	mid = ( low + high ) / 2;
+
+		if( rec->records[mid].time < time )
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+
+void
+recording_close(
+	recording_t *		rec
+)
+{
+	if( rec->map )
+		munmap( rec->map, rec->map_size );
+
+	memset( rec, 0, sizeof(*rec) );
+}
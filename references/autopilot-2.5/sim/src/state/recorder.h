@@ -0,0 +1,242 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Binary flight recorder.
+ *
+ * A log is a header page followed by fixed size records and, once
+ * the recorder is closed, an index of the time of every
+ * RECORDER_STRIDE'th record.  The file is sized for all of the
+ * records when it is opened and is written through a shared mapping,
+ * so a record is a memory copy and not a system call.
+ *
+ * recorder_write() only copies the record into a ring in memory.  A
+ * thread moves them from there into the mapping, so the caller never
+ * waits on a page fault or the disk.  If the ring is full the record
+ * is dropped and counted; the caller is never blocked.  There may
+ * only be one thread calling recorder_write().
+ *
+ * The header has the number of records that are in the file, so a
+ * log from a program that did not close it can still be read up to
+ * the last record that the thread wrote.  It just has no index.
+ *
+ * The records are in host byte order.  log2txt converts them to text.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _state_recorder_h_
+#define _state_recorder_h_
+
+#include <state/state.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+namespace libstate
+{
+#endif
+
+#define RECORDER_MAGIC		0x41504c47	/* "APLG" */
+#define RECORDER_VERSION	1
+#define RECORDER_HEADER		4096		/* Bytes before the first record */
+#define RECORDER_RING		4096		/* Records; power of two */
+#define RECORDER_STRIDE		256		/* Records per index entry */
+#define RECORDER_WAIT		1000		/* usec between looks while idle */
+
+#define RECORD_VALUES		18
+#define RECORD_LINE		144
+
+
+enum {
+	RECORD_STATE		= 1,	/* state_t */
+	RECORD_CONTROLS		= 2,	/* Servo commands, as doubles */
+	RECORD_SENSOR		= 3,	/* A line from the sensor board */
+};
+
+
+typedef struct
+{
+	uint32_t		type;
+	uint32_t		len;		/* Bytes of data used */
+	double			time;		/* Seconds */
+
+	union {
+		state_t			state;
+		double			value[ RECORD_VALUES ];
+		char			line[ RECORD_LINE ];
+	} data;
+} record_t;
+
+
+typedef struct
+{
+	double			time;
+	uint64_t		record;
+} record_index_t;
+
+
+typedef struct
+{
+	uint32_t		magic;
+	uint32_t		version;
+	uint32_t		header_size;
+	uint32_t		record_size;
+	uint32_t		stride;
+	uint32_t		pad;
+	uint64_t		capacity;	/* Records there is room for */
+	volatile uint64_t	records;	/* Records in the file */
+	uint64_t		index_entries;	/* 0 until it is closed */
+	int64_t			start_sec;	/* Wall clock when opened */
+	int64_t			start_usec;
+} recorder_header_t;
+
+
+typedef struct
+{
+	int			fd;
+	char *			map;
+	size_t			map_size;
+	recorder_header_t *	header;
+	record_t *		records;
+	record_index_t *	index;		/* Built at the end of the map */
+
+	/* Written only by the caller of recorder_write() */
+	volatile uint32_t	head;
+
+	/* Written only by the thread */
+	volatile uint32_t	tail;
+	uint64_t		count;
+
+	volatile int		running;
+	pthread_t		thread;
+
+	/* Records lost to a full ring and to a full file */
+	unsigned long		dropped;
+	unsigned long		overflow;
+
+	record_t		ring[ RECORDER_RING ];
+} recorder_t;
+
+
+/*
+ *  What a reader maps
+ */
+typedef struct
+{
+	void *			map;
+	size_t			map_size;
+	const recorder_header_t *	header;
+	const record_t *	records;
+	uint64_t		count;
+	const record_index_t *	index;		/* NULL if it was not closed */
+	uint64_t		index_entries;
+} recording_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ *  Create filename with room for capacity records and start the
+ * thread.  Returns NULL on an error.
+ */
+extern recorder_t *
+recorder_open(
+	const char *		filename,
+	uint64_t		capacity
+);
+
+
+/*
+ *  Copy len bytes of data into a record.  Returns 0, or -1 if the
+ * ring was full and the record was dropped.
+ */
+extern int
+recorder_write(
+	recorder_t *		recorder,
+	int			type,
+	double			time,
+	const void *		data,
+	size_t			len
+);
+
+
+/*
+ *  Wait until no more than records are left in the ring.  For a
+ * caller that is not real time and should not outrun the thread.
+ */
+extern void
+recorder_wait(
+	recorder_t *		recorder,
+	uint32_t		records
+);
+
+
+/*
+ *  Write out what is left in the ring, add the index and cut the
+ * file down to what was used.
+ */
+extern void
+recorder_close(
+	recorder_t *		recorder
+);
+
+
+/*
+ *  Map a log read only.  Returns 0, or -1 if it can not be read or
+ * is not a log that this library wrote.
+ */
+extern int
+recording_open(
+	recording_t *		recording,
+	const char *		filename
+);
+
+
+/*
+ *  The first record at or after time, or recording->count if there
+ * are none.  Uses the index if there is one.
+ */
+extern uint64_t
+recording_find(
+	const recording_t *	recording,
+	double			time
+);
+
+
+extern void
+recording_close(
+	recording_t *		recording
+);
+
+
+#ifdef __cplusplus
+}
+}
+#endif
+
+#endif
@@ -0,0 +1,270 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Shared memory ring of state_t frames.  See ring.h.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <state/ring.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/*
+ *  Keeps the compiler and the CPU from moving loads and stores
+ * across it
+ */
+#define barrier()		__sync_synchronize()
+
+
+static void
+ring_name(
+	char *			name,
+	size_t			len,
+	int			port
+)
+{
+	snprintf( name, len, "/autopilot-state-%d", port );
+}
+
+
+ring_t *
+ring_create(
+	int			port
+)
+{
+	char			name[ 64 ];
+	ring_t *		ring;
+	int			fd;
+
+	ring_name( name, sizeof(name), port );
+
+	/* Readers of an old ring keep their mapping of it */
+	shm_unlink( name );
+
+	fd = shm_open( name, O_RDWR | O_CREAT | O_EXCL, 0644 );
+	if( fd < 0 )
+		return 0;
+
+	if( ftruncate( fd, sizeof(*ring) ) < 0 )
+	{
+		close( fd );
+		shm_unlink( name );
+		return 0;
+	}
+
+	ring = (ring_t*) mmap(
+		0,
+		sizeof(*ring),
+		PROT_READ | PROT_WRITE,
+		MAP_SHARED,
+		fd,
+		0
+	);
+
+	close( fd );
+
+	if( ring == MAP_FAILED )
+	{
+		shm_unlink( name );
+		return 0;
+	}
+
+	memset( ring, 0, sizeof(*ring) );
+
+	ring->protocol		= STATE_PROTOCOL;
+	ring->frames		= RING_FRAMES;
+	ring->frame_size	= sizeof( ring_frame_t );
+	ring->pid		= getpid();
+
+	/* Readers check the magic last */
+	barrier();
+	ring->magic		= RING_MAGIC;
+
+	return ring;
+}
+
+
+ring_t *
+ring_open(
+	int			port,
+	uint32_t *		cursor
+)
+{
+	char			name[ 64 ];
+	ring_t *		ring;
+	int			fd;
+
+	ring_name( name, sizeof(name), port );
+
+	fd = shm_open( name, O_RDONLY, 0 );
+	if( fd < 0 )
+		return 0;
+
+	ring = (ring_t*) mmap(
+		0,
+		sizeof(*ring),
+		PROT_READ,
+		MAP_SHARED,
+		fd,
+		0
+	);
+
+	close( fd );
+
+	if( ring == MAP_FAILED )
+		return 0;
+
+	if( ring->magic != RING_MAGIC
+	||  ring->protocol != STATE_PROTOCOL
+	||  ring->frames != RING_FRAMES
+	||  ring->frame_size != sizeof( ring_frame_t )
+	||  ( kill( ring->pid, 0 ) < 0 && errno == ESRCH )
+	) {
+		munmap( (void*) ring, sizeof(*ring) );
+		return 0;
+	}
+
+	barrier();
+	*cursor = ring->head;
+
+	return ring;
+}
+
+
+void
+ring_close(
+	ring_t *		ring,
+	int			port,
+	int			writer
+)
+{
+	char			name[ 64 ];
+
+	if( !ring )
+		return;
+
+	munmap( (void*) ring, sizeof(*ring) );
+
+	if( !writer )
+		return;
+
+	ring_name( name, sizeof(name), port );
+	shm_unlink( name );
+}
+
+
+void
+ring_write(
+	ring_t *		ring,
+	const struct timeval *	when,
+	const state_t *		state
+)
+{
+	const uint32_t		n = ring->head;
+	ring_frame_t *		f = &ring->ring[ n % RING_FRAMES ];
+
+	f->seq++;
+	barrier();
+
+	f->number	= n;
+	f->when		= *when;
+	f->state	= *state;
+
+	barrier();
+	f->seq++;
+
+	barrier();
+	ring->head	= n + 1;
+}
+
+
+int
+ring_read(
+	const ring_t *		ring,
+	uint32_t *		cursor,
+	struct timeval *	when,
+	state_t *		state,
+	unsigned long *		lost
+)
+{
+	int			tries;
+
+	/* Only a writer that died in the middle of a frame stops this */
+	for( tries=0 ; tries<1000 ; tries++ )
+	{
+		const uint32_t		head = ring->head;
+		const ring_frame_t *	f;
+		uint32_t		seq;
+		ring_frame_t		copy;
+
+		barrier();
+
+		if( *cursor == head )
+			return 0;
+
+		/* Lapped; skip to the oldest frame that is left */
+		if( head - *cursor > RING_FRAMES )
+		{
+			if( lost )
+				*lost += head - *cursor - RING_FRAMES;
+			*cursor = head - RING_FRAMES;
+		}
+
+		f = &ring->ring[ *cursor % RING_FRAMES ];
+
+		seq = f->seq;
+		barrier();
+
+		memcpy( &copy, (const void*) f, sizeof(copy) );
+
+		barrier();
+
+		/* Torn or overwritten while we copied it; try again */
+		if( ( seq & 1 )
+		||  seq != f->seq
+		||  copy.number != *cursor
+		)
+			continue;
+
+		*when	= copy.when;
+		*state	= copy.state;
+		(*cursor)++;
+
+		return 1;
+	}
+
+	return 0;
+}
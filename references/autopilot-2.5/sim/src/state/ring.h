@@ -0,0 +1,149 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Shared memory ring of state_t frames for clients on the same host.
+ *
+ * The server writes each AHRS_STATE into the next slot of a ring in
+ * a POSIX shared memory segment named after its port.  Each slot has
+ * a sequence lock: the count is odd while the slot is being written,
+ * so a reader that copies a slot and sees the same even count before
+ * and after has an untorn frame.  There is only one writer and any
+ * number of readers, and the readers never write to the segment, so
+ * they cannot slow the server down.
+ *
+ * A reader that keeps up gets every frame with a memory copy and no
+ * system call.  One that falls more than RING_FRAMES behind skips to
+ * the oldest frame still in the ring and is told how many it lost.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _state_ring_h_
+#define _state_ring_h_
+
+#include <state/state.h>
+#include <sys/time.h>
+
+#ifdef __cplusplus
+namespace libstate
+{
+#endif
+
+#define RING_MAGIC		0x52494e47	/* "RING" */
+#define RING_FRAMES		64		/* Power of two */
+#define RING_WAIT		1000		/* usec between looks while idle */
+
+
+typedef struct
+{
+	volatile uint32_t	seq;		/* Odd while being written */
+	uint32_t		number;		/* Frame number in the slot */
+	struct timeval		when;
+	state_t			state;
+} ring_frame_t;
+
+
+typedef struct
+{
+	uint32_t		magic;
+	uint32_t		protocol;	/* STATE_PROTOCOL */
+	uint32_t		frames;
+	uint32_t		frame_size;
+	int32_t			pid;		/* Of the writer */
+	volatile uint32_t	head;		/* Frames written */
+	ring_frame_t		ring[ RING_FRAMES ];
+} ring_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ *  The writer makes a new, empty ring for its port.  An old ring from
+ * a server that is gone is replaced.  Returns NULL on an error.
+ */
+extern ring_t *
+ring_create(
+	int			port
+);
+
+
+/*
+ *  A reader maps the ring for port read only.  Returns NULL if there
+ * is none, it does not match this library or its writer has exited.
+ * *cursor is set to the next frame to be written, so only new frames
+ * will be read.
+ */
+extern ring_t *
+ring_open(
+	int			port,
+	uint32_t *		cursor
+);
+
+
+/*
+ *  Unmap the ring.  The writer also removes the name.
+ */
+extern void
+ring_close(
+	ring_t *		ring,
+	int			port,
+	int			writer
+);
+
+
+extern void
+ring_write(
+	ring_t *		ring,
+	const struct timeval *	when,
+	const state_t *		state
+);
+
+
+/*
+ *  Copy the frame at *cursor and move the cursor on.  Returns 1 if
+ * there was a frame and 0 if the reader is caught up.  The number of
+ * frames that were overwritten before they could be read is added to
+ * *lost, if it is not NULL.
+ */
+extern int
+ring_read(
+	const ring_t *		ring,
+	uint32_t *		cursor,
+	struct timeval *	when,
+	state_t *		state,
+	unsigned long *		lost
+);
+
+
+#ifdef __cplusplus
+}
+}
+#endif
+
+#endif
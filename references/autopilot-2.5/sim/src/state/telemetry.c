@@ -0,0 +1,380 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Compact, versioned telemetry encoding of state_t.  See telemetry.h.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <state/telemetry.h>
+
+#include <string.h>
+#include <math.h>
+
+
+/*
+ *  Size of one quantum of each field for TELEMETRY_QUANT16,
+ * in state_t order.
+ */
+static const double	resolution[ TELEMETRY_FIELDS ] = {
+	0.01,	0.01,	0.01,		/* ax, ay, az */
+	0.001,	0.001,	0.001,		/* p, r, q */
+	0.1,	0.1,	0.1,		/* x, y, z */
+	0.0001,	0.0001,	0.0001,		/* phi, theta, psi */
+	0.01,	0.01,	0.01,		/* vx, vy, vz */
+	0.01,	0.01,			/* mx, my */
+};
+
+
+static const int	field_size[] = {
+	8,				/* TELEMETRY_FLOAT64 */
+	4,				/* TELEMETRY_FLOAT32 */
+	2,				/* TELEMETRY_QUANT16 */
+};
+
+#define ENCODINGS		3
+
+static const char *	encoding_name[] = {
+	"float64",
+	"float32",
+	"quant16",
+};
+
+
+/*
+ *  The fields of state_t are all doubles, so it is indexed as an
+ * array of them.
+ */
+static double *
+field(
+	state_t *		state,
+	int			i
+)
+{
+	return &( (double*) state )[i];
+}
+
+
+static void
+put16(
+	uint8_t *		p,
+	uint16_t		v
+)
+{
+	p[0] = v >> 0;
+	p[1] = v >> 8;
+}
+
+
+static void
+put32(
+	uint8_t *		p,
+	uint32_t		v
+)
+{
+	p[0] = v >>  0;
+	p[1] = v >>  8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+
+static uint16_t
+get16(
+	const uint8_t *		p
+)
+{
+	return p[0] | p[1] << 8;
+}
+
+
+static uint32_t
+get32(
+	const uint8_t *		p
+)
+{
+	return (uint32_t) p[0] <<  0
+		| (uint32_t) p[1] <<  8
+		| (uint32_t) p[2] << 16
+		| (uint32_t) p[3] << 24;
+}
+
+
+static int
+fields(
+	uint32_t		mask
+)
+{
+	int			count = 0;
+
+	while( mask )
+	{
+		count += mask & 1;
+		mask >>= 1;
+	}
+
+	return count;
+}
+
+
+int
+telemetry_size(
+	int			encoding,
+	uint32_t		mask
+)
+{
+	if( encoding < 0 || encoding >= ENCODINGS )
+		return -1;
+
+	return TELEMETRY_HEADER + field_size[encoding] * fields( mask );
+}
+
+
+static void
+encode_field(
+	uint8_t *		p,
+	int			encoding,
+	int			i,
+	double			v
+)
+{
+	uint64_t		u64;
+	uint32_t		u32;
+	float			f;
+	double			q;
+
+	switch( encoding )
+	{
+	case TELEMETRY_FLOAT64:
+		memcpy( &u64, &v, sizeof(u64) );
+		put32( p + 0, u64 >>  0 );
+		put32( p + 4, u64 >> 32 );
+		break;
+
+	case TELEMETRY_FLOAT32:
+		f = v;
+		memcpy( &u32, &f, sizeof(u32) );
+		put32( p, u32 );
+		break;
+
+	case TELEMETRY_QUANT16:
+		q = floor( v / resolution[i] + 0.5 );
+		if( q > 32767 )
+			q = 32767;
+		if( q < -32768 )
+			q = -32768;
+		put16( p, (uint16_t)(int16_t) q );
+		break;
+	}
+}
+
+
+static double
+decode_field(
+	const uint8_t *		p,
+	int			encoding,
+	int			i
+)
+{
+	uint64_t		u64;
+	uint32_t		u32;
+	double			d;
+	float			f;
+
+	switch( encoding )
+	{
+	case TELEMETRY_FLOAT64:
+		u64 = (uint64_t) get32( p + 4 ) << 32 | get32( p + 0 );
+		memcpy( &d, &u64, sizeof(d) );
+		return d;
+
+	case TELEMETRY_FLOAT32:
+		u32 = get32( p );
+		memcpy( &f, &u32, sizeof(f) );
+		return f;
+
+	case TELEMETRY_QUANT16:
+		return (int16_t) get16( p ) * resolution[i];
+	}
+
+	return 0;
+}
+
+
+int
+telemetry_encode(
+	void *			buf,
+	int			max_len,
+	const state_t *		state,
+	int			encoding,
+	uint32_t		mask,
+	uint32_t		sequence,
+	double			time
+)
+{
+	uint8_t *		p = (uint8_t*) buf;
+	int			len;
+	int			i;
+
+	mask &= TELEMETRY_ALL;
+	len = telemetry_size( encoding, mask );
+
+	if( len < 0 || len > max_len )
+		return -1;
+
+	p[0] = TELEMETRY_MAGIC;
+	p[1] = TELEMETRY_VERSION;
+	p[2] = TELEMETRY_HEADER;
+	p[3] = encoding;
+	put32( p +  4, mask );
+	put32( p +  8, sequence );
+	put32( p + 12, (uint32_t)( time * 1000 + 0.5 ) );
+
+	p += TELEMETRY_HEADER;
+
+	for( i=0 ; i<TELEMETRY_FIELDS ; i++ )
+	{
+		if( !( mask & (1 << i) ) )
+			continue;
+
+		encode_field( p, encoding, i, *field( (state_t*) state, i ) );
+		p += field_size[encoding];
+	}
+
+	return len;
+}
+
+
+int
+telemetry_decode(
+	const void *		buf,
+	int			len,
+	state_t *		state,
+	telemetry_header_t *	header
+)
+{
+	const uint8_t *		p = (const uint8_t*) buf;
+	int			header_len;
+	int			encoding;
+	uint32_t		mask;
+	int			i;
+
+	if( len < TELEMETRY_HEADER || p[0] != TELEMETRY_MAGIC )
+		return -1;
+
+	header_len	= p[2];
+	encoding	= p[3];
+	mask		= get32( p + 4 );
+
+	/* Newer headers are longer, but never shorter */
+	if( header_len < TELEMETRY_HEADER
+	||  encoding >= ENCODINGS
+	||  len < header_len + field_size[encoding] * fields( mask & TELEMETRY_ALL )
+	)
+		return -1;
+
+	if( header )
+	{
+		header->version		= p[1];
+		header->encoding	= encoding;
+		header->mask		= mask;
+		header->sequence	= get32( p + 8 );
+		header->time_ms		= get32( p + 12 );
+	}
+
+	p += header_len;
+
+	/* Fields above the ones we know come after them */
+	for( i=0 ; i<TELEMETRY_FIELDS ; i++ )
+	{
+		if( !( mask & (1 << i) ) )
+			continue;
+
+		*field( state, i ) = decode_field( p, encoding, i );
+		p += field_size[encoding];
+	}
+
+	state->end_of_line = '\n';
+
+	return 0;
+}
+
+
+int
+telemetry_encoding(
+	const char *		name
+)
+{
+	int			i;
+
+	for( i=0 ; i<ENCODINGS ; i++ )
+		if( strcmp( name, encoding_name[i] ) == 0 )
+			return i;
+
+	return -1;
+}
+
+
+int
+telemetry_request_encode(
+	void *			buf,
+	int			encoding,
+	uint32_t		mask
+)
+{
+	uint8_t *		p = (uint8_t*) buf;
+
+	p[0] = TELEMETRY_VERSION;
+	p[1] = encoding;
+	p[2] = 0;
+	p[3] = 0;
+	put32( p + 4, mask );
+
+	return TELEMETRY_REQUEST;
+}
+
+
+int
+telemetry_request_decode(
+	const void *		buf,
+	int			len,
+	int *			encoding,
+	uint32_t *		mask
+)
+{
+	const uint8_t *		p = (const uint8_t*) buf;
+
+	if( len < TELEMETRY_REQUEST || p[1] >= ENCODINGS )
+		return -1;
+
+	*encoding	= p[1];
+	*mask		= get32( p + 4 ) & TELEMETRY_ALL;
+
+	if( !*mask )
+		*mask = TELEMETRY_ALL;
+
+	return 0;
+}
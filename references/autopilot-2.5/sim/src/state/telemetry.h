@@ -0,0 +1,208 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Compact, versioned telemetry encoding of state_t.
+ *
+ * state_t goes over the wire as a raw C struct: host byte order,
+ * host padding and 8 bytes for every field.  A telemetry packet is
+ * instead a packed little endian header followed by the selected
+ * fields in state_t order, all in one encoding:
+ *
+ *	offset	size
+ *	0	1	TELEMETRY_MAGIC
+ *	1	1	version
+ *	2	1	header length in bytes
+ *	3	1	encoding
+ *	4	4	field mask, bit n for field n of state_t
+ *	8	4	sequence number
+ *	12	4	simulation time in milliseconds
+ *	16		fields
+ *
+ * A newer version may only add to the end of the header and add
+ * fields above the known ones in the mask.  Those come after all of
+ * the known fields, so an older decoder skips the header by its
+ * length and stops after the fields it knows.
+ *
+ * TELEMETRY_QUANT16 is a signed 16 bit count of the field's
+ * resolution, saturated at the ends.  The resolutions are in
+ * telemetry.c; positions are to 0.1 ft out to 3276 ft.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  For more details:
+ *
+ *	http://autopilot.sourceforge.net/
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _state_telemetry_h_
+#define _state_telemetry_h_
+
+#include <state/state.h>
+
+#ifdef __cplusplus
+namespace libstate
+{
+#endif
+
+#define TELEMETRY_MAGIC		0xA5
+#define TELEMETRY_VERSION	1
+#define TELEMETRY_HEADER	16
+#define TELEMETRY_FIELDS	17
+#define TELEMETRY_ALL		( ( 1 << TELEMETRY_FIELDS ) - 1 )
+
+/*
+ *  A frame at most this many behind the last one came out of order
+ * and is dropped.  One further behind means that the sender started
+ * over.
+ */
+#define TELEMETRY_REORDER	64
+
+/* The largest packet: every field as a double */
+#define TELEMETRY_MAX		( TELEMETRY_HEADER + 8 * TELEMETRY_FIELDS )
+
+enum {
+	TELEMETRY_FLOAT64	= 0,
+	TELEMETRY_FLOAT32	= 1,
+	TELEMETRY_QUANT16	= 2,
+};
+
+/* Mask bits, in state_t order */
+enum {
+	TELEMETRY_ACCEL		= 0x00007,	/* ax, ay, az */
+	TELEMETRY_RATES		= 0x00038,	/* p, r, q */
+	TELEMETRY_POSITION	= 0x001C0,	/* x, y, z */
+	TELEMETRY_ANGLES	= 0x00E00,	/* phi, theta, psi */
+	TELEMETRY_VELOCITY	= 0x07000,	/* vx, vy, vz */
+	TELEMETRY_MOMENTS	= 0x18000,	/* mx, my */
+};
+
+
+typedef struct
+{
+	int			version;
+	int			encoding;
+	uint32_t		mask;
+	uint32_t		sequence;
+	uint32_t		time_ms;
+} telemetry_header_t;
+
+
+/*
+ *  What a client sends with COMMAND_OPEN_TELEMETRY to be sent
+ * AHRS_TELEMETRY instead of AHRS_STATE: its version, the encoding,
+ * two bytes of padding and the mask, little endian.
+ */
+#define TELEMETRY_REQUEST	8
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ *  Bytes that encoding and mask take, with the header
+ */
+extern int
+telemetry_size(
+	int			encoding,
+	uint32_t		mask
+);
+
+
+/*
+ *  Returns the length of the packet, or -1 if the encoding is not
+ * known or max_len is too short.
+ */
+extern int
+telemetry_encode(
+	void *			buf,
+	int			max_len,
+	const state_t *		state,
+	int			encoding,
+	uint32_t		mask,
+	uint32_t		sequence,
+	double			time
+);
+
+
+/*
+ *  Fields that are not in the mask are left alone in state.
+ * Returns 0, or -1 if it is not a telemetry packet that we can read.
+ */
+extern int
+telemetry_decode(
+	const void *		buf,
+	int			len,
+	state_t *		state,
+	telemetry_header_t *	header
+);
+
+
+/*
+ *  "float64", "float32" or "quant16" to the encoding, or -1
+ */
+extern int
+telemetry_encoding(
+	const char *		name
+);
+
+
+extern int
+telemetry_request_encode(
+	void *			buf,
+	int			encoding,
+	uint32_t		mask
+);
+
+/*
+ *  Returns 0, or -1 if the request is short or asks for an encoding
+ * that we do not know.  Fields we do not know are left out of *mask.
+ */
+extern int
+telemetry_request_decode(
+	const void *		buf,
+	int			len,
+	int *			encoding,
+	uint32_t *		mask
+);
+
+
+/*
+ *  For clients of read_state(): ask the server for AHRS_TELEMETRY.
+ * read_state() decodes it into the same state_t as before.  Ignored
+ * if the state comes from a shared memory ring.  connect_state()
+ * does this if the variable "SIMTELEMETRY" names an encoding.
+ */
+extern int
+request_telemetry(
+	int			encoding,
+	uint32_t		mask
+);
+
+
+#ifdef __cplusplus
+}
+}
+#endif
+
+#endif
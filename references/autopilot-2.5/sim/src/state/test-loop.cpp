@@ -0,0 +1,493 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Event loop test.  Runs a 200 Hz frame loop the way heli-sim used
+ * to, spinning on Server::poll() until the frame is over, and then
+ * with libstate::Loop.  Reports the CPU used and how far the frames
+ * stray from the schedule.  The loop has to start its frames in
+ * order, count at least one tick for each, and never count a tick
+ * before it is due.  How far it strays depends on what else the
+ * machine is doing, so that is only reported.  Also checks that a
+ * burst of packets is handled in one wakeup with fewer system calls
+ * than packets, that a Loop only changes the timer slack of its
+ * thread while it is asked to spin, that a regular file keeps the
+ * loop awake only until it is removed, and that wait_tick() with no
+ * tick fails with EINVAL.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#include <state/Server.h>
+#include <state/Loop.h>
+#include <state/udp.h>
+#include <state/commands.h>
+#include "timer.h"
+
+using namespace std;
+using namespace libstate;
+
+
+static const long	period		= 5000;		// usec
+static const int	frames		= 200;
+static const int	burst		= 100;
+
+
+struct result_t
+{
+	double			cpu;		// Fraction of the wall clock
+	double			jitter;		// Mean error in the interval, usec
+	double			median;		// Median error in the interval
+	double			worst;		// Largest error in the interval
+	double			drift;		// Last frame vs schedule, usec
+	int			ticks;		// Ticks over all the frames
+	int			out_of_order;	// Frames with no time or tick
+	int			early;		// Frames ahead of their ticks
+};
+
+
+static double
+cpu_usec( void )
+{
+	struct rusage		ru;
+
+	getrusage( RUSAGE_SELF, &ru );
+
+	return ru.ru_utime.tv_sec * 1e6 + ru.ru_utime.tv_usec
+		+ ru.ru_stime.tv_sec * 1e6 + ru.ru_stime.tv_usec;
+}
+
+
+/*
+ *  Turn the frame start times into a result.  Frame i should start
+ * slot[i] periods after the first one; the loop skips the ticks that
+ * it was too late for.
+ */
+static void
+summarize(
+	result_t *		r,
+	const double *		t,
+	const int *		slot,
+	double			cpu
+)
+{
+	double			errs[ frames - 1 ];
+
+	r->jitter	= 0;
+	r->worst	= 0;
+	r->out_of_order	= 0;
+	r->early	= 0;
+
+	for( int i=1 ; i<frames ; i++ )
+	{
+		if( !( t[i] > t[i-1] ) || !( slot[i] > slot[i-1] ) )
+			r->out_of_order++;
+
+		// Half a period covers the clocks not starting together
+		if( slot[i] * period > t[i] - t[0] + period / 2 )
+			r->early++;
+
+		const double	want = ( slot[i] - slot[i-1] ) * period;
+		const double	err = fabs( t[i] - t[i-1] - want );
+
+		errs[i-1] = err;
+		r->jitter += err / ( frames - 1 );
+		if( r->worst < err )
+			r->worst = err;
+	}
+
+	nth_element( errs, errs + ( frames - 1 ) / 2, errs + frames - 1 );
+	r->median	= errs[ ( frames - 1 ) / 2 ];
+
+	r->ticks	= slot[frames-1];
+	r->drift	= t[frames-1] - t[0] - slot[frames-1] * period;
+	r->cpu		= cpu / ( t[frames-1] - t[0] );
+}
+
+
+/*
+ *  The old heli-sim loop: spin on poll() for whatever is left of the
+ * frame after the work is done.
+ */
+static void
+run_spin(
+	Server &		server,
+	result_t *		r
+)
+{
+	static double		t[ frames ];
+	static int		slot[ frames ];
+	stopwatch_t		clock;
+	stopwatch_t		timer;
+
+	start( &clock );
+	const double		cpu = cpu_usec();
+
+	for( int i=0 ; i<frames ; i++ )
+	{
+		t[i] = stop( &clock );
+		slot[i] = i;
+
+		start( &timer );
+		const long	extra = period - (long) stop( &timer );
+
+		start( &timer );
+		while( (long) stop( &timer ) < extra )
+			if( server.poll() )
+				server.get_packet();
+	}
+
+	summarize( r, t, slot, cpu_usec() - cpu );
+}
+
+
+static void
+run_loop(
+	Server &		server,
+	result_t *		r
+)
+{
+	static double		t[ frames ];
+	static int		slot[ frames ];
+	stopwatch_t		clock;
+	Loop			loop;
+	int			ticks = 0;
+
+	loop.add_fd( server.sock, Server::update, (void*) &server );
+	loop.tick( period );
+
+	start( &clock );
+	const double		cpu = cpu_usec();
+
+	for( int i=0 ; i<frames ; i++ )
+	{
+		t[i] = stop( &clock );
+		slot[i] = ticks;
+		ticks += loop.wait_tick();
+	}
+
+	summarize( r, t, slot, cpu_usec() - cpu );
+}
+
+
+static int		handled;
+
+static void
+count_packet(
+	void *			UNUSED( priv ),
+	const host_t *		UNUSED( src ),
+	int			UNUSED( type ),
+	const struct timeval *	UNUSED( when ),
+	const void *		UNUSED( data ),
+	size_t			UNUSED( len )
+)
+{
+	handled++;
+}
+
+
+/*
+ *  A burst sent while nobody is looking must all be handled in the
+ * next wakeup.
+ */
+static int
+check_burst(
+	Server &		server
+)
+{
+	const int		fd = udp_serve( 0 );
+	host_t			dest;
+	Loop			loop;
+
+	udp_self( server.sock, &dest );
+	dest.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+	server.handle( SIM_RESET, count_packet, 0 );
+	loop.add_fd( server.sock, Server::update, (void*) &server );
+
+	for( int i=0 ; i<burst ; i++ )
+		udp_send( fd, &dest, SIM_RESET, 0, 0 );
+
+	const unsigned long	syscalls = server.recv_syscalls;
+
+	handled = 0;
+	loop.poll( 100000 );
+
+	printf( "burst: %d of %d packets in one wakeup, %lu syscalls\n",
+		handled,
+		burst,
+		server.recv_syscalls - syscalls
+	);
+
+	close( fd );
+
+	if( handled != burst )
+	{
+		printf( "FAILED: packets left behind\n" );
+		return 1;
+	}
+
+	if( server.recv_syscalls - syscalls >= (unsigned long) burst )
+	{
+		printf( "FAILED: one syscall per packet\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  The slack has to be left alone by default, cut while spinning and
+ * put back afterwards.
+ */
+static int
+check_slack( void )
+{
+#ifdef __linux__
+	const int		slack = prctl( PR_GET_TIMERSLACK, 0, 0, 0, 0 );
+	int			plain;
+	int			spinning;
+	int			after_spin;
+	int			after_loop;
+
+	{
+		Loop			loop;
+
+		loop.tick( period );
+		plain = prctl( PR_GET_TIMERSLACK, 0, 0, 0, 0 );
+
+		loop.spin( 50 );
+		spinning = prctl( PR_GET_TIMERSLACK, 0, 0, 0, 0 );
+
+		loop.spin( 0 );
+		after_spin = prctl( PR_GET_TIMERSLACK, 0, 0, 0, 0 );
+
+		loop.spin( 50 );
+	}
+
+	after_loop = prctl( PR_GET_TIMERSLACK, 0, 0, 0, 0 );
+
+	printf( "slack: %d nsec, %d with a loop, %d spinning,"
+		" %d after, %d after the loop is gone\n",
+		slack,
+		plain,
+		spinning,
+		after_spin,
+		after_loop
+	);
+
+	if( plain != slack || spinning != 1
+	||  after_spin != slack || after_loop != slack
+	)
+	{
+		printf( "FAILED: the timer slack was not put back\n" );
+		return 1;
+	}
+#endif
+
+	return 0;
+}
+
+
+static int		file_calls;
+
+static void
+count_file(
+	int			UNUSED( fd ),
+	void *			UNUSED( priv )
+)
+{
+	file_calls++;
+}
+
+
+/*
+ *  A regular file is always readable: poll() must not sleep and must
+ * call its handler while it is added, and must go back to sleeping
+ * once it is removed.
+ */
+static int
+check_file( void )
+{
+	FILE *			file = tmpfile();
+	const int		fd = fileno( file );
+	Loop			loop;
+	stopwatch_t		timer;
+	int			failed = 0;
+
+	if( loop.add_fd( fd, count_file, 0 ) < 0 )
+	{
+		perror( "add_fd" );
+		fclose( file );
+		return 1;
+	}
+
+	file_calls = 0;
+	start( &timer );
+	loop.poll( -1 );
+	const unsigned long	awake = stop( &timer );
+	const int		awake_calls = file_calls;
+
+	loop.remove_fd( fd );
+
+	file_calls = 0;
+	start( &timer );
+	loop.poll( 20000 );
+	const unsigned long	asleep = stop( &timer );
+	const int		asleep_calls = file_calls;
+
+	fclose( file );
+
+	printf( "file: %lu usec with %d calls while added,"
+		" %lu usec with %d calls after\n",
+		awake,
+		awake_calls,
+		asleep,
+		asleep_calls
+	);
+
+	if( awake_calls != 1 || awake > 10000 )
+	{
+		printf( "FAILED: a regular file did not keep the loop awake\n" );
+		failed++;
+	}
+
+	if( asleep_calls != 0 || asleep < 10000 )
+	{
+		printf( "FAILED: the loop stayed awake after the file\n" );
+		failed++;
+	}
+
+	Loop			untimed;
+
+	errno = 0;
+	if( untimed.wait_tick() != -1 || errno != EINVAL )
+	{
+		printf( "FAILED: wait_tick() with no tick did not set EINVAL\n" );
+		failed++;
+	}
+
+	return failed;
+}
+
+
+static void
+report(
+	const char *		name,
+	const result_t &	r
+)
+{
+	printf( "%s: %3.0f%% cpu, jitter %.1f usec (median %.1f, worst %.0f),"
+		" drift %.0f usec, %d ticks\n",
+		name,
+		r.cpu * 100,
+		r.jitter,
+		r.median,
+		r.worst,
+		r.drift,
+		r.ticks
+	);
+}
+
+
+int
+main( void )
+{
+	Server			server( 0 );
+	result_t		spin;
+	result_t		loop;
+	int			failed = 0;
+
+	run_spin( server, &spin );
+	run_loop( server, &loop );
+
+	printf( "%d frames of %ld usec\n", frames, period );
+	report( "spin", spin );
+	report( "loop", loop );
+
+	failed += check_burst( server );
+	failed += check_slack();
+	failed += check_file();
+
+	if( loop.out_of_order )
+	{
+		printf( "FAILED: %d frames did not start after the one"
+			" before\n",
+			loop.out_of_order
+		);
+		failed++;
+	}
+
+	// The ticks are on an absolute schedule, so however late the
+	// loop wakes up it can not have counted a tick that is not due
+	if( loop.early )
+	{
+		printf( "FAILED: %d frames counted ticks that were not due\n",
+			loop.early
+		);
+		failed++;
+	}
+
+	if( loop.ticks < frames - 1 )
+	{
+		printf( "FAILED: %d ticks for %d frames\n",
+			loop.ticks,
+			frames
+		);
+		failed++;
+	}
+
+	// Spinning uses all of the CPU it gets, the loop next to none
+	if( !( loop.cpu < 0.5 * spin.cpu ) )
+	{
+		printf( "FAILED: the loop is not idle while it waits\n" );
+		failed++;
+	}
+
+	// Preemption makes frames late in either one, so these are
+	// only reported
+	if( !( loop.median <= spin.median ) )
+		printf( "note: the loop ticked with more jitter than spinning\n" );
+
+	if( !( fabs( loop.drift ) < period ) )
+		printf( "note: the loop was %.0f usec off its schedule at the"
+			" end\n",
+			loop.drift
+		);
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
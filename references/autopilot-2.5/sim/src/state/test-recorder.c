@@ -0,0 +1,397 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Flight recorder test.  Records state and controls at the 500 Hz
+ * physics rate and checks that none were lost, that the index finds
+ * the same records as a search of the whole file, that a log whose
+ * writer died without closing it can still be read and that a full
+ * file counts what did not fit.  Also times a record against a line
+ * of text written with fprintf().
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <state/recorder.h>
+#include "timer.h"
+
+
+#define RATE		500		/* Hz */
+#define STEPS		1000		/* Two seconds of physics steps */
+#define TIMED		( 50 * RECORDER_RING / 2 )
+
+
+static char		filename[ 64 ];
+
+
+static void
+fill(
+	state_t *		s,
+	int			n
+)
+{
+	double *		d = (double*) s;
+	int			i;
+
+	/* The padding is compared, too */
+	memset( s, 0, sizeof(*s) );
+
+	for( i=0 ; i<17 ; i++ )
+		d[i] = n + i * 0.001;
+
+	s->end_of_line = '\n';
+}
+
+
+/*
+ *  One physics step: the state and the controls
+ */
+static void
+record_step(
+	recorder_t *		r,
+	int			n
+)
+{
+	const double		time = (double) n / RATE;
+	const double		controls[4] = { n, -n, 0.5, 0.25 };
+	state_t			s;
+
+	fill( &s, n );
+
+	recorder_write( r, RECORD_STATE, time, &s, sizeof(s) );
+	recorder_write( r, RECORD_CONTROLS, time, controls, sizeof(controls) );
+}
+
+
+static int
+check_rate( void )
+{
+	recorder_t *		r = recorder_open( filename, 4 * STEPS );
+	recording_t		log;
+	stopwatch_t		timer;
+	unsigned long		worst = 0;
+	unsigned long		total = 0;
+	unsigned long		dropped;
+	int			bad = 0;
+	int			i;
+
+	if( !r )
+	{
+		perror( filename );
+		return 1;
+	}
+
+	for( i=0 ; i<STEPS ; i++ )
+	{
+		unsigned long		usec;
+
+		start( &timer );
+		record_step( r, i );
+		usec = stop( &timer );
+
+		total += usec;
+		if( worst < usec )
+			worst = usec;
+
+		usleep( 1000000 / RATE );
+	}
+
+	dropped = r->dropped;
+	recorder_close( r );
+
+	if( recording_open( &log, filename ) < 0 )
+	{
+		printf( "FAILED: the log could not be read\n" );
+		return 1;
+	}
+
+	for( i=0 ; i < (int) log.count ; i++ )
+	{
+		const record_t *	rec = &log.records[i];
+		const int		n = i / 2;
+		state_t			s;
+
+		fill( &s, n );
+
+		if( rec->time != (double) n / RATE )
+			bad++;
+		else
+		if( rec->type == RECORD_STATE
+		&&  memcmp( &rec->data.state, &s, sizeof(s) ) != 0 )
+			bad++;
+		else
+		if( rec->type == RECORD_CONTROLS
+		&&  ( rec->len != 4 * sizeof(double) || rec->data.value[1] != -n ) )
+			bad++;
+	}
+
+	printf( "rate: %d steps at %d Hz, %lu records, %lu dropped, %d bad;"
+		" %.2f usec per step, %lu worst\n",
+		STEPS,
+		RATE,
+		(unsigned long) log.count,
+		dropped,
+		bad,
+		(double) total / STEPS,
+		worst
+	);
+
+	printf( "rate: %lu index entries\n", (unsigned long) log.index_entries );
+
+	if( log.count != 2 * STEPS || dropped || bad || !log.index )
+	{
+		printf( "FAILED: records were lost or changed\n" );
+		recording_close( &log );
+		return 1;
+	}
+
+	recording_close( &log );
+	return 0;
+}
+
+
+/*
+ *  The index must find what a search of every record finds
+ */
+static int
+check_find( void )
+{
+	recording_t		log;
+	recording_t		bare;
+	int			bad = 0;
+	int			i;
+
+	if( recording_open( &log, filename ) < 0 )
+		return 1;
+
+	bare = log;
+	bare.index = 0;
+
+	for( i=-1 ; i <= STEPS + 1 ; i += 7 )
+	{
+		const double		t = (double) i / RATE + 0.0001;
+		uint64_t		want = 0;
+
+		while( want < log.count && log.records[want].time < t )
+			want++;
+
+		if( recording_find( &log, t ) != want
+		||  recording_find( &bare, t ) != want
+		)
+			bad++;
+	}
+
+	recording_close( &log );
+
+	printf( "find: %d wrong\n", bad );
+
+	if( bad )
+	{
+		printf( "FAILED: the index found the wrong records\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  The writer dies without closing the log
+ */
+static int
+check_crash( void )
+{
+	recording_t		log;
+	pid_t			pid = fork();
+	int			ok;
+
+	if( pid == 0 )
+	{
+		recorder_t *		r = recorder_open( filename, 4 * STEPS );
+		int			i;
+
+		for( i=0 ; i<100 ; i++ )
+			record_step( r, i );
+
+		while( r->header->records < 200 )
+			usleep( 1000 );
+
+		_exit( 0 );
+	}
+
+	waitpid( pid, 0, 0 );
+
+	if( recording_open( &log, filename ) < 0 )
+	{
+		printf( "FAILED: the unclosed log could not be read\n" );
+		return 1;
+	}
+
+	printf( "crash: %lu records, %s\n",
+		(unsigned long) log.count,
+		log.index ? "indexed" : "no index"
+	);
+
+	ok = log.count == 200
+		&& !log.index
+		&& recording_find( &log, 0.05 ) == 50;
+
+	recording_close( &log );
+
+	if( !ok )
+	{
+		printf( "FAILED: the unclosed log was not read\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+static int
+check_full( void )
+{
+	recorder_t *		r = recorder_open( filename, 100 );
+	recording_t		log;
+	unsigned long		overflow;
+	int			i;
+	int			ok;
+
+	for( i=0 ; i<75 ; i++ )
+		record_step( r, i );
+
+	/* The thread counts what did not fit */
+	while( r->tail != r->head )
+		usleep( 1000 );
+
+	overflow = r->overflow;
+	recorder_close( r );
+
+	if( recording_open( &log, filename ) < 0 )
+		return 1;
+
+	printf( "full: %lu records of 150 fit, %lu overflowed, %lu index entries\n",
+		(unsigned long) log.count,
+		overflow,
+		(unsigned long) log.index_entries
+	);
+
+	ok = log.count == 100 && overflow == 50 && log.index_entries == 1;
+
+	recording_close( &log );
+
+	if( !ok )
+	{
+		printf( "FAILED: a full file was not handled\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  What a record costs the caller, against the text it used to be
+ */
+static void
+compare( void )
+{
+	recorder_t *		r = recorder_open( filename, 2 * TIMED );
+	FILE *			text = fopen( "/dev/null", "w" );
+	stopwatch_t		timer;
+	unsigned long		rec_usec;
+	unsigned long		text_usec;
+	unsigned long		dropped;
+	state_t			s;
+	int			i;
+
+	fill( &s, 1 );
+
+	/* Only the writes are timed, with the thread let in between */
+	rec_usec = 0;
+
+	for( i=0 ; i<TIMED ; )
+	{
+		const int		end = i + RECORDER_RING / 2;
+
+		while( r->tail != r->head )
+			usleep( 1000 );
+
+		start( &timer );
+		for( ; i<end ; i++ )
+			recorder_write( r, RECORD_STATE, i, &s, sizeof(s) );
+		rec_usec += stop( &timer );
+	}
+
+	dropped = r->dropped;
+	recorder_close( r );
+
+	start( &timer );
+	for( i=0 ; i<TIMED ; i++ )
+	{
+		const double *		d = (const double*) &s;
+
+		fprintf( text,
+			"%f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f\n",
+			d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7], d[8],
+			d[9], d[10], d[11], d[12], d[13], d[14], d[15], d[16]
+		);
+		fflush( text );
+	}
+	text_usec = stop( &timer );
+
+	fclose( text );
+
+	printf( "record: %.3f usec (%lu dropped), text: %.3f usec per state\n",
+		(double) rec_usec / TIMED,
+		dropped,
+		(double) text_usec / TIMED
+	);
+}
+
+
+int
+main( void )
+{
+	int			failed = 0;
+
+	snprintf( filename, sizeof(filename), "/tmp/test-recorder-%d.log", getpid() );
+
+	failed += check_rate();
+	failed += check_find();
+	failed += check_crash();
+	failed += check_full();
+	compare();
+
+	unlink( filename );
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
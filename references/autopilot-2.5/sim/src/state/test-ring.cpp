@@ -0,0 +1,374 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Shared memory ring test.  A reader in another process must never
+ * see a torn frame, a reader that falls behind must be told how many
+ * frames it lost, and a Server client on this host must get its
+ * AHRS_STATE from the ring and not over UDP.  Also times a frame
+ * through the ring against one through UDP over loopback.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <state/Server.h>
+#include <state/ring.h>
+#include <state/udp.h>
+#include <state/commands.h>
+#include "timer.h"
+
+using namespace std;
+using namespace libstate;
+
+
+static const uint32_t	frames		= 200000;
+static const int	timed		= 20000;
+
+
+/*
+ *  Every field of frame n is n, so a torn frame has a mix
+ */
+static void
+fill(
+	state_t *		s,
+	double			n
+)
+{
+	double *		d = (double*) s;
+
+	for( int i=0 ; i<17 ; i++ )
+		d[i] = n;
+
+	s->end_of_line = '\n';
+}
+
+
+static bool
+torn(
+	const state_t *		s
+)
+{
+	const double *		d = (const double*) s;
+
+	for( int i=1 ; i<17 ; i++ )
+		if( d[i] != d[0] )
+			return true;
+
+	return false;
+}
+
+
+/*
+ *  A reader that falls more than a ring behind
+ */
+static int
+check_lapped(
+	int			port
+)
+{
+	ring_t *		ring = ring_create( port );
+	uint32_t		cursor;
+	const ring_t *		reader = ring_open( port, &cursor );
+	struct timeval		when = { 0, 0 };
+	state_t			s;
+	unsigned long		lost = 0;
+	int			count = 0;
+	double			first = -1;
+
+	if( !ring || !reader )
+	{
+		perror( "ring" );
+		return 1;
+	}
+
+	for( int i=0 ; i<RING_FRAMES + 10 ; i++ )
+	{
+		fill( &s, i );
+		ring_write( ring, &when, &s );
+	}
+
+	while( ring_read( reader, &cursor, &when, &s, &lost ) )
+	{
+		if( first < 0 )
+			first = s.ax;
+		count++;
+	}
+
+	ring_close( (ring_t*) reader, port, 0 );
+	ring_close( ring, port, 1 );
+
+	printf( "lapped: %d frames read from %g, %lu lost\n", count, first, lost );
+
+	if( count != RING_FRAMES || lost != 10 || first != 10 )
+	{
+		printf( "FAILED: the lost frames were not counted\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  A writer in another process as fast as it can go
+ */
+static int
+check_torn(
+	int			port
+)
+{
+	ring_t *		ring = ring_create( port );
+	uint32_t		cursor;
+	const ring_t *		reader = ring_open( port, &cursor );
+	unsigned long		lost = 0;
+	unsigned long		read = 0;
+	unsigned long		bad = 0;
+	double			last = -1;
+
+	if( !ring || !reader )
+	{
+		perror( "ring" );
+		return 1;
+	}
+
+	const pid_t		pid = fork();
+
+	if( pid == 0 )
+	{
+		struct timeval		when = { 0, 0 };
+		state_t			s;
+
+		for( uint32_t i=0 ; i<frames ; i++ )
+		{
+			fill( &s, i );
+			ring_write( ring, &when, &s );
+		}
+
+		_exit( 0 );
+	}
+
+	while( cursor < frames )
+	{
+		struct timeval		when;
+		state_t			s;
+
+		if( !ring_read( reader, &cursor, &when, &s, &lost ) )
+			continue;
+
+		read++;
+
+		if( torn( &s ) || s.ax <= last )
+			bad++;
+
+		last = s.ax;
+	}
+
+	waitpid( pid, 0, 0 );
+
+	ring_close( (ring_t*) reader, port, 0 );
+	ring_close( ring, port, 1 );
+
+	printf( "torn: %lu frames read, %lu lost, %lu bad\n", read, lost, bad );
+
+	if( bad || read + lost != frames )
+	{
+		printf( "FAILED: torn or missing frames\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+struct client_t
+{
+	state_t			state;
+	int			count;
+};
+
+
+static void
+count_state(
+	void *			priv,
+	const host_t *		UNUSED( src ),
+	int			UNUSED( type ),
+	const struct timeval *	UNUSED( when ),
+	const void *		data,
+	size_t			len
+)
+{
+	client_t *		client = (client_t*) priv;
+
+	if( len == sizeof(state_t) )
+		memcpy( &client->state, data, len );
+	client->count++;
+}
+
+
+/*
+ *  A local client reads the ring, a remote one still gets UDP
+ */
+static int
+check_server( void )
+{
+	Server			server( 0 );
+	host_t			self;
+
+	udp_self( server.sock, &self );
+
+	const int		port = ntohs( self.sin_port );
+
+	if( server.share( port ) < 0 )
+	{
+		perror( "share" );
+		return 1;
+	}
+
+	Server			local( "127.0.0.1", port, 0 );
+	Server			remote( 0 );
+	client_t		local_client = { state_t(), 0 };
+	client_t		remote_client = { state_t(), 0 };
+
+	self.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	udp_send( remote.sock, &self, COMMAND_OPEN, 0, 0 );
+
+	local.handle( AHRS_STATE, count_state, (void*) &local_client );
+	remote.handle( AHRS_STATE, count_state, (void*) &remote_client );
+
+	usleep( 10000 );
+	server.drain();
+
+	for( int i=0 ; i<10 ; i++ )
+	{
+		state_t			s;
+
+		fill( &s, i );
+		server.send_packet( AHRS_STATE, &s, sizeof(s) );
+	}
+
+	usleep( 10000 );
+
+	local.drain();
+	remote.drain();
+
+	printf( "server: local client %s, %d states, %lu from the ring;"
+		" remote client %d states\n",
+		local.shared() ? "shared" : "not shared",
+		local_client.count,
+		local.ring_frames,
+		remote_client.count
+	);
+
+	// The local client only gets the ACK over UDP
+	if( !local.shared()
+	||  local_client.count != 10
+	||  local.ring_frames != 10
+	||  local.recv_packets != 1
+	||  local_client.state.ax != 9
+	) {
+		printf( "FAILED: the local client did not use the ring\n" );
+		return 1;
+	}
+
+	if( remote_client.count != 10 || remote_client.state.ax != 9 )
+	{
+		printf( "FAILED: the remote client lost its UDP state\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  One frame written and read each way, in this process
+ */
+static void
+compare( int port )
+{
+	ring_t *		ring = ring_create( port );
+	uint32_t		cursor;
+	const ring_t *		reader = ring_open( port, &cursor );
+	const int		rx = udp_serve( 0 );
+	const int		tx = udp_serve( 0 );
+	host_t			dest;
+	stopwatch_t		timer;
+	struct timeval		when = { 0, 0 };
+	state_t			s;
+	char			buf[ UDP_MAX_PACKET ];
+
+	udp_self( rx, &dest );
+	dest.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	fill( &s, 1 );
+
+	start( &timer );
+	for( int i=0 ; i<timed ; i++ )
+	{
+		ring_write( ring, &when, &s );
+		ring_read( reader, &cursor, &when, &s, 0 );
+	}
+	const unsigned long	ring_usec = stop( &timer );
+
+	start( &timer );
+	for( int i=0 ; i<timed ; i++ )
+	{
+		host_t			src;
+
+		udp_send_raw( tx, &dest, AHRS_STATE, &when, &s, sizeof(s) );
+		udp_read( rx, &src, buf, sizeof(buf) );
+	}
+	const unsigned long	udp_usec = stop( &timer );
+
+	printf( "ring: %.3f usec per frame, udp: %.3f usec per frame\n",
+		double( ring_usec ) / timed,
+		double( udp_usec ) / timed
+	);
+
+	close( rx );
+	close( tx );
+	ring_close( (ring_t*) reader, port, 0 );
+	ring_close( ring, port, 1 );
+}
+
+
+int
+main( void )
+{
+	const int		port = 40000 + getpid() % 20000;
+	int			failed = 0;
+
+	failed += check_lapped( port );
+	failed += check_torn( port );
+	failed += check_server();
+	compare( port );
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,240 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Fan-out test.  A frame of several packets to several loopback
+ * clients must arrive the same from udp_send_many() as from a loop
+ * of udp_send_raw(), in fewer system calls.  Also times both.
+ *
+ **************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <state/udp.h>
+#include "timer.h"
+
+
+#define CLIENTS		6
+#define PACKETS		3
+#define FRAMES		500
+#define SEEN		( FRAMES * CLIENTS * PACKETS * 256 )
+
+
+static int		clients[ CLIENTS ];
+static host_t		hosts[ CLIENTS ];
+
+
+/*
+ *  A frame is an AHRS_STATE sized packet and two small ones
+ */
+static void
+make_frame(
+	udp_packet_t *		packets,
+	char			bufs[ PACKETS ][ 256 ],
+	int			frame
+)
+{
+	int			i;
+
+	for( i=0 ; i<PACKETS ; i++ )
+	{
+		packets[i].when.tv_sec	= frame;
+		packets[i].when.tv_usec	= i;
+		packets[i].type		= 0x100 + i;
+		packets[i].buf		= bufs[i];
+		packets[i].len		= i == 0 ? 144 : 8;
+
+		memset( bufs[i], frame + i, sizeof( bufs[i] ) );
+	}
+}
+
+
+/*
+ *  Read everything that arrived at the clients, packet by packet,
+ * into out.  Returns the number of bytes.
+ */
+static int
+drain(
+	char *			out,
+	int			max_len
+)
+{
+	int			len = 0;
+	int			i;
+
+	for( i=0 ; i<CLIENTS ; i++ )
+	{
+		while( udp_poll( clients[i], 0 ) > 0 )
+		{
+			host_t			src;
+			int			rc;
+
+			rc = udp_read( clients[i], &src, out + len, max_len - len );
+			if( rc < 0 )
+				return -1;
+
+			len += rc;
+		}
+	}
+
+	return len;
+}
+
+
+/*
+ *  Send every frame one way or the other and check that the clients
+ * saw the same bytes.  Returns the send time in usec.
+ */
+static long
+run(
+	int			fd,
+	int			batched,
+	char *			seen,
+	int *			seen_len,
+	int *			syscalls
+)
+{
+	static char		bufs[ PACKETS ][ 256 ];
+	udp_packet_t		packets[ PACKETS ];
+	unsigned long		usec = 0;
+	stopwatch_t		timer;
+	int			frame;
+	int			i;
+	int			j;
+
+	*seen_len = 0;
+	*syscalls = 0;
+
+	for( frame=0 ; frame<FRAMES ; frame++ )
+	{
+		int			rc;
+
+		make_frame( packets, bufs, frame );
+
+		start( &timer );
+
+		if( batched )
+			udp_send_many( fd, hosts, CLIENTS, packets, PACKETS, syscalls );
+		else
+		{
+			for( i=0 ; i<PACKETS ; i++ )
+			for( j=0 ; j<CLIENTS ; j++ )
+			{
+				udp_send_raw(
+					fd,
+					&hosts[j],
+					packets[i].type,
+					&packets[i].when,
+					packets[i].buf,
+					packets[i].len
+				);
+				(*syscalls)++;
+			}
+		}
+
+		usec += stop( &timer );
+
+		/* Loopback delivery is synchronous, so it is all there */
+		rc = drain( seen + *seen_len, SEEN - *seen_len );
+		if( rc < 0 )
+			return -1;
+
+		*seen_len += rc;
+	}
+
+	return usec;
+}
+
+
+int
+main( void )
+{
+	static char		one[ SEEN ];
+	static char		many[ SEEN ];
+	const int		header = sizeof( struct timeval ) + sizeof( uint32_t );
+	int			one_len;
+	int			many_len;
+	int			one_calls;
+	int			many_calls;
+	long			one_usec;
+	long			many_usec;
+	int			fd;
+	int			i;
+
+	fd = udp_serve( 0 );
+	if( fd < 0 )
+	{
+		perror( "udp_serve" );
+		return EXIT_FAILURE;
+	}
+
+	for( i=0 ; i<CLIENTS ; i++ )
+	{
+		clients[i] = udp_serve( 0 );
+		if( clients[i] < 0 || udp_self( clients[i], &hosts[i] ) < 0 )
+		{
+			perror( "client" );
+			return EXIT_FAILURE;
+		}
+
+		hosts[i].sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	}
+
+	one_usec = run( fd, 0, one, &one_len, &one_calls );
+	many_usec = run( fd, 1, many, &many_len, &many_calls );
+
+	printf( "%d clients, %d packets per frame\n", CLIENTS, PACKETS );
+	printf( "udp_send_raw:  %.1f usec, %.1f syscalls per frame\n",
+		(double) one_usec / FRAMES,
+		(double) one_calls / FRAMES
+	);
+	printf( "udp_send_many: %.1f usec, %.1f syscalls per frame\n",
+		(double) many_usec / FRAMES,
+		(double) many_calls / FRAMES
+	);
+
+	if( one_usec < 0 || many_usec < 0 )
+	{
+		printf( "FAILED: unable to read from the clients\n" );
+		return EXIT_FAILURE;
+	}
+
+	if( one_len != many_len || memcmp( one, many, one_len ) != 0 )
+	{
+		printf( "FAILED: clients saw %d bytes one at a time, %d batched\n",
+			one_len,
+			many_len
+		);
+		return EXIT_FAILURE;
+	}
+
+	if( one_len != FRAMES * CLIENTS * ( PACKETS * header + 144 + 8 + 8 ) )
+	{
+		printf( "FAILED: only %d bytes arrived\n", one_len );
+		return EXIT_FAILURE;
+	}
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
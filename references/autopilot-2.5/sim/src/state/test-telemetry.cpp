@@ -0,0 +1,501 @@
+/* -*- indent-tabs-mode:T; c-basic-offset:8; tab-width:8; -*- vi: set ts=8:
+ * $Id$
+ *
+ * (c) Trammell Hudson
+ *
+ * Telemetry encoding test.  Every encoding must come back within its
+ * resolution, in little endian byte order, and quant16 must be half
+ * the size of the raw state_t or less.  A decoder must read a
+ * packet from a newer version with a longer header and more fields,
+ * and a Server client must be sent its own format and count the
+ * frames that it missed.
+ *
+ *************
+ *
+ *  This file is part of the autopilot simulation package.
+ *
+ *  Autopilot is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Autopilot is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Autopilot; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <unistd.h>
+#include <state/Server.h>
+#include <state/telemetry.h>
+#include <state/udp.h>
+#include <state/commands.h>
+#include "timer.h"
+
+using namespace std;
+using namespace libstate;
+
+
+static const int	timed		= 100000;
+
+static const char *	names[] = { "float64", "float32", "quant16" };
+
+/* Worst error allowed in each field after a round trip */
+static const double	float32_error	= 1e-6;		// Relative
+static const double	quant16_error[ TELEMETRY_FIELDS ] = {
+	0.005,	0.005,	0.005,
+	0.0005,	0.0005,	0.0005,
+	0.05,	0.05,	0.05,
+	0.00005, 0.00005, 0.00005,
+	0.005,	0.005,	0.005,
+	0.005,	0.005,
+};
+
+
+static double &
+field(
+	state_t &		s,
+	int			i
+)
+{
+	return ( (double*) &s )[i];
+}
+
+
+/*
+ *  Something like a helicopter in forward flight
+ */
+static void
+fill(
+	state_t *		s,
+	int			n
+)
+{
+	s->ax		= -0.31 + 0.001 * n;
+	s->ay		=  0.42;
+	s->az		= -32.17;
+	s->p		=  0.0123;
+	s->r		= -0.2345;
+	s->q		=  0.0456;
+	s->x		=  1234.56 + n;
+	s->y		= -321.09;
+	s->z		= -150.27;
+	s->phi		=  0.0873;
+	s->theta	= -0.0436;
+	s->psi		=  3.1;
+	s->vx		=  29.87;
+	s->vy		= -1.23;
+	s->vz		=  0.45;
+	s->mx		=  0.789;
+	s->my		= -0.456;
+	s->end_of_line	= '\n';
+}
+
+
+static int
+check_round_trip( void )
+{
+	int			failed = 0;
+	uint8_t			buf[ TELEMETRY_MAX ];
+	state_t			in;
+	state_t			out;
+
+	fill( &in, 0 );
+
+	printf( "raw state_t: %d bytes\n", (int) sizeof(state_t) );
+
+	for( int e=0 ; e<3 ; e++ )
+	{
+		memset( &out, 0, sizeof(out) );
+
+		const int	len = telemetry_encode(
+			buf,
+			sizeof(buf),
+			&in,
+			e,
+			TELEMETRY_ALL,
+			7,
+			12.3456
+		);
+
+		telemetry_header_t	header;
+
+		if( len != telemetry_size( e, TELEMETRY_ALL )
+		||  telemetry_decode( buf, len, &out, &header ) < 0
+		||  header.sequence != 7
+		||  header.time_ms != 12346
+		||  header.mask != TELEMETRY_ALL
+		) {
+			printf( "FAILED: %s did not decode\n", names[e] );
+			failed++;
+			continue;
+		}
+
+		double		worst = 0;
+		int		bad = 0;
+
+		for( int i=0 ; i<TELEMETRY_FIELDS ; i++ )
+		{
+			const double	err = fabs( field( out, i ) - field( in, i ) );
+			const double	allowed = e == TELEMETRY_FLOAT64 ? 0
+				: e == TELEMETRY_FLOAT32
+					? float32_error * fabs( field( in, i ) )
+					: quant16_error[i];
+
+			if( worst < err )
+				worst = err;
+			if( err > allowed )
+				bad++;
+		}
+
+		printf( "%s: %3d bytes, %3.0f%% of raw, worst error %g\n",
+			names[e],
+			len,
+			100.0 * len / sizeof(state_t),
+			worst
+		);
+
+		if( bad )
+		{
+			printf( "FAILED: %s lost %d fields\n", names[e], bad );
+			failed++;
+		}
+
+		if( ( e == TELEMETRY_FLOAT32 && len >= (int) sizeof(state_t) )
+		||  ( e == TELEMETRY_QUANT16 && 2 * len > (int) sizeof(state_t) )
+		) {
+			printf( "FAILED: %s is not small enough\n", names[e] );
+			failed++;
+		}
+	}
+
+	// Out of range is saturated, not wrapped
+	in.x = 1e6;
+	telemetry_encode( buf, sizeof(buf), &in, TELEMETRY_QUANT16,
+		TELEMETRY_POSITION, 0, 0 );
+	telemetry_decode( buf, sizeof(buf), &out, 0 );
+
+	if( out.x < 3276 )
+	{
+		printf( "FAILED: quant16 wrapped %g to %g\n", in.x, out.x );
+		failed++;
+	}
+
+	// Little endian on every host
+	in.ax = 1.0;
+	telemetry_encode( buf, sizeof(buf), &in, TELEMETRY_FLOAT64, 1, 0x01020304, 0 );
+
+	if( buf[8] != 0x04 || buf[11] != 0x01
+	||  buf[TELEMETRY_HEADER + 6] != 0xF0 || buf[TELEMETRY_HEADER + 7] != 0x3F
+	) {
+		printf( "FAILED: not little endian\n" );
+		failed++;
+	}
+
+	return failed;
+}
+
+
+/*
+ *  Only the fields in the mask are sent or changed
+ */
+static int
+check_mask( void )
+{
+	uint8_t			buf[ TELEMETRY_MAX ];
+	const uint32_t		mask = TELEMETRY_POSITION | TELEMETRY_ANGLES;
+	state_t			in;
+	state_t			out;
+
+	fill( &in, 0 );
+	memset( &out, 0, sizeof(out) );
+	out.vx = 99;
+
+	const int		len = telemetry_encode(
+		buf,
+		sizeof(buf),
+		&in,
+		TELEMETRY_QUANT16,
+		mask,
+		0,
+		0
+	);
+
+	telemetry_decode( buf, len, &out, 0 );
+
+	printf( "mask: position and angles in %d bytes\n", len );
+
+	if( len != TELEMETRY_HEADER + 6 * 2
+	||  fabs( out.x - in.x ) > 0.05
+	||  fabs( out.psi - in.psi ) > 0.00005
+	||  out.vx != 99
+	||  out.ax != 0
+	) {
+		printf( "FAILED: the mask was not followed\n" );
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/*
+ *  A packet from some later version, with four more bytes of header
+ * and a field that this one does not know about
+ */
+static int
+check_versions( void )
+{
+	uint8_t			v1[ TELEMETRY_MAX ];
+	uint8_t			v2[ TELEMETRY_MAX + 16 ];
+	state_t			in;
+	state_t			out;
+	telemetry_header_t	header;
+	int			failed = 0;
+
+	fill( &in, 0 );
+	const int		len = telemetry_encode(
+		v1,
+		sizeof(v1),
+		&in,
+		TELEMETRY_FLOAT32,
+		TELEMETRY_ALL,
+		3,
+		0
+	);
+
+	memcpy( v2, v1, TELEMETRY_HEADER );
+	v2[1] = TELEMETRY_VERSION + 1;
+	v2[2] = TELEMETRY_HEADER + 4;
+	v2[6] |= 1 << ( TELEMETRY_FIELDS - 16 );
+	memset( v2 + TELEMETRY_HEADER, 0xEE, 4 );
+	memcpy( v2 + TELEMETRY_HEADER + 4, v1 + TELEMETRY_HEADER, len - TELEMETRY_HEADER );
+	memset( v2 + len + 4, 0xEE, 4 );
+
+	memset( &out, 0, sizeof(out) );
+
+	if( telemetry_decode( v2, len + 8, &out, &header ) < 0
+	||  header.version != TELEMETRY_VERSION + 1
+	||  fabs( out.x - in.x ) > 0.001
+	||  fabs( out.my - in.my ) > 0.001
+	) {
+		printf( "FAILED: a newer packet could not be read\n" );
+		failed++;
+	}
+
+	// An encoding we do not know is refused, as is a short packet
+	v2[3] = 7;
+	if( telemetry_decode( v2, len + 8, &out, 0 ) == 0
+	||  telemetry_decode( v1, len - 1, &out, 0 ) == 0
+	) {
+		printf( "FAILED: a bad packet was decoded\n" );
+		failed++;
+	}
+
+	if( !failed )
+		printf( "versions: read a v%d packet with a %d byte header\n",
+			TELEMETRY_VERSION + 1,
+			TELEMETRY_HEADER + 4
+		);
+
+	return failed;
+}
+
+
+struct client_t
+{
+	state_t			state;
+	int			count;
+};
+
+
+static void
+count_state(
+	void *			priv,
+	const host_t *		UNUSED( src ),
+	int			UNUSED( type ),
+	const struct timeval *	UNUSED( when ),
+	const void *		data,
+	size_t			len
+)
+{
+	client_t *		client = (client_t*) priv;
+
+	if( len == sizeof(state_t) )
+		memcpy( &client->state, data, len );
+	client->count++;
+}
+
+
+/*
+ *  A raw, a quant16 and a float32 client of the same server.  Then
+ * frames are sent by hand with two missing, one late and a restart
+ * of the sequence.
+ */
+static int
+check_server( void )
+{
+	Server			server( 0 );
+	host_t			self;
+	int			failed = 0;
+
+	udp_self( server.sock, &self );
+
+	Server			raw( "127.0.0.1", ntohs( self.sin_port ), 0 );
+	Server			quant( "127.0.0.1", ntohs( self.sin_port ), 0 );
+	Server			some( "127.0.0.1", ntohs( self.sin_port ), 0 );
+	client_t		clients[3];
+
+	memset( clients, 0, sizeof(clients) );
+
+	quant.telemetry( TELEMETRY_QUANT16 );
+	some.telemetry( TELEMETRY_FLOAT32, TELEMETRY_POSITION );
+
+	raw.handle( AHRS_STATE, count_state, (void*) &clients[0] );
+	quant.handle( AHRS_STATE, count_state, (void*) &clients[1] );
+	some.handle( AHRS_STATE, count_state, (void*) &clients[2] );
+
+	usleep( 10000 );
+	server.drain();
+
+	for( int i=0 ; i<10 ; i++ )
+	{
+		state_t			s;
+
+		fill( &s, i );
+		server.set_time( i * 0.02 );
+		server.send_packet( AHRS_STATE, &s, sizeof(s) );
+	}
+
+	usleep( 10000 );
+	raw.drain();
+	quant.drain();
+	some.drain();
+
+	printf( "server: raw %d, quant16 %d, float32 %d states,"
+		" %lu telemetry frames, %lu dropped\n",
+		clients[0].count,
+		clients[1].count,
+		clients[2].count,
+		quant.telemetry_frames,
+		quant.telemetry_dropped
+	);
+
+	if( clients[0].count != 10
+	||  clients[1].count != 10
+	||  clients[2].count != 10
+	||  quant.telemetry_frames != 10
+	||  quant.telemetry_dropped != 0
+	||  some.telemetry_frames != 10
+	||  raw.telemetry_frames != 0
+	||  fabs( clients[1].state.x - 1243.56 ) > 0.05
+	||  fabs( clients[2].state.x - 1243.56 ) > 0.001
+	||  clients[2].state.vx != 0
+	) {
+		printf( "FAILED: a client did not get its format\n" );
+		failed++;
+	}
+
+	// Frames 502 and 503 never arrive, then 503 arrives late and
+	// the server restarts from 0
+	const int		fd = udp_serve( 0 );
+	host_t			dest;
+	const uint32_t		sequence[] = { 500, 501, 504, 503, 0, 1 };
+	const int		frames = sizeof(sequence) / sizeof(sequence[0]);
+	uint8_t			buf[ TELEMETRY_MAX ];
+	Server			lossy( 0 );
+	client_t		client;
+
+	memset( &client, 0, sizeof(client) );
+	lossy.handle( AHRS_STATE, count_state, (void*) &client );
+
+	udp_self( lossy.sock, &dest );
+	dest.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+	for( int i=0 ; i<frames ; i++ )
+	{
+		state_t			s;
+
+		fill( &s, i );
+
+		const int	len = telemetry_encode( buf, sizeof(buf), &s,
+			TELEMETRY_QUANT16, TELEMETRY_ALL, sequence[i], 0 );
+
+		udp_send( fd, &dest, AHRS_TELEMETRY, buf, len );
+	}
+
+	usleep( 10000 );
+	lossy.drain();
+	close( fd );
+
+	printf( "lossy: %d states, %lu dropped\n",
+		client.count,
+		lossy.telemetry_dropped
+	);
+
+	if( client.count != 5 || lossy.telemetry_dropped != 2 )
+	{
+		printf( "FAILED: the missing frames were not counted\n" );
+		failed++;
+	}
+
+	return failed;
+}
+
+
+/*
+ *  What it costs to encode a frame
+ */
+static void
+compare( void )
+{
+	uint8_t			buf[ TELEMETRY_MAX ];
+	state_t			s;
+	stopwatch_t		timer;
+
+	fill( &s, 0 );
+
+	for( int e=0 ; e<3 ; e++ )
+	{
+		start( &timer );
+		for( int i=0 ; i<timed ; i++ )
+		{
+			telemetry_encode( buf, sizeof(buf), &s, e,
+				TELEMETRY_ALL, i, 0 );
+			telemetry_decode( buf, sizeof(buf), &s, 0 );
+		}
+
+		printf( "%s: %.3f usec to encode and decode\n",
+			names[e],
+			double( stop( &timer ) ) / timed
+		);
+	}
+}
+
+
+int
+main( void )
+{
+	int			failed = 0;
+
+	failed += check_round_trip();
+	failed += check_mask();
+	failed += check_versions();
+	failed += check_server();
+	compare();
+
+	if( failed )
+		return EXIT_FAILURE;
+
+	printf( "PASSED\n" );
+	return EXIT_SUCCESS;
+}
@@ -28,6 +28,10 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  *
  */
+#ifdef __linux__
+#define _GNU_SOURCE		/* For sendmmsg() and recvmmsg() */
+#endif
+
 #include <state/udp.h>
 
 #include <unistd.h>
@@ -185,6 +189,213 @@ udp_send_raw(
 }
 
 
+#ifdef __linux__
+/*
+ *  Keep calling sendmmsg() until all of the messages are out.
+ * It stops at the first one that fails, which is skipped.
+ */
+static int
+udp_sendmmsg_all(
+	int			fd,
+	struct mmsghdr *	msgs,
+	int			count,
+	int *			syscalls
+)
+{
+	int			done = 0;
+	int			sent = 0;
+
+	while( done < count )
+	{
+		int rc = sendmmsg( fd, msgs + done, count - done, 0 );
+
+		if( syscalls )
+			(*syscalls)++;
+
+		if( rc < 0 )
+		{
+			if( errno != EINTR )
+				done++;
+			continue;
+		}
+
+		done += rc;
+		sent += rc;
+	}
+
+	return sent;
+}
+#endif
+
+
+int
+udp_send_many(
+	int			fd,
+	const host_t *		hosts,
+	int			num_hosts,
+	const udp_packet_t *	packets,
+	int			num_packets,
+	int *			syscalls
+)
+{
+	int			sent = 0;
+	int			i;
+	int			j;
+
+#ifdef __linux__
+	struct mmsghdr		msgs[ UDP_BATCH ];
+	struct iovec		vecs[ UDP_BATCH ][ 3 ];
+	int			count = 0;
+
+	for( i=0 ; i<num_packets ; i++ )
+	{
+		const udp_packet_t *	p = &packets[i];
+
+		for( j=0 ; j<num_hosts ; j++ )
+		{
+			struct msghdr *		hdr = &msgs[count].msg_hdr;
+			struct iovec *		vec = vecs[count];
+
+			vec[0].iov_base		= (void*) &p->when;
+			vec[0].iov_len		= sizeof(p->when);
+
+			vec[1].iov_base		= (void*) &p->type;
+			vec[1].iov_len		= sizeof(p->type);
+
+			vec[2].iov_base		= (void*) p->buf;
+			vec[2].iov_len		= p->len;
+
+			hdr->msg_name		= (void*) &hosts[j];
+			hdr->msg_namelen	= sizeof( hosts[j] );
+			hdr->msg_iov		= vec;
+			hdr->msg_iovlen		= 3;
+			hdr->msg_control	= 0;
+			hdr->msg_controllen	= 0;
+			hdr->msg_flags		= 0;
+
+			msgs[count].msg_len	= 0;
+
+			if( ++count < UDP_BATCH )
+				continue;
+
+			sent += udp_sendmmsg_all( fd, msgs, count, syscalls );
+			count = 0;
+		}
+	}
+
+	if( count )
+		sent += udp_sendmmsg_all( fd, msgs, count, syscalls );
+#else
+	for( i=0 ; i<num_packets ; i++ )
+	{
+		const udp_packet_t *	p = &packets[i];
+
+		for( j=0 ; j<num_hosts ; j++ )
+		{
+			if( syscalls )
+				(*syscalls)++;
+
+			if( udp_send_raw(
+				fd,
+				&hosts[j],
+				p->type,
+				&p->when,
+				p->buf,
+				p->len
+			) >= 0 )
+				sent++;
+		}
+	}
+#endif
+
+	return sent;
+}
+
+
+int
+udp_read_many(
+	int			fd,
+	udp_datagram_t *	msgs,
+	int			max,
+	int *			syscalls
+)
+{
+#ifdef __linux__
+	struct mmsghdr		hdrs[ UDP_BATCH ];
+	struct iovec		vecs[ UDP_BATCH ];
+	int			i;
+	int			rc;
+
+	if( max > UDP_BATCH )
+		max = UDP_BATCH;
+
+	for( i=0 ; i<max ; i++ )
+	{
+		struct msghdr *		hdr = &hdrs[i].msg_hdr;
+
+		vecs[i].iov_base	= msgs[i].buf;
+		vecs[i].iov_len		= sizeof( msgs[i].buf );
+
+		hdr->msg_name		= &msgs[i].src;
+		hdr->msg_namelen	= sizeof( msgs[i].src );
+		hdr->msg_iov		= &vecs[i];
+		hdr->msg_iovlen		= 1;
+		hdr->msg_control	= 0;
+		hdr->msg_controllen	= 0;
+		hdr->msg_flags		= 0;
+	}
+
+	do {
+		if( syscalls )
+			(*syscalls)++;
+
+		rc = recvmmsg( fd, hdrs, max, MSG_DONTWAIT, 0 );
+	} while( rc < 0 && errno == EINTR );
+
+	if( rc < 0 )
+		return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+	for( i=0 ; i<rc ; i++ )
+		msgs[i].len = hdrs[i].msg_len;
+
+	return rc;
+#else
+	int			count = 0;
+
+	while( count < max )
+	{
+		int			rc;
+
+		if( syscalls )
+			(*syscalls)++;
+
+		rc = udp_poll( fd, 0 );
+		if( rc < 0 )
+			return -1;
+		if( rc == 0 )
+			break;
+
+		if( syscalls )
+			(*syscalls)++;
+
+		rc = udp_read(
+			fd,
+			&msgs[count].src,
+			msgs[count].buf,
+			sizeof( msgs[count].buf )
+		);
+
+		if( rc < 0 )
+			return -1;
+
+		msgs[count++].len = rc;
+	}
+
+	return count;
+#endif
+}
+
+
 int
 udp_self(
 	int			fd,
@@ -40,6 +40,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/time.h>
 
 #ifdef WIN32
 typedef unsigned int uint32_t;
@@ -94,6 +95,74 @@ udp_send_raw(
 
 
 
+/*
+ *  One packet for udp_send_many().  The timestamp and type are
+ * sent from here, so the array has to stay put until it returns.
+ */
+typedef struct
+{
+	struct timeval		when;
+	uint32_t		type;
+	const void *		buf;
+	int			len;
+} udp_packet_t;
+
+
+/*
+ *  Send every packet to every host, packet by packet, with as few
+ * system calls as possible.  That is one sendmmsg(2) for up to
+ * UDP_BATCH datagrams on Linux and one sendmsg(2) per datagram
+ * elsewhere.  A datagram that fails is skipped, like the rest of
+ * the hosts would be with a loop of udp_send_raw().
+ *
+ * Returns the number of datagrams sent and adds the number of
+ * system calls to *syscalls, if it is not NULL.
+ */
+#define UDP_BATCH		64
+
+extern int
+udp_send_many(
+	int			fd,
+	const host_t *		hosts,
+	int			num_hosts,
+	const udp_packet_t *	packets,
+	int			num_packets,
+	int *			syscalls
+);
+
+
+/*
+ *  One datagram for udp_read_many().  UDP_MAX_PACKET is the same
+ * limit that Server::get_packet() has always used.
+ */
+#define UDP_MAX_PACKET		1024
+
+typedef struct
+{
+	host_t			src;
+	int			len;
+	char			buf[ UDP_MAX_PACKET ];
+} udp_datagram_t;
+
+
+/*
+ *  Read every datagram that is already waiting, up to max of them,
+ * without blocking.  That is one recvmmsg(2) on Linux and a
+ * udp_poll() and udp_read() for each one elsewhere.
+ *
+ * Returns the number read, which is 0 if nothing was waiting, or -1
+ * on an error.  Adds the number of system calls to *syscalls, if it
+ * is not NULL.
+ */
+extern int
+udp_read_many(
+	int			fd,
+	udp_datagram_t *	msgs,
+	int			max,
+	int *			syscalls
+);
+
+
 extern int
 udp_self(
 	int			fd,